@@ -0,0 +1,111 @@
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <string>
+#include "BodyCapturePolicy.h"
+
+
+/**
+ * Parse a byte count with an optional K / M / G suffix
+ */
+static bool parseByteCount(const char* text, uint64_t& byteCount)
+{
+	char* end;
+	byteCount = strtoull(text, &end, 10);
+	if (end == text)
+		return false;
+
+	switch (*end)
+	{
+	case 'K': case 'k': byteCount <<= 10; end++; break;
+	case 'M': case 'm': byteCount <<= 20; end++; break;
+	case 'G': case 'g': byteCount <<= 30; end++; break;
+	default: break;
+	}
+
+	return *end == '\0';
+}
+
+
+bool BodyCapturePolicy::parse(const char* policy)
+{
+	std::vector<Rule> rules;
+	std::string policyText(policy);
+
+	size_t ruleStart = 0;
+	while (ruleStart <= policyText.size())
+	{
+		size_t ruleEnd = policyText.find(',', ruleStart);
+		if (ruleEnd == std::string::npos)
+			ruleEnd = policyText.size();
+		std::string ruleText = policyText.substr(ruleStart, ruleEnd - ruleStart);
+		ruleStart = ruleEnd + 1;
+
+		// direction:content-type:max-bytes
+		size_t firstColon = ruleText.find(':');
+		size_t lastColon = ruleText.rfind(':');
+		if (firstColon == std::string::npos || lastColon == firstColon)
+			return false;
+
+		std::string direction = ruleText.substr(0, firstColon);
+		std::string pattern = ruleText.substr(firstColon + 1, lastColon - firstColon - 1);
+
+		Rule rule;
+		rule.matchRequests = (direction == "request" || direction == "*");
+		rule.matchResponses = (direction == "response" || direction == "*");
+		if ((!rule.matchRequests && !rule.matchResponses) || pattern.empty() || pattern.size() > BODY_POLICY_MAX_PATTERN_LEN)
+			return false;
+		if (!parseByteCount(ruleText.c_str() + lastColon + 1, rule.maxBodyBytes))
+			return false;
+
+		strcpy(rule.pattern, pattern.c_str());
+		rules.push_back(rule);
+	}
+
+	m_Rules.insert(m_Rules.end(), rules.begin(), rules.end());
+	return true;
+}
+
+
+void BodyCapturePolicy::addRule(bool matchRequests, bool matchResponses, const char* contentTypePattern, uint64_t maxBodyBytes)
+{
+	Rule rule;
+	rule.matchRequests = matchRequests;
+	rule.matchResponses = matchResponses;
+	rule.pattern[0] = '\0';
+	strncat(rule.pattern, contentTypePattern, BODY_POLICY_MAX_PATTERN_LEN);
+	rule.maxBodyBytes = maxBodyBytes;
+	m_Rules.push_back(rule);
+}
+
+
+bool BodyCapturePolicy::matchContentType(const char* pattern, const char* contentType)
+{
+	if (strcmp(pattern, "*") == 0)
+		return true;
+
+	// the media type ends at the parameters or at trailing whitespace
+	size_t typeLen = strcspn(contentType, "; \t");
+	if (typeLen == 0)
+		return false;
+
+	// "image/*" matches any subtype of the type
+	size_t patternLen = strlen(pattern);
+	if (patternLen >= 2 && pattern[patternLen - 1] == '*' && pattern[patternLen - 2] == '/')
+		return typeLen >= patternLen - 1 && strncasecmp(contentType, pattern, patternLen - 1) == 0;
+
+	return typeLen == patternLen && strncasecmp(contentType, pattern, patternLen) == 0;
+}
+
+
+uint64_t BodyCapturePolicy::getMaxBodyBytes(bool isRequest, const char* contentType) const
+{
+	for (size_t i = 0; i < m_Rules.size(); i++)
+	{
+		const Rule& rule = m_Rules[i];
+		if ((isRequest ? rule.matchRequests : rule.matchResponses) && matchContentType(rule.pattern, contentType))
+			return rule.maxBodyBytes;
+	}
+
+	return BODY_SIZE_UNLIMITED;
+}
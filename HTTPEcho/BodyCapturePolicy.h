@@ -0,0 +1,78 @@
+#ifndef HTTPECHO_BODY_CAPTURE_POLICY
+#define HTTPECHO_BODY_CAPTURE_POLICY
+
+#include <stdint.h>
+#include <vector>
+
+// the body size limit of messages no rule matches
+#define BODY_SIZE_UNLIMITED UINT64_MAX
+
+// the longest content type pattern of a rule
+#define BODY_POLICY_MAX_PATTERN_LEN 63
+
+
+/**
+ * Decides how many body bytes of an HTTP message are kept in the capture files, by direction and by Content-Type. Headers are always kept.
+ * Rules are checked in order and the first one which matches decides; messages no rule matches are kept whole. A policy is written as a comma
+ * separated list of "direction:content-type:max-bytes" rules, where:
+ * - direction is "request", "response" or "*"
+ * - content-type is an exact media type ("application/json"), a whole type (the type, a slash and "*", matching any subtype) or "*".
+ *   Parameters (";charset=...") are ignored and messages without a Content-Type only match "*"
+ * - max-bytes is a byte count with an optional K / M / G suffix, 0 keeps the headers only
+ *
+ * For example "request:*:64K" keeps request bodies up to 64KB (Deployment/README.md has more examples). A policy is read-only once parsed,
+ * so all capture workers can share one
+ */
+class BodyCapturePolicy
+{
+public:
+
+	/**
+	 * A c'tor for this class, creates an empty policy which keeps every body whole
+	 */
+	BodyCapturePolicy() {}
+
+	/**
+	 * Parse a policy and append its rules
+	 * @param[in] policy The policy
+	 * @return False if the policy is malformed, in which case no rule was added
+	 */
+	bool parse(const char* policy);
+
+	/**
+	 * Append a rule
+	 * @param[in] matchRequests Whether the rule applies to requests
+	 * @param[in] matchResponses Whether the rule applies to responses
+	 * @param[in] contentTypePattern The content type pattern
+	 * @param[in] maxBodyBytes The max number of body bytes kept
+	 */
+	void addRule(bool matchRequests, bool matchResponses, const char* contentTypePattern, uint64_t maxBodyBytes);
+
+	/**
+	 * @param[in] isRequest Whether the message is a request
+	 * @param[in] contentType The value of the message's Content-Type header, or an empty string if it has none
+	 * @return The max number of body bytes of the message to keep, BODY_SIZE_UNLIMITED if no rule matches
+	 */
+	uint64_t getMaxBodyBytes(bool isRequest, const char* contentType) const;
+
+	/**
+	 * @return True if the policy has no rules, i.e. it keeps everything
+	 */
+	bool isEmpty() const { return m_Rules.empty(); }
+
+private:
+
+	struct Rule
+	{
+		bool matchRequests;
+		bool matchResponses;
+		char pattern[BODY_POLICY_MAX_PATTERN_LEN + 1];
+		uint64_t maxBodyBytes;
+	};
+
+	std::vector<Rule> m_Rules;
+
+	static bool matchContentType(const char* pattern, const char* contentType);
+};
+
+#endif /* HTTPECHO_BODY_CAPTURE_POLICY */
@@ -0,0 +1,240 @@
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "CpuTopology.h"
+#include "CaptureMerger.h"
+
+// the merge thread spins this many rounds while it has nothing to hand out, then yields, then naps
+#define CAPTURE_MERGE_SPIN_ROUNDS 64
+#define CAPTURE_MERGE_YIELD_ROUNDS 1024
+#define CAPTURE_MERGE_NAP_USEC 10
+
+
+static uint64_t getMonotonicNsec()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+
+/**
+ * Wait a little before looking at the rings again. Short waits keep the merge latency in the microseconds, long idle periods don't burn a core
+ */
+static void idle(uint32_t idleRounds)
+{
+	if (idleRounds < CAPTURE_MERGE_SPIN_ROUNDS)
+	{
+#if defined(__SSE2__)
+		_mm_pause();
+#endif
+	}
+	else if (idleRounds < CAPTURE_MERGE_YIELD_ROUNDS)
+		std::this_thread::yield();
+	else
+		usleep(CAPTURE_MERGE_NAP_USEC);
+}
+
+
+CaptureMerger::Source::Source(PacketBufferPool* bufferPool, bool live) : bufferCache(bufferPool)
+{
+	tail.store(0);
+	closed.store(false);
+	head.store(0);
+	numOfPackets = 0;
+	numOfDroppedPackets = 0;
+	isLive = live;
+	entries = new Entry[CAPTURE_MERGE_RING_SIZE];
+}
+
+
+CaptureMerger::Source::~Source()
+{
+	delete [] entries;
+}
+
+
+CaptureMerger::CaptureMerger(PacketBufferPool* bufferPool, uint32_t maxDelayUsec) : m_BufferCache(bufferPool)
+{
+	numOfMergedPackets = 0;
+	numOfTimedOutPackets = 0;
+	numOfOutOfOrderPackets = 0;
+
+	m_BufferPool = bufferPool;
+	m_MaxDelayNsec = (uint64_t)maxDelayUsec * 1000;
+	m_NumOfSources = 0;
+	m_OnPacket = NULL;
+	m_UserCookie = NULL;
+	m_CoreId = -1;
+	m_LastTimestamp.tv_sec = 0;
+	m_LastTimestamp.tv_usec = 0;
+
+	// the merged packet never owns its data, it always points into the buffer of the entry being handed out
+	timeval zeroTime = timeval();
+	m_Packet = new pcpp::RawPacket(NULL, 0, zeroTime, false);
+}
+
+
+CaptureMerger::~CaptureMerger()
+{
+	// packets left in the rings (if the merge thread never ran) go back to the pool
+	for (int i = 0; i < m_NumOfSources; i++)
+	{
+		Source* source = m_Sources[i];
+		for (uint32_t head = source->head.load(); head != source->tail.load(); head++)
+			m_BufferCache.release(source->entries[head & (CAPTURE_MERGE_RING_SIZE - 1)].data);
+		delete source;
+	}
+
+	delete m_Packet;
+}
+
+
+int CaptureMerger::addSource(bool isLive)
+{
+	if (m_NumOfSources == CAPTURE_MERGE_MAX_SOURCES)
+		return -1;
+
+	m_Sources[m_NumOfSources] = new Source(m_BufferPool, isLive);
+	return m_NumOfSources++;
+}
+
+
+bool CaptureMerger::push(int sourceIndex, const pcpp::RawPacket* packet)
+{
+	Source& source = *m_Sources[sourceIndex];
+	uint32_t tail = source.tail.load(std::memory_order_relaxed);
+
+	// a live capture can't wait for the merge, a capture file can
+	while (tail - source.head.load(std::memory_order_acquire) >= CAPTURE_MERGE_RING_SIZE)
+	{
+		if (source.isLive)
+		{
+			source.numOfDroppedPackets++;
+			return false;
+		}
+		std::this_thread::yield();
+	}
+
+	Entry& entry = source.entries[tail & (CAPTURE_MERGE_RING_SIZE - 1)];
+	entry.dataLen = packet->getRawDataLen();
+	entry.data = source.bufferCache.allocate((size_t)entry.dataLen);
+	memcpy(entry.data, packet->getRawData(), (size_t)entry.dataLen);
+	entry.linkType = packet->getLinkLayerType();
+	entry.timestamp = packet->getPacketTimeStamp();
+	entry.arrivalNsec = (source.isLive ? getMonotonicNsec() : 0);
+
+	source.tail.store(tail + 1, std::memory_order_release);
+	source.numOfPackets++;
+	return true;
+}
+
+
+void CaptureMerger::closeSource(int sourceIndex)
+{
+	m_Sources[sourceIndex]->closed.store(true, std::memory_order_release);
+}
+
+
+void CaptureMerger::start(OnMergedPacket onPacket, void* userCookie, int coreId)
+{
+	m_OnPacket = onPacket;
+	m_UserCookie = userCookie;
+	m_CoreId = coreId;
+	m_Thread = std::thread(&CaptureMerger::run, this);
+}
+
+
+void CaptureMerger::join()
+{
+	if (m_Thread.joinable())
+		m_Thread.join();
+}
+
+
+void CaptureMerger::deliver(Source& source)
+{
+	uint32_t head = source.head.load(std::memory_order_relaxed);
+	Entry& entry = source.entries[head & (CAPTURE_MERGE_RING_SIZE - 1)];
+
+	if (timercmp(&entry.timestamp, &m_LastTimestamp, <))
+		numOfOutOfOrderPackets++;
+	else
+		m_LastTimestamp = entry.timestamp;
+
+	m_Packet->setRawData(entry.data, entry.dataLen, entry.timestamp, entry.linkType);
+	m_OnPacket(m_Packet, m_UserCookie);
+	numOfMergedPackets++;
+
+	// the pipeline copies whatever it keeps, so the buffer can go back as soon as the callback returns
+	m_BufferCache.release(entry.data);
+	source.head.store(head + 1, std::memory_order_release);
+}
+
+
+void CaptureMerger::run()
+{
+	if (m_CoreId >= 0 && !pinCurrentThread(m_CoreId))
+		printf("Couldn't pin the merge thread to core %d\n", m_CoreId);
+
+	uint32_t idleRounds = 0;
+	while (true)
+	{
+		// find the oldest packet at the head of the rings, and whether every source which may still push has a packet waiting
+		Source* oldest = NULL;
+		const Entry* oldestEntry = NULL;
+		bool allSourcesReady = true;
+		bool waitForFileSource = false;
+		bool allSourcesDone = true;
+
+		for (int i = 0; i < m_NumOfSources; i++)
+		{
+			Source& source = *m_Sources[i];
+			uint32_t head = source.head.load(std::memory_order_relaxed);
+
+			// closed is read before tail, so the packets pushed before the source was closed are seen
+			bool closed = source.closed.load(std::memory_order_acquire);
+			if (head == source.tail.load(std::memory_order_acquire))
+			{
+				if (!closed)
+				{
+					allSourcesDone = false;
+					allSourcesReady = false;
+					if (!source.isLive)
+						waitForFileSource = true;
+				}
+				continue;
+			}
+
+			allSourcesDone = false;
+			const Entry& entry = source.entries[head & (CAPTURE_MERGE_RING_SIZE - 1)];
+			if (oldestEntry == NULL || timercmp(&entry.timestamp, &oldestEntry->timestamp, <))
+			{
+				oldest = &source;
+				oldestEntry = &entry;
+			}
+		}
+
+		if (allSourcesDone)
+			return;
+
+		// a source which may still push an older packet is waited for: a file source always, a live source up to the max delay
+		bool canDeliver = (oldest != NULL && (allSourcesReady ||
+				(!waitForFileSource && oldestEntry->arrivalNsec + m_MaxDelayNsec <= getMonotonicNsec())));
+		if (!canDeliver)
+		{
+			idle(idleRounds++);
+			continue;
+		}
+
+		if (!allSourcesReady)
+			numOfTimedOutPackets++;
+
+		deliver(*oldest);
+		idleRounds = 0;
+	}
+}
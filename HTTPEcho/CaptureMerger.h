@@ -0,0 +1,169 @@
+#ifndef HTTPECHO_CAPTURE_MERGER
+#define HTTPECHO_CAPTURE_MERGER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include <atomic>
+#include <thread>
+#include "header/RawPacket.h"
+#include "PacketBufferPool.h"
+
+// max number of sources merged together
+#define CAPTURE_MERGE_MAX_SOURCES 16
+
+// the number of packets each source can have waiting for the merge, a power of 2
+#define CAPTURE_MERGE_RING_SIZE 8192
+
+// the default max time a live packet waits for the other live sources before it's handed out anyway
+#define DEFAULT_CAPTURE_MERGE_MAX_DELAY_USEC 100
+
+
+/**
+ * @typedef OnMergedPacket
+ * A callback invoked by CaptureMerger for every packet, in timestamp order, on the merge thread
+ * @param[in] packet The packet, only valid during the callback
+ * @param[in] userCookie The cookie given to start()
+ */
+typedef void (*OnMergedPacket)(pcpp::RawPacket* packet, void* userCookie);
+
+
+/**
+ * Merges the packets of several capture sources (live devices or capture files) into one stream ordered by packet timestamp, so one pipeline
+ * sees a connection whose packets cross interfaces in capture order. Every source is fed by its own thread, which only copies its packets
+ * into a single-producer ring of packet buffer pool buffers, so the sources never wait for each other or for the pipeline. A merge thread
+ * repeatedly hands out the oldest packet at the head of the rings (a k-way merge):
+ * - Capture file sources are merged exactly: the merge waits until every source which isn't done has a packet waiting
+ * - Live sources are merged with bounded latency: when another live source has nothing waiting, the oldest packet is handed out once it waited
+ *   the max delay. A packet which arrives later with an older timestamp is handed out as it is (and counted), TCP reassembly reorders it
+ * A full ring drops the packets of a live source and holds back the thread of a file source
+ */
+class CaptureMerger
+{
+public:
+
+	/**
+	 * A c'tor for this class
+	 * @param[in] bufferPool The pool packets are copied into while they wait for the merge
+	 * @param[in] maxDelayUsec The max time a live packet waits for the other live sources
+	 */
+	CaptureMerger(PacketBufferPool* bufferPool, uint32_t maxDelayUsec = DEFAULT_CAPTURE_MERGE_MAX_DELAY_USEC);
+
+	/**
+	 * A d'tor for this class. The merge thread must have been joined
+	 */
+	~CaptureMerger();
+
+	/**
+	 * Add a source. All sources must be added before start()
+	 * @param[in] isLive True for a live device, false for a capture file
+	 * @return The index of the source, or -1 if there are CAPTURE_MERGE_MAX_SOURCES sources already
+	 */
+	int addSource(bool isLive);
+
+	/**
+	 * Copy a packet into its source's ring. Must always be called from the same thread for a source
+	 * @param[in] source The index of the source
+	 * @param[in] packet The packet
+	 * @return False if the packet was dropped because the ring of a live source was full
+	 */
+	bool push(int source, const pcpp::RawPacket* packet);
+
+	/**
+	 * Report that a source won't push any more packets. Its waiting packets are still merged
+	 * @param[in] source The index of the source
+	 */
+	void closeSource(int source);
+
+	/**
+	 * Start the merge thread
+	 * @param[in] onPacket The callback to invoke for every packet
+	 * @param[in] userCookie A cookie passed to the callback
+	 * @param[in] coreId The core to pin the merge thread to, or -1 to leave it unpinned
+	 */
+	void start(OnMergedPacket onPacket, void* userCookie, int coreId);
+
+	/**
+	 * Wait until every source was closed and all its packets were merged, then stop the merge thread
+	 */
+	void join();
+
+	/**
+	 * @param[in] source The index of the source
+	 * @return The number of packets pushed by the source. Only exact once the source was closed
+	 */
+	uint64_t getNumOfPackets(int source) const { return m_Sources[source]->numOfPackets; }
+
+	/**
+	 * @param[in] source The index of the source
+	 * @return The number of packets of the source dropped because its ring was full. Only exact once the source was closed
+	 */
+	uint64_t getNumOfDroppedPackets(int source) const { return m_Sources[source]->numOfDroppedPackets; }
+
+	// stats: packets handed out, packets handed out after the max delay while a live source had nothing waiting, and packets handed out
+	// after a packet with a later timestamp. Updated by the merge thread
+	uint64_t numOfMergedPackets;
+	uint64_t numOfTimedOutPackets;
+	uint64_t numOfOutOfOrderPackets;
+
+private:
+
+	/**
+	 * A packet waiting in a ring. The data is a packet buffer pool buffer
+	 */
+	struct Entry
+	{
+		uint8_t* data;
+		int dataLen;
+		pcpp::LinkLayerType linkType;
+		timeval timestamp;
+		uint64_t arrivalNsec;
+	};
+
+	/**
+	 * A source: a single-producer single-consumer ring. The producer and the consumer side are kept on separate cache lines
+	 */
+	struct Source
+	{
+		// the producer side
+		std::atomic<uint32_t> tail;
+		std::atomic<bool> closed;
+		PacketBufferCache bufferCache;
+		uint64_t numOfPackets;
+		uint64_t numOfDroppedPackets;
+		uint8_t producerPadding[64];
+
+		// the consumer side
+		std::atomic<uint32_t> head;
+		uint8_t consumerPadding[64];
+
+		bool isLive;
+		Entry* entries;
+
+		Source(PacketBufferPool* bufferPool, bool live);
+		~Source();
+	};
+
+	PacketBufferPool* m_BufferPool;
+	uint64_t m_MaxDelayNsec;
+	Source* m_Sources[CAPTURE_MERGE_MAX_SOURCES];
+	int m_NumOfSources;
+
+	// the merge thread, and the state only it uses
+	std::thread m_Thread;
+	OnMergedPacket m_OnPacket;
+	void* m_UserCookie;
+	int m_CoreId;
+	PacketBufferCache m_BufferCache;
+	pcpp::RawPacket* m_Packet;
+	timeval m_LastTimestamp;
+
+	void run();
+	void deliver(Source& source);
+
+	// the merger owns its sources and thread, prevent copies
+	CaptureMerger(const CaptureMerger& other);
+	CaptureMerger& operator=(const CaptureMerger& other);
+};
+
+#endif /* HTTPECHO_CAPTURE_MERGER */
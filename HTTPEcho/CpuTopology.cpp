@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "CpuTopology.h"
+#include "header/SystemUtils.h"
+
+
+/**
+ * Read the first line of a (sysfs) file, without the line break
+ */
+static bool readFirstLine(const std::string& path, char* line, size_t maxLen)
+{
+	FILE* file = fopen(path.c_str(), "r");
+	if (file == NULL)
+		return false;
+
+	bool success = (fgets(line, (int)maxLen, file) != NULL);
+	fclose(file);
+
+	if (success)
+		line[strcspn(line, "\n")] = '\0';
+	return success;
+}
+
+
+/**
+ * Read the cores of a NUMA node from sysfs
+ */
+static bool getCoresOfNumaNode(int numaNode, std::vector<int>& coreIds)
+{
+	char path[128];
+	char cpuList[1024];
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", numaNode);
+	return readFirstLine(path, cpuList, sizeof(cpuList)) && parseCoreList(cpuList, coreIds);
+}
+
+
+bool parseCoreList(const char* coreList, std::vector<int>& coreIds)
+{
+	const char* pos = coreList;
+	while (*pos != '\0')
+	{
+		char* end;
+		long first = strtol(pos, &end, 10);
+		if (end == pos || first < 0)
+			return false;
+
+		long last = first;
+		pos = end;
+		if (*pos == '-')
+		{
+			last = strtol(pos + 1, &end, 10);
+			if (end == pos + 1 || last < first)
+				return false;
+			pos = end;
+		}
+
+		for (long core = first; core <= last; core++)
+			coreIds.push_back((int)core);
+
+		if (*pos == ',')
+			pos++;
+		else if (*pos != '\0')
+			return false;
+	}
+
+	return true;
+}
+
+
+int getNumOfNumaNodes()
+{
+	int numOfNodes = 0;
+	for (int node = 0; node < MAX_NUMA_NODES; node++)
+	{
+		std::vector<int> coreIds;
+		if (getCoresOfNumaNode(node, coreIds))
+			numOfNodes = node + 1;
+	}
+
+	return (numOfNodes > 0 ? numOfNodes : 1);
+}
+
+
+int getNumaNodeOfCore(int coreId)
+{
+	for (int node = 0; node < MAX_NUMA_NODES; node++)
+	{
+		std::vector<int> coreIds;
+		if (!getCoresOfNumaNode(node, coreIds))
+			continue;
+
+		for (size_t i = 0; i < coreIds.size(); i++)
+		{
+			if (coreIds[i] == coreId)
+				return node;
+		}
+	}
+
+	return 0;
+}
+
+
+int getNumaNodeOfDevice(const std::string& sysfsDevicePath)
+{
+	char value[32];
+	if (!readFirstLine(sysfsDevicePath + "/numa_node", value, sizeof(value)))
+		return -1;
+
+	// the kernel reports -1 for devices on machines without NUMA
+	return atoi(value);
+}
+
+
+bool pinCurrentThread(int coreId)
+{
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	CPU_SET(coreId, &cpuSet);
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+}
+
+
+bool setPreferredNumaNode(int numaNode)
+{
+	// called through syscall() so the build doesn't depend on libnuma
+	if (numaNode < 0)
+		return syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0) == 0;
+
+	unsigned long nodeMask[MAX_NUMA_NODES / (8 * sizeof(unsigned long)) + 1];
+	memset(nodeMask, 0, sizeof(nodeMask));
+	nodeMask[numaNode / (8 * sizeof(unsigned long))] |= 1UL << (numaNode % (8 * sizeof(unsigned long)));
+	return syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodeMask, (unsigned long)(sizeof(nodeMask) * 8)) == 0;
+}
+
+
+void printCpuTopology()
+{
+	int numOfNodes = getNumOfNumaNodes();
+	printf("CPU topology: %d cores, %d NUMA node%s\n", pcpp::getNumOfCores(), numOfNodes, numOfNodes > 1 ? "s" : "");
+
+	for (int node = 0; node < numOfNodes; node++)
+	{
+		char path[128];
+		char cpuList[1024];
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+		if (readFirstLine(path, cpuList, sizeof(cpuList)))
+			printf("    NUMA node %d: cores %s\n", node, cpuList);
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef HTTPECHO_CPU_TOPOLOGY
+#define HTTPECHO_CPU_TOPOLOGY
+
+#include <vector>
+#include <string>
+
+// max number of NUMA nodes looked up in sysfs
+#define MAX_NUMA_NODES 64
+
+
+/**
+ * Parse a core list in the format used by sysfs and taskset, e.g. "1,3,8-11"
+ * @param[in] coreList The list
+ * @param[out] coreIds The core IDs, in the order they appear
+ * @return False if the list is malformed
+ */
+bool parseCoreList(const char* coreList, std::vector<int>& coreIds);
+
+/**
+ * @return The number of NUMA nodes of the machine, 1 on machines (or kernels) without NUMA information
+ */
+int getNumOfNumaNodes();
+
+/**
+ * @param[in] coreId A core ID
+ * @return The NUMA node the core belongs to, 0 if unknown
+ */
+int getNumaNodeOfCore(int coreId);
+
+/**
+ * @param[in] sysfsDevicePath The sysfs directory of a device, e.g. "/sys/class/net/eth0/device" or "/sys/bus/pci/devices/0000:03:00.0"
+ * @return The NUMA node the device is attached to, or -1 if unknown
+ */
+int getNumaNodeOfDevice(const std::string& sysfsDevicePath);
+
+/**
+ * Pin the calling thread to a single core
+ * @param[in] coreId The core
+ * @return False if the affinity couldn't be set
+ */
+bool pinCurrentThread(int coreId);
+
+/**
+ * Make the calling thread allocate new memory on a NUMA node (falling back to other nodes if it's full). Affects pages faulted in from now on,
+ * so memory which is allocated and touched while the policy is set lands on the node
+ * @param[in] numaNode The node, or -1 to restore the default (local allocation) policy
+ * @return False if the policy couldn't be set
+ */
+bool setPreferredNumaNode(int numaNode);
+
+/**
+ * Print the cores and NUMA nodes of the machine
+ */
+void printCpuTopology();
+
+#endif /* HTTPECHO_CPU_TOPOLOGY */
@@ -0,0 +1,92 @@
+#ifdef USE_DPDK
+
+#include <stdio.h>
+#include <string.h>
+#include <rte_ethdev.h>
+#include "SymmetricRss.h"
+#include "DpdkCapture.h"
+
+DpdkCaptureWorker::DpdkCaptureWorker(pcpp::DpdkDevice* device, uint16_t rxQueueId, OnDpdkBurstArrive onBurstArrive, void* cookie) :
+	m_Device(device), m_RxQueueId(rxQueueId), m_OnBurstArrive(onBurstArrive), m_Cookie(cookie), m_CoreId(MAX_NUM_OF_CORES + 1), m_Stop(true), m_NumOfPackets(0),
+	m_NumOfRssQueues(0), m_RssRetaSize(DEFAULT_RSS_RETA_SIZE), m_NumOfMisdirectedPackets(0)
+{
+	// receivePackets() allocates the packet objects on first use and reuses them afterwards
+	memset(m_Packets, 0, sizeof(m_Packets));
+}
+
+
+DpdkCaptureWorker::~DpdkCaptureWorker()
+{
+	// deleting a packet object frees the mbuf it wraps
+	for (int i = 0; i < DPDK_RX_BURST_SIZE; i++)
+		delete m_Packets[i];
+}
+
+
+bool DpdkCaptureWorker::run(uint32_t coreId)
+{
+	m_CoreId = coreId;
+	m_Stop = false;
+
+	while (!m_Stop)
+	{
+		uint16_t numOfPackets = m_Device->receivePackets(m_Packets, DPDK_RX_BURST_SIZE, m_RxQueueId);
+		if (numOfPackets == 0)
+			continue;
+
+		m_NumOfPackets += numOfPackets;
+
+		if (m_NumOfRssQueues > 0)
+		{
+			for (uint16_t i = 0; i < numOfPackets; i++)
+			{
+				if (getRssQueue(computeSymmetricRssHash(m_Packets[i]), m_NumOfRssQueues, m_RssRetaSize) != m_RxQueueId)
+					m_NumOfMisdirectedPackets++;
+			}
+		}
+
+		m_OnBurstArrive(m_Packets, numOfPackets, m_Cookie);
+	}
+
+	return true;
+}
+
+
+pcpp::DpdkDevice::DpdkDeviceConfiguration createSymmetricRssConfiguration()
+{
+	return pcpp::DpdkDevice::DpdkDeviceConfiguration(1024, 512, 100,
+		pcpp::DpdkDevice::RSS_IPV4 | pcpp::DpdkDevice::RSS_IPV6,
+		getSymmetricRssKey(), RSS_KEY_LEN);
+}
+
+
+uint16_t setRssRedirectionTable(pcpp::DpdkDevice* device, uint16_t numOfQueues)
+{
+	uint16_t portId = (uint16_t)device->getDeviceId();
+	struct rte_eth_dev_info devInfo;
+	memset(&devInfo, 0, sizeof(devInfo));
+	rte_eth_dev_info_get(portId, &devInfo);
+
+	uint16_t retaSize = devInfo.reta_size;
+	if (retaSize == 0 || retaSize > ETH_RSS_RETA_SIZE_512 || (retaSize & (retaSize - 1)) != 0)
+	{
+		printf("DPDK port %d doesn't report a usable RSS redirection table size, assuming %d entries\n", (int)portId, DEFAULT_RSS_RETA_SIZE);
+		return DEFAULT_RSS_RETA_SIZE;
+	}
+
+	struct rte_eth_rss_reta_entry64 retaConf[ETH_RSS_RETA_SIZE_512 / RTE_RETA_GROUP_SIZE];
+	memset(retaConf, 0, sizeof(retaConf));
+	for (uint16_t i = 0; i < retaSize; i++)
+	{
+		retaConf[i / RTE_RETA_GROUP_SIZE].mask |= (1ULL << (i % RTE_RETA_GROUP_SIZE));
+		retaConf[i / RTE_RETA_GROUP_SIZE].reta[i % RTE_RETA_GROUP_SIZE] = i % numOfQueues;
+	}
+
+	// drivers fill the table the same way by default, so a PMD which can't update it most likely holds this layout already
+	if (rte_eth_dev_rss_reta_update(portId, retaConf, retaSize) != 0)
+		printf("Couldn't set the RSS redirection table of DPDK port %d, relying on the driver's default one\n", (int)portId);
+
+	return retaSize;
+}
+
+#endif /* USE_DPDK */
@@ -0,0 +1,114 @@
+#ifndef HTTPECHO_DPDK_CAPTURE
+#define HTTPECHO_DPDK_CAPTURE
+
+// the DPDK backend is only available when PcapPlusPlus was built with DPDK support (build with "make USE_DPDK=1")
+#ifdef USE_DPDK
+
+#include "header/DpdkDeviceList.h"
+
+// max number of packets read from an RX queue in one burst
+#define DPDK_RX_BURST_SIZE 64
+
+// default mbuf pool size per device. DPDK requires a power of 2 minus 1
+#define DEFAULT_DPDK_MBUF_POOL_SIZE 16383
+
+
+/**
+ * @typedef OnDpdkBurstArrive
+ * A callback invoked by a DpdkCaptureWorker for every burst of packets read from its RX queue
+ * @param[in] packets The packets of the burst. The packets wrap the device's mbufs directly (no copy) and are only valid during the callback
+ * @param[in] numOfPackets The number of packets in the burst
+ * @param[in] cookie The cookie given to the worker
+ */
+typedef void (*OnDpdkBurstArrive)(pcpp::MBufRawPacket** packets, uint16_t numOfPackets, void* cookie);
+
+
+/**
+ * A DPDK worker thread which polls a single RX queue of a DpdkDevice and hands every burst to a callback on its own core.
+ * Each worker is meant to own a complete processing pipeline, so with one worker per RX queue no packet or connection state is ever shared
+ * between cores. The MBufRawPacket objects are allocated once and reused for every burst, each burst releases the mbufs of the previous one
+ */
+class DpdkCaptureWorker : public pcpp::DpdkWorkerThread
+{
+public:
+
+	/**
+	 * A c'tor for this class
+	 * @param[in] device The device to read from
+	 * @param[in] rxQueueId The RX queue this worker polls
+	 * @param[in] onBurstArrive The callback to invoke for every burst
+	 * @param[in] cookie A cookie passed to the callback, usually the worker's pipeline
+	 */
+	DpdkCaptureWorker(pcpp::DpdkDevice* device, uint16_t rxQueueId, OnDpdkBurstArrive onBurstArrive, void* cookie);
+
+	/**
+	 * A d'tor for this class, releases the mbufs still held by the worker
+	 */
+	~DpdkCaptureWorker();
+
+	// implement abstract methods
+
+	bool run(uint32_t coreId);
+
+	void stop() { m_Stop = true; }
+
+	uint32_t getCoreId() const { return m_CoreId; }
+
+	/**
+	 * @return The RX queue this worker polls
+	 */
+	uint16_t getRxQueueId() const { return m_RxQueueId; }
+
+	/**
+	 * @return The number of packets this worker received so far
+	 */
+	uint64_t getNumOfPackets() const { return m_NumOfPackets; }
+
+	/**
+	 * Check every packet against the software RSS hash: the queue getRssQueue() picks for it should be the worker's. The packets which
+	 * arrive elsewhere are counted, they show the NIC doesn't steer with the same hash (and their connections are split between workers).
+	 * Off by default, since it decodes and hashes every packet once more. Must be called before the worker starts
+	 * @param[in] numOfQueues The number of RX queues the port was opened with
+	 * @param[in] retaSize The size of the port's RSS redirection table
+	 */
+	void setRssSteeringCheck(uint16_t numOfQueues, uint16_t retaSize) { m_NumOfRssQueues = numOfQueues; m_RssRetaSize = retaSize; }
+
+	/**
+	 * @return The number of packets the software RSS hash puts on another worker's queue. Only counted once setRssSteeringCheck() was called
+	 */
+	uint64_t getNumOfMisdirectedPackets() const { return m_NumOfMisdirectedPackets; }
+
+private:
+	pcpp::DpdkDevice* m_Device;
+	uint16_t m_RxQueueId;
+	OnDpdkBurstArrive m_OnBurstArrive;
+	void* m_Cookie;
+	uint32_t m_CoreId;
+	volatile bool m_Stop;
+	uint64_t m_NumOfPackets;
+	uint16_t m_NumOfRssQueues;
+	uint16_t m_RssRetaSize;
+	uint64_t m_NumOfMisdirectedPackets;
+	pcpp::MBufRawPacket* m_Packets[DPDK_RX_BURST_SIZE];
+};
+
+
+/**
+ * Create a device configuration which spreads connections over RX queues so both directions of a connection reach the same queue.
+ * The RSS hash is computed on the IP addresses only (so IP fragments, which have no ports, land on the same queue as the rest of their flow)
+ * with the symmetric Toeplitz key of SymmetricRss.h, so computeSymmetricRssHash() gives the hash the NIC computes
+ */
+pcpp::DpdkDevice::DpdkDeviceConfiguration createSymmetricRssConfiguration();
+
+/**
+ * Fill the RSS redirection table of an opened port so entry i holds queue (i % number of queues), the layout getRssQueue() assumes. With it
+ * the software hash tells which queue, and so which worker, any packet reaches
+ * @param[in] device The device, opened with numOfQueues RX queues
+ * @param[in] numOfQueues The number of RX queues
+ * @return The size of the redirection table
+ */
+uint16_t setRssRedirectionTable(pcpp::DpdkDevice* device, uint16_t numOfQueues);
+
+#endif /* USE_DPDK */
+
+#endif /* HTTPECHO_DPDK_CAPTURE */
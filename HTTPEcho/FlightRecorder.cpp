@@ -0,0 +1,371 @@
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <new>
+#include <algorithm>
+#include <sstream>
+#include "header/PcapFileDevice.h"
+#include "PacketBufferPool.h"
+#include "FlightRecorder.h"
+
+// the data length of the header which fills the end of a lane when the next record doesn't fit there. The record goes to the start instead
+#define FLIGHT_RECORDER_WRAP_MARK 0xffffffff
+
+// how often the dump thread looks for a trigger. Triggers only set a flag, so they can come from a signal handler
+#define FLIGHT_RECORDER_POLL_USEC 10000
+
+
+/**
+ * The position of a dump in a lane, and the record it read last
+ */
+struct FlightRecorder::LaneCursor
+{
+	uint64_t position;
+	uint64_t end;
+	uint64_t nextIndex;
+	bool started;
+	bool hasRecord;
+	RecordHeader header;
+	uint8_t data[FLIGHT_RECORDER_MAX_PACKET_LEN];
+};
+
+
+FlightRecorder::FlightRecorder(size_t bytesPerLane, uint32_t maxAgeSec)
+{
+	numOfDumps = 0;
+	numOfDumpedPackets = 0;
+	numOfOverwrittenPackets = 0;
+	numOfCoalescedTriggers = 0;
+
+	m_BytesPerLane = (bytesPerLane + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+	if (m_BytesPerLane == 0)
+		m_BytesPerLane = HUGE_PAGE_SIZE;
+	m_MaxAgeSec = maxAgeSec;
+	m_NumOfLanes = 0;
+	m_PendingTrigger.store(NULL);
+
+	m_MaxErrors = 0;
+	m_ErrorWindowSec = 0;
+	for (int i = 0; i < FLIGHT_RECORDER_MAX_ERROR_WINDOW_SEC; i++)
+		m_ErrorBuckets[i].store(0);
+	m_ErrorRuleQuietUntil.store(0);
+
+	m_Stop.store(false);
+}
+
+
+FlightRecorder::~FlightRecorder()
+{
+	stop();
+
+	for (int i = 0; i < m_NumOfLanes; i++)
+	{
+		freeHugePageMemory(m_Lanes[i]->memory, m_Lanes[i]->size);
+		delete m_Lanes[i];
+	}
+}
+
+
+int FlightRecorder::addLane()
+{
+	if (m_NumOfLanes == FLIGHT_RECORDER_MAX_LANES)
+		return -1;
+
+	Lane* lane = new Lane;
+	lane->tail.store(0);
+	lane->oldest.store(0);
+	lane->newestSec.store(0);
+	lane->numOfPackets.store(0);
+	lane->size = m_BytesPerLane;
+	lane->memory = (uint8_t*)allocateHugePageMemory(lane->size);
+	if (lane->memory == NULL)
+	{
+		delete lane;
+		throw std::bad_alloc();
+	}
+
+	m_Lanes[m_NumOfLanes] = lane;
+	return m_NumOfLanes++;
+}
+
+
+void FlightRecorder::makeRoom(Lane& lane, uint64_t end)
+{
+	uint64_t oldest = lane.oldest.load(std::memory_order_relaxed);
+	if (end - oldest <= lane.size)
+		return;
+
+	// drop the oldest records until the new one fits. Only this thread writes the lane, so the headers it walks are intact
+	while (end - oldest > lane.size)
+	{
+		size_t offset = oldest % lane.size;
+		size_t spaceToEnd = lane.size - offset;
+		uint32_t dataLen = FLIGHT_RECORDER_WRAP_MARK;
+		if (spaceToEnd >= sizeof(RecordHeader))
+			memcpy(&dataLen, lane.memory + offset + offsetof(RecordHeader, dataLen), sizeof(dataLen));
+		oldest += (dataLen == FLIGHT_RECORDER_WRAP_MARK ? spaceToEnd : getRecordLen(dataLen));
+	}
+
+	// publish the new oldest record before its predecessors are overwritten, a dump which copied them checks it afterwards
+	lane.oldest.store(oldest, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+
+void FlightRecorder::record(int laneIndex, const pcpp::RawPacket* packet)
+{
+	Lane& lane = *m_Lanes[laneIndex];
+
+	RecordHeader header;
+	header.index = lane.numOfPackets.load(std::memory_order_relaxed);
+	header.timestampSec = packet->getPacketTimeStamp().tv_sec;
+	header.timestampUsec = (uint32_t)packet->getPacketTimeStamp().tv_usec;
+	header.dataLen = (uint32_t)packet->getRawDataLen();
+	if (header.dataLen > FLIGHT_RECORDER_MAX_PACKET_LEN)
+		header.dataLen = FLIGHT_RECORDER_MAX_PACKET_LEN;
+	header.frameLength = (uint32_t)packet->getFrameLength();
+	header.linkType = (uint16_t)packet->getLinkLayerType();
+	header.reserved = 0;
+
+	// a record never crosses the end of the lane: when it doesn't fit there, the rest of the lane is skipped (marked by a header if it has room)
+	uint64_t position = lane.tail.load(std::memory_order_relaxed);
+	size_t recordLen = getRecordLen(header.dataLen);
+	size_t spaceToEnd = lane.size - position % lane.size;
+	uint64_t start = (spaceToEnd < recordLen ? position + spaceToEnd : position);
+
+	makeRoom(lane, start + recordLen);
+
+	if (start != position && spaceToEnd >= sizeof(RecordHeader))
+	{
+		RecordHeader wrapHeader;
+		memset(&wrapHeader, 0, sizeof(wrapHeader));
+		wrapHeader.dataLen = FLIGHT_RECORDER_WRAP_MARK;
+		memcpy(lane.memory + position % lane.size, &wrapHeader, sizeof(wrapHeader));
+	}
+
+	uint8_t* recordData = lane.memory + start % lane.size;
+	memcpy(recordData, &header, sizeof(header));
+	memcpy(recordData + sizeof(header), packet->getRawData(), header.dataLen);
+
+	lane.tail.store(start + recordLen, std::memory_order_release);
+	lane.numOfPackets.store(header.index + 1, std::memory_order_relaxed);
+	if (lane.newestSec.load(std::memory_order_relaxed) != header.timestampSec)
+		lane.newestSec.store(header.timestampSec, std::memory_order_relaxed);
+}
+
+
+void FlightRecorder::trigger(const char* reason)
+{
+	const char* noTrigger = NULL;
+	if (!m_PendingTrigger.compare_exchange_strong(noTrigger, reason))
+		numOfCoalescedTriggers.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+void FlightRecorder::setErrorRateTrigger(uint32_t maxErrors, uint32_t windowSec)
+{
+	m_MaxErrors = maxErrors;
+	m_ErrorWindowSec = (windowSec > FLIGHT_RECORDER_MAX_ERROR_WINDOW_SEC ? FLIGHT_RECORDER_MAX_ERROR_WINDOW_SEC : windowSec);
+}
+
+
+void FlightRecorder::onHttpResponse(uint16_t statusCode, time_t now)
+{
+	if (m_ErrorWindowSec == 0 || statusCode < 500 || statusCode > 599)
+		return;
+
+	std::atomic<uint64_t>& bucket = m_ErrorBuckets[(uint64_t)now % FLIGHT_RECORDER_MAX_ERROR_WINDOW_SEC];
+	uint64_t second = (uint32_t)now;
+	uint64_t value = bucket.load(std::memory_order_relaxed);
+	while (true)
+	{
+		// the bucket moved on to a later second already (a worker whose capture time is behind the others), the response is too old to count
+		if ((value >> 32) > second)
+			return;
+
+		uint64_t newValue = ((value >> 32) == second ? value + 1 : (second << 32) | 1);
+		if (bucket.compare_exchange_weak(value, newValue, std::memory_order_relaxed))
+			break;
+	}
+
+	uint64_t numOfErrors = 0;
+	for (int i = 0; i < FLIGHT_RECORDER_MAX_ERROR_WINDOW_SEC; i++)
+	{
+		uint64_t bucketValue = m_ErrorBuckets[i].load(std::memory_order_relaxed);
+		if ((bucketValue >> 32) + m_ErrorWindowSec > second && (bucketValue >> 32) <= second)
+			numOfErrors += (bucketValue & 0xffffffff);
+	}
+
+	if (numOfErrors <= m_MaxErrors)
+		return;
+
+	// one worker wins the trigger, then the rule stays quiet for a window
+	int64_t quietUntil = m_ErrorRuleQuietUntil.load(std::memory_order_relaxed);
+	if ((int64_t)now >= quietUntil && m_ErrorRuleQuietUntil.compare_exchange_strong(quietUntil, (int64_t)now + m_ErrorWindowSec))
+		trigger("HTTP 5xx rate over the error trigger threshold");
+}
+
+
+bool FlightRecorder::readNext(const Lane& lane, LaneCursor& cursor, int64_t minSec)
+{
+	while (cursor.position < cursor.end)
+	{
+		size_t offset = cursor.position % lane.size;
+		size_t spaceToEnd = lane.size - offset;
+		if (spaceToEnd < sizeof(RecordHeader))
+		{
+			cursor.position += spaceToEnd;
+			continue;
+		}
+
+		memcpy(&cursor.header, lane.memory + offset, sizeof(RecordHeader));
+		bool isWrap = (cursor.header.dataLen == FLIGHT_RECORDER_WRAP_MARK);
+		if (!isWrap && cursor.header.dataLen <= FLIGHT_RECORDER_MAX_PACKET_LEN && cursor.header.dataLen <= spaceToEnd - sizeof(RecordHeader))
+			memcpy(cursor.data, lane.memory + offset + sizeof(RecordHeader), cursor.header.dataLen);
+
+		// the copy may race with the worker. It's only good if the record was still intact after it was copied, otherwise the worker
+		// overwrote it (and everything before the new oldest record), so move on to the oldest record
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t oldest = lane.oldest.load(std::memory_order_relaxed);
+		if (oldest > cursor.position)
+		{
+			cursor.position = oldest;
+			continue;
+		}
+
+		if (isWrap)
+		{
+			cursor.position += spaceToEnd;
+			continue;
+		}
+
+		cursor.position += getRecordLen(cursor.header.dataLen);
+		if (cursor.started && cursor.header.index > cursor.nextIndex)
+			numOfOverwrittenPackets += cursor.header.index - cursor.nextIndex;
+		cursor.started = true;
+		cursor.nextIndex = cursor.header.index + 1;
+
+		if (cursor.header.timestampSec >= minSec)
+			return true;
+	}
+
+	return false;
+}
+
+
+void FlightRecorder::dump(const char* reason)
+{
+	int numOfLanes = m_NumOfLanes;
+	if (numOfLanes == 0)
+		return;
+
+	// the window ends where the lanes were when the dump started, and reaches back max age seconds from the newest packet of any lane
+	int64_t newestSec = 0;
+	for (int i = 0; i < numOfLanes; i++)
+		newestSec = std::max(newestSec, (int64_t)m_Lanes[i]->newestSec.load(std::memory_order_relaxed));
+	int64_t minSec = (m_MaxAgeSec > 0 ? newestSec - (int64_t)m_MaxAgeSec : INT64_MIN);
+
+	LaneCursor* cursors = new LaneCursor[numOfLanes];
+	for (int i = 0; i < numOfLanes; i++)
+	{
+		cursors[i].end = m_Lanes[i]->tail.load(std::memory_order_acquire);
+		cursors[i].position = m_Lanes[i]->oldest.load(std::memory_order_acquire);
+		cursors[i].nextIndex = 0;
+		cursors[i].started = false;
+		cursors[i].hasRecord = readNext(*m_Lanes[i], cursors[i], minSec);
+	}
+
+	std::stringstream fileName;
+	if (m_OutputDir != "")
+		fileName << m_OutputDir << '/';
+	fileName << "flight_recorder_" << time(NULL) << "_" << numOfDumps << ".pcapng";
+	std::string comment = std::string("Triggered by: ") + reason;
+
+	pcpp::PcapNgFileWriterDevice writer(fileName.str().c_str());
+	if (!writer.open("", "", "HTTPEcho", comment.c_str()))
+	{
+		printf("Couldn't open flight recorder dump file '%s'\n", fileName.str().c_str());
+		delete [] cursors;
+		return;
+	}
+
+	// merge the lanes by timestamp, each lane is in capture order already
+	uint64_t numOfPackets = 0;
+	timeval zeroTime = timeval();
+	pcpp::RawPacket packet(NULL, 0, zeroTime, false);
+	while (true)
+	{
+		LaneCursor* oldest = NULL;
+		for (int i = 0; i < numOfLanes; i++)
+		{
+			if (!cursors[i].hasRecord)
+				continue;
+			if (oldest == NULL || cursors[i].header.timestampSec < oldest->header.timestampSec ||
+					(cursors[i].header.timestampSec == oldest->header.timestampSec && cursors[i].header.timestampUsec < oldest->header.timestampUsec))
+				oldest = &cursors[i];
+		}
+
+		if (oldest == NULL)
+			break;
+
+		timeval timestamp;
+		timestamp.tv_sec = (time_t)oldest->header.timestampSec;
+		timestamp.tv_usec = (suseconds_t)oldest->header.timestampUsec;
+		packet.setRawData(oldest->data, (int)oldest->header.dataLen, timestamp, (pcpp::LinkLayerType)oldest->header.linkType,
+				(int)oldest->header.frameLength);
+		writer.writePacket(packet);
+		numOfPackets++;
+
+		oldest->hasRecord = readNext(*m_Lanes[oldest - cursors], *oldest, minSec);
+	}
+
+	writer.close();
+	delete [] cursors;
+
+	numOfDumps++;
+	numOfDumpedPackets += numOfPackets;
+	printf("Flight recorder: wrote %llu packets to '%s' (triggered by: %s)\n", (unsigned long long)numOfPackets, fileName.str().c_str(), reason);
+}
+
+
+void FlightRecorder::run()
+{
+	while (true)
+	{
+		const char* reason = m_PendingTrigger.exchange(NULL);
+		if (reason != NULL)
+		{
+			dump(reason);
+			continue;
+		}
+
+		if (m_Stop.load())
+			return;
+
+		usleep(FLIGHT_RECORDER_POLL_USEC);
+	}
+}
+
+
+void FlightRecorder::start(const std::string& outputDir)
+{
+	m_OutputDir = outputDir;
+	m_Thread = std::thread(&FlightRecorder::run, this);
+}
+
+
+void FlightRecorder::stop()
+{
+	m_Stop.store(true);
+	if (m_Thread.joinable())
+		m_Thread.join();
+}
+
+
+uint64_t FlightRecorder::getNumOfRecordedPackets() const
+{
+	uint64_t numOfPackets = 0;
+	for (int i = 0; i < m_NumOfLanes; i++)
+		numOfPackets += m_Lanes[i]->numOfPackets.load();
+	return numOfPackets;
+}
@@ -0,0 +1,179 @@
+#ifndef HTTPECHO_FLIGHT_RECORDER
+#define HTTPECHO_FLIGHT_RECORDER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include "header/RawPacket.h"
+
+// max number of lanes (capture workers) a recorder keeps packets for
+#define FLIGHT_RECORDER_MAX_LANES 64
+
+// packets are recorded up to this many bytes, longer ones are cut (their original length is kept)
+#define FLIGHT_RECORDER_MAX_PACKET_LEN 65535
+
+// the number of seconds the HTTP 5xx rate trigger can look back
+#define FLIGHT_RECORDER_MAX_ERROR_WINDOW_SEC 60
+
+
+/**
+ * A flight recorder: keeps the last packets captured in preallocated memory, so the traffic which led up to an incident can be written to a
+ * pcap-ng file after the fact without keeping a full capture on disk.
+ * Every capture worker records into its own lane, a circular buffer of whole packets (a header with the timestamp and lengths, then the data)
+ * in huge page memory, which it alone writes, so recording is a copy and never waits. When a packet doesn't fit, the oldest packets are dropped
+ * from the lane; the lane keeps the position of its oldest intact packet in an atomic, advanced before the memory is overwritten.
+ * A dump is triggered from any thread (a signal handler included) and runs on the recorder's own thread while the capture goes on: it reads the
+ * lanes from their oldest packet to where they were when the dump started, merges them by timestamp and writes the packets no older than the
+ * max age. A packet is copied out and then checked against the lane's oldest position, so a packet which a worker overwrote during the dump is
+ * skipped (and counted) instead of being written torn
+ */
+class FlightRecorder
+{
+public:
+
+	/**
+	 * A c'tor for this class
+	 * @param[in] bytesPerLane The memory of each lane, rounded up to a multiple of HUGE_PAGE_SIZE
+	 * @param[in] maxAgeSec A dump only writes the packets captured at most this many seconds before the newest packet (0 for no limit)
+	 */
+	FlightRecorder(size_t bytesPerLane, uint32_t maxAgeSec);
+
+	/**
+	 * A d'tor for this class. Stops the dump thread
+	 */
+	~FlightRecorder();
+
+	/**
+	 * Add a lane. Its memory is pre-faulted, so it lands on the NUMA node preferred by the calling thread. All lanes must be added before start().
+	 * Throws std::bad_alloc if the memory can't be mapped
+	 * @return The index of the lane, or -1 if there are FLIGHT_RECORDER_MAX_LANES lanes already
+	 */
+	int addLane();
+
+	/**
+	 * Record a packet. Must always be called from the same thread for a lane
+	 * @param[in] lane The index of the lane
+	 * @param[in] packet The packet
+	 */
+	void record(int lane, const pcpp::RawPacket* packet);
+
+	/**
+	 * Dump the recorded packets. Only sets a flag the dump thread picks up, so it's safe to call from any thread and from a signal handler.
+	 * While a dump is pending, more triggers are coalesced into it
+	 * @param[in] reason Why the dump was triggered, written as the file's comment. Must stay valid (e.g. a string literal)
+	 */
+	void trigger(const char* reason);
+
+	/**
+	 * Trigger a dump when more than maxErrors HTTP 5xx responses are seen within windowSec seconds of capture time. After a dump is triggered
+	 * this way the rule stays quiet for windowSec seconds. Must be called before start()
+	 * @param[in] maxErrors The number of 5xx responses tolerated within the window
+	 * @param[in] windowSec The window, up to FLIGHT_RECORDER_MAX_ERROR_WINDOW_SEC seconds
+	 */
+	void setErrorRateTrigger(uint32_t maxErrors, uint32_t windowSec);
+
+	/**
+	 * Count an HTTP response for the error rate trigger. Safe to call from any capture worker
+	 * @param[in] statusCode The status code of the response
+	 * @param[in] now The capture time of the response
+	 */
+	void onHttpResponse(uint16_t statusCode, time_t now);
+
+	/**
+	 * Start the dump thread
+	 * @param[in] outputDir The directory dumps are written to (empty for the current directory)
+	 */
+	void start(const std::string& outputDir);
+
+	/**
+	 * Stop the dump thread, after it finishes the dump in progress and the pending one
+	 */
+	void stop();
+
+	/**
+	 * @return The number of packets recorded by all lanes. Only exact once the capture stopped
+	 */
+	uint64_t getNumOfRecordedPackets() const;
+
+	// stats: dumps written, packets written by them, packets overwritten by a worker before a dump read them and triggers coalesced into a
+	// pending dump. Updated by the dump thread (the last one by the triggering threads)
+	uint64_t numOfDumps;
+	uint64_t numOfDumpedPackets;
+	uint64_t numOfOverwrittenPackets;
+	std::atomic<uint64_t> numOfCoalescedTriggers;
+
+private:
+
+	/**
+	 * The header of a recorded packet. The packet data follows it, and the next record starts at the next multiple of 8 bytes
+	 */
+	struct RecordHeader
+	{
+		uint64_t index;
+		int64_t timestampSec;
+		uint32_t timestampUsec;
+		uint32_t dataLen;
+		uint32_t frameLength;
+		uint16_t linkType;
+		uint16_t reserved;
+	};
+
+	/**
+	 * A lane. Positions are byte offsets which only grow, a position is found in the memory at position % size. The lane's worker writes
+	 * everything, the dump thread only reads
+	 */
+	struct Lane
+	{
+		uint8_t padding[64];
+
+		// the end of the last record and the start of the oldest intact record
+		std::atomic<uint64_t> tail;
+		std::atomic<uint64_t> oldest;
+
+		// the capture time (seconds) of the newest record
+		std::atomic<int64_t> newestSec;
+
+		std::atomic<uint64_t> numOfPackets;
+		uint8_t* memory;
+		size_t size;
+
+		uint8_t trailingPadding[64];
+	};
+
+	struct LaneCursor;
+
+	static size_t getRecordLen(uint32_t dataLen) { return (sizeof(RecordHeader) + dataLen + 7) & ~(size_t)7; }
+
+	size_t m_BytesPerLane;
+	uint32_t m_MaxAgeSec;
+	Lane* m_Lanes[FLIGHT_RECORDER_MAX_LANES];
+	int m_NumOfLanes;
+
+	std::atomic<const char*> m_PendingTrigger;
+
+	// the HTTP 5xx rate trigger (a window of 0 turns it off). A bucket counts the 5xx responses of a second, packed as the second (high 32 bits)
+	// and the count (low 32 bits) so both are updated together
+	uint32_t m_MaxErrors;
+	uint32_t m_ErrorWindowSec;
+	std::atomic<uint64_t> m_ErrorBuckets[FLIGHT_RECORDER_MAX_ERROR_WINDOW_SEC];
+	std::atomic<int64_t> m_ErrorRuleQuietUntil;
+
+	// the dump thread
+	std::thread m_Thread;
+	std::atomic<bool> m_Stop;
+	std::string m_OutputDir;
+
+	void makeRoom(Lane& lane, uint64_t end);
+	bool readNext(const Lane& lane, LaneCursor& cursor, int64_t minSec);
+	void dump(const char* reason);
+	void run();
+
+	// the recorder owns its lanes and thread, prevent copies
+	FlightRecorder(const FlightRecorder& other);
+	FlightRecorder& operator=(const FlightRecorder& other);
+};
+
+#endif /* HTTPECHO_FLIGHT_RECORDER */
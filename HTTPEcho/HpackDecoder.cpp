@@ -0,0 +1,483 @@
+#include <string.h>
+#include <algorithm>
+#include "HpackDecoder.h"
+
+
+#define HPACK_STATIC_ENTRY(name, value) { name, sizeof(name) - 1, value, sizeof(value) - 1 }
+
+struct HpackStaticEntry
+{
+	const char* name;
+	size_t nameLen;
+	const char* value;
+	size_t valueLen;
+};
+
+// RFC 7541 Appendix A, index 1 is the first entry
+static const HpackStaticEntry s_StaticTable[] =
+{
+	HPACK_STATIC_ENTRY(":authority", ""),
+	HPACK_STATIC_ENTRY(":method", "GET"),
+	HPACK_STATIC_ENTRY(":method", "POST"),
+	HPACK_STATIC_ENTRY(":path", "/"),
+	HPACK_STATIC_ENTRY(":path", "/index.html"),
+	HPACK_STATIC_ENTRY(":scheme", "http"),
+	HPACK_STATIC_ENTRY(":scheme", "https"),
+	HPACK_STATIC_ENTRY(":status", "200"),
+	HPACK_STATIC_ENTRY(":status", "204"),
+	HPACK_STATIC_ENTRY(":status", "206"),
+	HPACK_STATIC_ENTRY(":status", "304"),
+	HPACK_STATIC_ENTRY(":status", "400"),
+	HPACK_STATIC_ENTRY(":status", "404"),
+	HPACK_STATIC_ENTRY(":status", "500"),
+	HPACK_STATIC_ENTRY("accept-charset", ""),
+	HPACK_STATIC_ENTRY("accept-encoding", "gzip, deflate"),
+	HPACK_STATIC_ENTRY("accept-language", ""),
+	HPACK_STATIC_ENTRY("accept-ranges", ""),
+	HPACK_STATIC_ENTRY("accept", ""),
+	HPACK_STATIC_ENTRY("access-control-allow-origin", ""),
+	HPACK_STATIC_ENTRY("age", ""),
+	HPACK_STATIC_ENTRY("allow", ""),
+	HPACK_STATIC_ENTRY("authorization", ""),
+	HPACK_STATIC_ENTRY("cache-control", ""),
+	HPACK_STATIC_ENTRY("content-disposition", ""),
+	HPACK_STATIC_ENTRY("content-encoding", ""),
+	HPACK_STATIC_ENTRY("content-language", ""),
+	HPACK_STATIC_ENTRY("content-length", ""),
+	HPACK_STATIC_ENTRY("content-location", ""),
+	HPACK_STATIC_ENTRY("content-range", ""),
+	HPACK_STATIC_ENTRY("content-type", ""),
+	HPACK_STATIC_ENTRY("cookie", ""),
+	HPACK_STATIC_ENTRY("date", ""),
+	HPACK_STATIC_ENTRY("etag", ""),
+	HPACK_STATIC_ENTRY("expect", ""),
+	HPACK_STATIC_ENTRY("expires", ""),
+	HPACK_STATIC_ENTRY("from", ""),
+	HPACK_STATIC_ENTRY("host", ""),
+	HPACK_STATIC_ENTRY("if-match", ""),
+	HPACK_STATIC_ENTRY("if-modified-since", ""),
+	HPACK_STATIC_ENTRY("if-none-match", ""),
+	HPACK_STATIC_ENTRY("if-range", ""),
+	HPACK_STATIC_ENTRY("if-unmodified-since", ""),
+	HPACK_STATIC_ENTRY("last-modified", ""),
+	HPACK_STATIC_ENTRY("link", ""),
+	HPACK_STATIC_ENTRY("location", ""),
+	HPACK_STATIC_ENTRY("max-forwards", ""),
+	HPACK_STATIC_ENTRY("proxy-authenticate", ""),
+	HPACK_STATIC_ENTRY("proxy-authorization", ""),
+	HPACK_STATIC_ENTRY("range", ""),
+	HPACK_STATIC_ENTRY("referer", ""),
+	HPACK_STATIC_ENTRY("refresh", ""),
+	HPACK_STATIC_ENTRY("retry-after", ""),
+	HPACK_STATIC_ENTRY("server", ""),
+	HPACK_STATIC_ENTRY("set-cookie", ""),
+	HPACK_STATIC_ENTRY("strict-transport-security", ""),
+	HPACK_STATIC_ENTRY("transfer-encoding", ""),
+	HPACK_STATIC_ENTRY("user-agent", ""),
+	HPACK_STATIC_ENTRY("vary", ""),
+	HPACK_STATIC_ENTRY("via", ""),
+	HPACK_STATIC_ENTRY("www-authenticate", "")
+};
+
+#define HPACK_STATIC_TABLE_LEN (sizeof(s_StaticTable) / sizeof(s_StaticTable[0]))
+
+
+// the code length of every symbol of the RFC 7541 Appendix B Huffman code (256 is EOS). The code is canonical, so the lengths are all it takes
+// to rebuild the codes
+static const uint8_t s_HuffmanCodeLengths[257] =
+{
+	13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+	28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+	6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+	5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+	13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+	15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+	6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+	20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+	24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+	22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+	21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+	26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+	19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+	20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+	26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+	30
+};
+
+#define HUFFMAN_EOS 256
+#define HUFFMAN_NUM_OF_STATES 256
+
+// flags of a decode step
+#define HUFFMAN_EMIT 0x01
+#define HUFFMAN_ACCEPT 0x02
+#define HUFFMAN_FAIL 0x04
+
+/**
+ * One step of the Huffman decoder: the state reached after feeding 4 bits to a state, and the symbol completed on the way (at most one, as the
+ * shortest code is 5 bits long). States are the inner nodes of the code tree, state 0 is the root
+ */
+struct HuffmanDecodeStep
+{
+	uint8_t nextState;
+	uint8_t flags;
+	uint8_t symbol;
+};
+
+static HuffmanDecodeStep s_HuffmanDecodeTable[HUFFMAN_NUM_OF_STATES][16];
+
+
+/**
+ * Order symbols by code length
+ */
+static bool isShorterCode(int symbolA, int symbolB)
+{
+	return s_HuffmanCodeLengths[symbolA] < s_HuffmanCodeLengths[symbolB];
+}
+
+
+/**
+ * Rebuild the code tree from the code lengths, then walk every 4-bit input from every inner node. A state accepts (may end the string) if it's
+ * the root or if it's reached from the root by at most 7 one-bits, i.e. the padding is a prefix of EOS
+ */
+static bool buildHuffmanDecodeTable()
+{
+	// children of the inner nodes: >= 0 is an inner node, < 0 is the leaf of symbol (-child - 1)
+	int children[HUFFMAN_NUM_OF_STATES][2];
+	bool accepting[HUFFMAN_NUM_OF_STATES];
+	int numOfNodes = 1;
+	memset(children, 0, sizeof(children));
+	accepting[0] = true;
+
+	// canonical codes are assigned in order of length, then of symbol
+	int symbols[257];
+	for (int i = 0; i < 257; i++)
+		symbols[i] = i;
+	std::stable_sort(symbols, symbols + 257, isShorterCode);
+
+	uint32_t code = 0;
+	int prevLen = s_HuffmanCodeLengths[symbols[0]];
+	for (int i = 0; i < 257; i++)
+	{
+		int symbol = symbols[i];
+		int len = s_HuffmanCodeLengths[symbol];
+		code <<= (len - prevLen);
+		prevLen = len;
+
+		int node = 0;
+		bool allOnes = true;
+		for (int bit = len - 1; bit > 0; bit--)
+		{
+			int branch = (code >> bit) & 1;
+			allOnes = allOnes && branch == 1;
+			if (children[node][branch] == 0)
+			{
+				accepting[numOfNodes] = allOnes && (len - bit) <= 7;
+				children[node][branch] = numOfNodes++;
+			}
+			node = children[node][branch];
+		}
+		children[node][code & 1] = -symbol - 1;
+		code++;
+	}
+
+	for (int state = 0; state < HUFFMAN_NUM_OF_STATES; state++)
+	{
+		for (int input = 0; input < 16; input++)
+		{
+			HuffmanDecodeStep& step = s_HuffmanDecodeTable[state][input];
+			step.flags = 0;
+			step.symbol = 0;
+
+			int node = state;
+			for (int bit = 3; bit >= 0; bit--)
+			{
+				int child = children[node][(input >> bit) & 1];
+				if (child >= 0)
+				{
+					node = child;
+					continue;
+				}
+
+				if (-child - 1 == HUFFMAN_EOS)
+					step.flags |= HUFFMAN_FAIL;
+				step.flags |= HUFFMAN_EMIT;
+				step.symbol = (uint8_t)(-child - 1);
+				node = 0;
+			}
+
+			step.nextState = (uint8_t)node;
+			if (accepting[node])
+				step.flags |= HUFFMAN_ACCEPT;
+		}
+	}
+
+	return numOfNodes == HUFFMAN_NUM_OF_STATES;
+}
+
+static const bool s_HuffmanDecodeTableBuilt = buildHuffmanDecodeTable();
+
+
+bool HpackDecoder::huffmanDecode(const uint8_t* src, size_t srcLen, char* dst, size_t dstCapacity, size_t& decodedLen)
+{
+	uint8_t state = 0;
+	bool accept = true;
+	decodedLen = 0;
+
+	for (size_t i = 0; i < srcLen; i++)
+	{
+		for (int shift = 4; shift >= 0; shift -= 4)
+		{
+			const HuffmanDecodeStep& step = s_HuffmanDecodeTable[state][(src[i] >> shift) & 0x0f];
+			if (step.flags & HUFFMAN_FAIL)
+				return false;
+
+			if (step.flags & HUFFMAN_EMIT)
+			{
+				if (decodedLen < dstCapacity)
+					dst[decodedLen] = (char)step.symbol;
+				decodedLen++;
+			}
+
+			state = step.nextState;
+			accept = (step.flags & HUFFMAN_ACCEPT) != 0;
+		}
+	}
+
+	return accept;
+}
+
+
+HpackDecoder::HpackDecoder()
+{
+	m_DataStart = 0;
+	m_DataEnd = 0;
+	m_FirstEntry = 0;
+	m_NumOfEntries = 0;
+	m_TableSize = 0;
+	m_MaxTableSize = HPACK_MAX_TABLE_SIZE;
+}
+
+
+bool HpackDecoder::decodeInteger(const uint8_t*& pos, const uint8_t* end, int prefixBits, uint32_t& value)
+{
+	if (pos >= end)
+		return false;
+
+	uint32_t prefixMask = (1U << prefixBits) - 1;
+	value = *pos++ & prefixMask;
+	if (value < prefixMask)
+		return true;
+
+	// the rest is 7 bits per byte, least significant group first
+	uint64_t fullValue = value;
+	for (int shift = 0; ; shift += 7)
+	{
+		if (pos >= end || shift > 28)
+			return false;
+
+		uint8_t byte = *pos++;
+		fullValue += (uint64_t)(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0)
+			break;
+	}
+
+	if (fullValue > UINT32_MAX)
+		return false;
+
+	value = (uint32_t)fullValue;
+	return true;
+}
+
+
+bool HpackDecoder::decodeString(const uint8_t*& pos, const uint8_t* end, char* buffer, const char*& str, size_t& strLen, bool& isTruncated)
+{
+	if (pos >= end)
+		return false;
+
+	bool isHuffmanCoded = (*pos & 0x80) != 0;
+	uint32_t len;
+	if (!decodeInteger(pos, end, 7, len) || len > (size_t)(end - pos))
+		return false;
+
+	isTruncated = false;
+	if (!isHuffmanCoded)
+	{
+		str = (const char*)pos;
+		strLen = len;
+	}
+	else
+	{
+		if (!huffmanDecode(pos, len, buffer, HPACK_MAX_STRING_LEN, strLen))
+			return false;
+
+		isTruncated = (strLen > HPACK_MAX_STRING_LEN);
+		if (isTruncated)
+			strLen = HPACK_MAX_STRING_LEN;
+		str = buffer;
+	}
+
+	pos += len;
+	return true;
+}
+
+
+bool HpackDecoder::getEntry(uint32_t index, const char*& name, size_t& nameLen, const char*& value, size_t& valueLen) const
+{
+	if (index == 0)
+		return false;
+
+	if (index <= HPACK_STATIC_TABLE_LEN)
+	{
+		const HpackStaticEntry& entry = s_StaticTable[index - 1];
+		name = entry.name;
+		nameLen = entry.nameLen;
+		value = entry.value;
+		valueLen = entry.valueLen;
+		return true;
+	}
+
+	// dynamic index 1 is the newest entry
+	size_t dynamicIndex = index - HPACK_STATIC_TABLE_LEN;
+	if (dynamicIndex > m_NumOfEntries)
+		return false;
+
+	const TableEntry& entry = m_Entries[(m_FirstEntry + m_NumOfEntries - dynamicIndex) % HPACK_MAX_ENTRIES];
+	name = m_Data + entry.offset;
+	nameLen = entry.nameLen;
+	value = m_Data + entry.offset + entry.nameLen;
+	valueLen = entry.valueLen;
+	return true;
+}
+
+
+void HpackDecoder::evictEntries(size_t requiredSize)
+{
+	while (m_NumOfEntries > 0 && m_TableSize + requiredSize > m_MaxTableSize)
+	{
+		const TableEntry& oldest = m_Entries[m_FirstEntry];
+		m_DataStart += oldest.nameLen + oldest.valueLen;
+		m_TableSize -= oldest.nameLen + oldest.valueLen + HPACK_ENTRY_OVERHEAD;
+		m_FirstEntry = (m_FirstEntry + 1) % HPACK_MAX_ENTRIES;
+		m_NumOfEntries--;
+	}
+
+	if (m_NumOfEntries == 0)
+	{
+		m_DataStart = 0;
+		m_DataEnd = 0;
+	}
+}
+
+
+void HpackDecoder::addEntry(const char* name, size_t nameLen, const char* value, size_t valueLen, bool isTruncated)
+{
+	// an entry larger than the whole table empties it and isn't added (a cut string is always larger)
+	size_t entrySize = nameLen + valueLen + HPACK_ENTRY_OVERHEAD;
+	if (isTruncated || entrySize > m_MaxTableSize)
+	{
+		evictEntries(m_MaxTableSize + 1);
+		return;
+	}
+
+	// the name may refer to an entry which is about to be evicted or moved
+	if (name >= m_Data && name < m_Data + sizeof(m_Data))
+	{
+		memcpy(m_NameBuffer, name, nameLen);
+		name = m_NameBuffer;
+	}
+
+	evictEntries(entrySize);
+
+	// no room left at the end of the arena - move the live entries back to its beginning. They always fit with the new one, as the table size
+	// counts an overhead on top of every name and value
+	if (m_DataEnd + nameLen + valueLen > sizeof(m_Data))
+	{
+		memmove(m_Data, m_Data + m_DataStart, m_DataEnd - m_DataStart);
+		for (size_t i = 0; i < m_NumOfEntries; i++)
+			m_Entries[(m_FirstEntry + i) % HPACK_MAX_ENTRIES].offset -= (uint32_t)m_DataStart;
+		m_DataEnd -= m_DataStart;
+		m_DataStart = 0;
+	}
+
+	TableEntry& entry = m_Entries[(m_FirstEntry + m_NumOfEntries) % HPACK_MAX_ENTRIES];
+	entry.offset = (uint32_t)m_DataEnd;
+	entry.nameLen = (uint16_t)nameLen;
+	entry.valueLen = (uint16_t)valueLen;
+	memcpy(m_Data + m_DataEnd, name, nameLen);
+	memcpy(m_Data + m_DataEnd + nameLen, value, valueLen);
+
+	m_DataEnd += nameLen + valueLen;
+	m_TableSize += entrySize;
+	m_NumOfEntries++;
+}
+
+
+bool HpackDecoder::decodeHeaderBlock(const uint8_t* block, size_t blockLen, OnHpackHeader onHeader, void* userCookie)
+{
+	const uint8_t* pos = block;
+	const uint8_t* end = block + blockLen;
+
+	while (pos < end)
+	{
+		uint8_t firstByte = *pos;
+		const char* name;
+		const char* value;
+		size_t nameLen;
+		size_t valueLen;
+
+		// indexed header field
+		if (firstByte & 0x80)
+		{
+			uint32_t index;
+			if (!decodeInteger(pos, end, 7, index) || !getEntry(index, name, nameLen, value, valueLen))
+				return false;
+
+			onHeader(name, nameLen, value, valueLen, userCookie);
+			continue;
+		}
+
+		// dynamic table size update
+		if ((firstByte & 0xe0) == 0x20)
+		{
+			uint32_t maxTableSize;
+			if (!decodeInteger(pos, end, 5, maxTableSize) || maxTableSize > HPACK_MAX_TABLE_SIZE)
+				return false;
+
+			m_MaxTableSize = maxTableSize;
+			evictEntries(0);
+			continue;
+		}
+
+		// literal header field with incremental indexing (6-bit name index), or without indexing / never indexed (4-bit name index)
+		bool addToTable = ((firstByte & 0xc0) == 0x40);
+		uint32_t nameIndex;
+		bool isNameTruncated = false;
+		bool isValueTruncated = false;
+		if (!decodeInteger(pos, end, addToTable ? 6 : 4, nameIndex))
+			return false;
+
+		if (nameIndex == 0)
+		{
+			if (!decodeString(pos, end, m_NameBuffer, name, nameLen, isNameTruncated))
+				return false;
+		}
+		else
+		{
+			const char* unusedValue;
+			size_t unusedValueLen;
+			if (!getEntry(nameIndex, name, nameLen, unusedValue, unusedValueLen))
+				return false;
+		}
+
+		if (!decodeString(pos, end, m_ValueBuffer, value, valueLen, isValueTruncated))
+			return false;
+
+		onHeader(name, nameLen, value, valueLen, userCookie);
+
+		if (addToTable)
+			addEntry(name, nameLen, value, valueLen, isNameTruncated || isValueTruncated);
+	}
+
+	return true;
+}
@@ -0,0 +1,118 @@
+#ifndef HTTPECHO_HPACK_DECODER
+#define HTTPECHO_HPACK_DECODER
+
+#include <stdint.h>
+#include <stddef.h>
+
+// the largest dynamic table a decoder can hold (the HTTP/2 default of SETTINGS_HEADER_TABLE_SIZE). A peer which grows its table beyond it
+// can't be decoded
+#define HPACK_MAX_TABLE_SIZE 4096
+
+// the per-entry overhead RFC 7541 adds to the length of the name and value when sizing the dynamic table
+#define HPACK_ENTRY_OVERHEAD 32
+
+// the most entries a table of HPACK_MAX_TABLE_SIZE can hold (all with empty names and values)
+#define HPACK_MAX_ENTRIES (HPACK_MAX_TABLE_SIZE / HPACK_ENTRY_OVERHEAD)
+
+// the part of a Huffman coded name or value which is kept, the rest of a longer string is cut (it would never fit in the dynamic table)
+#define HPACK_MAX_STRING_LEN 4096
+
+
+/**
+ * @typedef OnHpackHeader
+ * A callback invoked by HpackDecoder for every header field of a block, in order. The strings aren't null-terminated and are only valid during
+ * the callback
+ * @param[in] name The header name
+ * @param[in] nameLen The header name length
+ * @param[in] value The header value
+ * @param[in] valueLen The header value length
+ * @param[in] userCookie The cookie given to decodeHeaderBlock()
+ */
+typedef void (*OnHpackHeader)(const char* name, size_t nameLen, const char* value, size_t valueLen, void* userCookie);
+
+
+/**
+ * Decodes the HPACK (RFC 7541) header blocks one side of an HTTP/2 connection sends. The decoder keeps the side's dynamic table, so it must see
+ * every header block of the side in order - after a block which fails to decode the table no longer matches the encoder's.
+ * Nothing is allocated: the dynamic table is a fixed arena (entries are appended at its end and evicted from its start, the live part is moved
+ * back to the beginning when the end is reached), Huffman strings are decoded into fixed buffers with a 4-bits-at-a-time state machine, and
+ * literals which aren't Huffman coded are handed to the callback straight from the block
+ */
+class HpackDecoder
+{
+public:
+
+	/**
+	 * A c'tor for this class, the dynamic table starts empty with a max size of HPACK_MAX_TABLE_SIZE
+	 */
+	HpackDecoder();
+
+	/**
+	 * Decode a complete header block
+	 * @param[in] block The header block, i.e. the fragments of a HEADERS / PUSH_PROMISE frame and its CONTINUATION frames put together
+	 * @param[in] blockLen The header block length
+	 * @param[in] onHeader The callback to invoke for every header field
+	 * @param[in] userCookie A cookie passed to the callback
+	 * @return False if the block is malformed or refers to a table state the decoder can't hold, in which case the dynamic table is out of sync
+	 */
+	bool decodeHeaderBlock(const uint8_t* block, size_t blockLen, OnHpackHeader onHeader, void* userCookie);
+
+	/**
+	 * @return The size of the dynamic table as RFC 7541 counts it (name and value lengths plus HPACK_ENTRY_OVERHEAD per entry)
+	 */
+	size_t getTableSize() const { return m_TableSize; }
+
+	/**
+	 * @return The number of entries in the dynamic table
+	 */
+	size_t getNumOfEntries() const { return m_NumOfEntries; }
+
+	/**
+	 * Decode a Huffman coded string
+	 * @param[in] src The coded string
+	 * @param[in] srcLen The coded string length
+	 * @param[out] dst The buffer to decode into
+	 * @param[in] dstCapacity The buffer size, symbols beyond it are counted but not written
+	 * @param[out] decodedLen The number of decoded symbols
+	 * @return False if the string contains the EOS symbol or isn't padded with the most significant bits of EOS (at most 7 bits)
+	 */
+	static bool huffmanDecode(const uint8_t* src, size_t srcLen, char* dst, size_t dstCapacity, size_t& decodedLen);
+
+private:
+
+	struct TableEntry
+	{
+		uint32_t offset;
+		uint16_t nameLen;
+		uint16_t valueLen;
+	};
+
+	// the names and values of the dynamic table entries, oldest first, in [m_DataStart, m_DataEnd)
+	char m_Data[HPACK_MAX_TABLE_SIZE];
+	size_t m_DataStart;
+	size_t m_DataEnd;
+
+	// the entries, a ring buffer from the oldest (m_FirstEntry) to the newest
+	TableEntry m_Entries[HPACK_MAX_ENTRIES];
+	size_t m_FirstEntry;
+	size_t m_NumOfEntries;
+
+	size_t m_TableSize;
+	size_t m_MaxTableSize;
+
+	// where Huffman coded literals are decoded to
+	char m_NameBuffer[HPACK_MAX_STRING_LEN];
+	char m_ValueBuffer[HPACK_MAX_STRING_LEN];
+
+	bool getEntry(uint32_t index, const char*& name, size_t& nameLen, const char*& value, size_t& valueLen) const;
+	void addEntry(const char* name, size_t nameLen, const char* value, size_t valueLen, bool isTruncated);
+	void evictEntries(size_t requiredSize);
+	bool decodeString(const uint8_t*& pos, const uint8_t* end, char* buffer, const char*& str, size_t& strLen, bool& isTruncated);
+	static bool decodeInteger(const uint8_t*& pos, const uint8_t* end, int prefixBits, uint32_t& value);
+
+	// the decoder holds a table of several KB, it's never meant to be copied
+	HpackDecoder(const HpackDecoder&);
+	HpackDecoder& operator=(const HpackDecoder&);
+};
+
+#endif /* HTTPECHO_HPACK_DECODER */
@@ -0,0 +1,620 @@
+#include <string.h>
+#include <stdlib.h>
+#include "Http2TransactionTracker.h"
+
+
+static const char s_ConnectionPreface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+// frame types (RFC 7540 section 6)
+#define HTTP2_FRAME_DATA 0x0
+#define HTTP2_FRAME_HEADERS 0x1
+#define HTTP2_FRAME_RST_STREAM 0x3
+#define HTTP2_FRAME_PUSH_PROMISE 0x5
+#define HTTP2_FRAME_CONTINUATION 0x9
+
+// frame flags
+#define HTTP2_FLAG_END_STREAM 0x01
+#define HTTP2_FLAG_END_HEADERS 0x04
+#define HTTP2_FLAG_PADDED 0x08
+#define HTTP2_FLAG_PRIORITY 0x20
+
+
+/**
+ * The time from 'earlier' to 'later' in microseconds, 0 if 'later' is actually earlier
+ */
+static uint64_t getElapsedUsec(const timeval& earlier, const timeval& later)
+{
+	int64_t elapsed = ((int64_t)later.tv_sec - (int64_t)earlier.tv_sec) * 1000000 + ((int64_t)later.tv_usec - (int64_t)earlier.tv_usec);
+	return (elapsed > 0 ? (uint64_t)elapsed : 0);
+}
+
+
+/**
+ * Copy at most maxLen chars of a string which isn't null-terminated and null-terminate
+ */
+static void copyField(char* dst, size_t maxLen, const char* src, size_t srcLen)
+{
+	if (srcLen > maxLen)
+		srcLen = maxLen;
+	memcpy(dst, src, srcLen);
+	dst[srcLen] = '\0';
+}
+
+
+/**
+ * Whether the payload of a frame type is part of a header block
+ */
+static bool isHeaderBlockFrame(uint8_t frameType)
+{
+	return frameType == HTTP2_FRAME_HEADERS || frameType == HTTP2_FRAME_PUSH_PROMISE || frameType == HTTP2_FRAME_CONTINUATION;
+}
+
+
+Http2TransactionTracker::Http2TransactionTracker(const pcpp::ConnectionData& connData, int clientSide, HttpLatencyTable* latencyTable,
+		TrafficStats* trafficStats, OnHttpTransactionComplete onTransactionComplete, void* userCookie)
+{
+	numOfTransactions = 0;
+	numOfUnmatchedResponses = 0;
+	numOfResetStreams = 0;
+	numOfHeaderBlockErrors = 0;
+
+	m_LatencyTable = latencyTable;
+	m_TrafficStats = trafficStats;
+	m_OnTransactionComplete = onTransactionComplete;
+	m_UserCookie = userCookie;
+	m_ClientSide = clientSide;
+
+	// side 0 is the source of the connection's first packet
+	const pcpp::IPAddress* clientIP = (clientSide == 0 ? connData.srcIP : connData.dstIP);
+	const pcpp::IPAddress* serverIP = (clientSide == 0 ? connData.dstIP : connData.srcIP);
+	m_ClientIP[0] = '\0';
+	m_ServerIP[0] = '\0';
+	if (clientIP != NULL)
+		strncat(m_ClientIP, clientIP->toString().c_str(), HTTP_MAX_IP_STRING_LEN - 1);
+	if (serverIP != NULL)
+		strncat(m_ServerIP, serverIP->toString().c_str(), HTTP_MAX_IP_STRING_LEN - 1);
+	m_ClientPort = (clientSide == 0 ? connData.srcPort : connData.dstPort);
+	m_ServerPort = (clientSide == 0 ? connData.dstPort : connData.srcPort);
+	m_ServerName[0] = '\0';
+	m_PatternMatches = 0;
+	m_MatchedPattern = NULL;
+
+	for (int side = 0; side < 2; side++)
+	{
+		FrameParser& parser = m_Parsers[side];
+
+		// only the client sends the preface, the server's first frame is its SETTINGS
+		parser.state = (side == clientSide ? Preface : FrameHeader);
+		parser.prefaceLen = 0;
+		parser.frameHeaderLen = 0;
+		parser.payloadLen = 0;
+		parser.payloadRemaining = 0;
+		parser.frameType = 0;
+		parser.frameFlags = 0;
+		parser.streamId = 0;
+		parser.padLen = -1;
+		parser.headerBlock = NULL;
+		parser.headerBlockLen = 0;
+		parser.headerBlockOverflow = false;
+		parser.expectContinuation = false;
+		parser.headerBlockFrameType = 0;
+		parser.headerBlockFlags = 0;
+		parser.headerBlockStreamId = 0;
+		parser.promisedStreamId = 0;
+		parser.lastByteTime.tv_sec = 0;
+		parser.lastByteTime.tv_usec = 0;
+	}
+
+	for (int i = 0; i < HTTP2_MAX_TRACKED_STREAMS; i++)
+		m_Streams[i].inUse = false;
+}
+
+
+Http2TransactionTracker::~Http2TransactionTracker()
+{
+	delete [] m_Parsers[0].headerBlock;
+	delete [] m_Parsers[1].headerBlock;
+}
+
+
+bool Http2TransactionTracker::isConnectionPreface(const uint8_t* data, size_t dataLen)
+{
+	// "PRI " already tells the preface from any HTTP/1.x request
+	size_t len = (dataLen < HTTP2_CONNECTION_PREFACE_LEN ? dataLen : HTTP2_CONNECTION_PREFACE_LEN);
+	return len >= 4 && memcmp(data, s_ConnectionPreface, len) == 0;
+}
+
+
+Http2TransactionTracker::StreamState* Http2TransactionTracker::findStream(uint32_t streamId)
+{
+	for (int i = 0; i < HTTP2_MAX_TRACKED_STREAMS; i++)
+	{
+		if (m_Streams[i].inUse && m_Streams[i].streamId == streamId)
+			return &m_Streams[i];
+	}
+
+	return NULL;
+}
+
+
+Http2TransactionTracker::StreamState* Http2TransactionTracker::openStream(uint32_t streamId)
+{
+	for (int i = 0; i < HTTP2_MAX_TRACKED_STREAMS; i++)
+	{
+		StreamState& stream = m_Streams[i];
+		if (stream.inUse)
+			continue;
+
+		stream.inUse = true;
+		stream.streamId = streamId;
+		stream.method[0] = '\0';
+		stream.host[0] = '\0';
+		stream.uri[0] = '\0';
+		stream.requestComplete = false;
+		stream.requestBodyBytes = 0;
+		stream.responseStarted = false;
+		stream.statusCode = 0;
+		stream.responseBodyBytes = 0;
+		return &stream;
+	}
+
+	// no room for another stream, this one won't be timed
+	return NULL;
+}
+
+
+void Http2TransactionTracker::dropStreams()
+{
+	for (int i = 0; i < HTTP2_MAX_TRACKED_STREAMS; i++)
+		m_Streams[i].inUse = false;
+}
+
+
+void Http2TransactionTracker::setLost(FrameParser& parser)
+{
+	parser.state = Lost;
+	parser.expectContinuation = false;
+	dropStreams();
+}
+
+
+void Http2TransactionTracker::onHeaderDecoded(const char* name, size_t nameLen, const char* value, size_t valueLen, void* userCookie)
+{
+	DecodedHeaders& headers = ((Http2TransactionTracker*)userCookie)->m_DecodedHeaders;
+
+	// HTTP/2 header names are always lower case
+	if (nameLen == 7 && memcmp(name, ":method", 7) == 0)
+		copyField(headers.method, HTTP_MAX_METHOD_LEN, value, valueLen);
+	else if (nameLen == 10 && memcmp(name, ":authority", 10) == 0)
+		copyField(headers.authority, LATENCY_MAX_HOST_LEN, value, valueLen);
+	else if (nameLen == 4 && memcmp(name, "host", 4) == 0)
+		copyField(headers.host, LATENCY_MAX_HOST_LEN, value, valueLen);
+	else if (nameLen == 5 && memcmp(name, ":path", 5) == 0)
+	{
+		// the query string is dropped so the URIs of one endpoint aggregate together
+		const char* query = (const char*)memchr(value, '?', valueLen);
+		copyField(headers.path, LATENCY_MAX_URI_LEN, value, query != NULL ? (size_t)(query - value) : valueLen);
+	}
+	else if (nameLen == 7 && memcmp(name, ":status", 7) == 0 && valueLen == 3)
+		headers.statusCode = (value[0] - '0') * 100 + (value[1] - '0') * 10 + (value[2] - '0');
+}
+
+
+void Http2TransactionTracker::handleFrameHeader(FrameParser& parser)
+{
+	const uint8_t* header = parser.frameHeader;
+	parser.payloadLen = ((uint32_t)header[0] << 16) | ((uint32_t)header[1] << 8) | header[2];
+	parser.payloadRemaining = parser.payloadLen;
+	parser.frameType = header[3];
+	parser.frameFlags = header[4];
+	parser.streamId = (((uint32_t)header[5] << 24) | ((uint32_t)header[6] << 16) | ((uint32_t)header[7] << 8) | header[8]) & 0x7fffffff;
+	parser.padLen = -1;
+	parser.frameHeaderLen = 0;
+	parser.state = FramePayload;
+
+	// nothing may come between a header block's frames
+	if (parser.expectContinuation != (parser.frameType == HTTP2_FRAME_CONTINUATION))
+	{
+		setLost(parser);
+		return;
+	}
+
+	if (parser.frameType == HTTP2_FRAME_HEADERS || parser.frameType == HTTP2_FRAME_PUSH_PROMISE)
+	{
+		if (parser.headerBlock == NULL)
+			parser.headerBlock = new uint8_t[HTTP2_MAX_HEADER_BLOCK_LEN];
+		parser.headerBlockLen = 0;
+		parser.headerBlockOverflow = false;
+		parser.headerBlockFrameType = parser.frameType;
+		parser.headerBlockFlags = parser.frameFlags;
+		parser.headerBlockStreamId = parser.streamId;
+		parser.headerBlockStartTime = parser.frameStartTime;
+	}
+	else if (parser.frameType == HTTP2_FRAME_CONTINUATION && parser.streamId != parser.headerBlockStreamId)
+		setLost(parser);
+}
+
+
+void Http2TransactionTracker::handleFramePayload(FrameParser& parser, const uint8_t* data, size_t dataLen)
+{
+	if (isHeaderBlockFrame(parser.frameType))
+	{
+		size_t room = HTTP2_MAX_HEADER_BLOCK_LEN - parser.headerBlockLen;
+		if (dataLen > room)
+		{
+			parser.headerBlockOverflow = true;
+			dataLen = room;
+		}
+		memcpy(parser.headerBlock + parser.headerBlockLen, data, dataLen);
+		parser.headerBlockLen += dataLen;
+		return;
+	}
+
+	// the first byte of a padded DATA frame is the padding length
+	if (parser.frameType == HTTP2_FRAME_DATA && (parser.frameFlags & HTTP2_FLAG_PADDED) && parser.payloadRemaining == parser.payloadLen)
+		parser.padLen = data[0];
+}
+
+
+void Http2TransactionTracker::handleFrameEnd(bool isRequest, FrameParser& parser, const timeval& timestamp)
+{
+	switch (parser.frameType)
+	{
+	case HTTP2_FRAME_DATA:
+	{
+		uint32_t padding = ((parser.frameFlags & HTTP2_FLAG_PADDED) ? 1 + (parser.padLen > 0 ? parser.padLen : 0) : 0);
+		uint64_t bodyBytes = (parser.payloadLen > padding ? parser.payloadLen - padding : 0);
+
+		StreamState* stream = findStream(parser.streamId);
+		if (stream == NULL)
+			break;
+
+		if (isRequest)
+		{
+			stream->requestBodyBytes += bodyBytes;
+			stream->requestLastByteTime = timestamp;
+			if (parser.frameFlags & HTTP2_FLAG_END_STREAM)
+				stream->requestComplete = true;
+		}
+		else
+		{
+			stream->responseBodyBytes += bodyBytes;
+			if ((parser.frameFlags & HTTP2_FLAG_END_STREAM) && stream->responseStarted)
+				completeTransaction(*stream, timestamp);
+		}
+		break;
+	}
+
+	case HTTP2_FRAME_HEADERS:
+	case HTTP2_FRAME_PUSH_PROMISE:
+	{
+		// strip the padding, the priority fields of HEADERS and the promised stream ID of PUSH_PROMISE off the first fragment
+		size_t prefixLen = 0;
+		size_t padLen = 0;
+		if (parser.frameFlags & HTTP2_FLAG_PADDED)
+		{
+			padLen = (parser.headerBlockLen > 0 ? parser.headerBlock[0] : 0);
+			prefixLen++;
+		}
+		if (parser.frameType == HTTP2_FRAME_HEADERS && (parser.frameFlags & HTTP2_FLAG_PRIORITY))
+			prefixLen += 5;
+		if (parser.frameType == HTTP2_FRAME_PUSH_PROMISE)
+		{
+			prefixLen += 4;
+			if (parser.headerBlockLen >= prefixLen)
+			{
+				const uint8_t* promised = parser.headerBlock + prefixLen - 4;
+				parser.promisedStreamId = (((uint32_t)promised[0] << 24) | ((uint32_t)promised[1] << 16) | ((uint32_t)promised[2] << 8) | promised[3]) & 0x7fffffff;
+			}
+		}
+
+		if (prefixLen + padLen > parser.payloadLen)
+		{
+			setLost(parser);
+			break;
+		}
+
+		if (!parser.headerBlockOverflow)
+		{
+			parser.headerBlockLen = parser.payloadLen - prefixLen - padLen;
+			memmove(parser.headerBlock, parser.headerBlock + prefixLen, parser.headerBlockLen);
+		}
+
+		if (parser.frameFlags & HTTP2_FLAG_END_HEADERS)
+			handleHeaderBlock(isRequest, parser, timestamp);
+		else
+			parser.expectContinuation = true;
+		break;
+	}
+
+	case HTTP2_FRAME_CONTINUATION:
+	{
+		if (parser.frameFlags & HTTP2_FLAG_END_HEADERS)
+		{
+			parser.expectContinuation = false;
+			handleHeaderBlock(isRequest, parser, timestamp);
+		}
+		break;
+	}
+
+	case HTTP2_FRAME_RST_STREAM:
+	{
+		StreamState* stream = findStream(parser.streamId);
+		if (stream != NULL)
+		{
+			numOfResetStreams++;
+			stream->inUse = false;
+		}
+		break;
+	}
+
+	default:
+		// SETTINGS, PING, GOAWAY, WINDOW_UPDATE, PRIORITY and extension frames don't affect the timing
+		break;
+	}
+}
+
+
+void Http2TransactionTracker::handleHeaderBlock(bool isRequest, FrameParser& parser, const timeval& timestamp)
+{
+	DecodedHeaders& headers = m_DecodedHeaders;
+	headers.method[0] = '\0';
+	headers.authority[0] = '\0';
+	headers.host[0] = '\0';
+	headers.path[0] = '\0';
+	headers.statusCode = 0;
+
+	// a block which can't be decoded leaves the HPACK table of the side behind the encoder's for good
+	if (parser.headerBlockOverflow || !parser.decoder.decodeHeaderBlock(parser.headerBlock, parser.headerBlockLen, onHeaderDecoded, this))
+	{
+		numOfHeaderBlockErrors++;
+		setLost(parser);
+		return;
+	}
+
+	bool endStream = (parser.headerBlockFrameType == HTTP2_FRAME_HEADERS && (parser.headerBlockFlags & HTTP2_FLAG_END_STREAM));
+	StreamState* stream = NULL;
+
+	// a new request, or the request the server promises to push a response to
+	if ((isRequest && findStream(parser.headerBlockStreamId) == NULL) || parser.headerBlockFrameType == HTTP2_FRAME_PUSH_PROMISE)
+	{
+		stream = openStream(parser.headerBlockFrameType == HTTP2_FRAME_PUSH_PROMISE ? parser.promisedStreamId : parser.headerBlockStreamId);
+		if (stream == NULL)
+			return;
+
+		strcpy(stream->method, headers.method);
+		strcpy(stream->host, headers.authority[0] != '\0' ? headers.authority : headers.host);
+		strcpy(stream->uri, headers.path[0] != '\0' ? headers.path : "/");
+		stream->requestFirstByteTime = parser.headerBlockStartTime;
+		stream->requestLastByteTime = timestamp;
+		stream->requestComplete = (endStream || parser.headerBlockFrameType == HTTP2_FRAME_PUSH_PROMISE);
+
+		if (m_TrafficStats != NULL)
+			m_TrafficStats->recordRequest(stream->host, stream->uri);
+		return;
+	}
+
+	stream = findStream(parser.headerBlockStreamId);
+
+	// request trailers
+	if (isRequest)
+	{
+		stream->requestLastByteTime = timestamp;
+		if (endStream)
+			stream->requestComplete = true;
+		return;
+	}
+
+	if (stream == NULL)
+	{
+		if (headers.statusCode >= 200)
+			numOfUnmatchedResponses++;
+		return;
+	}
+
+	if (!stream->responseStarted)
+	{
+		// interim responses (100 Continue, 103 Early Hints) precede the final response
+		if (headers.statusCode < 200)
+			return;
+
+		stream->responseStarted = true;
+		stream->statusCode = headers.statusCode;
+		stream->responseFirstByteTime = parser.headerBlockStartTime;
+	}
+
+	// the final response's headers, or its trailers, end the stream
+	if (endStream)
+		completeTransaction(*stream, timestamp);
+}
+
+
+void Http2TransactionTracker::completeTransaction(StreamState& stream, const timeval& timestamp)
+{
+	uint64_t timeToFirstByte = getElapsedUsec(stream.requestLastByteTime, stream.responseFirstByteTime);
+	uint64_t responseTime = getElapsedUsec(stream.requestLastByteTime, timestamp);
+	m_LatencyTable->record(stream.host, stream.uri, timeToFirstByte, responseTime);
+	numOfTransactions++;
+
+	if (m_OnTransactionComplete != NULL)
+	{
+		HttpTransaction transaction;
+		transaction.clientIP = m_ClientIP;
+		transaction.serverIP = m_ServerIP;
+		transaction.clientPort = m_ClientPort;
+		transaction.serverPort = m_ServerPort;
+		transaction.serverName = m_ServerName;
+		transaction.method = stream.method;
+		transaction.host = stream.host;
+		transaction.uri = stream.uri;
+		transaction.statusCode = (uint16_t)stream.statusCode;
+		transaction.requestTime = stream.requestFirstByteTime;
+		transaction.requestBodyBytes = stream.requestBodyBytes;
+		transaction.responseBodyBytes = stream.responseBodyBytes;
+		transaction.timeToFirstByteUsec = timeToFirstByte;
+		transaction.responseTimeUsec = responseTime;
+		transaction.patternMatches = m_PatternMatches;
+		transaction.matchedPattern = (m_MatchedPattern != NULL ? m_MatchedPattern : "");
+		m_OnTransactionComplete(transaction, m_UserCookie);
+	}
+	m_PatternMatches = 0;
+	m_MatchedPattern = NULL;
+
+	stream.inUse = false;
+}
+
+
+void Http2TransactionTracker::feed(int side, const uint8_t* data, size_t dataLen, const timeval& timestamp, std::vector<StreamSpan>* headerBlockSpans)
+{
+	if (dataLen == 0)
+		return;
+
+	bool isRequest = (side == m_ClientSide);
+	FrameParser& parser = m_Parsers[side];
+	parser.lastByteTime = timestamp;
+
+	const uint8_t* dataStart = data;
+	while (dataLen > 0)
+	{
+		size_t consumed = 0;
+
+		switch (parser.state)
+		{
+		case Preface:
+		{
+			consumed = HTTP2_CONNECTION_PREFACE_LEN - parser.prefaceLen;
+			if (consumed > dataLen)
+				consumed = dataLen;
+			if (memcmp(data, s_ConnectionPreface + parser.prefaceLen, consumed) != 0)
+			{
+				setLost(parser);
+				return;
+			}
+
+			parser.prefaceLen += consumed;
+			if (parser.prefaceLen == HTTP2_CONNECTION_PREFACE_LEN)
+				parser.state = FrameHeader;
+			break;
+		}
+
+		case FrameHeader:
+		{
+			// a frame is timed from the packet which carried its first byte
+			if (parser.frameHeaderLen == 0)
+				parser.frameStartTime = timestamp;
+
+			consumed = HTTP2_FRAME_HEADER_LEN - parser.frameHeaderLen;
+			if (consumed > dataLen)
+				consumed = dataLen;
+			memcpy(parser.frameHeader + parser.frameHeaderLen, data, consumed);
+			parser.frameHeaderLen += consumed;
+			if (parser.frameHeaderLen < HTTP2_FRAME_HEADER_LEN)
+				break;
+
+			handleFrameHeader(parser);
+			if (parser.state == FramePayload && parser.payloadLen == 0)
+			{
+				parser.state = FrameHeader;
+				handleFrameEnd(isRequest, parser, timestamp);
+			}
+			break;
+		}
+
+		case FramePayload:
+		{
+			consumed = (dataLen < parser.payloadRemaining ? dataLen : parser.payloadRemaining);
+			if (headerBlockSpans != NULL && isHeaderBlockFrame(parser.frameType))
+			{
+				if (parser.payloadRemaining == parser.payloadLen && parser.frameType != HTTP2_FRAME_CONTINUATION && m_TrafficStats != NULL)
+					m_TrafficStats->recordDroppedHeaderBlock();
+
+				StreamSpan span;
+				span.offset = (uint32_t)(data - dataStart);
+				span.length = (uint32_t)consumed;
+				headerBlockSpans->push_back(span);
+			}
+			handleFramePayload(parser, data, consumed);
+			parser.payloadRemaining -= (uint32_t)consumed;
+			if (parser.payloadRemaining == 0)
+			{
+				parser.state = FrameHeader;
+				handleFrameEnd(isRequest, parser, timestamp);
+			}
+			break;
+		}
+
+		case Lost:
+			return;
+		}
+
+		data += consumed;
+		dataLen -= consumed;
+	}
+}
+
+
+void Http2TransactionTracker::addUpgradeRequest(const HttpTransaction& request, const timeval& lastByteTime)
+{
+	// the request is half-closed by the client already, its response comes as the server's first HEADERS on stream 1
+	StreamState* stream = openStream(1);
+	if (stream == NULL)
+		return;
+
+	copyField(stream->method, HTTP_MAX_METHOD_LEN, request.method, strlen(request.method));
+	copyField(stream->host, LATENCY_MAX_HOST_LEN, request.host, strlen(request.host));
+	copyField(stream->uri, LATENCY_MAX_URI_LEN, request.uri, strlen(request.uri));
+	stream->requestFirstByteTime = request.requestTime;
+	stream->requestLastByteTime = lastByteTime;
+	stream->requestComplete = true;
+	stream->requestBodyBytes = request.requestBodyBytes;
+}
+
+
+void Http2TransactionTracker::skipMissingData(int side, uint32_t missingDataLen)
+{
+	bool isRequest = (side == m_ClientSide);
+	FrameParser& parser = m_Parsers[side];
+	if (parser.state == Lost)
+		return;
+
+	// the hole is inside a frame which isn't needed byte by byte - skip it and stay in sync
+	if (parser.state == FramePayload && !isHeaderBlockFrame(parser.frameType) && missingDataLen <= parser.payloadRemaining)
+	{
+		// a lost padding length is taken as no padding
+		if (parser.frameType == HTTP2_FRAME_DATA && (parser.frameFlags & HTTP2_FLAG_PADDED) && parser.payloadRemaining == parser.payloadLen)
+			parser.padLen = 0;
+
+		parser.payloadRemaining -= missingDataLen;
+		if (parser.payloadRemaining == 0)
+		{
+			parser.state = FrameHeader;
+			handleFrameEnd(isRequest, parser, parser.lastByteTime);
+		}
+		return;
+	}
+
+	setLost(parser);
+}
+
+
+void Http2TransactionTracker::finish()
+{
+	// HTTP/2 responses always end with their stream, whatever is still open at the end of the connection is incomplete
+	dropStreams();
+}
+
+
+void Http2TransactionTracker::setServerName(const char* serverName)
+{
+	m_ServerName[0] = '\0';
+	strncat(m_ServerName, serverName, HTTP_MAX_SERVER_NAME_LEN);
+}
+
+
+void Http2TransactionTracker::addPatternMatch(const char* label)
+{
+	if (m_PatternMatches == 0)
+		m_MatchedPattern = label;
+	if (m_PatternMatches < UINT32_MAX)
+		m_PatternMatches++;
+}
@@ -0,0 +1,222 @@
+#ifndef HTTPECHO_HTTP2_TRANSACTION_TRACKER
+#define HTTPECHO_HTTP2_TRANSACTION_TRACKER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include "header/TcpReassembly.h"
+#include "HttpTransactionTracker.h"
+#include "HpackDecoder.h"
+
+// the client connection preface, "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define HTTP2_CONNECTION_PREFACE_LEN 24
+
+#define HTTP2_FRAME_HEADER_LEN 9
+
+// max number of streams of one connection timed at once, streams opened beyond it aren't timed
+#define HTTP2_MAX_TRACKED_STREAMS 64
+
+// the longest header block (a HEADERS or PUSH_PROMISE frame with its CONTINUATION frames) which can be decoded. A longer one leaves the
+// sending side's HPACK table out of sync, so the side isn't decoded anymore
+#define HTTP2_MAX_HEADER_BLOCK_LEN 16384
+
+
+/**
+ * Pairs the requests and responses of one cleartext HTTP/2 connection (prior knowledge, or after an h2c upgrade) and times them from the packet
+ * timestamps, the same way HttpTransactionTracker does for HTTP/1.x: each side's stream is cut into frames as it streams in, header blocks are
+ * collected and decoded by the side's HpackDecoder, DATA frames are only counted, and the requests and responses are paired by stream ID in a
+ * fixed table. Transactions are recorded in the HttpLatencyTable and the TrafficStats and handed to the OnHttpTransactionComplete callback with
+ * the :method, :authority (or Host) and :path of the request and the :status of the final response:
+ * - Time to first byte: from the last byte of the request to the first byte of the final response's HEADERS frame
+ * - Response time: from the last byte of the request to the end of the response stream
+ * A hole inside a frame which isn't part of a header block is skipped without losing sync. Any other hole loses the frame boundaries and the
+ * HPACK table of the side, so the side isn't parsed anymore and the open streams are dropped
+ */
+class Http2TransactionTracker
+{
+public:
+
+	/**
+	 * A c'tor for this class
+	 * @param[in] connData The connection, its endpoints are copied for the transaction records
+	 * @param[in] clientSide The side of the connection (0 or 1) which sends the requests
+	 * @param[in] latencyTable The table completed transactions are recorded in
+	 * @param[in] trafficStats The traffic statistics requests are counted in. Optional
+	 * @param[in] onTransactionComplete The callback to invoke for every completed transaction. Optional
+	 * @param[in] userCookie A cookie passed to the callback
+	 */
+	Http2TransactionTracker(const pcpp::ConnectionData& connData, int clientSide, HttpLatencyTable* latencyTable, TrafficStats* trafficStats = NULL,
+			OnHttpTransactionComplete onTransactionComplete = NULL, void* userCookie = NULL);
+
+	~Http2TransactionTracker();
+
+	/**
+	 * Feed the next chunk of stream data from one side of the connection. The client side must start with the connection preface
+	 * @param[in] side The side of the connection (0 or 1)
+	 * @param[in] data The stream data
+	 * @param[in] dataLen The stream data length
+	 * @param[in] timestamp The capture time of the packet which carried the data
+	 * @param[out] headerBlockSpans If not NULL, the ranges of the data which hold header block fragments (the payloads of HEADERS, PUSH_PROMISE
+	 * and CONTINUATION frames) are appended to it, in order. HPACK-coded headers can't be redacted in place, this is how they're kept out of
+	 * the capture files instead. Every header block reported is counted in the TrafficStats
+	 */
+	void feed(int side, const uint8_t* data, size_t dataLen, const timeval& timestamp, std::vector<StreamSpan>* headerBlockSpans = NULL);
+
+	/**
+	 * Open stream 1 for the HTTP/1.1 request which upgraded the connection to h2c. The server answers it on that stream (RFC 7540 section 3.2),
+	 * so it's paired and timed like any other request. Call it before the server's first frames are fed
+	 * @param[in] request The upgrade request's method, host, URI, first byte time and body size (the other fields are ignored). It was counted
+	 * in the TrafficStats already, as an HTTP/1.1 request
+	 * @param[in] lastByteTime The capture time of the request's last byte
+	 */
+	void addUpgradeRequest(const HttpTransaction& request, const timeval& lastByteTime);
+
+	/**
+	 * Report that data is missing from one side's stream
+	 * @param[in] side The side of the connection (0 or 1)
+	 * @param[in] missingDataLen The number of bytes missing
+	 */
+	void skipMissingData(int side, uint32_t missingDataLen);
+
+	/**
+	 * Report that the connection ended, streams which are still open are dropped
+	 */
+	void finish();
+
+	/**
+	 * Set the name the transactions of the connection are labelled with (empty by default)
+	 * @param[in] serverName The name the server's address was resolved from, cut at HTTP_MAX_SERVER_NAME_LEN
+	 */
+	void setServerName(const char* serverName);
+
+	/**
+	 * Count a payload pattern match in the connection's data. Matches are reported with the next transaction which completes, whatever
+	 * stream they were found in
+	 * @param[in] label The label of the pattern, must stay valid for the life of the tracker
+	 */
+	void addPatternMatch(const char* label);
+
+	/**
+	 * @param[in] data The first stream data of a connection's client side (or its first data after an h2c upgrade)
+	 * @param[in] dataLen The data length
+	 * @return True if the data starts with the HTTP/2 connection preface (or, if it's shorter than the preface, with a large enough part of it)
+	 */
+	static bool isConnectionPreface(const uint8_t* data, size_t dataLen);
+
+	// stats: completed transactions, final responses which had no request to pair with, streams reset before their response completed and
+	// header blocks which couldn't be decoded
+	uint32_t numOfTransactions;
+	uint32_t numOfUnmatchedResponses;
+	uint32_t numOfResetStreams;
+	uint32_t numOfHeaderBlockErrors;
+
+private:
+
+	enum ParserState
+	{
+		Preface,
+		FrameHeader,
+		FramePayload,
+		// lost the frame boundaries or the HPACK table after a hole, nothing more is parsed on this side
+		Lost
+	};
+
+	/**
+	 * The streaming frame parser state of one direction
+	 */
+	struct FrameParser
+	{
+		ParserState state;
+		size_t prefaceLen;
+		uint8_t frameHeader[HTTP2_FRAME_HEADER_LEN];
+		size_t frameHeaderLen;
+		uint32_t payloadLen;
+		uint32_t payloadRemaining;
+		uint8_t frameType;
+		uint8_t frameFlags;
+		uint32_t streamId;
+		timeval frameStartTime;
+		int padLen;
+
+		// the header block being collected from a HEADERS / PUSH_PROMISE frame and the CONTINUATION frames after it, allocated on first use
+		uint8_t* headerBlock;
+		size_t headerBlockLen;
+		bool headerBlockOverflow;
+		bool expectContinuation;
+		uint8_t headerBlockFrameType;
+		uint8_t headerBlockFlags;
+		uint32_t headerBlockStreamId;
+		uint32_t promisedStreamId;
+		timeval headerBlockStartTime;
+
+		// the capture time of the latest data of the side
+		timeval lastByteTime;
+
+		HpackDecoder decoder;
+	};
+
+	/**
+	 * A stream which is being timed
+	 */
+	struct StreamState
+	{
+		bool inUse;
+		uint32_t streamId;
+		char method[HTTP_MAX_METHOD_LEN + 1];
+		char host[LATENCY_MAX_HOST_LEN + 1];
+		char uri[LATENCY_MAX_URI_LEN + 1];
+		timeval requestFirstByteTime;
+		timeval requestLastByteTime;
+		bool requestComplete;
+		uint64_t requestBodyBytes;
+		bool responseStarted;
+		int statusCode;
+		timeval responseFirstByteTime;
+		uint64_t responseBodyBytes;
+	};
+
+	/**
+	 * The fields of a decoded header block the tracker cares about
+	 */
+	struct DecodedHeaders
+	{
+		char method[HTTP_MAX_METHOD_LEN + 1];
+		char authority[LATENCY_MAX_HOST_LEN + 1];
+		char host[LATENCY_MAX_HOST_LEN + 1];
+		char path[LATENCY_MAX_URI_LEN + 1];
+		int statusCode;
+	};
+
+	HttpLatencyTable* m_LatencyTable;
+	TrafficStats* m_TrafficStats;
+	OnHttpTransactionComplete m_OnTransactionComplete;
+	void* m_UserCookie;
+	int m_ClientSide;
+	char m_ClientIP[HTTP_MAX_IP_STRING_LEN];
+	char m_ServerIP[HTTP_MAX_IP_STRING_LEN];
+	char m_ServerName[HTTP_MAX_SERVER_NAME_LEN + 1];
+	uint16_t m_ClientPort;
+	uint16_t m_ServerPort;
+	uint32_t m_PatternMatches;
+	const char* m_MatchedPattern;
+	FrameParser m_Parsers[2];
+	StreamState m_Streams[HTTP2_MAX_TRACKED_STREAMS];
+	DecodedHeaders m_DecodedHeaders;
+
+	StreamState* findStream(uint32_t streamId);
+	StreamState* openStream(uint32_t streamId);
+	void dropStreams();
+	void setLost(FrameParser& parser);
+	void handleFrameHeader(FrameParser& parser);
+	void handleFramePayload(FrameParser& parser, const uint8_t* data, size_t dataLen);
+	void handleFrameEnd(bool isRequest, FrameParser& parser, const timeval& timestamp);
+	void handleHeaderBlock(bool isRequest, FrameParser& parser, const timeval& timestamp);
+	void completeTransaction(StreamState& stream, const timeval& timestamp);
+	static void onHeaderDecoded(const char* name, size_t nameLen, const char* value, size_t valueLen, void* userCookie);
+
+	// the tracker owns its header block buffers, it's never meant to be copied
+	Http2TransactionTracker(const Http2TransactionTracker&);
+	Http2TransactionTracker& operator=(const Http2TransactionTracker&);
+};
+
+#endif /* HTTPECHO_HTTP2_TRANSACTION_TRACKER */
@@ -0,0 +1,175 @@
+#include <string.h>
+#include <stdio.h>
+#include "HttpLatencyTable.h"
+
+
+/**
+ * FNV-1a over the host and the URI
+ */
+static uint32_t hashHostAndUri(const char* host, const char* uri)
+{
+	uint32_t hash = 2166136261u;
+	for (const char* ptr = host; *ptr != '\0'; ptr++)
+		hash = (hash ^ (uint8_t)*ptr) * 16777619u;
+
+	hash = (hash ^ (uint8_t)' ') * 16777619u;
+
+	for (const char* ptr = uri; *ptr != '\0'; ptr++)
+		hash = (hash ^ (uint8_t)*ptr) * 16777619u;
+
+	return hash;
+}
+
+
+static void copyTruncated(char* dst, const char* src, size_t maxLen)
+{
+	size_t len = strlen(src);
+	if (len > maxLen)
+		len = maxLen;
+	memcpy(dst, src, len);
+	dst[len] = '\0';
+}
+
+
+HttpLatencyTable::HttpLatencyTable(size_t maxEntries)
+{
+	numOfTransactions = 0;
+	numOfOverflowTransactions = 0;
+
+	// keep the hash slots at most half full so lookups stay short
+	m_MaxEntries = maxEntries;
+	m_NumOfSlots = 16;
+	while (m_NumOfSlots < maxEntries * 2)
+		m_NumOfSlots <<= 1;
+	m_SlotMask = m_NumOfSlots - 1;
+	m_NumOfEntries = 0;
+
+	m_Entries = new LatencyEntry[m_MaxEntries];
+	m_Slots = new int32_t[m_NumOfSlots];
+	for (size_t i = 0; i < m_NumOfSlots; i++)
+		m_Slots[i] = -1;
+
+	m_Overflow.hash = 0;
+	strcpy(m_Overflow.host, "*");
+	strcpy(m_Overflow.uri, "*");
+}
+
+
+HttpLatencyTable::~HttpLatencyTable()
+{
+	delete [] m_Entries;
+	delete [] m_Slots;
+}
+
+
+HttpLatencyTable::LatencyEntry* HttpLatencyTable::findOrCreateEntry(const char* host, const char* uri)
+{
+	uint32_t hash = hashHostAndUri(host, uri);
+
+	size_t index = hash & m_SlotMask;
+	while (m_Slots[index] >= 0)
+	{
+		LatencyEntry& entry = m_Entries[m_Slots[index]];
+		if (entry.hash == hash && strncmp(entry.host, host, LATENCY_MAX_HOST_LEN) == 0 && strncmp(entry.uri, uri, LATENCY_MAX_URI_LEN) == 0)
+			return &entry;
+
+		index = (index + 1) & m_SlotMask;
+	}
+
+	if (m_NumOfEntries >= m_MaxEntries)
+		return NULL;
+
+	m_Slots[index] = (int32_t)m_NumOfEntries;
+	LatencyEntry& entry = m_Entries[m_NumOfEntries++];
+	entry.hash = hash;
+	copyTruncated(entry.host, host, LATENCY_MAX_HOST_LEN);
+	copyTruncated(entry.uri, uri, LATENCY_MAX_URI_LEN);
+	entry.timeToFirstByte.clear();
+	entry.responseTime.clear();
+
+	return &entry;
+}
+
+
+void HttpLatencyTable::record(const char* host, const char* uri, uint64_t timeToFirstByteUsec, uint64_t responseTimeUsec)
+{
+	LatencyEntry* entry = findOrCreateEntry(host, uri);
+	if (entry == NULL)
+	{
+		entry = &m_Overflow;
+		numOfOverflowTransactions++;
+	}
+
+	entry->timeToFirstByte.record(timeToFirstByteUsec);
+	entry->responseTime.record(responseTimeUsec);
+	numOfTransactions++;
+}
+
+
+void HttpLatencyTable::merge(const HttpLatencyTable& other)
+{
+	for (size_t i = 0; i < other.m_NumOfEntries; i++)
+	{
+		const LatencyEntry& otherEntry = other.m_Entries[i];
+		LatencyEntry* entry = findOrCreateEntry(otherEntry.host, otherEntry.uri);
+		if (entry == NULL)
+		{
+			entry = &m_Overflow;
+			numOfOverflowTransactions += otherEntry.timeToFirstByte.getCount();
+		}
+
+		entry->timeToFirstByte.merge(otherEntry.timeToFirstByte);
+		entry->responseTime.merge(otherEntry.responseTime);
+	}
+
+	m_Overflow.timeToFirstByte.merge(other.m_Overflow.timeToFirstByte);
+	m_Overflow.responseTime.merge(other.m_Overflow.responseTime);
+	numOfTransactions += other.numOfTransactions;
+	numOfOverflowTransactions += other.numOfOverflowTransactions;
+}
+
+
+void HttpLatencyTable::clear()
+{
+	for (size_t i = 0; i < m_NumOfSlots; i++)
+		m_Slots[i] = -1;
+
+	m_NumOfEntries = 0;
+	m_Overflow.timeToFirstByte.clear();
+	m_Overflow.responseTime.clear();
+	numOfTransactions = 0;
+	numOfOverflowTransactions = 0;
+}
+
+
+void HttpLatencyTable::writeEntry(std::ostream& stream, const LatencyEntry& entry)
+{
+	const LatencyHistogram& ttfb = entry.timeToFirstByte;
+	const LatencyHistogram& response = entry.responseTime;
+
+	char line[512];
+	int lineLen = snprintf(line, sizeof(line), "%s\t%s\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu\n",
+		entry.host[0] != '\0' ? entry.host : "-", entry.uri,
+		(unsigned long long)ttfb.getCount(),
+		(unsigned long long)ttfb.getValueAtPercentile(50), (unsigned long long)ttfb.getValueAtPercentile(90),
+		(unsigned long long)ttfb.getValueAtPercentile(99), (unsigned long long)ttfb.getMax(),
+		(unsigned long long)response.getValueAtPercentile(50), (unsigned long long)response.getValueAtPercentile(90),
+		(unsigned long long)response.getValueAtPercentile(99), (unsigned long long)response.getMax());
+
+	if (lineLen > 0)
+		stream.write(line, (lineLen < (int)sizeof(line) ? lineLen : (int)sizeof(line) - 1));
+}
+
+
+void HttpLatencyTable::writeReport(std::ostream& stream) const
+{
+	stream << "host\turi\ttransactions\tttfb_p50_us\tttfb_p90_us\tttfb_p99_us\tttfb_max_us\tresponse_p50_us\tresponse_p90_us\tresponse_p99_us\tresponse_max_us\n";
+
+	for (size_t i = 0; i < m_NumOfEntries; i++)
+		writeEntry(stream, m_Entries[i]);
+
+	if (m_Overflow.timeToFirstByte.getCount() > 0)
+		writeEntry(stream, m_Overflow);
+
+	stream.flush();
+}
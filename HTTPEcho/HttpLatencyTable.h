@@ -0,0 +1,97 @@
+#ifndef HTTPECHO_HTTP_LATENCY_TABLE
+#define HTTPECHO_HTTP_LATENCY_TABLE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <ostream>
+#include "LatencyHistogram.h"
+
+// default max number of (host, URI) pairs tracked, the rest are aggregated into one overflow entry
+#define DEFAULT_MAX_LATENCY_ENTRIES 1024
+
+// max length of the host and URI kept per entry, longer values are truncated
+#define LATENCY_MAX_HOST_LEN 63
+#define LATENCY_MAX_URI_LEN 127
+
+
+/**
+ * Server latency metrics aggregated per (host, URI path) pair: a time-to-first-byte histogram and a full response time histogram for each pair.
+ * The table is allocated once with a fixed number of entries; transactions of pairs which don't fit anymore are counted in a single overflow
+ * entry (host and URI "*"), so memory stays fixed no matter how many distinct URIs the traffic has.
+ * Each capture worker owns its own table, the tables are merged when the report is written
+ */
+class HttpLatencyTable
+{
+public:
+
+	/**
+	 * A c'tor for this class
+	 * @param[in] maxEntries The max number of (host, URI) pairs tracked
+	 */
+	HttpLatencyTable(size_t maxEntries = DEFAULT_MAX_LATENCY_ENTRIES);
+
+	/**
+	 * A d'tor for this class
+	 */
+	~HttpLatencyTable();
+
+	/**
+	 * Record a completed transaction
+	 * @param[in] host The Host header of the request (may be empty)
+	 * @param[in] uri The URI path of the request, without the query string
+	 * @param[in] timeToFirstByteUsec Time from the end of the request to the first byte of the response (microseconds)
+	 * @param[in] responseTimeUsec Time from the end of the request to the end of the response (microseconds)
+	 */
+	void record(const char* host, const char* uri, uint64_t timeToFirstByteUsec, uint64_t responseTimeUsec);
+
+	/**
+	 * Add all transactions of another table to this one
+	 * @param[in] other The table to merge
+	 */
+	void merge(const HttpLatencyTable& other);
+
+	/**
+	 * Remove all entries and stats
+	 */
+	void clear();
+
+	/**
+	 * Write the table as tab separated lines (with a header line): host, URI, number of transactions, and p50/p90/p99/max of the
+	 * time-to-first-byte and of the response time, in microseconds
+	 * @param[in] stream The stream to write to
+	 */
+	void writeReport(std::ostream& stream) const;
+
+	// stats: number of transactions recorded and how many of them went to the overflow entry
+	uint64_t numOfTransactions;
+	uint64_t numOfOverflowTransactions;
+
+private:
+
+	struct LatencyEntry
+	{
+		uint32_t hash;
+		char host[LATENCY_MAX_HOST_LEN + 1];
+		char uri[LATENCY_MAX_URI_LEN + 1];
+		LatencyHistogram timeToFirstByte;
+		LatencyHistogram responseTime;
+	};
+
+	// the entries are stored densely, the hash slots point into them (-1 for an empty slot)
+	LatencyEntry* m_Entries;
+	int32_t* m_Slots;
+	size_t m_NumOfSlots;
+	size_t m_SlotMask;
+	size_t m_MaxEntries;
+	size_t m_NumOfEntries;
+	LatencyEntry m_Overflow;
+
+	LatencyEntry* findOrCreateEntry(const char* host, const char* uri);
+	static void writeEntry(std::ostream& stream, const LatencyEntry& entry);
+
+	// the table holds large arrays, copying it by mistake would be expensive
+	HttpLatencyTable(const HttpLatencyTable&);
+	HttpLatencyTable& operator=(const HttpLatencyTable&);
+};
+
+#endif /* HTTPECHO_HTTP_LATENCY_TABLE */
@@ -0,0 +1,270 @@
+#include <string.h>
+#include "HttpMessageFramer.h"
+
+// the headers which decide the framing, lower case, and a value telling none of them matched
+static const char* s_FramingHeaders[] = { "content-length", "transfer-encoding", "connection" };
+#define HEADER_CONTENT_LENGTH 0
+#define HEADER_TRANSFER_ENCODING 1
+#define HEADER_CONNECTION 2
+#define HEADER_OTHER 0xff
+
+
+/**
+ * Advance the match of a token within a header value by one byte. The tokens looked for have no repeated prefix, so a mismatch only has to check
+ * whether the byte starts the token again
+ * @return True if the byte completes the token
+ */
+static bool matchToken(const char* token, size_t tokenLen, uint8_t& tokenPos, uint8_t c)
+{
+	if (c >= 'A' && c <= 'Z')
+		c += 'a' - 'A';
+
+	if (c == (uint8_t)token[tokenPos])
+		tokenPos++;
+	else
+		tokenPos = (c == (uint8_t)token[0] ? 1 : 0);
+
+	if (tokenPos < tokenLen)
+		return false;
+
+	tokenPos = 0;
+	return true;
+}
+
+
+void HttpMessageFramer::reset(bool isRequest, bool noBody)
+{
+	m_Remaining = 0;
+	m_StatusCode = 0;
+	m_LinePos = 0;
+	m_State = StartLine;
+	m_HeaderCandidates = 0;
+	m_Header = HEADER_OTHER;
+	m_TokenPos = 0;
+	m_KeepAliveTokenPos = 0;
+	m_IsRequest = isRequest;
+	m_NoBody = noBody;
+	m_Started = false;
+	m_Http10 = false;
+	m_HasContentLength = false;
+	m_Chunked = false;
+	m_KeepAlive = true;
+	m_BodyUntilClose = false;
+}
+
+
+void HttpMessageFramer::scanStartLine(uint8_t c)
+{
+	if (c == '\n')
+	{
+		m_State = HeaderName;
+		m_LinePos = 0;
+		m_HeaderCandidates = (1 << HEADER_CONTENT_LENGTH) | (1 << HEADER_TRANSFER_ENCODING) | (1 << HEADER_CONNECTION);
+		return;
+	}
+
+	// "HTTP/1.x nnn ...": only responses need their version and status code
+	if (!m_IsRequest)
+	{
+		if (m_LinePos == 7 && c == '0')
+		{
+			m_Http10 = true;
+			m_KeepAlive = false;
+		}
+		else if (m_LinePos >= 9 && m_LinePos <= 11 && c >= '0' && c <= '9')
+			m_StatusCode = m_StatusCode * 10 + (c - '0');
+	}
+
+	if (m_LinePos < UINT16_MAX)
+		m_LinePos++;
+}
+
+
+void HttpMessageFramer::scanHeaderName(uint8_t c)
+{
+	if (c == '\r')
+		return;
+
+	if (c == '\n')
+	{
+		// an empty line ends the headers, a line without a colon is skipped
+		if (m_LinePos == 0)
+			endHeaders();
+		m_LinePos = 0;
+		m_HeaderCandidates = (1 << HEADER_CONTENT_LENGTH) | (1 << HEADER_TRANSFER_ENCODING) | (1 << HEADER_CONNECTION);
+		return;
+	}
+
+	if (c == ':')
+	{
+		m_Header = HEADER_OTHER;
+		for (uint8_t i = 0; i < sizeof(s_FramingHeaders) / sizeof(s_FramingHeaders[0]); i++)
+		{
+			if ((m_HeaderCandidates & (1 << i)) != 0 && strlen(s_FramingHeaders[i]) == m_LinePos)
+				m_Header = i;
+		}
+		m_TokenPos = 0;
+		m_KeepAliveTokenPos = 0;
+		m_State = HeaderValue;
+		return;
+	}
+
+	if (c >= 'A' && c <= 'Z')
+		c += 'a' - 'A';
+	for (uint8_t i = 0; i < sizeof(s_FramingHeaders) / sizeof(s_FramingHeaders[0]); i++)
+	{
+		if ((m_HeaderCandidates & (1 << i)) != 0 && (m_LinePos >= strlen(s_FramingHeaders[i]) || (uint8_t)s_FramingHeaders[i][m_LinePos] != c))
+			m_HeaderCandidates &= ~(1 << i);
+	}
+
+	if (m_LinePos < UINT16_MAX)
+		m_LinePos++;
+}
+
+
+void HttpMessageFramer::scanHeaderValue(uint8_t c)
+{
+	if (c == '\n')
+	{
+		m_State = HeaderName;
+		m_LinePos = 0;
+		m_HeaderCandidates = (1 << HEADER_CONTENT_LENGTH) | (1 << HEADER_TRANSFER_ENCODING) | (1 << HEADER_CONNECTION);
+		return;
+	}
+
+	switch (m_Header)
+	{
+		case HEADER_CONTENT_LENGTH:
+			if (c >= '0' && c <= '9')
+			{
+				m_Remaining = m_Remaining * 10 + (c - '0');
+				m_HasContentLength = true;
+			}
+			break;
+		case HEADER_TRANSFER_ENCODING:
+			if (matchToken("chunked", 7, m_TokenPos, c))
+				m_Chunked = true;
+			break;
+		case HEADER_CONNECTION:
+			if (matchToken("close", 5, m_TokenPos, c))
+				m_KeepAlive = false;
+			if (matchToken("keep-alive", 10, m_KeepAliveTokenPos, c))
+				m_KeepAlive = true;
+			break;
+		default:
+			break;
+	}
+}
+
+
+void HttpMessageFramer::endHeaders()
+{
+	bool responseWithoutBody = (!m_IsRequest &&
+			(m_NoBody || (m_StatusCode >= 100 && m_StatusCode < 200) || m_StatusCode == 204 || m_StatusCode == 304));
+
+	if (responseWithoutBody)
+		m_State = Done;
+	else if (m_Chunked)
+	{
+		m_Remaining = 0;
+		m_LinePos = 0;
+		m_State = ChunkSize;
+	}
+	else if (m_HasContentLength)
+		m_State = (m_Remaining > 0 ? BodyByLength : Done);
+	else if (m_IsRequest)
+		m_State = Done;
+	else
+	{
+		m_BodyUntilClose = true;
+		m_State = BodyUntilClose;
+	}
+}
+
+
+size_t HttpMessageFramer::feed(const uint8_t* data, size_t dataLen)
+{
+	if (dataLen > 0)
+		m_Started = true;
+
+	size_t pos = 0;
+	while (pos < dataLen && m_State != Done)
+	{
+		// bodies are skipped in bulk, everything else a byte at a time
+		if (m_State == BodyByLength || m_State == ChunkData)
+		{
+			size_t toSkip = dataLen - pos;
+			if (toSkip > m_Remaining)
+				toSkip = (size_t)m_Remaining;
+			if (m_BodyListener != NULL)
+				m_BodyListener->onBodyData(data + pos, toSkip);
+			pos += toSkip;
+			m_Remaining -= toSkip;
+			if (m_Remaining == 0)
+				m_State = (m_State == BodyByLength ? Done : ChunkDataEnd);
+			continue;
+		}
+
+		if (m_State == BodyUntilClose)
+		{
+			if (m_BodyListener != NULL)
+				m_BodyListener->onBodyData(data + pos, dataLen - pos);
+			return dataLen;
+		}
+
+		uint8_t c = data[pos++];
+		switch (m_State)
+		{
+			case StartLine:
+				scanStartLine(c);
+				break;
+			case HeaderName:
+				scanHeaderName(c);
+				break;
+			case HeaderValue:
+				scanHeaderValue(c);
+				break;
+			case ChunkSize:
+			case ChunkExtension:
+				if (c == '\n')
+				{
+					m_LinePos = 0;
+					m_State = (m_Remaining > 0 ? ChunkData : ChunkTrailer);
+				}
+				else if (m_State == ChunkSize && c >= '0' && c <= '9')
+					m_Remaining = (m_Remaining << 4) | (c - '0');
+				else if (m_State == ChunkSize && ((c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')))
+					m_Remaining = (m_Remaining << 4) | ((c | 0x20) - 'a' + 10);
+				else if (c != '\r')
+					m_State = ChunkExtension;
+				break;
+			case ChunkDataEnd:
+				if (c == '\n')
+					m_State = ChunkSize;
+				break;
+			case ChunkTrailer:
+				if (c == '\n')
+				{
+					if (m_LinePos == 0)
+						m_State = Done;
+					m_LinePos = 0;
+				}
+				else if (c != '\r')
+					m_LinePos = 1;
+				break;
+			default:
+				break;
+		}
+	}
+
+	return pos;
+}
+
+
+bool HttpMessageFramer::finish()
+{
+	if (m_State == BodyUntilClose)
+		m_State = Done;
+
+	return isComplete();
+}
@@ -0,0 +1,135 @@
+#ifndef HTTPECHO_HTTP_MESSAGE_FRAMER
+#define HTTPECHO_HTTP_MESSAGE_FRAMER
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+/**
+ * Receives the body of the messages an HttpMessageFramer frames as it streams past: the payload only, without the chunked framing
+ */
+class HttpBodyListener
+{
+public:
+	virtual ~HttpBodyListener() {}
+
+	/**
+	 * Called with the next bytes of a message's body
+	 * @param[in] data The body data
+	 * @param[in] dataLen The body data length
+	 */
+	virtual void onBodyData(const uint8_t* data, size_t dataLen) = 0;
+};
+
+
+/**
+ * Finds where one HTTP/1.x message ends, as its bytes stream in: the start line, the headers which decide the framing (Content-Length,
+ * Transfer-Encoding and Connection), then the body by length, by chunks or until the connection closes. Headers are matched a byte at a time
+ * against those three names, so no line is buffered and the whole state is a few dozen bytes; it's meant for the replay side, which keeps one per
+ * simulated connection. Nothing is validated beyond what framing needs, the capture side's HttpTransactionTracker does the full parsing
+ */
+class HttpMessageFramer
+{
+public:
+
+	/**
+	 * A c'tor for this class, the framer waits for a request
+	 */
+	HttpMessageFramer() { m_BodyListener = NULL; reset(true, false); }
+
+	/**
+	 * Start framing the next message
+	 * @param[in] isRequest Whether the message is a request (or a response)
+	 * @param[in] noBody Whether the message has no body whatever its headers say, i.e. it's the response to a HEAD request
+	 */
+	void reset(bool isRequest, bool noBody);
+
+	/**
+	 * Set a listener to pass the body bytes of the messages to, it's kept across messages
+	 * @param[in] listener The listener, NULL for none
+	 */
+	void setBodyListener(HttpBodyListener* listener) { m_BodyListener = listener; }
+
+	/**
+	 * Feed the next bytes of the stream
+	 * @param[in] data The stream data
+	 * @param[in] dataLen The stream data length
+	 * @return How many of the bytes belong to the message, less than dataLen only if the message ended (the rest starts the next one)
+	 */
+	size_t feed(const uint8_t* data, size_t dataLen);
+
+	/**
+	 * Report that the stream ended, which completes a body delimited by the connection close
+	 * @return True if the message is complete
+	 */
+	bool finish();
+
+	/**
+	 * @return True once the message's last byte was fed
+	 */
+	bool isComplete() const { return m_State == Done; }
+
+	/**
+	 * @return True if at least one byte of the message was fed
+	 */
+	bool isStarted() const { return m_Started; }
+
+	/**
+	 * @return The status code of a response, 0 until its start line was read
+	 */
+	int getStatusCode() const { return m_StatusCode; }
+
+	/**
+	 * @return True if the message is an interim response (1xx except 101 Switching Protocols), which is followed by the final response
+	 */
+	bool isInterim() const { return m_StatusCode >= 100 && m_StatusCode < 200 && m_StatusCode != 101; }
+
+	/**
+	 * @return True if the connection can carry another message after this one: HTTP/1.1 without "Connection: close", or HTTP/1.0 with
+	 * "Connection: keep-alive", and a body which isn't delimited by the close
+	 */
+	bool isKeepAlive() const { return m_KeepAlive && !m_BodyUntilClose && m_StatusCode != 101; }
+
+private:
+
+	HttpBodyListener* m_BodyListener;
+
+	enum FramerState
+	{
+		StartLine,
+		HeaderName,
+		HeaderValue,
+		BodyByLength,
+		ChunkSize,
+		ChunkExtension,
+		ChunkData,
+		ChunkDataEnd,
+		ChunkTrailer,
+		BodyUntilClose,
+		Done
+	};
+
+	uint64_t m_Remaining;
+	uint16_t m_StatusCode;
+	uint16_t m_LinePos;
+	uint8_t m_State;
+	uint8_t m_HeaderCandidates;
+	uint8_t m_Header;
+	uint8_t m_TokenPos;
+	uint8_t m_KeepAliveTokenPos;
+	bool m_IsRequest;
+	bool m_NoBody;
+	bool m_Started;
+	bool m_Http10;
+	bool m_HasContentLength;
+	bool m_Chunked;
+	bool m_KeepAlive;
+	bool m_BodyUntilClose;
+
+	void endHeaders();
+	void scanStartLine(uint8_t c);
+	void scanHeaderName(uint8_t c);
+	void scanHeaderValue(uint8_t c);
+};
+
+#endif /* HTTPECHO_HTTP_MESSAGE_FRAMER */
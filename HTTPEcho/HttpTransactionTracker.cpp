@@ -0,0 +1,942 @@
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include "HttpTransactionTracker.h"
+
+
+static const char* s_RequestMethods[] = { "GET ", "POST ", "PUT ", "HEAD ", "DELETE ", "OPTIONS ", "PATCH ", "CONNECT ", "TRACE " };
+
+
+/**
+ * The time from 'earlier' to 'later' in microseconds, 0 if 'later' is actually earlier
+ */
+static uint64_t getElapsedUsec(const timeval& earlier, const timeval& later)
+{
+	int64_t elapsed = ((int64_t)later.tv_sec - (int64_t)earlier.tv_sec) * 1000000 + ((int64_t)later.tv_usec - (int64_t)earlier.tv_usec);
+	return (elapsed > 0 ? (uint64_t)elapsed : 0);
+}
+
+
+/**
+ * Copy at most maxLen chars of [start, end) and null-terminate
+ */
+static void copyField(char* dst, size_t maxLen, const char* start, const char* end)
+{
+	size_t len = (size_t)(end - start);
+	if (len > maxLen)
+		len = maxLen;
+	memcpy(dst, start, len);
+	dst[len] = '\0';
+}
+
+
+HttpTransactionTracker::HttpTransactionTracker(const pcpp::ConnectionData& connData, int clientSide, HttpLatencyTable* latencyTable,
+		TrafficStats* trafficStats, OnHttpTransactionComplete onTransactionComplete, void* userCookie, const BodyCapturePolicy* bodyPolicy,
+		const RedactionPolicy* redactionPolicy)
+{
+	numOfTransactions = 0;
+	numOfUnmatchedResponses = 0;
+
+	m_LatencyTable = latencyTable;
+	m_TrafficStats = trafficStats;
+	m_BodyPolicy = (bodyPolicy != NULL && !bodyPolicy->isEmpty() ? bodyPolicy : NULL);
+	m_RedactionPolicy = (redactionPolicy != NULL && !redactionPolicy->isEmpty() ? redactionPolicy : NULL);
+	m_OnTransactionComplete = onTransactionComplete;
+	m_UserCookie = userCookie;
+	m_ClientSide = clientSide;
+
+	// side 0 is the source of the connection's first packet
+	const pcpp::IPAddress* clientIP = (clientSide == 0 ? connData.srcIP : connData.dstIP);
+	const pcpp::IPAddress* serverIP = (clientSide == 0 ? connData.dstIP : connData.srcIP);
+	m_ClientIP[0] = '\0';
+	m_ServerIP[0] = '\0';
+	if (clientIP != NULL)
+		strncat(m_ClientIP, clientIP->toString().c_str(), HTTP_MAX_IP_STRING_LEN - 1);
+	if (serverIP != NULL)
+		strncat(m_ServerIP, serverIP->toString().c_str(), HTTP_MAX_IP_STRING_LEN - 1);
+	m_ClientPort = (clientSide == 0 ? connData.srcPort : connData.dstPort);
+	m_ServerPort = (clientSide == 0 ? connData.dstPort : connData.srcPort);
+	m_ServerName[0] = '\0';
+	m_Upgraded = false;
+	m_UpgradeProtocol[0] = '\0';
+	m_UpgradeOffset = 0;
+	m_PatternMatches = 0;
+	m_MatchedPattern = NULL;
+
+	m_PendingHead = 0;
+	m_PendingTail = 0;
+	m_ParsingRequestTracked = false;
+	m_ParsingRequestSeq = 0;
+	m_ResponsePaired = false;
+
+	for (int i = 0; i < 2; i++)
+	{
+		resetParser(m_Parsers[i], StartLine);
+		m_Parsers[i].redactHeldLen = 0;
+		m_Parsers[i].lastByteTime.tv_sec = 0;
+		m_Parsers[i].lastByteTime.tv_usec = 0;
+	}
+}
+
+
+void HttpTransactionTracker::resetParser(MessageParser& parser, ParserState state)
+{
+	parser.state = state;
+	parser.lineLen = 0;
+	parser.bodyRemaining = 0;
+	parser.chunked = false;
+	parser.hasContentLength = false;
+	parser.contentLength = 0;
+	parser.bodyBytes = 0;
+	parser.contentType[0] = '\0';
+	parser.upgrade[0] = '\0';
+	parser.bodyLimit = BODY_SIZE_UNLIMITED;
+	parser.messageStarted = false;
+	parser.statusCode = 0;
+	parser.redactLineStarted = false;
+	parser.redactAction = -1;
+}
+
+
+bool HttpTransactionTracker::looksLikeMessageStart(bool isRequest, const uint8_t* data, size_t dataLen)
+{
+	// data may be shorter than the method / version a start line begins with (the start of a line so far), then it only has to match as far
+	// as it goes
+	if (!isRequest)
+		return memcmp(data, "HTTP/1.", dataLen < 7 ? dataLen : 7) == 0;
+
+	for (size_t i = 0; i < sizeof(s_RequestMethods) / sizeof(s_RequestMethods[0]); i++)
+	{
+		size_t methodLen = strlen(s_RequestMethods[i]);
+		if (memcmp(data, s_RequestMethods[i], dataLen < methodLen ? dataLen : methodLen) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+
+size_t HttpTransactionTracker::consumeLine(MessageParser& parser, const uint8_t* data, size_t dataLen, bool& lineComplete)
+{
+	const uint8_t* lineEnd = (const uint8_t*)memchr(data, '\n', dataLen);
+	size_t available = (lineEnd != NULL ? (size_t)(lineEnd - data) : dataLen);
+
+	// keep what fits, the rest of an overly long line is dropped
+	size_t toCopy = HTTP_MAX_LINE_LEN - parser.lineLen;
+	if (toCopy > available)
+		toCopy = available;
+	memcpy(parser.line + parser.lineLen, data, toCopy);
+	parser.lineLen += toCopy;
+
+	lineComplete = (lineEnd != NULL);
+	if (!lineComplete)
+		return dataLen;
+
+	if (parser.lineLen > 0 && parser.line[parser.lineLen - 1] == '\r')
+		parser.lineLen--;
+	parser.line[parser.lineLen] = '\0';
+
+	return available + 1;
+}
+
+
+void HttpTransactionTracker::handleRequestLine(MessageParser& parser, const timeval& timestamp)
+{
+	// METHOD SP request-target SP HTTP-version
+	char* methodEnd = strchr(parser.line, ' ');
+	char* target = (methodEnd != NULL ? methodEnd + 1 : NULL);
+	char* targetEnd = (target != NULL ? strchr(target, ' ') : NULL);
+	if (targetEnd == NULL)
+	{
+		resetParser(parser, Lost);
+		dropPendingRequests();
+		return;
+	}
+
+	timeval firstByteTime = parser.firstByteTime;
+	resetParser(parser, Headers);
+	parser.messageStarted = true;
+
+	// no room for another pending request, this one won't be timed
+	m_ParsingRequestTracked = (m_PendingTail - m_PendingHead < HTTP_MAX_PENDING_REQUESTS);
+	if (!m_ParsingRequestTracked)
+		return;
+
+	PendingRequest& request = m_Pending[m_PendingTail % HTTP_MAX_PENDING_REQUESTS];
+	m_ParsingRequestSeq = m_PendingTail;
+	m_PendingTail++;
+
+	size_t methodLen = (size_t)(methodEnd - parser.line);
+	copyField(request.method, HTTP_MAX_METHOD_LEN, parser.line, methodEnd);
+	request.isHead = (methodLen == 4 && memcmp(parser.line, "HEAD", 4) == 0);
+	request.isConnect = (methodLen == 7 && memcmp(parser.line, "CONNECT", 7) == 0);
+	request.host[0] = '\0';
+	request.firstByteTime = firstByteTime;
+	request.lastByteTime = timestamp;
+	request.bodyBytes = 0;
+
+	// absolute-form ("http://host/path") carries the host in the target
+	if (strncasecmp(target, "http://", 7) == 0)
+	{
+		char* authority = target + 7;
+		char* authorityEnd = authority;
+		while (authorityEnd < targetEnd && *authorityEnd != '/')
+			authorityEnd++;
+		copyField(request.host, LATENCY_MAX_HOST_LEN, authority, authorityEnd);
+		target = authorityEnd;
+	}
+
+	// the query string is dropped so the URIs of one endpoint aggregate together
+	char* pathEnd = target;
+	while (pathEnd < targetEnd && *pathEnd != '?')
+		pathEnd++;
+
+	if (pathEnd == target)
+		strcpy(request.uri, "/");
+	else
+		copyField(request.uri, LATENCY_MAX_URI_LEN, target, pathEnd);
+}
+
+
+void HttpTransactionTracker::handleResponseLine(MessageParser& parser, const timeval& timestamp)
+{
+	// HTTP-version SP status-code SP reason-phrase
+	char* statusCode = strchr(parser.line, ' ');
+	if (strncmp(parser.line, "HTTP/", 5) != 0 || statusCode == NULL || strlen(statusCode) < 4)
+	{
+		resetParser(parser, Lost);
+		dropPendingRequests();
+		return;
+	}
+
+	timeval firstByteTime = parser.firstByteTime;
+	resetParser(parser, Headers);
+	parser.messageStarted = true;
+	parser.firstByteTime = firstByteTime;
+	parser.statusCode = atoi(statusCode + 1);
+}
+
+
+void HttpTransactionTracker::handleHeadersEnd(bool isRequest, MessageParser& parser)
+{
+	if (m_BodyPolicy != NULL)
+		parser.bodyLimit = m_BodyPolicy->getMaxBodyBytes(isRequest, parser.contentType);
+
+	if (isRequest)
+	{
+		// the request line and headers are complete, the request is counted even if its body never shows up
+		if (m_TrafficStats != NULL && m_ParsingRequestTracked)
+		{
+			const PendingRequest& request = m_Pending[m_ParsingRequestSeq % HTTP_MAX_PENDING_REQUESTS];
+			m_TrafficStats->recordRequest(request.host, request.uri);
+		}
+
+		if (parser.chunked)
+			parser.state = ChunkSize;
+		else if (parser.hasContentLength && parser.contentLength > 0)
+		{
+			parser.state = BodyByLength;
+			parser.bodyRemaining = parser.contentLength;
+		}
+		else
+			completeMessage(true, parser);
+
+		return;
+	}
+
+	int status = parser.statusCode;
+
+	// interim responses (100 Continue, 103 Early Hints) precede the final response to the same request
+	if (status >= 100 && status < 200 && status != 101)
+	{
+		resetParser(parser, StartLine);
+		return;
+	}
+
+	m_ResponsePaired = (m_PendingHead != m_PendingTail);
+	if (!m_ResponsePaired)
+		numOfUnmatchedResponses++;
+
+	const PendingRequest* request = (m_ResponsePaired ? &m_Pending[m_PendingHead % HTTP_MAX_PENDING_REQUESTS] : NULL);
+
+	// the connection switches to another protocol, nothing after this response is HTTP/1.x
+	if (status == 101 || (request != NULL && request->isConnect && status >= 200 && status < 300))
+	{
+		if (status == 101)
+			strcpy(m_UpgradeProtocol, parser.upgrade);
+
+		// an h2c upgrade's request is answered on HTTP/2 stream 1 (RFC 7540 section 3.2), the 101 doesn't complete it
+		if (status == 101 && strcasecmp(m_UpgradeProtocol, "h2c") == 0)
+		{
+			m_ResponsePaired = false;
+			resetParser(parser, StartLine);
+		}
+		else
+			completeMessage(false, parser);
+		m_Upgraded = true;
+		return;
+	}
+
+	if (status == 204 || status == 304 || (request != NULL && request->isHead))
+		completeMessage(false, parser);
+	else if (parser.chunked)
+		parser.state = ChunkSize;
+	else if (parser.hasContentLength)
+	{
+		if (parser.contentLength == 0)
+			completeMessage(false, parser);
+		else
+		{
+			parser.state = BodyByLength;
+			parser.bodyRemaining = parser.contentLength;
+		}
+	}
+	else
+		parser.state = BodyUntilClose;
+}
+
+
+void HttpTransactionTracker::completeMessage(bool isRequest, MessageParser& parser)
+{
+	if (isRequest)
+	{
+		if (m_ParsingRequestTracked)
+		{
+			PendingRequest& request = m_Pending[m_ParsingRequestSeq % HTTP_MAX_PENDING_REQUESTS];
+			request.lastByteTime = parser.lastByteTime;
+			request.bodyBytes = parser.bodyBytes;
+		}
+		m_ParsingRequestTracked = false;
+	}
+	else if (m_ResponsePaired)
+	{
+		PendingRequest& request = m_Pending[m_PendingHead % HTTP_MAX_PENDING_REQUESTS];
+		uint64_t timeToFirstByte = getElapsedUsec(request.lastByteTime, parser.firstByteTime);
+		uint64_t responseTime = getElapsedUsec(request.lastByteTime, parser.lastByteTime);
+		m_LatencyTable->record(request.host, request.uri, timeToFirstByte, responseTime);
+		numOfTransactions++;
+
+		if (m_OnTransactionComplete != NULL)
+		{
+			HttpTransaction transaction;
+			transaction.clientIP = m_ClientIP;
+			transaction.serverIP = m_ServerIP;
+			transaction.clientPort = m_ClientPort;
+			transaction.serverPort = m_ServerPort;
+			transaction.serverName = m_ServerName;
+			transaction.method = request.method;
+			transaction.host = request.host;
+			transaction.uri = request.uri;
+			transaction.statusCode = (uint16_t)parser.statusCode;
+			transaction.requestTime = request.firstByteTime;
+			transaction.requestBodyBytes = request.bodyBytes;
+			transaction.responseBodyBytes = parser.bodyBytes;
+			transaction.timeToFirstByteUsec = timeToFirstByte;
+			transaction.responseTimeUsec = responseTime;
+			transaction.patternMatches = m_PatternMatches;
+			transaction.matchedPattern = (m_MatchedPattern != NULL ? m_MatchedPattern : "");
+			m_OnTransactionComplete(transaction, m_UserCookie);
+		}
+		m_PatternMatches = 0;
+		m_MatchedPattern = NULL;
+
+		// the server answered before the request was fully sent - stop tracking the rest of it
+		if (m_ParsingRequestTracked && m_ParsingRequestSeq == m_PendingHead)
+			m_ParsingRequestTracked = false;
+
+		m_PendingHead++;
+		m_ResponsePaired = false;
+	}
+
+	resetParser(parser, StartLine);
+}
+
+
+void HttpTransactionTracker::keepBodyBytes(MessageParser& parser, size_t offset, size_t numOfBytes, std::vector<StreamSpan>* droppedSpans)
+{
+	// the body bytes before this chunk were counted already, the ones past the limit are dropped
+	uint64_t keepable = (parser.bodyBytes < parser.bodyLimit ? parser.bodyLimit - parser.bodyBytes : 0);
+	parser.bodyBytes += numOfBytes;
+	if (droppedSpans == NULL || keepable >= numOfBytes)
+		return;
+
+	StreamSpan span;
+	span.offset = (uint32_t)(offset + keepable);
+	span.length = (uint32_t)(numOfBytes - keepable);
+
+	// a body split into chunks is dropped as one range
+	if (!droppedSpans->empty() && droppedSpans->back().offset + droppedSpans->back().length == span.offset)
+		droppedSpans->back().length += span.length;
+	else
+		droppedSpans->push_back(span);
+}
+
+
+void HttpTransactionTracker::appendRedactionName(MessageParser& parser, const uint8_t* data, size_t dataLen)
+{
+	// a name too long for any rule is marked by a length past the max
+	if (parser.redactNameLen + dataLen > REDACTION_MAX_NAME_LEN)
+	{
+		parser.redactNameLen = REDACTION_MAX_NAME_LEN + 1;
+		return;
+	}
+
+	memcpy(parser.redactName + parser.redactNameLen, data, dataLen);
+	parser.redactNameLen += dataLen;
+}
+
+
+void HttpTransactionTracker::startRedactedValue(MessageParser& parser, bool isHeader)
+{
+	parser.redactAction = (parser.redactNameLen <= REDACTION_MAX_NAME_LEN ?
+			m_RedactionPolicy->findRule(isHeader, parser.redactName, parser.redactNameLen) : -1);
+	parser.redactValueLen = 0;
+	if (parser.redactAction < 0)
+		return;
+
+	if (parser.redactAction == REDACT_HASH)
+		m_RedactionPolicy->startDigest(parser.redactDigest);
+
+	if (m_TrafficStats != NULL)
+		m_TrafficStats->recordRedaction(isHeader);
+}
+
+
+void HttpTransactionTracker::addRedactedPiece(MessageParser& parser, const uint8_t* data, size_t offset, size_t length, bool valueEnds,
+		std::vector<RedactedSpan>* redactedSpans)
+{
+	if (parser.redactAction < 0)
+		return;
+
+	RedactedSpan span;
+	span.offset = (uint32_t)offset;
+	span.length = (uint32_t)length;
+	span.replacementLen = (uint32_t)length;
+	span.digestLen = 0;
+	parser.redactValueLen += length;
+
+	if (parser.redactAction == REDACT_HASH)
+	{
+		parser.redactDigest.update(data, length);
+
+		// the digest is written over the last bytes of the value, which aren't known until it ends. So a piece which doesn't end the value holds
+		// back the bytes which may still be under the digest, and the last piece writes them
+		span.replacementLen += (uint32_t)parser.redactHeldLen;
+		parser.redactHeldLen = (valueEnds ? 0 : (parser.redactValueLen < REDACTION_DIGEST_LEN ? parser.redactValueLen : REDACTION_DIGEST_LEN));
+		span.replacementLen -= (uint32_t)parser.redactHeldLen;
+
+		if (valueEnds)
+		{
+			static const char hexDigits[] = "0123456789abcdef";
+			uint8_t digest[16];
+			parser.redactDigest.finish(digest);
+			span.digestLen = (uint8_t)(parser.redactValueLen < REDACTION_DIGEST_LEN ? parser.redactValueLen : REDACTION_DIGEST_LEN);
+			for (int i = 0; i < span.digestLen; i++)
+				span.digest[i] = hexDigits[(digest[i / 2] >> (i % 2 == 0 ? 4 : 0)) & 0x0f];
+		}
+	}
+
+	if (valueEnds)
+		parser.redactAction = -1;
+
+	if (span.length > 0 || span.replacementLen > 0)
+		redactedSpans->push_back(span);
+}
+
+
+void HttpTransactionTracker::maskLostData(MessageParser& parser, size_t offset, size_t length, std::vector<RedactedSpan>* redactedSpans)
+{
+	RedactedSpan span;
+	span.offset = (uint32_t)offset;
+	span.length = (uint32_t)length;
+	span.replacementLen = (uint32_t)(length + parser.redactHeldLen);
+	span.digestLen = 0;
+	parser.redactHeldLen = 0;
+
+	// the values already found in the range are masked with the rest of it. A piece which held bytes back wrote that many fewer (they're
+	// counted in redactHeldLen), the last piece of a value as many more
+	while (!redactedSpans->empty() && redactedSpans->back().offset >= offset)
+	{
+		span.replacementLen += redactedSpans->back().replacementLen - redactedSpans->back().length;
+		redactedSpans->pop_back();
+	}
+
+	if (span.length > 0 || span.replacementLen > 0)
+		redactedSpans->push_back(span);
+}
+
+
+void HttpTransactionTracker::redactLineSegment(MessageParser& parser, const uint8_t* data, size_t segmentLen, size_t offset, bool lineComplete,
+		std::vector<RedactedSpan>* redactedSpans)
+{
+	if (!parser.redactLineStarted)
+	{
+		parser.redactLineStarted = true;
+		parser.redactState = (parser.state == StartLine ? RedactMethod : RedactHeaderName);
+		parser.redactNameLen = 0;
+		parser.redactAction = -1;
+	}
+
+	size_t pos = 0;
+	while (pos < segmentLen && parser.redactState != RedactLineRest)
+	{
+		switch (parser.redactState)
+		{
+		case RedactMethod:
+		{
+			const uint8_t* methodEnd = (const uint8_t*)memchr(data + pos, ' ', segmentLen - pos);
+			pos = (methodEnd != NULL ? (size_t)(methodEnd - data) + 1 : segmentLen);
+			if (methodEnd != NULL)
+				parser.redactState = RedactPath;
+			break;
+		}
+
+		case RedactPath:
+		{
+			uint8_t byte = data[pos++];
+			if (byte == '?')
+			{
+				parser.redactState = RedactParamName;
+				parser.redactNameLen = 0;
+			}
+			else if (byte == ' ')
+				parser.redactState = RedactLineRest;
+			break;
+		}
+
+		case RedactParamName:
+		{
+			size_t nameEnd = pos;
+			while (nameEnd < segmentLen && data[nameEnd] != '=' && data[nameEnd] != '&' && data[nameEnd] != ' ' && data[nameEnd] != '#')
+				nameEnd++;
+			appendRedactionName(parser, data + pos, nameEnd - pos);
+			pos = nameEnd;
+			if (pos == segmentLen)
+				break;
+
+			uint8_t byte = data[pos++];
+			if (byte == '=')
+			{
+				startRedactedValue(parser, false);
+				parser.redactState = RedactParamValue;
+			}
+			else if (byte == '&')
+				parser.redactNameLen = 0;
+			else
+				parser.redactState = RedactLineRest;
+			break;
+		}
+
+		case RedactParamValue:
+		{
+			size_t valueEnd = pos;
+			while (valueEnd < segmentLen && data[valueEnd] != '&' && data[valueEnd] != ' ' && data[valueEnd] != '#')
+				valueEnd++;
+			addRedactedPiece(parser, data + pos, offset + pos, valueEnd - pos, valueEnd < segmentLen, redactedSpans);
+			pos = valueEnd;
+			if (pos == segmentLen)
+				break;
+
+			if (data[pos++] == '&')
+			{
+				parser.redactState = RedactParamName;
+				parser.redactNameLen = 0;
+			}
+			else
+				parser.redactState = RedactLineRest;
+			break;
+		}
+
+		case RedactHeaderName:
+		{
+			const uint8_t* colon = (const uint8_t*)memchr(data + pos, ':', segmentLen - pos);
+			size_t nameEnd = (colon != NULL ? (size_t)(colon - data) : segmentLen);
+			appendRedactionName(parser, data + pos, nameEnd - pos);
+			pos = nameEnd;
+			if (colon == NULL)
+				break;
+
+			pos++;
+			startRedactedValue(parser, true);
+			parser.redactState = (parser.redactAction >= 0 ? RedactHeaderValueStart : RedactLineRest);
+			break;
+		}
+
+		case RedactHeaderValueStart:
+		{
+			if (data[pos] == ' ' || data[pos] == '\t')
+				pos++;
+			else
+				parser.redactState = RedactHeaderValue;
+			break;
+		}
+
+		case RedactHeaderValue:
+		{
+			// a value can't hold a CR, so the line's CR is never redacted even if it comes without its LF
+			const uint8_t* valueEnd = (const uint8_t*)memchr(data + pos, '\r', segmentLen - pos);
+			size_t pieceEnd = (valueEnd != NULL ? (size_t)(valueEnd - data) : segmentLen);
+			addRedactedPiece(parser, data + pos, offset + pos, pieceEnd - pos, valueEnd != NULL || lineComplete, redactedSpans);
+			pos = pieceEnd;
+			if (valueEnd != NULL || lineComplete)
+				parser.redactState = RedactLineRest;
+			break;
+		}
+
+		case RedactLineRest:
+			break;
+		}
+	}
+
+	if (!lineComplete)
+		return;
+
+	// a value which ran up to the end of the previous segment ends here
+	if (parser.redactAction >= 0)
+		addRedactedPiece(parser, data, offset, 0, true, redactedSpans);
+	parser.redactLineStarted = false;
+}
+
+
+void HttpTransactionTracker::dropPendingRequests()
+{
+	m_PendingHead = m_PendingTail;
+	m_ParsingRequestTracked = false;
+	m_ResponsePaired = false;
+}
+
+
+void HttpTransactionTracker::feed(int side, const uint8_t* data, size_t dataLen, const timeval& timestamp, std::vector<StreamSpan>* droppedSpans,
+		std::vector<RedactedSpan>* redactedSpans)
+{
+	if (m_Upgraded || dataLen == 0)
+		return;
+
+	bool isRequest = (side == m_ClientSide);
+	MessageParser& parser = m_Parsers[side];
+	parser.lastByteTime = timestamp;
+
+	// response start lines carry nothing to redact, request lines only query parameters
+	bool redactHeaders = (m_RedactionPolicy != NULL && redactedSpans != NULL);
+	bool redactStartLine = (redactHeaders && isRequest && m_RedactionPolicy->hasQueryRules());
+
+	// a hashed value which a hole cut short still owes its held back bytes, they're masked before this data
+	if (redactHeaders && parser.redactHeldLen > 0 && parser.redactAction < 0)
+		maskLostData(parser, 0, 0, redactedSpans);
+
+	if (parser.state == Lost)
+	{
+		if (!looksLikeMessageStart(isRequest, data, dataLen))
+		{
+			// there's no telling where the values are in data which is out of sync, so with a redaction policy all of it is masked
+			if (redactHeaders)
+				maskLostData(parser, 0, dataLen, redactedSpans);
+			return;
+		}
+		resetParser(parser, StartLine);
+	}
+
+	// a request which is still being sent is timed from its latest byte
+	if (isRequest && m_ParsingRequestTracked)
+		m_Pending[m_ParsingRequestSeq % HTTP_MAX_PENDING_REQUESTS].lastByteTime = timestamp;
+
+	const uint8_t* dataStart = data;
+	while (dataLen > 0 && !m_Upgraded)
+	{
+		bool lineComplete = false;
+		size_t consumed = 0;
+		size_t lineOffset = (size_t)(data - dataStart);
+
+		switch (parser.state)
+		{
+		case StartLine:
+		{
+			// empty lines between messages are ignored
+			if (!parser.messageStarted && parser.lineLen == 0 && (*data == '\r' || *data == '\n'))
+			{
+				consumed = 1;
+				break;
+			}
+
+			if (!parser.messageStarted)
+			{
+				parser.messageStarted = true;
+				parser.firstByteTime = timestamp;
+			}
+
+			consumed = consumeLine(parser, data, dataLen, lineComplete);
+
+			// with a redaction policy, a line which can't be a start line (e.g. a header line of a connection picked up mid-stream) loses sync
+			// as soon as that shows, before any of it is written
+			if (redactHeaders && !looksLikeMessageStart(isRequest, (const uint8_t*)parser.line, parser.lineLen))
+			{
+				resetParser(parser, Lost);
+				dropPendingRequests();
+				break;
+			}
+
+			if (redactStartLine)
+				redactLineSegment(parser, data, consumed - (lineComplete ? 1 : 0), (size_t)(data - dataStart), lineComplete, redactedSpans);
+			if (!lineComplete)
+				break;
+
+			if (isRequest)
+				handleRequestLine(parser, timestamp);
+			else
+				handleResponseLine(parser, timestamp);
+			break;
+		}
+
+		case Headers:
+		{
+			consumed = consumeLine(parser, data, dataLen, lineComplete);
+			if (redactHeaders)
+				redactLineSegment(parser, data, consumed - (lineComplete ? 1 : 0), (size_t)(data - dataStart), lineComplete, redactedSpans);
+			if (!lineComplete)
+				break;
+
+			if (parser.lineLen == 0)
+			{
+				handleHeadersEnd(isRequest, parser);
+				break;
+			}
+
+			parser.lineLen = 0;
+
+			char* colon = strchr(parser.line, ':');
+			if (colon == NULL)
+				break;
+
+			size_t nameLen = (size_t)(colon - parser.line);
+			char* value = colon + 1;
+			while (*value == ' ' || *value == '\t')
+				value++;
+
+			if (nameLen == 14 && strncasecmp(parser.line, "Content-Length", 14) == 0)
+			{
+				parser.hasContentLength = true;
+				parser.contentLength = strtoull(value, NULL, 10);
+			}
+			else if (nameLen == 17 && strncasecmp(parser.line, "Transfer-Encoding", 17) == 0)
+			{
+				parser.chunked = (strcasestr(value, "chunked") != NULL);
+			}
+			else if (nameLen == 12 && m_BodyPolicy != NULL && strncasecmp(parser.line, "Content-Type", 12) == 0)
+			{
+				parser.contentType[0] = '\0';
+				strncat(parser.contentType, value, HTTP_MAX_CONTENT_TYPE_LEN);
+			}
+			else if (nameLen == 7 && !isRequest && strncasecmp(parser.line, "Upgrade", 7) == 0)
+			{
+				size_t upgradeLen = strcspn(value, " \t,");
+				copyField(parser.upgrade, HTTP_MAX_UPGRADE_LEN, value, value + upgradeLen);
+			}
+			else if (nameLen == 4 && isRequest && m_ParsingRequestTracked && strncasecmp(parser.line, "Host", 4) == 0)
+			{
+				PendingRequest& request = m_Pending[m_ParsingRequestSeq % HTTP_MAX_PENDING_REQUESTS];
+				char* valueEnd = value + strlen(value);
+				while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t'))
+					valueEnd--;
+				copyField(request.host, LATENCY_MAX_HOST_LEN, value, valueEnd);
+			}
+			break;
+		}
+
+		case BodyByLength:
+		case ChunkData:
+		{
+			consumed = (dataLen < parser.bodyRemaining ? dataLen : (size_t)parser.bodyRemaining);
+			parser.bodyRemaining -= consumed;
+			keepBodyBytes(parser, (size_t)(data - dataStart), consumed, droppedSpans);
+			if (parser.bodyRemaining > 0)
+				break;
+
+			if (parser.state == ChunkData)
+				parser.state = ChunkDataEnd;
+			else
+				completeMessage(isRequest, parser);
+			break;
+		}
+
+		case ChunkSize:
+		{
+			consumed = consumeLine(parser, data, dataLen, lineComplete);
+			if (!lineComplete)
+				break;
+
+			char* sizeEnd;
+			uint64_t chunkSize = strtoull(parser.line, &sizeEnd, 16);
+			parser.lineLen = 0;
+			if (sizeEnd == parser.line)
+			{
+				resetParser(parser, Lost);
+				dropPendingRequests();
+				break;
+			}
+
+			if (chunkSize == 0)
+				parser.state = ChunkTrailer;
+			else
+			{
+				parser.state = ChunkData;
+				parser.bodyRemaining = chunkSize;
+			}
+			break;
+		}
+
+		case ChunkDataEnd:
+		{
+			// the CRLF after the chunk data
+			consumed = consumeLine(parser, data, dataLen, lineComplete);
+			if (!lineComplete)
+				break;
+
+			parser.lineLen = 0;
+			parser.state = ChunkSize;
+			break;
+		}
+
+		case ChunkTrailer:
+		{
+			consumed = consumeLine(parser, data, dataLen, lineComplete);
+			if (!lineComplete)
+				break;
+
+			if (parser.lineLen == 0)
+				completeMessage(isRequest, parser);
+			else
+				parser.lineLen = 0;
+			break;
+		}
+
+		case BodyUntilClose:
+			consumed = dataLen;
+			keepBodyBytes(parser, (size_t)(data - dataStart), consumed, droppedSpans);
+			break;
+
+		case Lost:
+			break;
+		}
+
+		// lost sync: with a redaction policy the rest of the data is masked, from the start of the line sync was lost on
+		if (parser.state == Lost)
+		{
+			if (redactHeaders)
+				maskLostData(parser, lineOffset, (size_t)(data - dataStart) + dataLen - lineOffset, redactedSpans);
+			return;
+		}
+
+		data += consumed;
+		dataLen -= consumed;
+	}
+
+	if (m_Upgraded)
+		m_UpgradeOffset = (size_t)(data - dataStart);
+}
+
+
+bool HttpTransactionTracker::getUpgradeRequest(HttpTransaction& request, timeval& lastByteTime) const
+{
+	// only an h2c upgrade leaves its request pending
+	if (!m_Upgraded || m_PendingHead == m_PendingTail)
+		return false;
+
+	const PendingRequest& pending = m_Pending[m_PendingHead % HTTP_MAX_PENDING_REQUESTS];
+	request.clientIP = m_ClientIP;
+	request.serverIP = m_ServerIP;
+	request.clientPort = m_ClientPort;
+	request.serverPort = m_ServerPort;
+	request.serverName = m_ServerName;
+	request.method = pending.method;
+	request.host = pending.host;
+	request.uri = pending.uri;
+	request.statusCode = 0;
+	request.requestTime = pending.firstByteTime;
+	request.requestBodyBytes = pending.bodyBytes;
+	request.responseBodyBytes = 0;
+	request.timeToFirstByteUsec = 0;
+	request.responseTimeUsec = 0;
+	request.patternMatches = 0;
+	request.matchedPattern = "";
+	lastByteTime = pending.lastByteTime;
+	return true;
+}
+
+
+void HttpTransactionTracker::skipMissingData(int side, uint32_t missingDataLen)
+{
+	if (m_Upgraded)
+		return;
+
+	bool isRequest = (side == m_ClientSide);
+	MessageParser& parser = m_Parsers[side];
+
+	// the hole is inside a body of known length - skip it and stay in sync
+	if ((parser.state == BodyByLength || parser.state == ChunkData) && missingDataLen <= parser.bodyRemaining)
+	{
+		parser.bodyRemaining -= missingDataLen;
+		parser.bodyBytes += missingDataLen;
+		if (parser.bodyRemaining == 0)
+		{
+			if (parser.state == ChunkData)
+				parser.state = ChunkDataEnd;
+			else
+				completeMessage(isRequest, parser);
+		}
+		return;
+	}
+
+	// the response ends with the connection anyway
+	if (parser.state == BodyUntilClose)
+	{
+		parser.bodyBytes += missingDataLen;
+		return;
+	}
+
+	resetParser(parser, Lost);
+	dropPendingRequests();
+}
+
+
+uint32_t HttpTransactionTracker::getDiscardableBytes(int side) const
+{
+	const MessageParser& parser = m_Parsers[side];
+	if (m_Upgraded || (parser.state != BodyByLength && parser.state != ChunkData) || parser.bodyBytes < parser.bodyLimit || parser.bodyRemaining <= 1)
+		return 0;
+
+	return (uint32_t)(parser.bodyRemaining - 1 < HTTP_MAX_DISCARD_LEN ? parser.bodyRemaining - 1 : HTTP_MAX_DISCARD_LEN);
+}
+
+
+void HttpTransactionTracker::discardData(int side, uint32_t numOfBytes)
+{
+	MessageParser& parser = m_Parsers[side];
+	parser.bodyRemaining -= numOfBytes;
+	parser.bodyBytes += numOfBytes;
+}
+
+
+void HttpTransactionTracker::finish()
+{
+	for (int side = 0; side < 2; side++)
+	{
+		if (m_Parsers[side].state == BodyUntilClose)
+			completeMessage(side == m_ClientSide, m_Parsers[side]);
+	}
+}
+
+
+void HttpTransactionTracker::setServerName(const char* serverName)
+{
+	m_ServerName[0] = '\0';
+	strncat(m_ServerName, serverName, HTTP_MAX_SERVER_NAME_LEN);
+}
+
+
+void HttpTransactionTracker::addPatternMatch(const char* label)
+{
+	if (m_PatternMatches == 0)
+		m_MatchedPattern = label;
+	if (m_PatternMatches < UINT32_MAX)
+		m_PatternMatches++;
+}
@@ -0,0 +1,359 @@
+#ifndef HTTPECHO_HTTP_TRANSACTION_TRACKER
+#define HTTPECHO_HTTP_TRANSACTION_TRACKER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include <vector>
+#include "header/TcpReassembly.h"
+#include "HttpLatencyTable.h"
+#include "TrafficStats.h"
+#include "BodyCapturePolicy.h"
+#include "RedactionPolicy.h"
+
+// max number of requests waiting for their response on one connection (pipelining depth), requests beyond it aren't timed
+#define HTTP_MAX_PENDING_REQUESTS 16
+
+// the part of a start line / header line which is kept for parsing, the rest of a longer line is skipped
+#define HTTP_MAX_LINE_LEN 1023
+
+// the longest request method kept for a transaction record
+#define HTTP_MAX_METHOD_LEN 15
+
+// room for the text form of an IPv4 or IPv6 address
+#define HTTP_MAX_IP_STRING_LEN 46
+
+// the longest server name (see setServerName()) kept for the transaction records
+#define HTTP_MAX_SERVER_NAME_LEN 95
+
+// the part of a Content-Type header kept for the body capture policy
+#define HTTP_MAX_CONTENT_TYPE_LEN 63
+
+// the part of an Upgrade header kept to tell which protocol the connection switched to
+#define HTTP_MAX_UPGRADE_LEN 31
+
+// max number of bytes given up at once by getDiscardableBytes(), keeps the reassembler's sequence arithmetic far from wrapping
+#define HTTP_MAX_DISCARD_LEN (1U << 30)
+
+
+/**
+ * @struct HttpTransaction
+ * A completed request/response pair, as handed to the OnHttpTransactionComplete callback. The strings are owned by the tracker and are only
+ * valid during the callback
+ */
+struct HttpTransaction
+{
+	// the client and server endpoints of the connection
+	const char* clientIP;
+	const char* serverIP;
+	uint16_t clientPort;
+	uint16_t serverPort;
+
+	// the name the client resolved the server's address from, as seen by the passive DNS cache (empty if it wasn't seen)
+	const char* serverName;
+
+	// the request method, the Host header (or the host of an absolute-form target) and the URI path without the query string
+	const char* method;
+	const char* host;
+	const char* uri;
+
+	// the status code of the final response
+	uint16_t statusCode;
+
+	// the capture time of the first byte of the request
+	timeval requestTime;
+
+	// the number of body bytes of the request and of the response (after dechunking, including bytes lost in stream holes)
+	uint64_t requestBodyBytes;
+	uint64_t responseBodyBytes;
+
+	// from the last byte of the request to the first / last byte of the response
+	uint64_t timeToFirstByteUsec;
+	uint64_t responseTimeUsec;
+
+	// the number of payload pattern matches in the connection's data since the previous transaction completed, and the label of the first
+	// (empty if there were none)
+	uint32_t patternMatches;
+	const char* matchedPattern;
+};
+
+
+/**
+ * @struct StreamSpan
+ * A range of bytes within a chunk of stream data
+ */
+struct StreamSpan
+{
+	uint32_t offset;
+	uint32_t length;
+};
+
+
+/**
+ * @typedef OnHttpTransactionComplete
+ * A callback invoked by HttpTransactionTracker when a response completes a transaction
+ * @param[in] transaction The transaction
+ * @param[in] userCookie The cookie given to the tracker
+ */
+typedef void (*OnHttpTransactionComplete)(const HttpTransaction& transaction, void* userCookie);
+
+
+/**
+ * Pairs the requests and responses of one HTTP/1.x connection and times them from the packet timestamps.
+ * Both directions are parsed as they stream in (start line, the few headers needed for framing, then the body is skipped by Content-Length, by
+ * chunks or until the connection closes), nothing is copied except the current header line. Requests wait in a fixed FIFO so pipelined requests
+ * are answered in order; 1xx interim responses (e.g. 100 Continue) don't consume a request. For each transaction two values are recorded in the
+ * HttpLatencyTable under the request's host and URI path (and every request is counted in the TrafficStats, if given):
+ * - Time to first byte: from the last byte of the request to the first byte of the final response
+ * - Response time: from the last byte of the request to the last byte of the response
+ * A hole in the stream that falls inside a body of known length is skipped without losing sync, any other hole drops the pending requests and
+ * the side waits for the next data that starts a message.
+ * With a BodyCapturePolicy, body bytes beyond the policy's limit for the message are reported as dropped so they can be left out of the capture
+ * files, and getDiscardableBytes() tells how much of a body the reassembler can skip without copying. With a RedactionPolicy, the values of the
+ * policy's headers and query parameters are reported as they stream by (a value split over chunks in pieces), so they can be replaced when the
+ * data is written; that's one more look at the bytes of each line the parser keeps anyway. The full transaction (endpoints, request, status,
+ * body sizes and both times) is also handed to an optional OnHttpTransactionComplete callback
+ */
+class HttpTransactionTracker
+{
+public:
+
+	/**
+	 * A c'tor for this class
+	 * @param[in] connData The connection, its endpoints are copied for the transaction records
+	 * @param[in] clientSide The side of the connection (0 or 1) which sends the requests
+	 * @param[in] latencyTable The table completed transactions are recorded in
+	 * @param[in] trafficStats The traffic statistics requests are counted in. Optional
+	 * @param[in] onTransactionComplete The callback to invoke for every completed transaction. Optional
+	 * @param[in] userCookie A cookie passed to the callback
+	 * @param[in] bodyPolicy The policy which limits the body bytes kept. Optional, if NULL all bodies are kept whole
+	 * @param[in] redactionPolicy The policy which picks the header and query parameter values to redact. Optional, if NULL nothing is redacted
+	 */
+	HttpTransactionTracker(const pcpp::ConnectionData& connData, int clientSide, HttpLatencyTable* latencyTable, TrafficStats* trafficStats = NULL,
+			OnHttpTransactionComplete onTransactionComplete = NULL, void* userCookie = NULL, const BodyCapturePolicy* bodyPolicy = NULL,
+			const RedactionPolicy* redactionPolicy = NULL);
+
+	/**
+	 * Feed the next chunk of stream data from one side of the connection
+	 * @param[in] side The side of the connection (0 or 1)
+	 * @param[in] data The stream data
+	 * @param[in] dataLen The stream data length
+	 * @param[in] timestamp The capture time of the packet which carried the data
+	 * @param[out] droppedSpans If not NULL, the ranges of the data which the body capture policy drops are appended to it (in order, not merged
+	 * with ranges of previous chunks)
+	 * @param[out] redactedSpans If not NULL, the ranges of the data which the redaction policy replaces are appended to it (in order). They never
+	 * overlap the dropped ranges. Data the parser can't make sense of (after a hole, or a connection picked up mid-stream) is masked whole
+	 * until a message starts again, so nothing the policy covers is written in the clear
+	 */
+	void feed(int side, const uint8_t* data, size_t dataLen, const timeval& timestamp, std::vector<StreamSpan>* droppedSpans = NULL,
+			std::vector<RedactedSpan>* redactedSpans = NULL);
+
+	/**
+	 * Report that data is missing from one side's stream
+	 * @param[in] side The side of the connection (0 or 1)
+	 * @param[in] missingDataLen The number of bytes missing
+	 */
+	void skipMissingData(int side, uint32_t missingDataLen);
+
+	/**
+	 * Report that the connection ended, completes a response which is delimited by the connection close
+	 */
+	void finish();
+
+	/**
+	 * @param[in] side The side of the connection (0 or 1)
+	 * @return How many of the side's upcoming stream bytes are dropped by the body capture policy and needn't be delivered at all. It's the rest
+	 * of a body of known length (or of a chunk) past the limit, except for its last byte, which still has to arrive to time the message. 0 if
+	 * the upcoming bytes are needed
+	 */
+	uint32_t getDiscardableBytes(int side) const;
+
+	/**
+	 * Skip stream bytes which the caller won't deliver, after getDiscardableBytes() said they can be discarded
+	 * @param[in] side The side of the connection (0 or 1)
+	 * @param[in] numOfBytes The number of bytes skipped, at most what getDiscardableBytes() returned
+	 */
+	void discardData(int side, uint32_t numOfBytes);
+
+	/**
+	 * @param[in] side The side of the connection (0 or 1)
+	 * @return How many replaced bytes of a hashed value the side's redacted spans still owe: a value split over chunks holds back the bytes its
+	 * digest will be written over until it ends. If the connection ends first, the caller writes them masked
+	 */
+	uint32_t getHeldRedactedBytes(int side) const { return (uint32_t)m_Parsers[side].redactHeldLen; }
+
+	/**
+	 * @return True if the connection switched to another protocol (101 Switching Protocols or a successful CONNECT), after which nothing is parsed
+	 */
+	bool isUpgraded() const { return m_Upgraded; }
+
+	/**
+	 * @return The Upgrade header of the 101 Switching Protocols response (e.g. "websocket" or "h2c"), an empty string if there was none or
+	 * the connection isn't upgraded
+	 */
+	const char* getUpgradeProtocol() const { return m_UpgradeProtocol; }
+
+	/**
+	 * Get the request of an h2c upgrade, which the server answers again on HTTP/2 stream 1. The 101 response doesn't complete it, so it's left
+	 * to the Http2TransactionTracker the connection switches to
+	 * @param[out] request The request's endpoints, method, host, URI, first byte time and body size. The response fields are zeroed, and the
+	 * strings stay valid for the life of the tracker
+	 * @param[out] lastByteTime The capture time of the request's last byte
+	 * @return False if the connection wasn't upgraded to h2c or its request wasn't seen
+	 */
+	bool getUpgradeRequest(HttpTransaction& request, timeval& lastByteTime) const;
+
+	/**
+	 * @return Where the other protocol starts in the data of the feed() call which upgraded the connection, i.e. the length of the upgrading
+	 * response's part of that data
+	 */
+	size_t getUpgradeOffset() const { return m_UpgradeOffset; }
+
+	/**
+	 * Set the name the transactions of the connection are labelled with (empty by default)
+	 * @param[in] serverName The name the server's address was resolved from, cut at HTTP_MAX_SERVER_NAME_LEN
+	 */
+	void setServerName(const char* serverName);
+
+	/**
+	 * Count a payload pattern match in the connection's data. Matches are reported with the next transaction which completes
+	 * @param[in] label The label of the pattern, must stay valid for the life of the tracker
+	 */
+	void addPatternMatch(const char* label);
+
+	// stats: completed transactions and final responses which had no request to pair with
+	uint32_t numOfTransactions;
+	uint32_t numOfUnmatchedResponses;
+
+private:
+
+	/**
+	 * Where the redaction scan is within the current line
+	 */
+	enum RedactionState
+	{
+		RedactMethod,
+		RedactPath,
+		RedactParamName,
+		RedactParamValue,
+		RedactHeaderName,
+		RedactHeaderValueStart,
+		RedactHeaderValue,
+		// nothing more to redact on the line
+		RedactLineRest
+	};
+
+	enum ParserState
+	{
+		StartLine,
+		Headers,
+		BodyByLength,
+		ChunkSize,
+		ChunkData,
+		ChunkDataEnd,
+		ChunkTrailer,
+		BodyUntilClose,
+		// lost sync after a hole, waiting for data which starts a message
+		Lost
+	};
+
+	/**
+	 * The streaming parser state of one direction
+	 */
+	struct MessageParser
+	{
+		ParserState state;
+		char line[HTTP_MAX_LINE_LEN + 1];
+		size_t lineLen;
+		uint64_t bodyRemaining;
+		bool chunked;
+		bool hasContentLength;
+		uint64_t contentLength;
+		uint64_t bodyBytes;
+		char contentType[HTTP_MAX_CONTENT_TYPE_LEN + 1];
+		char upgrade[HTTP_MAX_UPGRADE_LEN + 1];
+		uint64_t bodyLimit;
+		bool messageStarted;
+		timeval firstByteTime;
+		timeval lastByteTime;
+		int statusCode;
+
+		// the redaction scan of the current line: the header / parameter name so far (longer names match no rule), the value being redacted
+		// (if redactAction isn't -1), its length so far and its digest
+		bool redactLineStarted;
+		RedactionState redactState;
+		char redactName[REDACTION_MAX_NAME_LEN + 1];
+		size_t redactNameLen;
+		int redactAction;
+		size_t redactValueLen;
+		Md5 redactDigest;
+
+		// the replaced bytes of a hashed value which weren't written yet, they're written with the value's last piece (or masked if it's cut off)
+		size_t redactHeldLen;
+	};
+
+	/**
+	 * A request waiting for its response
+	 */
+	struct PendingRequest
+	{
+		char method[HTTP_MAX_METHOD_LEN + 1];
+		char host[LATENCY_MAX_HOST_LEN + 1];
+		char uri[LATENCY_MAX_URI_LEN + 1];
+		bool isHead;
+		bool isConnect;
+		timeval firstByteTime;
+		timeval lastByteTime;
+		uint64_t bodyBytes;
+	};
+
+	HttpLatencyTable* m_LatencyTable;
+	TrafficStats* m_TrafficStats;
+	const BodyCapturePolicy* m_BodyPolicy;
+	const RedactionPolicy* m_RedactionPolicy;
+	OnHttpTransactionComplete m_OnTransactionComplete;
+	void* m_UserCookie;
+	int m_ClientSide;
+	char m_ClientIP[HTTP_MAX_IP_STRING_LEN];
+	char m_ServerIP[HTTP_MAX_IP_STRING_LEN];
+	char m_ServerName[HTTP_MAX_SERVER_NAME_LEN + 1];
+	uint16_t m_ClientPort;
+	uint16_t m_ServerPort;
+	bool m_Upgraded;
+	char m_UpgradeProtocol[HTTP_MAX_UPGRADE_LEN + 1];
+	size_t m_UpgradeOffset;
+	uint32_t m_PatternMatches;
+	const char* m_MatchedPattern;
+	MessageParser m_Parsers[2];
+
+	// the FIFO of pending requests, addressed by ever growing sequence numbers
+	PendingRequest m_Pending[HTTP_MAX_PENDING_REQUESTS];
+	uint32_t m_PendingHead;
+	uint32_t m_PendingTail;
+
+	// the sequence number of the request currently being parsed, if it has a FIFO slot
+	bool m_ParsingRequestTracked;
+	uint32_t m_ParsingRequestSeq;
+
+	// whether the response being parsed was paired with the request at the FIFO head
+	bool m_ResponsePaired;
+
+	void resetParser(MessageParser& parser, ParserState state);
+	size_t consumeLine(MessageParser& parser, const uint8_t* data, size_t dataLen, bool& lineComplete);
+	void handleRequestLine(MessageParser& parser, const timeval& timestamp);
+	void handleResponseLine(MessageParser& parser, const timeval& timestamp);
+	void handleHeadersEnd(bool isRequest, MessageParser& parser);
+	void completeMessage(bool isRequest, MessageParser& parser);
+	void dropPendingRequests();
+	void keepBodyBytes(MessageParser& parser, size_t offset, size_t numOfBytes, std::vector<StreamSpan>* droppedSpans);
+	void redactLineSegment(MessageParser& parser, const uint8_t* data, size_t segmentLen, size_t offset, bool lineComplete,
+			std::vector<RedactedSpan>* redactedSpans);
+	void startRedactedValue(MessageParser& parser, bool isHeader);
+	void addRedactedPiece(MessageParser& parser, const uint8_t* data, size_t offset, size_t length, bool valueEnds,
+			std::vector<RedactedSpan>* redactedSpans);
+	void maskLostData(MessageParser& parser, size_t offset, size_t length, std::vector<RedactedSpan>* redactedSpans);
+	void appendRedactionName(MessageParser& parser, const uint8_t* data, size_t dataLen);
+	static bool looksLikeMessageStart(bool isRequest, const uint8_t* data, size_t dataLen);
+};
+
+#endif /* HTTPECHO_HTTP_TRANSACTION_TRACKER */
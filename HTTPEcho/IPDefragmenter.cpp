@@ -0,0 +1,434 @@
+#include <string.h>
+#include <arpa/inet.h>
+#include <new>
+#include "IPDefragmenter.h"
+#include "LinkLayerUtils.h"
+#include "PacketBufferPool.h"
+
+// room kept in front of each datagram buffer for the link + IP headers of the first fragment
+#define HEADERS_HEADROOM 256
+
+// the largest IP payload that can be reassembled
+#define MAX_DATAGRAM_PAYLOAD 65535
+
+// size of the received-blocks bitmap (one bit per 8-byte fragment block)
+#define BLOCK_BITMAP_SIZE ((MAX_DATAGRAM_PAYLOAD / 8 + 1 + 7) / 8)
+
+// number of consecutive table slots checked when looking up a datagram
+#define SLOT_PROBE_WINDOW 8
+
+#define IPV6_FRAGMENT_HEADER 44
+
+
+static inline uint16_t read16(const uint8_t* ptr)
+{
+	uint16_t val;
+	memcpy(&val, ptr, sizeof(val));
+	return ntohs(val);
+}
+
+static inline uint32_t read32(const uint8_t* ptr)
+{
+	uint32_t val;
+	memcpy(&val, ptr, sizeof(val));
+	return ntohl(val);
+}
+
+static inline void write16(uint8_t* ptr, uint16_t val)
+{
+	val = htons(val);
+	memcpy(ptr, &val, sizeof(val));
+}
+
+
+/**
+ * Compute the IPv4 header checksum of a header whose checksum field is already zeroed
+ */
+static uint16_t computeIPv4Checksum(const uint8_t* ipHeader, size_t headerLen)
+{
+	uint32_t sum = 0;
+	for (size_t i = 0; i + 1 < headerLen; i += 2)
+		sum += (uint32_t)((ipHeader[i] << 8) | ipHeader[i + 1]);
+
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return (uint16_t)~sum;
+}
+
+
+IPDefragmenter::IPDefragmenter(size_t maxDatagrams, uint32_t timeoutSec)
+{
+	numOfFragments = 0;
+	numOfReassembled = 0;
+	numOfMalformed = 0;
+	numOfEvicted = 0;
+
+	// round the table size up to a power of 2 so a slot index is a mask away from the hash
+	m_NumOfSlots = SLOT_PROBE_WINDOW;
+	while (m_NumOfSlots < maxDatagrams)
+		m_NumOfSlots <<= 1;
+	m_SlotMask = m_NumOfSlots - 1;
+	m_NumOfActiveSlots = 0;
+	m_TimeoutSec = timeoutSec;
+
+	m_Slots = new DatagramSlot[m_NumOfSlots];
+	// the datagram buffers are large and touched at random offsets, keep them on huge pages
+	m_BufferPool = (uint8_t*)allocateHugePageMemory(m_NumOfSlots * (HEADERS_HEADROOM + MAX_DATAGRAM_PAYLOAD));
+	if (m_BufferPool == NULL)
+		throw std::bad_alloc();
+	m_BitmapPool = new uint8_t[m_NumOfSlots * BLOCK_BITMAP_SIZE];
+
+	for (size_t i = 0; i < m_NumOfSlots; i++)
+	{
+		memset(&m_Slots[i], 0, sizeof(DatagramSlot));
+		m_Slots[i].buffer = m_BufferPool + i * (HEADERS_HEADROOM + MAX_DATAGRAM_PAYLOAD);
+		m_Slots[i].blockBitmap = m_BitmapPool + i * BLOCK_BITMAP_SIZE;
+	}
+
+	// the reassembled packet never owns its data, it always points into one of the slot buffers
+	timeval zeroTime = timeval();
+	m_ReassembledPacket = new pcpp::RawPacket(m_BufferPool, 0, zeroTime, false);
+}
+
+
+IPDefragmenter::~IPDefragmenter()
+{
+	delete m_ReassembledPacket;
+	delete [] m_Slots;
+	freeHugePageMemory(m_BufferPool, m_NumOfSlots * (HEADERS_HEADROOM + MAX_DATAGRAM_PAYLOAD));
+	delete [] m_BitmapPool;
+}
+
+
+uint32_t IPDefragmenter::hashKey(const DatagramKey& key)
+{
+	// FNV-1a over the key bytes
+	const uint8_t* bytes = (const uint8_t*)&key;
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < sizeof(DatagramKey); i++)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+
+void IPDefragmenter::releaseSlot(DatagramSlot* slot)
+{
+	slot->inUse = false;
+	m_NumOfActiveSlots--;
+}
+
+
+IPDefragmenter::DatagramSlot* IPDefragmenter::findOrCreateSlot(const DatagramKey& key, const timeval& now)
+{
+	size_t home = hashKey(key);
+	DatagramSlot* freeSlot = NULL;
+	DatagramSlot* oldestSlot = NULL;
+
+	for (size_t i = 0; i < SLOT_PROBE_WINDOW; i++)
+	{
+		DatagramSlot* slot = &m_Slots[(home + i) & m_SlotMask];
+
+		if (slot->inUse)
+		{
+			bool expired = (now.tv_sec - slot->lastSeen.tv_sec) > (long)m_TimeoutSec;
+
+			if (!expired && memcmp(&slot->key, &key, sizeof(DatagramKey)) == 0)
+				return slot;
+
+			// drop datagrams which didn't complete in time, this slot can be reused
+			if (expired)
+			{
+				releaseSlot(slot);
+				numOfEvicted++;
+			}
+		}
+
+		if (!slot->inUse)
+		{
+			if (freeSlot == NULL)
+				freeSlot = slot;
+			continue;
+		}
+
+		if (oldestSlot == NULL || slot->lastSeen.tv_sec < oldestSlot->lastSeen.tv_sec)
+			oldestSlot = slot;
+	}
+
+	// the probe window is full - drop the datagram which was updated least recently
+	if (freeSlot == NULL)
+	{
+		releaseSlot(oldestSlot);
+		numOfEvicted++;
+		freeSlot = oldestSlot;
+	}
+
+	freeSlot->key = key;
+	freeSlot->inUse = true;
+	freeSlot->gotFirstFragment = false;
+	freeSlot->totalPayloadLen = 0;
+	freeSlot->numOfBlocksReceived = 0;
+	freeSlot->endOfBlocksReceived = 0;
+	freeSlot->headersLen = 0;
+	memset(freeSlot->blockBitmap, 0, BLOCK_BITMAP_SIZE);
+	m_NumOfActiveSlots++;
+
+	return freeSlot;
+}
+
+
+bool IPDefragmenter::addFragment(DatagramSlot* slot, const uint8_t* payload, size_t payloadLen, uint32_t offset, bool moreFragments)
+{
+	if (offset + payloadLen > MAX_DATAGRAM_PAYLOAD)
+		return false;
+
+	if (moreFragments)
+	{
+		// all fragments but the last must carry a non-empty multiple of 8 bytes
+		if (payloadLen == 0 || (payloadLen % 8) != 0)
+			return false;
+
+		// data past the end of the datagram
+		if (slot->totalPayloadLen != 0 && offset + payloadLen > slot->totalPayloadLen)
+			return false;
+	}
+	else
+	{
+		// two different "last" fragments
+		if (slot->totalPayloadLen != 0 && slot->totalPayloadLen != offset + payloadLen)
+			return false;
+
+		// a fragment received earlier went past the end this one sets
+		if (slot->endOfBlocksReceived > (offset + payloadLen + 7) / 8)
+			return false;
+		slot->totalPayloadLen = (uint32_t)(offset + payloadLen);
+	}
+
+	memcpy(slot->buffer + HEADERS_HEADROOM + offset, payload, payloadLen);
+
+	// mark received blocks. Overlapping and duplicate fragments only count blocks that weren't seen before. Since no block past the end of the
+	// datagram is ever kept, the datagram is covered exactly when the count reaches its number of blocks
+	uint32_t firstBlock = offset / 8;
+	uint32_t endBlock = (uint32_t)((offset + payloadLen + 7) / 8);
+	if (endBlock > slot->endOfBlocksReceived)
+		slot->endOfBlocksReceived = endBlock;
+	for (uint32_t block = firstBlock; block < endBlock; block++)
+	{
+		uint8_t mask = (uint8_t)(1 << (block & 7));
+		if ((slot->blockBitmap[block >> 3] & mask) == 0)
+		{
+			slot->blockBitmap[block >> 3] |= mask;
+			slot->numOfBlocksReceived++;
+		}
+	}
+
+	return true;
+}
+
+
+pcpp::RawPacket* IPDefragmenter::buildReassembledPacket(DatagramSlot* slot, const timeval& timestamp)
+{
+	// the headers of the first fragment were saved right in front of the payload, so the frame is contiguous
+	uint8_t* frame = slot->buffer + HEADERS_HEADROOM - slot->headersLen;
+	uint8_t* ipHeader = frame + slot->ipHeaderOffset;
+	size_t ipHeadersLen = slot->headersLen - slot->ipHeaderOffset;
+
+	if (slot->key.ipVersion == 4)
+	{
+		if (ipHeadersLen + slot->totalPayloadLen > 0xffff)
+			return NULL;
+
+		write16(ipHeader + 2, (uint16_t)(ipHeadersLen + slot->totalPayloadLen));
+		// keep only the DF bit, clear MF and the offset
+		write16(ipHeader + 6, read16(ipHeader + 6) & 0x4000);
+		write16(ipHeader + 10, 0);
+		write16(ipHeader + 10, computeIPv4Checksum(ipHeader, ipHeadersLen));
+	}
+	else
+	{
+		if (ipHeadersLen - 40 + slot->totalPayloadLen > 0xffff)
+			return NULL;
+
+		// the fragment header was left out of the saved headers - link the previous header directly to the upper layer protocol
+		write16(ipHeader + 4, (uint16_t)(ipHeadersLen - 40 + slot->totalPayloadLen));
+		frame[slot->nextHeaderFieldOffset] = slot->nextHeaderValue;
+	}
+
+	m_ReassembledPacket->setRawData(frame, (int)(slot->headersLen + slot->totalPayloadLen), timestamp, slot->linkType);
+
+	return m_ReassembledPacket;
+}
+
+
+pcpp::RawPacket* IPDefragmenter::processPacket(pcpp::RawPacket* packet, Status& status)
+{
+	const uint8_t* data = packet->getRawDataReadOnly();
+	size_t dataLen = (size_t)packet->getRawDataLen();
+	size_t l3Offset = 0;
+
+	int ipVersion = locateNetworkLayer(data, dataLen, packet->getLinkLayerType(), l3Offset);
+	if (ipVersion == 0)
+	{
+		status = NonIPPacket;
+		return packet;
+	}
+
+	const uint8_t* ipHeader = data + l3Offset;
+	DatagramKey key;
+	const uint8_t* payload;
+	size_t payloadLen;
+	uint32_t offset;
+	bool moreFragments;
+	size_t headersLen;
+	size_t nextHeaderFieldOffset = 0;
+	uint8_t nextHeaderValue = 0;
+
+	if (ipVersion == 4)
+	{
+		// the common case: neither "more fragments" nor a fragment offset
+		uint16_t fragmentField = read16(ipHeader + 6);
+		if ((fragmentField & 0x3fff) == 0)
+		{
+			status = NonFragment;
+			return packet;
+		}
+
+		numOfFragments++;
+
+		size_t ihl = (ipHeader[0] & 0x0f) * 4;
+		size_t totalLen = read16(ipHeader + 2);
+		if (ihl < 20 || totalLen < ihl || l3Offset + totalLen > dataLen)
+		{
+			numOfMalformed++;
+			status = MalformedFragment;
+			return NULL;
+		}
+
+		memset(&key, 0, sizeof(key));
+		memcpy(key.srcIP, ipHeader + 12, 4);
+		memcpy(key.dstIP, ipHeader + 16, 4);
+		key.fragmentID = read16(ipHeader + 4);
+		key.ipVersion = 4;
+		key.protocol = ipHeader[9];
+
+		payload = ipHeader + ihl;
+		payloadLen = totalLen - ihl;
+		offset = (uint32_t)(fragmentField & 0x1fff) * 8;
+		moreFragments = (fragmentField & 0x2000) != 0;
+		headersLen = l3Offset + ihl;
+	}
+	else
+	{
+		// the common case: the fixed header is followed directly by the transport layer
+		uint8_t nextHeader = ipHeader[6];
+		if (nextHeader != IPV6_FRAGMENT_HEADER && !isIPv6UnfragmentableExtension(nextHeader))
+		{
+			status = NonFragment;
+			return packet;
+		}
+
+		size_t ipEnd = 40 + read16(ipHeader + 4);
+		if (l3Offset + ipEnd > dataLen)
+			ipEnd = dataLen - l3Offset;
+
+		// walk the extension headers which may precede the fragment header
+		size_t extOffset = 40;
+		nextHeaderFieldOffset = 6;
+		while (isIPv6UnfragmentableExtension(nextHeader))
+		{
+			if (extOffset + 8 > ipEnd)
+				break;
+			nextHeaderFieldOffset = extOffset;
+			nextHeader = ipHeader[extOffset];
+			extOffset += (ipHeader[extOffset + 1] + 1) * 8;
+		}
+
+		if (nextHeader != IPV6_FRAGMENT_HEADER)
+		{
+			status = NonFragment;
+			return packet;
+		}
+
+		numOfFragments++;
+
+		if (extOffset + 8 > ipEnd)
+		{
+			numOfMalformed++;
+			status = MalformedFragment;
+			return NULL;
+		}
+
+		const uint8_t* fragmentHeader = ipHeader + extOffset;
+		uint16_t fragmentField = read16(fragmentHeader + 2);
+
+		memset(&key, 0, sizeof(key));
+		memcpy(key.srcIP, ipHeader + 8, 16);
+		memcpy(key.dstIP, ipHeader + 24, 16);
+		key.fragmentID = read32(fragmentHeader + 4);
+		key.ipVersion = 6;
+
+		payload = fragmentHeader + 8;
+		payloadLen = ipEnd - extOffset - 8;
+		offset = fragmentField & 0xfff8;
+		moreFragments = (fragmentField & 0x0001) != 0;
+		headersLen = l3Offset + extOffset;
+		nextHeaderFieldOffset += l3Offset;
+		nextHeaderValue = fragmentHeader[0];
+	}
+
+	if (headersLen > HEADERS_HEADROOM)
+	{
+		numOfMalformed++;
+		status = MalformedFragment;
+		return NULL;
+	}
+
+	timeval timestamp = packet->getPacketTimeStamp();
+	DatagramSlot* slot = findOrCreateSlot(key, timestamp);
+	slot->lastSeen = timestamp;
+
+	if (!addFragment(slot, payload, payloadLen, offset, moreFragments))
+	{
+		releaseSlot(slot);
+		numOfMalformed++;
+		status = MalformedFragment;
+		return NULL;
+	}
+
+	// save the link and IP headers of the first fragment right in front of the payload area
+	if (offset == 0 && !slot->gotFirstFragment)
+	{
+		memcpy(slot->buffer + HEADERS_HEADROOM - headersLen, data, headersLen);
+		slot->gotFirstFragment = true;
+		slot->headersLen = (uint32_t)headersLen;
+		slot->ipHeaderOffset = (uint32_t)l3Offset;
+		slot->nextHeaderFieldOffset = (uint32_t)nextHeaderFieldOffset;
+		slot->nextHeaderValue = nextHeaderValue;
+		slot->linkType = packet->getLinkLayerType();
+	}
+
+	// the datagram is complete once the first and last fragments arrived and every block in between is covered
+	if (!slot->gotFirstFragment || slot->totalPayloadLen == 0 || slot->numOfBlocksReceived < (slot->totalPayloadLen + 7) / 8)
+	{
+		status = FragmentStored;
+		return NULL;
+	}
+
+	releaseSlot(slot);
+
+	pcpp::RawPacket* reassembled = buildReassembledPacket(slot, timestamp);
+	if (reassembled == NULL)
+	{
+		numOfMalformed++;
+		status = MalformedFragment;
+		return NULL;
+	}
+
+	numOfReassembled++;
+	status = Reassembled;
+	return reassembled;
+}
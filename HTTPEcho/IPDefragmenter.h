@@ -0,0 +1,131 @@
+#ifndef HTTPECHO_IP_DEFRAGMENTER
+#define HTTPECHO_IP_DEFRAGMENTER
+
+#include <stdint.h>
+#include <stddef.h>
+#include "header/RawPacket.h"
+
+// default number of datagrams that can be under reassembly at the same time
+#define DEFAULT_MAX_DATAGRAMS_IN_REASSEMBLY 64
+
+// default time (in seconds, packet time) after which an incomplete datagram is dropped
+#define DEFAULT_FRAGMENT_TIMEOUT_SEC 30
+
+
+/**
+ * An IPv4/IPv6 defragmentation stage which sits in front of the TCP reassembly.
+ * It serves the same purpose as pcpp::IPReassembly but is built for a pipeline where almost nothing is fragmented:
+ * - An unfragmented packet costs one look at the link and IP headers, the packet is never parsed into layers or copied
+ * - Datagrams under reassembly are kept in a fixed size open-addressing table (instead of std::map + LRUList), probed in a short window
+ * - All fragment buffers are preallocated at construction, so no memory is allocated per fragment or per datagram
+ * - The reassembled datagram (link header + IP header + full payload) is built in place in the datagram's buffer and handed back as a RawPacket
+ *   that doesn't own its data
+ */
+class IPDefragmenter
+{
+public:
+
+	/**
+	 * The result of processing a single packet
+	 */
+	enum Status
+	{
+		// the packet isn't IPv4/IPv6 (or is truncated)
+		NonIPPacket,
+		// the packet isn't fragmented, process it as is
+		NonFragment,
+		// the packet is a fragment and was stored, nothing to process yet
+		FragmentStored,
+		// the packet completed a datagram, process the returned reassembled packet
+		Reassembled,
+		// the packet is a fragment which can't be reassembled (bad offsets, too big, headers too long) and was dropped
+		MalformedFragment
+	};
+
+	/**
+	 * A c'tor for this class. Allocates all fragment buffers up front
+	 * @param[in] maxDatagrams The max number of datagrams that can be under reassembly at the same time. When the table is full the oldest datagram
+	 * in the probe window is dropped
+	 * @param[in] timeoutSec An incomplete datagram which hasn't seen a fragment for this many seconds is dropped
+	 */
+	IPDefragmenter(size_t maxDatagrams = DEFAULT_MAX_DATAGRAMS_IN_REASSEMBLY, uint32_t timeoutSec = DEFAULT_FRAGMENT_TIMEOUT_SEC);
+
+	/**
+	 * A d'tor for this class, frees all fragment buffers
+	 */
+	~IPDefragmenter();
+
+	/**
+	 * Process a single packet
+	 * @param[in] packet The packet to process
+	 * @param[out] status The processing result
+	 * @return The packet that should continue down the pipeline: the input packet itself if it isn't fragmented (or isn't IP), the reassembled
+	 * packet if this fragment completed a datagram, or NULL if the fragment was stored or dropped. A reassembled packet is only valid until the
+	 * next call to this method
+	 */
+	pcpp::RawPacket* processPacket(pcpp::RawPacket* packet, Status& status);
+
+	/**
+	 * @return The number of datagrams currently under reassembly
+	 */
+	size_t getNumOfDatagramsInReassembly() const { return m_NumOfActiveSlots; }
+
+	// stats data
+	uint64_t numOfFragments;
+	uint64_t numOfReassembled;
+	uint64_t numOfMalformed;
+	uint64_t numOfEvicted;
+
+private:
+
+	/**
+	 * Identifies the datagram a fragment belongs to. Kept as plain bytes so keys can be compared with memcmp
+	 */
+	struct DatagramKey
+	{
+		uint8_t srcIP[16];
+		uint8_t dstIP[16];
+		uint32_t fragmentID;
+		uint8_t ipVersion;
+		uint8_t protocol;
+		uint16_t reserved;
+	};
+
+	/**
+	 * A slot in the fragment table. Each slot owns a preallocated buffer of HEADROOM + max payload size and a bitmap of received 8-byte blocks
+	 */
+	struct DatagramSlot
+	{
+		DatagramKey key;
+		bool inUse;
+		bool gotFirstFragment;
+		uint32_t totalPayloadLen;     // 0 until the last fragment is seen
+		uint32_t numOfBlocksReceived; // number of 8-byte blocks received so far
+		uint32_t endOfBlocksReceived; // one past the highest 8-byte block received so far
+		uint32_t headersLen;          // length of link + IP headers saved from the first fragment
+		uint32_t nextHeaderFieldOffset; // IPv6 only: where the next header field pointing to the fragment header is, inside the saved headers
+		uint8_t nextHeaderValue;      // IPv6 only: the protocol which follows the fragment header
+		uint32_t ipHeaderOffset;      // offset of the IP header inside the saved headers
+		pcpp::LinkLayerType linkType;
+		timeval lastSeen;
+		uint8_t* buffer;
+		uint8_t* blockBitmap;
+	};
+
+	DatagramSlot* m_Slots;
+	size_t m_NumOfSlots;
+	size_t m_SlotMask;
+	size_t m_NumOfActiveSlots;
+	uint32_t m_TimeoutSec;
+	uint8_t* m_BufferPool;
+	uint8_t* m_BitmapPool;
+	pcpp::RawPacket* m_ReassembledPacket;
+
+	DatagramSlot* findOrCreateSlot(const DatagramKey& key, const timeval& now);
+	void releaseSlot(DatagramSlot* slot);
+	bool addFragment(DatagramSlot* slot, const uint8_t* payload, size_t payloadLen, uint32_t offset, bool moreFragments);
+	pcpp::RawPacket* buildReassembledPacket(DatagramSlot* slot, const timeval& timestamp);
+	static uint32_t hashKey(const DatagramKey& key);
+};
+
+#endif /* HTTPECHO_IP_DEFRAGMENTER */
@@ -0,0 +1,89 @@
+#include <string.h>
+#include "LatencyHistogram.h"
+
+
+size_t LatencyHistogram::getBucketIndex(uint64_t value)
+{
+	// the first sub-buckets hold the small values exactly
+	if (value < LATENCY_HISTOGRAM_SUB_BUCKETS)
+		return (size_t)value;
+
+	if (value >= (1ULL << LATENCY_HISTOGRAM_MAX_VALUE_BITS))
+		return LATENCY_HISTOGRAM_NUM_OF_BUCKETS - 1;
+
+	// the power of 2 selects the bucket group, the bits right below the leading one select the sub-bucket
+	int msb = 63 - __builtin_clzll(value);
+	int shift = msb - LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+	return (size_t)(shift + 1) * LATENCY_HISTOGRAM_SUB_BUCKETS + (size_t)((value >> shift) & (LATENCY_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+
+uint64_t LatencyHistogram::getBucketMiddle(size_t index)
+{
+	if (index < LATENCY_HISTOGRAM_SUB_BUCKETS)
+		return (uint64_t)index;
+
+	int shift = (int)(index / LATENCY_HISTOGRAM_SUB_BUCKETS) - 1;
+	uint64_t subBucket = index % LATENCY_HISTOGRAM_SUB_BUCKETS;
+	uint64_t lowerBound = (LATENCY_HISTOGRAM_SUB_BUCKETS + subBucket) << shift;
+	return lowerBound + ((1ULL << shift) >> 1);
+}
+
+
+void LatencyHistogram::record(uint64_t valueUsec)
+{
+	m_Buckets[getBucketIndex(valueUsec)]++;
+	m_Count++;
+	m_Sum += valueUsec;
+	if (valueUsec > m_Max)
+		m_Max = valueUsec;
+}
+
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+	for (size_t i = 0; i < LATENCY_HISTOGRAM_NUM_OF_BUCKETS; i++)
+		m_Buckets[i] += other.m_Buckets[i];
+
+	m_Count += other.m_Count;
+	m_Sum += other.m_Sum;
+	if (other.m_Max > m_Max)
+		m_Max = other.m_Max;
+}
+
+
+void LatencyHistogram::clear()
+{
+	memset(m_Buckets, 0, sizeof(m_Buckets));
+	m_Count = 0;
+	m_Sum = 0;
+	m_Max = 0;
+}
+
+
+uint64_t LatencyHistogram::getValueAtPercentile(double percentile) const
+{
+	if (m_Count == 0)
+		return 0;
+
+	// the rank of the requested value, 1-based
+	uint64_t rank = (uint64_t)(percentile / 100.0 * (double)m_Count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	if (rank > m_Count)
+		rank = m_Count;
+
+	uint64_t seen = 0;
+	for (size_t i = 0; i < LATENCY_HISTOGRAM_NUM_OF_BUCKETS; i++)
+	{
+		seen += m_Buckets[i];
+		if (seen >= rank)
+		{
+			// never report more than what was actually seen
+			uint64_t value = getBucketMiddle(i);
+			return (value > m_Max ? m_Max : value);
+		}
+	}
+
+	return m_Max;
+}
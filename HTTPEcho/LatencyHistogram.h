@@ -0,0 +1,80 @@
+#ifndef HTTPECHO_LATENCY_HISTOGRAM
+#define HTTPECHO_LATENCY_HISTOGRAM
+
+#include <stdint.h>
+#include <stddef.h>
+
+// each power of 2 is split into this many linear sub-buckets, which bounds the relative error of a reported value to 1/16
+#define LATENCY_HISTOGRAM_SUB_BUCKET_BITS 3
+#define LATENCY_HISTOGRAM_SUB_BUCKETS (1 << LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+
+// values are recorded in microseconds, anything at or above 2^36 usec (~19 hours) goes to the last bucket
+#define LATENCY_HISTOGRAM_MAX_VALUE_BITS 36
+
+#define LATENCY_HISTOGRAM_NUM_OF_BUCKETS ((LATENCY_HISTOGRAM_MAX_VALUE_BITS - LATENCY_HISTOGRAM_SUB_BUCKET_BITS + 1) * LATENCY_HISTOGRAM_SUB_BUCKETS)
+
+
+/**
+ * A fixed size log-linear histogram of latency values (in microseconds), in the spirit of HdrHistogram: values are bucketed by their power of 2 and
+ * then linearly inside it, so every value is kept with a bounded relative error and the memory footprint never grows.
+ * Recording a value is a few shifts and an increment. Histograms of the same layout can be merged, e.g to combine the results of several capture workers
+ */
+class LatencyHistogram
+{
+public:
+
+	/**
+	 * A c'tor for this class, creates an empty histogram
+	 */
+	LatencyHistogram() { clear(); }
+
+	/**
+	 * Record a single value
+	 * @param[in] valueUsec The value in microseconds
+	 */
+	void record(uint64_t valueUsec);
+
+	/**
+	 * Add all values recorded by another histogram to this one
+	 * @param[in] other The histogram to merge
+	 */
+	void merge(const LatencyHistogram& other);
+
+	/**
+	 * Remove all recorded values
+	 */
+	void clear();
+
+	/**
+	 * Get the value at a certain percentile
+	 * @param[in] percentile The percentile (0-100)
+	 * @return The value (in microseconds) at this percentile, represented by the middle of its bucket. 0 if the histogram is empty
+	 */
+	uint64_t getValueAtPercentile(double percentile) const;
+
+	/**
+	 * @return The number of values recorded
+	 */
+	uint64_t getCount() const { return m_Count; }
+
+	/**
+	 * @return The exact largest value recorded
+	 */
+	uint64_t getMax() const { return m_Max; }
+
+	/**
+	 * @return The exact mean of the recorded values
+	 */
+	double getMean() const { return m_Count == 0 ? 0.0 : (double)m_Sum / (double)m_Count; }
+
+private:
+	uint32_t m_Buckets[LATENCY_HISTOGRAM_NUM_OF_BUCKETS];
+	uint64_t m_Count;
+	uint64_t m_Sum;
+	uint64_t m_Max;
+
+	static size_t getBucketIndex(uint64_t value);
+	static uint64_t getBucketMiddle(size_t index);
+};
+
+#endif /* HTTPECHO_LATENCY_HISTOGRAM */
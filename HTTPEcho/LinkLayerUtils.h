@@ -0,0 +1,105 @@
+#ifndef HTTPECHO_LINK_LAYER_UTILS
+#define HTTPECHO_LINK_LAYER_UTILS
+
+#include <stdint.h>
+#include <stddef.h>
+#include <arpa/inet.h>
+#include "header/RawPacket.h"
+#include "header/EthLayer.h"
+
+// 802.1ad (QinQ) outer tag, not defined in EthLayer.h
+#define HTTPECHO_ETHERTYPE_QINQ 0x88a8
+
+
+/**
+ * Find where the network layer (IPv4/IPv6) header starts in a raw frame without building a pcpp::Packet. This is the cheap header check used by all
+ * the per-packet fast paths (defragmentation, flow classification, dispatching).
+ * Supported link layers are Ethernet (with any number of VLAN/QinQ tags), Linux cooked capture, BSD loopback and raw IP.
+ * @param[in] data The raw frame
+ * @param[in] dataLen The length of the raw frame
+ * @param[in] linkType The link layer type of the frame
+ * @param[out] l3Offset The offset of the network layer header inside the frame
+ * @return The IP version (4 or 6), or 0 if the frame doesn't carry IP or is truncated
+ */
+inline int locateNetworkLayer(const uint8_t* data, size_t dataLen, pcpp::LinkLayerType linkType, size_t& l3Offset)
+{
+	uint16_t etherType;
+
+	switch (linkType)
+	{
+	case pcpp::LINKTYPE_ETHERNET:
+	{
+		size_t offset = 12;
+		if (dataLen < offset + 2)
+			return 0;
+
+		etherType = (uint16_t)((data[offset] << 8) | data[offset + 1]);
+
+		// skip all VLAN tags
+		while (etherType == PCPP_ETHERTYPE_VLAN || etherType == HTTPECHO_ETHERTYPE_QINQ)
+		{
+			offset += 4;
+			if (dataLen < offset + 2)
+				return 0;
+			etherType = (uint16_t)((data[offset] << 8) | data[offset + 1]);
+		}
+
+		l3Offset = offset + 2;
+		break;
+	}
+
+	case pcpp::LINKTYPE_LINUX_SLL:
+		if (dataLen < 16)
+			return 0;
+		etherType = (uint16_t)((data[14] << 8) | data[15]);
+		l3Offset = 16;
+		break;
+
+	case pcpp::LINKTYPE_NULL:
+		l3Offset = 4;
+		etherType = 0;
+		break;
+
+	case pcpp::LINKTYPE_RAW:
+	case pcpp::LINKTYPE_DLT_RAW1:
+	case pcpp::LINKTYPE_DLT_RAW2:
+	case pcpp::LINKTYPE_IPV4:
+	case pcpp::LINKTYPE_IPV6:
+		l3Offset = 0;
+		etherType = 0;
+		break;
+
+	default:
+		return 0;
+	}
+
+	if (etherType == PCPP_ETHERTYPE_IP)
+		return (dataLen >= l3Offset + 20) ? 4 : 0;
+
+	if (etherType == PCPP_ETHERTYPE_IPV6)
+		return (dataLen >= l3Offset + 40) ? 6 : 0;
+
+	// link layers without an ether type - take the version from the IP header itself
+	if (etherType == 0 && dataLen > l3Offset)
+	{
+		int version = data[l3Offset] >> 4;
+		if (version == 4 && dataLen >= l3Offset + 20)
+			return 4;
+		if (version == 6 && dataLen >= l3Offset + 40)
+			return 6;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Returns true if the given IPv6 next header value is an extension header that may precede the fragment header
+ * (hop-by-hop options, routing or destination options)
+ */
+inline bool isIPv6UnfragmentableExtension(uint8_t nextHeader)
+{
+	return nextHeader == 0 || nextHeader == 43 || nextHeader == 60;
+}
+
+#endif /* HTTPECHO_LINK_LAYER_UTILS */
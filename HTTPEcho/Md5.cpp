@@ -0,0 +1,157 @@
+#include <string.h>
+#include "Md5.h"
+
+// per-round shift amounts
+static const uint32_t s_Shifts[64] = {
+	7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+	5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+	4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+	6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+// binary integer part of the sines of integers (in radians)
+static const uint32_t s_Constants[64] = {
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+	0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+	0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+	0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+	0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+	0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+
+void Md5::reset()
+{
+	m_State[0] = 0x67452301;
+	m_State[1] = 0xefcdab89;
+	m_State[2] = 0x98badcfe;
+	m_State[3] = 0x10325476;
+	m_TotalLen = 0;
+	m_BlockLen = 0;
+}
+
+
+void Md5::processBlock(const uint8_t* block)
+{
+	uint32_t words[16];
+	for (int i = 0; i < 16; i++)
+		words[i] = (uint32_t)block[i*4] | ((uint32_t)block[i*4 + 1] << 8) | ((uint32_t)block[i*4 + 2] << 16) | ((uint32_t)block[i*4 + 3] << 24);
+
+	uint32_t a = m_State[0], b = m_State[1], c = m_State[2], d = m_State[3];
+
+	for (int i = 0; i < 64; i++)
+	{
+		uint32_t f;
+		int g;
+
+		if (i < 16)
+		{
+			f = (b & c) | (~b & d);
+			g = i;
+		}
+		else if (i < 32)
+		{
+			f = (d & b) | (~d & c);
+			g = (5*i + 1) % 16;
+		}
+		else if (i < 48)
+		{
+			f = b ^ c ^ d;
+			g = (3*i + 5) % 16;
+		}
+		else
+		{
+			f = c ^ (b | ~d);
+			g = (7*i) % 16;
+		}
+
+		f = f + a + s_Constants[i] + words[g];
+		a = d;
+		d = c;
+		c = b;
+		b = b + ((f << s_Shifts[i]) | (f >> (32 - s_Shifts[i])));
+	}
+
+	m_State[0] += a;
+	m_State[1] += b;
+	m_State[2] += c;
+	m_State[3] += d;
+}
+
+
+void Md5::update(const uint8_t* data, size_t dataLen)
+{
+	m_TotalLen += dataLen;
+
+	// complete a partially filled block first
+	if (m_BlockLen > 0)
+	{
+		size_t toCopy = 64 - m_BlockLen;
+		if (toCopy > dataLen)
+			toCopy = dataLen;
+		memcpy(m_Block + m_BlockLen, data, toCopy);
+		m_BlockLen += toCopy;
+		data += toCopy;
+		dataLen -= toCopy;
+
+		if (m_BlockLen < 64)
+			return;
+
+		processBlock(m_Block);
+		m_BlockLen = 0;
+	}
+
+	while (dataLen >= 64)
+	{
+		processBlock(data);
+		data += 64;
+		dataLen -= 64;
+	}
+
+	memcpy(m_Block, data, dataLen);
+	m_BlockLen = dataLen;
+}
+
+
+void Md5::finish(uint8_t digest[16])
+{
+	uint64_t bitLen = m_TotalLen * 8;
+
+	// pad with 0x80 and zeros up to 56 bytes mod 64, then the length in bits
+	uint8_t padding[72];
+	size_t padLen = (m_BlockLen < 56) ? (56 - m_BlockLen) : (120 - m_BlockLen);
+	memset(padding, 0, sizeof(padding));
+	padding[0] = 0x80;
+	for (int i = 0; i < 8; i++)
+		padding[padLen + i] = (uint8_t)(bitLen >> (8*i));
+
+	update(padding, padLen + 8);
+
+	for (int i = 0; i < 4; i++)
+	{
+		digest[i*4]     = (uint8_t)(m_State[i]);
+		digest[i*4 + 1] = (uint8_t)(m_State[i] >> 8);
+		digest[i*4 + 2] = (uint8_t)(m_State[i] >> 16);
+		digest[i*4 + 3] = (uint8_t)(m_State[i] >> 24);
+	}
+}
+
+
+void Md5::hexDigest(const uint8_t* data, size_t dataLen, char hexDigest[33])
+{
+	static const char hexChars[] = "0123456789abcdef";
+
+	Md5 md5;
+	uint8_t digest[16];
+	md5.update(data, dataLen);
+	md5.finish(digest);
+
+	for (int i = 0; i < 16; i++)
+	{
+		hexDigest[i*2] = hexChars[digest[i] >> 4];
+		hexDigest[i*2 + 1] = hexChars[digest[i] & 0x0f];
+	}
+	hexDigest[32] = '\0';
+}
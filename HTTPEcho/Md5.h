@@ -0,0 +1,53 @@
+#ifndef HTTPECHO_MD5
+#define HTTPECHO_MD5
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+/**
+ * A small self-contained MD5 implementation (RFC 1321), used for fingerprints such as JA3 where a crypto library would be an extra dependency
+ */
+class Md5
+{
+public:
+
+	/**
+	 * A c'tor for this class, starts a new digest
+	 */
+	Md5() { reset(); }
+
+	/**
+	 * Start a new digest
+	 */
+	void reset();
+
+	/**
+	 * Add data to the digest
+	 */
+	void update(const uint8_t* data, size_t dataLen);
+
+	/**
+	 * Finish the digest
+	 * @param[out] digest The 16 byte digest
+	 */
+	void finish(uint8_t digest[16]);
+
+	/**
+	 * Compute the digest of a buffer and write it as 32 lower-case hex characters followed by a null terminator
+	 * @param[in] data The data to digest
+	 * @param[in] dataLen The data length
+	 * @param[out] hexDigest A buffer of at least 33 chars
+	 */
+	static void hexDigest(const uint8_t* data, size_t dataLen, char hexDigest[33]);
+
+private:
+	uint32_t m_State[4];
+	uint64_t m_TotalLen;
+	uint8_t m_Block[64];
+	size_t m_BlockLen;
+
+	void processBlock(const uint8_t* block);
+};
+
+#endif /* HTTPECHO_MD5 */
@@ -0,0 +1,170 @@
+#include <sys/mman.h>
+#include <new>
+#include "PacketBufferPool.h"
+
+
+void* allocateHugePageMemory(size_t size, bool* isHugePageBacked)
+{
+	size = (size + HUGE_PAGE_SIZE - 1) & ~((size_t)HUGE_PAGE_SIZE - 1);
+
+	if (isHugePageBacked != NULL)
+		*isHugePageBacked = false;
+
+	void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+	if (memory != MAP_FAILED)
+	{
+		if (isHugePageBacked != NULL)
+			*isHugePageBacked = true;
+		return memory;
+	}
+
+	// no reserved huge pages - ask for transparent huge pages before the memory is touched
+	memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED)
+		return NULL;
+
+	madvise(memory, size, MADV_HUGEPAGE);
+	for (size_t offset = 0; offset < size; offset += 4096)
+		((volatile uint8_t*)memory)[offset] = 0;
+
+	return memory;
+}
+
+
+void freeHugePageMemory(void* memory, size_t size)
+{
+	if (memory == NULL)
+		return;
+
+	size = (size + HUGE_PAGE_SIZE - 1) & ~((size_t)HUGE_PAGE_SIZE - 1);
+	munmap(memory, size);
+}
+
+
+PacketBufferPool::PacketBufferPool(size_t numOfBuffers)
+{
+	m_NumOfBuffers = numOfBuffers;
+	m_MemorySize = numOfBuffers * PACKET_BUFFER_SIZE;
+	m_Memory = (uint8_t*)allocateHugePageMemory(m_MemorySize, &m_IsHugePageBacked);
+	if (m_Memory == NULL)
+		throw std::bad_alloc();
+	m_MemoryEnd = m_Memory + m_MemorySize;
+
+	// initially every buffer is free, linked in address order
+	m_Next = new std::atomic<uint32_t>[numOfBuffers];
+	for (size_t i = 0; i < numOfBuffers; i++)
+		m_Next[i].store(i + 1 < numOfBuffers ? (uint32_t)(i + 2) : 0, std::memory_order_relaxed);
+	m_FreeHead.store(numOfBuffers > 0 ? 1 : 0);
+}
+
+
+PacketBufferPool::~PacketBufferPool()
+{
+	delete [] m_Next;
+	freeHugePageMemory(m_Memory, m_MemorySize);
+}
+
+
+size_t PacketBufferPool::popBuffers(uint8_t** buffers, size_t maxBuffers)
+{
+	uint64_t head = m_FreeHead.load(std::memory_order_acquire);
+	while (true)
+	{
+		// walk down the stack, the walk is only trusted if the head (and its tag) didn't change meanwhile
+		uint32_t next = (uint32_t)head;
+		size_t numOfBuffers = 0;
+		while (next != 0 && numOfBuffers < maxBuffers)
+		{
+			buffers[numOfBuffers++] = getBuffer(next - 1);
+			next = m_Next[next - 1].load(std::memory_order_relaxed);
+		}
+
+		if (numOfBuffers == 0)
+			return 0;
+
+		uint64_t newHead = (((head >> 32) + 1) << 32) | next;
+		if (m_FreeHead.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire))
+			return numOfBuffers;
+	}
+}
+
+
+void PacketBufferPool::pushBuffers(uint8_t* const* buffers, size_t numOfBuffers)
+{
+	if (numOfBuffers == 0)
+		return;
+
+	// link the buffers to each other first, then splice the chain on top of the stack with a single CAS
+	for (size_t i = 0; i + 1 < numOfBuffers; i++)
+		m_Next[getIndex(buffers[i])].store(getIndex(buffers[i + 1]) + 1, std::memory_order_relaxed);
+
+	uint32_t last = getIndex(buffers[numOfBuffers - 1]);
+	uint64_t head = m_FreeHead.load(std::memory_order_relaxed);
+	uint64_t newHead;
+	do
+	{
+		m_Next[last].store((uint32_t)head, std::memory_order_relaxed);
+		newHead = (((head >> 32) + 1) << 32) | (getIndex(buffers[0]) + 1);
+	} while (!m_FreeHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+}
+
+
+PacketBufferCache::PacketBufferCache(PacketBufferPool* pool)
+{
+	numOfOversizedAllocations = 0;
+	numOfExhaustedAllocations = 0;
+	m_Pool = pool;
+	m_NumOfBuffers = 0;
+}
+
+
+PacketBufferCache::~PacketBufferCache()
+{
+	if (m_Pool != NULL)
+		m_Pool->pushBuffers(m_Buffers, m_NumOfBuffers);
+}
+
+
+uint8_t* PacketBufferCache::allocate(size_t size)
+{
+	if (m_Pool == NULL)
+		return new uint8_t[size > 0 ? size : 1];
+
+	if (size > PACKET_BUFFER_SIZE)
+	{
+		numOfOversizedAllocations++;
+		return new uint8_t[size];
+	}
+
+	if (m_NumOfBuffers == 0)
+		m_NumOfBuffers = m_Pool->popBuffers(m_Buffers, PACKET_BUFFER_CACHE_BATCH);
+
+	if (m_NumOfBuffers == 0)
+	{
+		numOfExhaustedAllocations++;
+		return new uint8_t[size > 0 ? size : 1];
+	}
+
+	return m_Buffers[--m_NumOfBuffers];
+}
+
+
+void PacketBufferCache::release(uint8_t* buffer)
+{
+	if (m_Pool == NULL || !m_Pool->owns(buffer))
+	{
+		delete [] buffer;
+		return;
+	}
+
+	// the cache is full - hand the oldest part of it back to the pool
+	if (m_NumOfBuffers == PACKET_BUFFER_CACHE_SIZE)
+	{
+		m_Pool->pushBuffers(m_Buffers, PACKET_BUFFER_CACHE_BATCH);
+		m_NumOfBuffers -= PACKET_BUFFER_CACHE_BATCH;
+		for (size_t i = 0; i < m_NumOfBuffers; i++)
+			m_Buffers[i] = m_Buffers[i + PACKET_BUFFER_CACHE_BATCH];
+	}
+
+	m_Buffers[m_NumOfBuffers++] = buffer;
+}
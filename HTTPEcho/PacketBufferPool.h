@@ -0,0 +1,151 @@
+#ifndef HTTPECHO_PACKET_BUFFER_POOL
+#define HTTPECHO_PACKET_BUFFER_POOL
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// the size of one pool buffer, enough for the payload of any standard (non-jumbo) frame
+#define PACKET_BUFFER_SIZE 2048
+
+// the default number of buffers in the process-wide pool (32MB)
+#define DEFAULT_PACKET_BUFFER_POOL_SIZE 16384
+
+// max number of free buffers a PacketBufferCache holds, and how many it moves from / to the shared pool at once
+#define PACKET_BUFFER_CACHE_SIZE 512
+#define PACKET_BUFFER_CACHE_BATCH 128
+
+// the huge page size the memory is rounded to
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+
+/**
+ * Map memory backed by 2MB huge pages. If no huge pages are reserved (vm.nr_hugepages) the memory is mapped with regular pages and
+ * transparent huge pages are requested for it instead. The memory is pre-faulted, so touching it later doesn't page fault
+ * @param[in] size The size to map, rounded up to a multiple of HUGE_PAGE_SIZE
+ * @param[out] isHugePageBacked If not NULL, set to true if the memory was mapped from reserved huge pages
+ * @return The memory, or NULL if it couldn't be mapped at all
+ */
+void* allocateHugePageMemory(size_t size, bool* isHugePageBacked = NULL);
+
+/**
+ * Unmap memory mapped by allocateHugePageMemory()
+ * @param[in] memory The memory
+ * @param[in] size The size it was allocated with
+ */
+void freeHugePageMemory(void* memory, size_t size);
+
+
+/**
+ * A fixed set of equally sized buffers carved from one huge page region, for packet data which has to outlive its capture buffer.
+ * Keeping all retained packet data in one pre-faulted region means steady state capture never goes to malloc, never page faults on it and
+ * needs only a handful of TLB entries for it. The free buffers are kept in a lock-free stack, so any thread can take or return buffers without
+ * a lock; threads normally go through their own PacketBufferCache and only touch the shared stack in batches
+ */
+class PacketBufferPool
+{
+	friend class PacketBufferCache;
+
+public:
+
+	/**
+	 * A c'tor for this class. Throws std::bad_alloc if the memory can't be mapped
+	 * @param[in] numOfBuffers The number of buffers in the pool
+	 */
+	PacketBufferPool(size_t numOfBuffers = DEFAULT_PACKET_BUFFER_POOL_SIZE);
+
+	/**
+	 * A d'tor for this class. All caches using the pool must be destroyed first
+	 */
+	~PacketBufferPool();
+
+	/**
+	 * @param[in] buffer A pointer
+	 * @return True if the pointer is a buffer of this pool
+	 */
+	bool owns(const void* buffer) const { return (const uint8_t*)buffer >= m_Memory && (const uint8_t*)buffer < m_MemoryEnd; }
+
+	/**
+	 * @return True if the pool is backed by reserved huge pages (and not just by transparent huge pages, if at all)
+	 */
+	bool isHugePageBacked() const { return m_IsHugePageBacked; }
+
+	/**
+	 * @return The number of buffers in the pool
+	 */
+	size_t getNumOfBuffers() const { return m_NumOfBuffers; }
+
+private:
+
+	uint8_t* m_Memory;
+	uint8_t* m_MemoryEnd;
+	size_t m_MemorySize;
+	size_t m_NumOfBuffers;
+	bool m_IsHugePageBacked;
+
+	// the free stack: the head holds a tag (bumped on every change, against ABA) in the upper 32 bits and the top buffer index + 1 in the lower
+	// 32 bits (0 means empty). m_Next links every free buffer to the one below it
+	std::atomic<uint64_t> m_FreeHead;
+	std::atomic<uint32_t>* m_Next;
+
+	uint8_t* getBuffer(uint32_t index) const { return m_Memory + (size_t)index * PACKET_BUFFER_SIZE; }
+	uint32_t getIndex(const uint8_t* buffer) const { return (uint32_t)((size_t)(buffer - m_Memory) / PACKET_BUFFER_SIZE); }
+
+	size_t popBuffers(uint8_t** buffers, size_t maxBuffers);
+	void pushBuffers(uint8_t* const* buffers, size_t numOfBuffers);
+
+	// the pool owns its memory, prevent copies
+	PacketBufferPool(const PacketBufferPool& other);
+	PacketBufferPool& operator=(const PacketBufferPool& other);
+};
+
+
+/**
+ * A single thread's cache of free PacketBufferPool buffers. Allocation and release work on the cache alone; it refills from / spills back to
+ * the shared pool PACKET_BUFFER_CACHE_BATCH buffers at a time. A buffer may be released to any cache of the same pool, e.g. by a thread
+ * other than the one which allocated it. Requests larger than PACKET_BUFFER_SIZE, or made while the pool is exhausted, are served with new[]
+ * and release() tells the two apart, so callers don't need to track where a buffer came from
+ */
+class PacketBufferCache
+{
+public:
+
+	/**
+	 * A c'tor for this class
+	 * @param[in] pool The pool to take buffers from. If NULL every allocation uses new[]
+	 */
+	PacketBufferCache(PacketBufferPool* pool);
+
+	/**
+	 * A d'tor for this class, returns the cached buffers to the pool
+	 */
+	~PacketBufferCache();
+
+	/**
+	 * Allocate a buffer
+	 * @param[in] size The number of bytes needed
+	 * @return The buffer
+	 */
+	uint8_t* allocate(size_t size);
+
+	/**
+	 * Release a buffer returned by allocate() (of this cache or of another cache of the same pool)
+	 * @param[in] buffer The buffer
+	 */
+	void release(uint8_t* buffer);
+
+	// stats: allocations which fell back to new[] because they were too large / because the pool was exhausted
+	uint64_t numOfOversizedAllocations;
+	uint64_t numOfExhaustedAllocations;
+
+private:
+	PacketBufferPool* m_Pool;
+	uint8_t* m_Buffers[PACKET_BUFFER_CACHE_SIZE];
+	size_t m_NumOfBuffers;
+
+	// a cache belongs to one thread, prevent copies
+	PacketBufferCache(const PacketBufferCache& other);
+	PacketBufferCache& operator=(const PacketBufferCache& other);
+};
+
+#endif /* HTTPECHO_PACKET_BUFFER_POOL */
@@ -0,0 +1,22 @@
+#include "header/Packet.h"
+#include "header/IPv4Layer.h"
+#include "header/IPv6Layer.h"
+#include "PacketDecoder.h"
+
+
+bool locateNetworkLayerWithPacket(pcpp::RawPacket* packet, PacketView& view)
+{
+	// the layers above IP are left to the decoders
+	pcpp::Packet parsedPacket(packet, false, pcpp::UnknownProtocol, pcpp::OsiModelNetworkLayer);
+
+	pcpp::Layer* ipLayer = parsedPacket.getLayerOfType<pcpp::IPv4Layer>();
+	if (ipLayer == NULL)
+		ipLayer = parsedPacket.getLayerOfType<pcpp::IPv6Layer>();
+	if (ipLayer == NULL)
+		return false;
+
+	// the layers point into the raw frame, so the view stays valid after the packet is gone
+	view.cursor = ipLayer->getData();
+	view.etherType = 0;
+	return true;
+}
@@ -0,0 +1,360 @@
+#ifndef HTTPECHO_PACKET_DECODER
+#define HTTPECHO_PACKET_DECODER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "header/RawPacket.h"
+#include "LinkLayerUtils.h"
+
+#define DECODER_IP_PROTOCOL_TCP 6
+
+// the decoders of a stack are folded into the one function which runs the stack
+#define DECODER_INLINE inline __attribute__((always_inline))
+
+
+/**
+ * What the start of a TCP payload looks like to HttpDecoder
+ */
+enum HttpMessageStart
+{
+	// not the first bytes of an HTTP/1.x message (a continuation, or another protocol)
+	HttpNoMessageStart,
+	HttpRequestStart,
+	HttpResponseStart
+};
+
+
+/**
+ * @struct PacketView
+ * The headers of a decoded packet, as pointers into the raw frame. It's meant to live on the caller's stack: decoding allocates nothing and
+ * copies nothing. The fields of a layer are only set once its decoder ran
+ */
+struct PacketView
+{
+	const uint8_t* data;
+	const uint8_t* dataEnd;
+
+	// where the next decoder of the stack starts
+	const uint8_t* cursor;
+
+	// link layer: the ether type of the network layer (0 for link layers which don't have one), and the VLAN / QinQ tags skipped
+	uint16_t etherType;
+	uint8_t numOfVlanTags;
+	uint16_t vlanId;
+
+	// network layer. l4End is where the transport layer ends, the IP length clamped to the frame (it may be padded or truncated)
+	uint8_t ipVersion;
+	uint8_t ipProtocol;
+	bool isFragment;
+	const uint8_t* ipHeader;
+	const uint8_t* srcIP;
+	const uint8_t* dstIP;
+	size_t ipAddrLen;
+	const uint8_t* l4End;
+
+	// transport layer
+	const uint8_t* tcpHeader;
+	uint16_t srcPort;
+	uint16_t dstPort;
+	uint32_t sequence;
+	uint32_t ackNumber;
+	uint8_t tcpFlags;
+	const uint8_t* payload;
+	size_t payloadLen;
+
+	// application layer
+	HttpMessageStart httpStart;
+};
+
+
+static DECODER_INLINE uint16_t decoderRead16(const uint8_t* ptr)
+{
+	uint16_t val;
+	memcpy(&val, ptr, sizeof(val));
+	return ntohs(val);
+}
+
+static DECODER_INLINE uint32_t decoderRead32(const uint8_t* ptr)
+{
+	uint32_t val;
+	memcpy(&val, ptr, sizeof(val));
+	return ntohl(val);
+}
+
+
+/**
+ * The protocol decoders a stack is made of. Each one decodes its layer at the view's cursor, moves the cursor past it and returns false if the
+ * packet isn't what the stack expects. The optional layers (VlanDecoder, HttpDecoder) never fail
+ */
+struct EthernetDecoder
+{
+	static DECODER_INLINE bool decode(PacketView& view)
+	{
+		if (view.dataEnd - view.cursor < 14)
+			return false;
+		view.etherType = decoderRead16(view.cursor + 12);
+		view.cursor += 14;
+		return true;
+	}
+};
+
+struct VlanDecoder
+{
+	static DECODER_INLINE bool decode(PacketView& view)
+	{
+		while ((view.etherType == PCPP_ETHERTYPE_VLAN || view.etherType == HTTPECHO_ETHERTYPE_QINQ) && view.dataEnd - view.cursor >= 4)
+		{
+			if (view.numOfVlanTags++ == 0)
+				view.vlanId = decoderRead16(view.cursor) & 0x0fff;
+			view.etherType = decoderRead16(view.cursor + 2);
+			view.cursor += 4;
+		}
+		return true;
+	}
+};
+
+struct LinuxSllDecoder
+{
+	static DECODER_INLINE bool decode(PacketView& view)
+	{
+		if (view.dataEnd - view.cursor < 16)
+			return false;
+		view.etherType = decoderRead16(view.cursor + 14);
+		view.cursor += 16;
+		return true;
+	}
+};
+
+// BSD loopback: a 4-byte address family in host order, the IP version is taken from the IP header
+struct NullLinkDecoder
+{
+	static DECODER_INLINE bool decode(PacketView& view)
+	{
+		view.cursor += 4;
+		return true;
+	}
+};
+
+// raw IP: the frame starts with the IP header
+struct RawIPDecoder
+{
+	static DECODER_INLINE bool decode(PacketView& /* view */)
+	{
+		return true;
+	}
+};
+
+// IPv4 or IPv6, by the ether type or (without one) by the version in the header. IPv6 extension headers which may come before the transport
+// layer are skipped, a fragment header isn't
+struct IPDecoder
+{
+	static DECODER_INLINE bool decode(PacketView& view)
+	{
+		const uint8_t* ipHeader = view.cursor;
+		if (ipHeader >= view.dataEnd)
+			return false;
+
+		int version;
+		if (view.etherType == PCPP_ETHERTYPE_IP)
+			version = 4;
+		else if (view.etherType == PCPP_ETHERTYPE_IPV6)
+			version = 6;
+		else if (view.etherType == 0)
+			version = ipHeader[0] >> 4;
+		else
+			return false;
+
+		view.ipHeader = ipHeader;
+		if (version == 4)
+		{
+			if (view.dataEnd - ipHeader < 20)
+				return false;
+
+			size_t headerLen = (ipHeader[0] & 0x0f) * 4;
+			size_t totalLen = decoderRead16(ipHeader + 2);
+			if (headerLen < 20 || totalLen < headerLen)
+				return false;
+
+			view.ipVersion = 4;
+			view.ipProtocol = ipHeader[9];
+			view.isFragment = ((decoderRead16(ipHeader + 6) & 0x3fff) != 0);
+			view.srcIP = ipHeader + 12;
+			view.dstIP = ipHeader + 16;
+			view.ipAddrLen = 4;
+			view.cursor = ipHeader + headerLen;
+			view.l4End = ipHeader + totalLen;
+		}
+		else if (version == 6)
+		{
+			if (view.dataEnd - ipHeader < 40)
+				return false;
+
+			uint8_t nextHeader = ipHeader[6];
+			const uint8_t* l4Header = ipHeader + 40;
+			view.l4End = l4Header + decoderRead16(ipHeader + 4);
+			while (isIPv6UnfragmentableExtension(nextHeader))
+			{
+				if (view.dataEnd - l4Header < 8)
+					return false;
+				nextHeader = l4Header[0];
+				l4Header += (l4Header[1] + 1) * 8;
+			}
+
+			view.ipVersion = 6;
+			view.ipProtocol = nextHeader;
+			view.isFragment = (nextHeader == 44);
+			view.srcIP = ipHeader + 8;
+			view.dstIP = ipHeader + 24;
+			view.ipAddrLen = 16;
+			view.cursor = l4Header;
+		}
+		else
+			return false;
+
+		if (view.l4End > view.dataEnd)
+			view.l4End = view.dataEnd;
+		return true;
+	}
+};
+
+// TCP, not fragmented (fragments are reassembled before the decode)
+struct TcpDecoder
+{
+	static DECODER_INLINE bool decode(PacketView& view)
+	{
+		const uint8_t* tcpHeader = view.cursor;
+		if (view.ipProtocol != DECODER_IP_PROTOCOL_TCP || view.isFragment || tcpHeader + 20 > view.l4End)
+			return false;
+
+		size_t headerLen = (tcpHeader[12] >> 4) * 4;
+		if (headerLen < 20 || tcpHeader + headerLen > view.l4End)
+			return false;
+
+		view.tcpHeader = tcpHeader;
+		view.srcPort = decoderRead16(tcpHeader);
+		view.dstPort = decoderRead16(tcpHeader + 2);
+		view.sequence = decoderRead32(tcpHeader + 4);
+		view.ackNumber = decoderRead32(tcpHeader + 8);
+		view.tcpFlags = tcpHeader[13];
+		view.payload = tcpHeader + headerLen;
+		view.payloadLen = (size_t)(view.l4End - view.payload);
+		view.cursor = view.payload;
+		return true;
+	}
+};
+
+// tells whether the payload starts an HTTP/1.x request or response, from its first token
+struct HttpDecoder
+{
+	static DECODER_INLINE bool decode(PacketView& view)
+	{
+		view.httpStart = HttpNoMessageStart;
+		const uint8_t* start = view.cursor;
+		size_t len = (size_t)(view.l4End - start);
+		if (len < 5)
+			return true;
+
+		if (memcmp(start, "HTTP/", 5) == 0)
+		{
+			view.httpStart = HttpResponseStart;
+			return true;
+		}
+
+		// the method token: upper case letters followed by a space
+		size_t tokenLen = 0;
+		while (tokenLen < len && tokenLen < 8 && start[tokenLen] >= 'A' && start[tokenLen] <= 'Z')
+			tokenLen++;
+		if (tokenLen >= 3 && tokenLen < len && start[tokenLen] == ' ')
+			view.httpStart = HttpRequestStart;
+		return true;
+	}
+};
+
+
+/**
+ * A protocol stack resolved at compile time: DecodeStack<EthernetDecoder, VlanDecoder, IPDecoder, TcpDecoder>::decode() runs the decoders in
+ * order as one function (they're all inlined into it), so a packet is decoded without virtual calls, without allocating layers and without
+ * walking a layer list to find one
+ */
+template<typename... Decoders>
+struct DecodeStack;
+
+template<>
+struct DecodeStack<>
+{
+	static DECODER_INLINE bool decode(PacketView& /* view */) { return true; }
+};
+
+template<typename Decoder, typename... Rest>
+struct DecodeStack<Decoder, Rest...>
+{
+	static DECODER_INLINE bool decode(PacketView& view) { return Decoder::decode(view) && DecodeStack<Rest...>::decode(view); }
+};
+
+
+/**
+ * Decode from the network layer a packet whose link layer only pcpp::Packet knows. It's the fallback of decodeIPPacket(), which the
+ * specialized stacks don't cover
+ * @param[in] packet The packet
+ * @param[out] view The view, its cursor is set to the network layer
+ * @return False if the packet doesn't carry IP
+ */
+bool locateNetworkLayerWithPacket(pcpp::RawPacket* packet, PacketView& view);
+
+
+/**
+ * Decode an IP packet, and the layers of the stack above IP. The link layer type picks one of the specialized stacks (Ethernet with VLAN tags,
+ * Linux cooked capture, BSD loopback, raw IP), the packets of other link layers go through pcpp::Packet
+ * @param[in] packet The packet
+ * @param[out] view The decoded headers
+ * @return False if the packet isn't IP, or an upper decoder failed
+ */
+template<typename... UpperDecoders>
+inline bool decodeIPPacket(pcpp::RawPacket* packet, PacketView& view)
+{
+	view.data = packet->getRawData();
+	view.dataEnd = view.data + packet->getRawDataLen();
+	view.cursor = view.data;
+	view.etherType = 0;
+	view.numOfVlanTags = 0;
+	view.vlanId = 0;
+
+	switch (packet->getLinkLayerType())
+	{
+	case pcpp::LINKTYPE_ETHERNET:
+		return DecodeStack<EthernetDecoder, VlanDecoder, IPDecoder, UpperDecoders...>::decode(view);
+
+	case pcpp::LINKTYPE_LINUX_SLL:
+		return DecodeStack<LinuxSllDecoder, IPDecoder, UpperDecoders...>::decode(view);
+
+	case pcpp::LINKTYPE_NULL:
+		return DecodeStack<NullLinkDecoder, IPDecoder, UpperDecoders...>::decode(view);
+
+	case pcpp::LINKTYPE_RAW:
+	case pcpp::LINKTYPE_DLT_RAW1:
+	case pcpp::LINKTYPE_DLT_RAW2:
+	case pcpp::LINKTYPE_IPV4:
+	case pcpp::LINKTYPE_IPV6:
+		return DecodeStack<RawIPDecoder, IPDecoder, UpperDecoders...>::decode(view);
+
+	default:
+		return locateNetworkLayerWithPacket(packet, view) && DecodeStack<IPDecoder, UpperDecoders...>::decode(view);
+	}
+}
+
+
+/**
+ * Decode a TCP packet, and the layers of the stack above TCP (e.g. HttpDecoder)
+ * @param[in] packet The packet
+ * @param[out] view The decoded headers
+ * @return False if the packet isn't an unfragmented TCP packet
+ */
+template<typename... UpperDecoders>
+inline bool decodeTcpPacket(pcpp::RawPacket* packet, PacketView& view)
+{
+	return decodeIPPacket<TcpDecoder, UpperDecoders...>(packet, view);
+}
+
+#endif /* HTTPECHO_PACKET_DECODER */
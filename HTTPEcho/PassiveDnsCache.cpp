@@ -0,0 +1,304 @@
+#include <string.h>
+#include <new>
+#include <string>
+#include "header/Packet.h"
+#include "header/DnsLayer.h"
+#include "header/DnsResourceData.h"
+#include "header/IPv4Layer.h"
+#include "LinkLayerUtils.h"
+#include "PacketBufferPool.h"
+#include "PassiveDnsCache.h"
+
+// how many times a lookup re-reads a slot a writer is updating before it gives up on it
+#define DNS_CACHE_READ_ATTEMPTS 4
+
+
+/**
+ * Turn an address into a slot key: IPv6 addresses as they are, IPv4 addresses as IPv4-mapped IPv6 addresses
+ */
+static void makeKey(const uint8_t* address, size_t addressLen, uint64_t* key)
+{
+	uint8_t bytes[16] = { 0 };
+	if (addressLen == 4)
+	{
+		bytes[10] = 0xff;
+		bytes[11] = 0xff;
+		memcpy(bytes + 12, address, 4);
+	}
+	else
+		memcpy(bytes, address, 16);
+
+	memcpy(key, bytes, 16);
+}
+
+
+static uint64_t hashKey(const uint64_t* key)
+{
+	// splitmix64 finalizer over both words
+	uint64_t hash = key[0] ^ (key[1] * 0x9e3779b97f4a7c15ULL);
+	hash ^= hash >> 30;
+	hash *= 0xbf58476d1ce4e5b9ULL;
+	hash ^= hash >> 27;
+	hash *= 0x94d049bb133111ebULL;
+	hash ^= hash >> 31;
+	return hash;
+}
+
+
+PassiveDnsCache::PassiveDnsCache(size_t numOfSlots)
+{
+	numOfResponses = 0;
+	numOfRecords = 0;
+	numOfEvictions = 0;
+	numOfDroppedUpdates = 0;
+
+	m_NumOfSlots = DNS_CACHE_MAX_PROBES;
+	while (m_NumOfSlots < numOfSlots)
+		m_NumOfSlots <<= 1;
+	m_SlotMask = m_NumOfSlots - 1;
+
+	// the lookups land on random slots, so the table goes on huge pages like the packet buffers
+	m_Slots = (Slot*)allocateHugePageMemory(m_NumOfSlots * sizeof(Slot));
+	if (m_Slots == NULL)
+		throw std::bad_alloc();
+
+	for (size_t i = 0; i < m_NumOfSlots; i++)
+	{
+		Slot* slot = new (&m_Slots[i]) Slot;
+		slot->sequence.store(0, std::memory_order_relaxed);
+		slot->key[0].store(0, std::memory_order_relaxed);
+		slot->key[1].store(0, std::memory_order_relaxed);
+		slot->expiry.store(0, std::memory_order_relaxed);
+		for (int word = 0; word < DNS_CACHE_NAME_WORDS; word++)
+			slot->name[word].store(0, std::memory_order_relaxed);
+	}
+}
+
+
+PassiveDnsCache::~PassiveDnsCache()
+{
+	freeHugePageMemory(m_Slots, m_NumOfSlots * sizeof(Slot));
+}
+
+
+bool PassiveDnsCache::processPacket(pcpp::RawPacket* packet)
+{
+	// a DNS response is a UDP datagram from the DNS port - check that on the raw headers before parsing anything
+	const uint8_t* data = packet->getRawData();
+	size_t dataLen = (size_t)packet->getRawDataLen();
+	size_t l3Offset = 0;
+	size_t l4Offset;
+	uint8_t protocol;
+
+	int ipVersion = locateNetworkLayer(data, dataLen, packet->getLinkLayerType(), l3Offset);
+	if (ipVersion == 4)
+	{
+		// only a complete datagram (or its first fragment) has the UDP header
+		if ((((data[l3Offset + 6] & 0x1f) << 8) | data[l3Offset + 7]) != 0)
+			return false;
+		protocol = data[l3Offset + 9];
+		l4Offset = l3Offset + (data[l3Offset] & 0x0f) * 4;
+	}
+	else if (ipVersion == 6)
+	{
+		protocol = data[l3Offset + 6];
+		l4Offset = l3Offset + 40;
+	}
+	else
+		return false;
+
+	if (protocol != pcpp::PACKETPP_IPPROTO_UDP || dataLen < l4Offset + 8 || ((data[l4Offset] << 8) | data[l4Offset + 1]) != DNS_PORT)
+		return false;
+
+	numOfResponses.fetch_add(1, std::memory_order_relaxed);
+
+	pcpp::Packet parsedPacket(packet, false, pcpp::DNS);
+	pcpp::DnsLayer* dnsLayer = parsedPacket.getLayerOfType<pcpp::DnsLayer>();
+	if (dnsLayer == NULL || !dnsLayer->getDnsHeader()->queryOrResponse || dnsLayer->getDnsHeader()->responseCode != 0)
+		return true;
+
+	// every address is labelled with the name the client asked for, even if it was reached through a CNAME chain
+	pcpp::DnsQuery* query = dnsLayer->getFirstQuery();
+	if (query == NULL || query->getName().empty())
+		return true;
+
+	std::string name = query->getName();
+	for (size_t i = 0; i < name.size(); i++)
+	{
+		if (name[i] >= 'A' && name[i] <= 'Z')
+			name[i] += 'a' - 'A';
+	}
+
+	time_t now = packet->getPacketTimeStamp().tv_sec;
+	for (pcpp::DnsResource* answer = dnsLayer->getFirstAnswer(); answer != NULL; answer = dnsLayer->getNextAnswer(answer))
+	{
+		if (answer->getDnsType() == pcpp::DNS_TYPE_A)
+		{
+			pcpp::DnsResourceDataPtr recordData = answer->getData();
+			pcpp::IPv4DnsResourceData* record = recordData.castAs<pcpp::IPv4DnsResourceData>();
+			if (record == NULL)
+				continue;
+			uint32_t address = record->getIpAddress().toInt();
+			insert((const uint8_t*)&address, 4, name.c_str(), name.size(), answer->getTTL(), now);
+		}
+		else if (answer->getDnsType() == pcpp::DNS_TYPE_AAAA)
+		{
+			pcpp::DnsResourceDataPtr recordData = answer->getData();
+			pcpp::IPv6DnsResourceData* record = recordData.castAs<pcpp::IPv6DnsResourceData>();
+			if (record == NULL)
+				continue;
+			uint8_t address[16];
+			record->getIpAddress().copyTo(address);
+			insert(address, 16, name.c_str(), name.size(), answer->getTTL(), now);
+		}
+	}
+
+	return true;
+}
+
+
+void PassiveDnsCache::insert(const uint8_t* address, size_t addressLen, const char* name, size_t nameLen, uint32_t ttl, time_t now)
+{
+	uint64_t key[2];
+	makeKey(address, addressLen, key);
+	uint64_t hash = hashKey(key);
+
+	if (ttl < DNS_CACHE_MIN_TTL_SEC)
+		ttl = DNS_CACHE_MIN_TTL_SEC;
+	else if (ttl > DNS_CACHE_MAX_TTL_SEC)
+		ttl = DNS_CACHE_MAX_TTL_SEC;
+	uint64_t expiry = (uint64_t)now + ttl;
+
+	// the slot of the address if it's cached already, otherwise the first free (or expired) slot, otherwise the one which expires first
+	Slot* target = NULL;
+	Slot* freeSlot = NULL;
+	Slot* firstToExpire = NULL;
+	uint64_t firstExpiry = UINT64_MAX;
+	for (size_t probe = 0; probe < DNS_CACHE_MAX_PROBES; probe++)
+	{
+		Slot* slot = &m_Slots[(hash + probe) & m_SlotMask];
+		uint64_t slotExpiry = slot->expiry.load(std::memory_order_relaxed);
+		if (slot->key[0].load(std::memory_order_relaxed) == key[0] && slot->key[1].load(std::memory_order_relaxed) == key[1] && slotExpiry != 0)
+		{
+			target = slot;
+			break;
+		}
+
+		if (slotExpiry <= (uint64_t)now)
+		{
+			if (freeSlot == NULL)
+				freeSlot = slot;
+		}
+		else if (slotExpiry < firstExpiry)
+		{
+			firstToExpire = slot;
+			firstExpiry = slotExpiry;
+		}
+	}
+
+	if (target == NULL)
+		target = (freeSlot != NULL ? freeSlot : firstToExpire);
+
+	uint64_t sequence = target->sequence.load(std::memory_order_relaxed);
+	if ((sequence & 1) != 0 || !target->sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire, std::memory_order_relaxed))
+	{
+		numOfDroppedUpdates.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	std::atomic_thread_fence(std::memory_order_release);
+
+	// the slot was picked without holding it. If another writer filled it with a live entry of another address meanwhile, leave that entry be
+	bool sameKey = (target->key[0].load(std::memory_order_relaxed) == key[0] && target->key[1].load(std::memory_order_relaxed) == key[1]);
+	bool isLive = (target->expiry.load(std::memory_order_relaxed) > (uint64_t)now);
+	if (!sameKey && isLive)
+	{
+		if (target != firstToExpire)
+		{
+			target->sequence.store(sequence + 2, std::memory_order_release);
+			numOfDroppedUpdates.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		numOfEvictions.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	uint8_t nameBytes[DNS_CACHE_NAME_WORDS * 8] = { 0 };
+	memcpy(nameBytes, name, (nameLen > DNS_CACHE_MAX_NAME_LEN ? DNS_CACHE_MAX_NAME_LEN : nameLen));
+	uint64_t nameWords[DNS_CACHE_NAME_WORDS];
+	memcpy(nameWords, nameBytes, sizeof(nameWords));
+
+	target->key[0].store(key[0], std::memory_order_relaxed);
+	target->key[1].store(key[1], std::memory_order_relaxed);
+	target->expiry.store(expiry, std::memory_order_relaxed);
+	for (int word = 0; word < DNS_CACHE_NAME_WORDS; word++)
+		target->name[word].store(nameWords[word], std::memory_order_relaxed);
+
+	target->sequence.store(sequence + 2, std::memory_order_release);
+	numOfRecords.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+bool PassiveDnsCache::lookupKey(const uint64_t* key, time_t now, char* name) const
+{
+	name[0] = '\0';
+	uint64_t hash = hashKey(key);
+
+	for (size_t probe = 0; probe < DNS_CACHE_MAX_PROBES; probe++)
+	{
+		const Slot& slot = m_Slots[(hash + probe) & m_SlotMask];
+
+		for (int attempt = 0; attempt < DNS_CACHE_READ_ATTEMPTS; attempt++)
+		{
+			uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+
+			// a slot which was never written ends the probe sequence, an address is always stored before the first such slot
+			if (sequence == 0)
+				return false;
+			if ((sequence & 1) != 0)
+				continue;
+
+			bool found = slot.key[0].load(std::memory_order_relaxed) == key[0] && slot.key[1].load(std::memory_order_relaxed) == key[1] &&
+					slot.expiry.load(std::memory_order_relaxed) > (uint64_t)now;
+
+			uint64_t nameWords[DNS_CACHE_NAME_WORDS];
+			if (found)
+			{
+				for (int word = 0; word < DNS_CACHE_NAME_WORDS; word++)
+					nameWords[word] = slot.name[word].load(std::memory_order_relaxed);
+			}
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+				continue;
+
+			if (!found)
+				break;
+
+			memcpy(name, nameWords, DNS_CACHE_MAX_NAME_LEN);
+			name[DNS_CACHE_MAX_NAME_LEN] = '\0';
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+bool PassiveDnsCache::lookup(const uint8_t* address, size_t addressLen, time_t now, char* name) const
+{
+	uint64_t key[2];
+	makeKey(address, addressLen, key);
+	return lookupKey(key, now, name);
+}
+
+
+bool PassiveDnsCache::lookup(const pcpp::IPAddress* address, time_t now, char* name) const
+{
+	if (address->getType() == pcpp::IPAddress::IPv4AddressType)
+	{
+		uint32_t ipv4 = ((const pcpp::IPv4Address*)address)->toInt();
+		return lookup((const uint8_t*)&ipv4, 4, now, name);
+	}
+
+	return lookup((const uint8_t*)((const pcpp::IPv6Address*)address)->toIn6Addr(), 16, now, name);
+}
@@ -0,0 +1,120 @@
+#ifndef HTTPECHO_PASSIVE_DNS_CACHE
+#define HTTPECHO_PASSIVE_DNS_CACHE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <atomic>
+#include "header/RawPacket.h"
+#include "header/IpAddress.h"
+
+// the DNS server port, responses are taken from UDP packets sent from it
+#define DNS_PORT 53
+
+// the default number of cache slots (8MB)
+#define DEFAULT_DNS_CACHE_SIZE 65536
+
+// the longest name kept for an address, longer names are cut. A slot keeps the name in whole 8-byte words
+#define DNS_CACHE_MAX_NAME_LEN 95
+#define DNS_CACHE_NAME_WORDS ((DNS_CACHE_MAX_NAME_LEN + 1) / 8)
+
+// the number of consecutive slots an address may be stored in, so a lookup reads at most this many slots
+#define DNS_CACHE_MAX_PROBES 8
+
+// record TTLs are raised to the min TTL (clients often keep using an address a little past its TTL) and cut at the max TTL
+#define DNS_CACHE_MIN_TTL_SEC 60
+#define DNS_CACHE_MAX_TTL_SEC 86400
+
+
+/**
+ * A passive DNS cache: the A and AAAA records of the DNS responses seen on the wire, kept as address -> queried name until their TTL expires,
+ * so connections (HTTPS ones and HTTP ones without a Host header included) can be labelled with the name the client resolved to reach the server.
+ * The cache is a fixed table of slots with open addressing and a short probe sequence, so its memory is bounded and a lookup reads a few adjacent
+ * slots at most; when all the slots an address may go to are taken, the one which expires first is replaced.
+ * Every slot is guarded by a sequence lock, so any number of threads can look up and insert at the same time without a lock: readers copy a slot
+ * and retry if its sequence changed meanwhile, writers claim a slot with a CAS on its sequence. An update which finds its slot claimed by another
+ * writer is dropped, the next response for the name fills it in
+ */
+class PassiveDnsCache
+{
+public:
+
+	/**
+	 * A c'tor for this class
+	 * @param[in] numOfSlots The number of slots, rounded up to a power of 2
+	 */
+	PassiveDnsCache(size_t numOfSlots = DEFAULT_DNS_CACHE_SIZE);
+
+	~PassiveDnsCache();
+
+	/**
+	 * Cache the address records of a packet if it's a DNS response. Other packets are recognized from their headers without parsing them
+	 * @param[in] packet The packet (a complete datagram, after IP defragmentation)
+	 * @return True if the packet was a DNS response (sent from the DNS port over UDP), whether or not it had any usable records
+	 */
+	bool processPacket(pcpp::RawPacket* packet);
+
+	/**
+	 * Store the name of an address
+	 * @param[in] address The address, 4 bytes (IPv4) or 16 bytes (IPv6) in network order
+	 * @param[in] addressLen The address length
+	 * @param[in] name The name
+	 * @param[in] nameLen The name length
+	 * @param[in] ttl The TTL of the record, in seconds
+	 * @param[in] now The capture time of the response
+	 */
+	void insert(const uint8_t* address, size_t addressLen, const char* name, size_t nameLen, uint32_t ttl, time_t now);
+
+	/**
+	 * Look up the name of an address
+	 * @param[in] address The address, 4 bytes (IPv4) or 16 bytes (IPv6) in network order
+	 * @param[in] addressLen The address length
+	 * @param[in] now The current capture time, entries which expired by then aren't returned
+	 * @param[out] name A buffer of at least DNS_CACHE_MAX_NAME_LEN + 1 bytes the name is copied to (empty if the address isn't cached)
+	 * @return True if the address was found
+	 */
+	bool lookup(const uint8_t* address, size_t addressLen, time_t now, char* name) const;
+
+	/**
+	 * Look up the name of an address
+	 * @param[in] address The address
+	 * @param[in] now The current capture time, entries which expired by then aren't returned
+	 * @param[out] name A buffer of at least DNS_CACHE_MAX_NAME_LEN + 1 bytes the name is copied to (empty if the address isn't cached)
+	 * @return True if the address was found
+	 */
+	bool lookup(const pcpp::IPAddress* address, time_t now, char* name) const;
+
+	// stats: DNS responses seen, address records cached, live entries replaced to make room and updates dropped because another thread was
+	// writing the slot. Updated by all the threads which use the cache
+	std::atomic<uint64_t> numOfResponses;
+	std::atomic<uint64_t> numOfRecords;
+	std::atomic<uint64_t> numOfEvictions;
+	std::atomic<uint64_t> numOfDroppedUpdates;
+
+private:
+
+	/**
+	 * A slot (two cache lines): the address as an IPv6 (or IPv4-mapped) address, the expiry time (0 for an empty slot) and the name. The
+	 * sequence is odd while a writer updates the slot. Every field is an atomic word, so a reader racing with a writer reads torn values at
+	 * worst, which the sequence check then throws away
+	 */
+	struct alignas(64) Slot
+	{
+		std::atomic<uint64_t> sequence;
+		std::atomic<uint64_t> key[2];
+		std::atomic<uint64_t> expiry;
+		std::atomic<uint64_t> name[DNS_CACHE_NAME_WORDS];
+	};
+
+	Slot* m_Slots;
+	size_t m_NumOfSlots;
+	size_t m_SlotMask;
+
+	bool lookupKey(const uint64_t* key, time_t now, char* name) const;
+
+	// the cache owns its slots, prevent copies
+	PassiveDnsCache(const PassiveDnsCache& other);
+	PassiveDnsCache& operator=(const PassiveDnsCache& other);
+};
+
+#endif /* HTTPECHO_PASSIVE_DNS_CACHE */
@@ -0,0 +1,407 @@
+#include <string.h>
+#include <stdio.h>
+#include <new>
+#include <fstream>
+#include <sstream>
+#include <deque>
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#define PATTERN_MATCHER_SHUFTI
+#endif
+#include "PacketBufferPool.h"
+#include "PatternMatcher.h"
+
+// set in a transition when a pattern ends in its target state
+#define STATE_MATCH_FLAG 0x80000000U
+
+// a trie edge which doesn't exist (yet)
+#define NO_STATE 0xffffffffU
+
+
+static inline uint8_t foldCase(uint8_t byte)
+{
+	return (byte >= 'A' && byte <= 'Z' ? byte + ('a' - 'A') : byte);
+}
+
+
+static int parseHexDigit(char digit)
+{
+	if (digit >= '0' && digit <= '9')
+		return digit - '0';
+	if (digit >= 'a' && digit <= 'f')
+		return digit - 'a' + 10;
+	if (digit >= 'A' && digit <= 'F')
+		return digit - 'A' + 10;
+	return -1;
+}
+
+
+/**
+ * Turn the \xHH and \\ escapes of a pattern into bytes
+ */
+static bool unescapePattern(const std::string& text, std::string& pattern)
+{
+	pattern.clear();
+	for (size_t i = 0; i < text.size(); i++)
+	{
+		if (text[i] != '\\')
+		{
+			pattern.push_back(text[i]);
+			continue;
+		}
+
+		if (i + 1 < text.size() && text[i + 1] == '\\')
+		{
+			pattern.push_back('\\');
+			i++;
+			continue;
+		}
+
+		if (i + 3 >= text.size() ||text[i + 1] != 'x' || parseHexDigit(text[i + 2]) < 0 || parseHexDigit(text[i + 3]) < 0)
+			return false;
+		pattern.push_back((char)(parseHexDigit(text[i + 2]) * 16 + parseHexDigit(text[i + 3])));
+		i += 3;
+	}
+
+	return true;
+}
+
+
+#ifdef PATTERN_MATCHER_SHUFTI
+/**
+ * Find the first byte of the full 16-byte blocks which may be in the set described by the nibble masks: a byte is in it if the low mask of its low
+ * nibble and the high mask of its high nibble share a bit. Returns where the last full block ends if no block has such a byte
+ */
+__attribute__((target("ssse3")))
+static const uint8_t* findShuftiCandidate(const uint8_t* data, const uint8_t* end, const uint8_t* lowMasks, const uint8_t* highMasks)
+{
+	__m128i lowTable = _mm_loadu_si128((const __m128i*)lowMasks);
+	__m128i highTable = _mm_loadu_si128((const __m128i*)highMasks);
+	__m128i nibbleMask = _mm_set1_epi8(0x0f);
+	__m128i zero = _mm_setzero_si128();
+
+	for (; end - data >= 16; data += 16)
+	{
+		__m128i block = _mm_loadu_si128((const __m128i*)data);
+		__m128i low = _mm_shuffle_epi8(lowTable, _mm_and_si128(block, nibbleMask));
+		__m128i high = _mm_shuffle_epi8(highTable, _mm_and_si128(_mm_srli_epi16(block, 4), nibbleMask));
+		int candidates = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(low, high), zero)) ^ 0xffff;
+		if (candidates != 0)
+			return data + __builtin_ctz(candidates);
+	}
+
+	return data;
+}
+#endif
+
+
+PatternMatcher::PatternMatcher(bool caseless)
+{
+	m_Caseless = caseless;
+	m_NumOfClasses = 0;
+	m_Transitions = NULL;
+	m_TransitionsSize = 0;
+	m_NumOfStates = 0;
+	m_UseShufti = false;
+	memset(m_ByteClass, 0, sizeof(m_ByteClass));
+	memset(m_IsFirstByte, 0, sizeof(m_IsFirstByte));
+	memset(m_ShuftiLow, 0, sizeof(m_ShuftiLow));
+	memset(m_ShuftiHigh, 0, sizeof(m_ShuftiHigh));
+}
+
+
+PatternMatcher::~PatternMatcher()
+{
+	if (m_Transitions != NULL)
+		freeHugePageMemory(m_Transitions, m_TransitionsSize);
+}
+
+
+bool PatternMatcher::addPattern(const std::string& pattern, const std::string& label)
+{
+	if (pattern.empty() || pattern.size() > PATTERN_MAX_LEN)
+		return false;
+
+	m_Patterns.push_back(pattern);
+	m_Labels.push_back(label.substr(0, PATTERN_MAX_LABEL_LEN));
+	return true;
+}
+
+
+bool PatternMatcher::loadPatterns(const char* fileName)
+{
+	std::ifstream file(fileName);
+	if (!file.is_open())
+	{
+		printf("Couldn't open pattern file '%s'\n", fileName);
+		return false;
+	}
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::string label;
+		std::string text = line;
+		size_t tab = line.find('\t');
+		if (tab != std::string::npos)
+		{
+			label = line.substr(0, tab);
+			text = line.substr(tab + 1);
+		}
+		else
+		{
+			std::stringstream lineLabel;
+			lineLabel << "line " << lineNumber;
+			label = lineLabel.str();
+		}
+
+		std::string pattern;
+		if (!unescapePattern(text, pattern) || !addPattern(pattern, label))
+		{
+			printf("Malformed pattern on line %d of '%s'\n", lineNumber, fileName);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+bool PatternMatcher::compile()
+{
+	if (m_Patterns.empty())
+		return false;
+
+	// every byte which appears in a pattern gets its own class, all the others share class 0. Caseless, a letter's two cases share a class
+	bool isUsed[256] = { false };
+	for (size_t i = 0; i < m_Patterns.size(); i++)
+	{
+		for (size_t j = 0; j < m_Patterns[i].size(); j++)
+		{
+			uint8_t byte = (uint8_t)m_Patterns[i][j];
+			isUsed[m_Caseless ? foldCase(byte) : byte] = true;
+		}
+	}
+
+	size_t numOfUsedBytes = 0;
+	for (int byte = 0; byte < 256; byte++)
+		numOfUsedBytes += (isUsed[byte] ? 1 : 0);
+
+	int nextClass = (numOfUsedBytes == 256 ? 0 : 1);
+	uint8_t classOfByte[256] = { 0 };
+	for (int byte = 0; byte < 256; byte++)
+	{
+		if (isUsed[byte])
+			classOfByte[byte] = (uint8_t)nextClass++;
+	}
+	m_NumOfClasses = (size_t)nextClass;
+	for (int byte = 0; byte < 256; byte++)
+		m_ByteClass[byte] = classOfByte[m_Caseless ? foldCase((uint8_t)byte) : byte];
+
+	// the trie, with the patterns which end in each state
+	size_t numOfClasses = m_NumOfClasses;
+	std::vector<uint32_t> delta(numOfClasses, NO_STATE);
+	std::vector<std::vector<uint32_t> > ownOutputs(1);
+	for (size_t i = 0; i < m_Patterns.size(); i++)
+	{
+		uint32_t state = 0;
+		for (size_t j = 0; j < m_Patterns[i].size(); j++)
+		{
+			uint8_t byteClass = m_ByteClass[(uint8_t)m_Patterns[i][j]];
+			if (delta[state * numOfClasses + byteClass] == NO_STATE)
+			{
+				delta[state * numOfClasses + byteClass] = (uint32_t)ownOutputs.size();
+				ownOutputs.push_back(std::vector<uint32_t>());
+				delta.resize(delta.size() + numOfClasses, NO_STATE);
+			}
+			state = delta[state * numOfClasses + byteClass];
+		}
+		ownOutputs[state].push_back((uint32_t)i);
+	}
+
+	m_NumOfStates = ownOutputs.size();
+	if (m_NumOfStates * numOfClasses >= STATE_MATCH_FLAG)
+	{
+		printf("Too many patterns: the automaton has %d states of %d classes\n", (int)m_NumOfStates, (int)numOfClasses);
+		return false;
+	}
+
+	// breadth first: the failure state of a state is shallower, so its transitions are complete when the state fills its missing ones from it
+	std::vector<uint32_t> failure(m_NumOfStates, 0);
+	std::vector<bool> hasOutput(m_NumOfStates, false);
+	m_OutputLink.assign(m_NumOfStates, 0);
+	std::deque<uint32_t> queue;
+	for (size_t byteClass = 0; byteClass < numOfClasses; byteClass++)
+	{
+		uint32_t child = delta[byteClass];
+		if (child == NO_STATE)
+			delta[byteClass] = 0;
+		else
+			queue.push_back(child);
+	}
+
+	while (!queue.empty())
+	{
+		uint32_t state = queue.front();
+		queue.pop_front();
+
+		uint32_t failureState = failure[state];
+		hasOutput[state] = !ownOutputs[state].empty() || hasOutput[failureState];
+		m_OutputLink[state] = (!ownOutputs[failureState].empty() ? failureState : m_OutputLink[failureState]);
+
+		for (size_t byteClass = 0; byteClass < numOfClasses; byteClass++)
+		{
+			uint32_t child = delta[state * numOfClasses + byteClass];
+			if (child == NO_STATE)
+				delta[state * numOfClasses + byteClass] = delta[failureState * numOfClasses + byteClass];
+			else
+			{
+				failure[child] = delta[failureState * numOfClasses + byteClass];
+				queue.push_back(child);
+			}
+		}
+	}
+
+	m_OutputStart.assign(m_NumOfStates, 0);
+	m_OutputCount.assign(m_NumOfStates, 0);
+	m_StateOutputs.clear();
+	for (size_t state = 0; state < m_NumOfStates; state++)
+	{
+		m_OutputStart[state] = (uint32_t)m_StateOutputs.size();
+		m_OutputCount[state] = (uint32_t)ownOutputs[state].size();
+		m_StateOutputs.insert(m_StateOutputs.end(), ownOutputs[state].begin(), ownOutputs[state].end());
+	}
+
+	// the table holds rows instead of state numbers, so a step is one add and one load
+	if (m_Transitions != NULL)
+		freeHugePageMemory(m_Transitions, m_TransitionsSize);
+	m_TransitionsSize = m_NumOfStates * numOfClasses * sizeof(uint32_t);
+	m_Transitions = (uint32_t*)allocateHugePageMemory(m_TransitionsSize);
+	if (m_Transitions == NULL)
+		throw std::bad_alloc();
+
+	for (size_t i = 0; i < delta.size(); i++)
+		m_Transitions[i] = delta[i] * (uint32_t)numOfClasses | (hasOutput[delta[i]] ? STATE_MATCH_FLAG : 0);
+
+	buildPrefilter();
+	return true;
+}
+
+
+void PatternMatcher::buildPrefilter()
+{
+	for (int byte = 0; byte < 256; byte++)
+		m_IsFirstByte[byte] = ((m_Transitions[m_ByteClass[byte]] & ~STATE_MATCH_FLAG) != 0);
+
+	// shufti: the high nibbles are grouped by the set of low nibbles they start a pattern with, each group gets a bit in the masks. With more
+	// than 8 distinct sets, sets share a bit and the test lets through a few more bytes, which the exact table then rejects
+	uint16_t lowNibbleSets[16] = { 0 };
+	for (int byte = 0; byte < 256; byte++)
+	{
+		if (m_IsFirstByte[byte])
+			lowNibbleSets[byte >> 4] |= (uint16_t)(1 << (byte & 0x0f));
+	}
+
+	std::vector<uint16_t> distinctSets;
+	memset(m_ShuftiLow, 0, sizeof(m_ShuftiLow));
+	memset(m_ShuftiHigh, 0, sizeof(m_ShuftiHigh));
+	for (int highNibble = 0; highNibble < 16; highNibble++)
+	{
+		if (lowNibbleSets[highNibble] == 0)
+			continue;
+
+		size_t bucket = 0;
+		while (bucket < distinctSets.size() && distinctSets[bucket] != lowNibbleSets[highNibble])
+			bucket++;
+		if (bucket == distinctSets.size())
+			distinctSets.push_back(lowNibbleSets[highNibble]);
+
+		uint8_t bit = (uint8_t)(1 << (bucket % 8));
+		m_ShuftiHigh[highNibble] |= bit;
+		for (int lowNibble = 0; lowNibble < 16; lowNibble++)
+		{
+			if (lowNibbleSets[highNibble] & (1 << lowNibble))
+				m_ShuftiLow[lowNibble] |= bit;
+		}
+	}
+
+#ifdef PATTERN_MATCHER_SHUFTI
+	m_UseShufti = __builtin_cpu_supports("ssse3");
+#else
+	m_UseShufti = false;
+#endif
+}
+
+
+const uint8_t* PatternMatcher::skipToCandidate(const uint8_t* data, const uint8_t* end) const
+{
+	while (data < end)
+	{
+#ifdef PATTERN_MATCHER_SHUFTI
+		if (m_UseShufti && end - data >= 16)
+		{
+			data = findShuftiCandidate(data, end, m_ShuftiLow, m_ShuftiHigh);
+			if (data == end)
+				break;
+		}
+#endif
+		if (m_IsFirstByte[*data])
+			return data;
+		data++;
+	}
+
+	return end;
+}
+
+
+size_t PatternMatcher::reportMatches(uint32_t row, uint64_t endOffset, OnPatternMatch onMatch, void* userCookie) const
+{
+	size_t numOfMatches = 0;
+	for (uint32_t state = row / (uint32_t)m_NumOfClasses; state != 0; state = m_OutputLink[state])
+	{
+		for (uint32_t i = 0; i < m_OutputCount[state]; i++)
+		{
+			if (onMatch != NULL)
+				onMatch(m_StateOutputs[m_OutputStart[state] + i], endOffset, userCookie);
+			numOfMatches++;
+		}
+	}
+
+	return numOfMatches;
+}
+
+
+size_t PatternMatcher::scan(PatternMatchState& state, const uint8_t* data, size_t dataLen, OnPatternMatch onMatch, void* userCookie) const
+{
+	const uint8_t* end = data + dataLen;
+	const uint8_t* current = data;
+	uint32_t row = state.state;
+	size_t numOfMatches = 0;
+
+	while (current < end)
+	{
+		// nothing is under way in the start state, skip to where a pattern may start
+		if (row == 0)
+		{
+			current = skipToCandidate(current, end);
+			if (current == end)
+				break;
+		}
+
+		uint32_t next = m_Transitions[row + m_ByteClass[*current++]];
+		row = next & ~STATE_MATCH_FLAG;
+		if (next & STATE_MATCH_FLAG)
+			numOfMatches += reportMatches(row, state.offset + (uint64_t)(current - data), onMatch, userCookie);
+	}
+
+	state.state = row;
+	state.offset += dataLen;
+	return numOfMatches;
+}
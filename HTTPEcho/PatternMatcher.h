@@ -0,0 +1,166 @@
+#ifndef HTTPECHO_PATTERN_MATCHER
+#define HTTPECHO_PATTERN_MATCHER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// the longest pattern, and the longest label a pattern is reported by
+#define PATTERN_MAX_LEN 255
+#define PATTERN_MAX_LABEL_LEN 31
+
+
+/**
+ * @struct PatternMatchState
+ * Where one direction of a flow is in the automaton. It carries a match across the boundary of two chunks of the stream
+ */
+struct PatternMatchState
+{
+	// the automaton state (0 is the start state)
+	uint32_t state;
+
+	// the number of stream bytes scanned so far (including holes), match offsets are counted from the start of the stream
+	uint64_t offset;
+
+	PatternMatchState() : state(0), offset(0) {}
+};
+
+
+/**
+ * @typedef OnPatternMatch
+ * A callback invoked by PatternMatcher::scan() for every match
+ * @param[in] patternId The index of the pattern which matched
+ * @param[in] endOffset The stream offset right after the match
+ * @param[in] userCookie The cookie given to scan()
+ */
+typedef void (*OnPatternMatch)(uint32_t patternId, uint64_t endOffset, void* userCookie);
+
+
+/**
+ * Finds any of a set of literal patterns (thousands of them) in streams, in one pass over the data whatever the number of patterns.
+ * The patterns are compiled into an Aho-Corasick automaton turned into a full DFA, so every byte costs one table lookup: bytes which appear in no
+ * pattern share one input class, which keeps the table at states x classes entries, and a transition into a state where a pattern ends is
+ * flagged in the table entry itself, so the scan loop only branches out on a match.
+ * While the automaton is in its start state, the scan skips ahead to the next byte which can start a pattern, 16 bytes at a time with a
+ * nibble-table (shufti) test on CPUs with SSSE3, so data which doesn't look like any pattern isn't walked byte by byte.
+ * The automaton is read-only once compiled, so all capture workers share one; each flow keeps its own PatternMatchState per direction
+ */
+class PatternMatcher
+{
+public:
+
+	/**
+	 * A c'tor for this class
+	 * @param[in] caseless Match the patterns regardless of ASCII letter case
+	 */
+	PatternMatcher(bool caseless = false);
+
+	~PatternMatcher();
+
+	/**
+	 * Add a pattern. Must be called before compile()
+	 * @param[in] pattern The pattern bytes, 1 to PATTERN_MAX_LEN of them
+	 * @param[in] label The name matches of the pattern are reported by, cut at PATTERN_MAX_LABEL_LEN
+	 * @return False if the pattern is empty or too long
+	 */
+	bool addPattern(const std::string& pattern, const std::string& label);
+
+	/**
+	 * Add the patterns of a file: one per line, as "label<TAB>pattern" or just the pattern (labelled by its line number). A pattern may use
+	 * \xHH for any byte and \\ for a backslash. Empty lines and lines starting with # are skipped
+	 * @param[in] fileName The file
+	 * @return False if the file couldn't be read or a pattern is malformed, with the reason printed
+	 */
+	bool loadPatterns(const char* fileName);
+
+	/**
+	 * Build the automaton from the patterns added
+	 * @return False if there are no patterns
+	 */
+	bool compile();
+
+	/**
+	 * Scan the next chunk of a stream
+	 * @param[in,out] state The state of the stream, updated to the end of the chunk
+	 * @param[in] data The chunk
+	 * @param[in] dataLen The chunk length
+	 * @param[in] onMatch The callback to invoke for every match
+	 * @param[in] userCookie A cookie passed to the callback
+	 * @return The number of matches
+	 */
+	size_t scan(PatternMatchState& state, const uint8_t* data, size_t dataLen, OnPatternMatch onMatch, void* userCookie) const;
+
+	/**
+	 * Skip a hole in a stream. A match can't span the hole, so the stream restarts from the start state
+	 * @param[in,out] state The state of the stream
+	 * @param[in] missingDataLen The number of bytes missing
+	 */
+	static void skipMissingData(PatternMatchState& state, uint64_t missingDataLen) { state.state = 0; state.offset += missingDataLen; }
+
+	/**
+	 * @return The number of patterns
+	 */
+	size_t getNumOfPatterns() const { return m_Patterns.size(); }
+
+	/**
+	 * @return The number of automaton states
+	 */
+	size_t getNumOfStates() const { return m_NumOfStates; }
+
+	/**
+	 * @param[in] patternId The index of a pattern
+	 * @return Its label
+	 */
+	const char* getLabel(uint32_t patternId) const { return m_Labels[patternId].c_str(); }
+
+	/**
+	 * @param[in] patternId The index of a pattern
+	 * @return Its length
+	 */
+	size_t getPatternLen(uint32_t patternId) const { return m_Patterns[patternId].size(); }
+
+	/**
+	 * @return True if the start state skip runs 16 bytes at a time on this CPU
+	 */
+	bool isVectorized() const { return m_UseShufti; }
+
+private:
+
+	bool m_Caseless;
+	std::vector<std::string> m_Patterns;
+	std::vector<std::string> m_Labels;
+
+	// the input class of every byte, and the number of classes
+	uint8_t m_ByteClass[256];
+	size_t m_NumOfClasses;
+
+	// the DFA: states x classes entries, each the target state's row (its index x classes) with STATE_MATCH_FLAG set if a pattern ends there.
+	// In huge page memory, a scan touches rows all over the table
+	uint32_t* m_Transitions;
+	size_t m_TransitionsSize;
+	size_t m_NumOfStates;
+
+	// per state: the first of the patterns which end exactly there (an index into m_StateOutputs) and how many, and the next state on the
+	// failure chain where a pattern ends (0 for none)
+	std::vector<uint32_t> m_OutputStart;
+	std::vector<uint32_t> m_OutputCount;
+	std::vector<uint32_t> m_OutputLink;
+	std::vector<uint32_t> m_StateOutputs;
+
+	// the bytes which leave the start state, as a table and as the shufti nibble masks (a superset)
+	bool m_IsFirstByte[256];
+	uint8_t m_ShuftiLow[16];
+	uint8_t m_ShuftiHigh[16];
+	bool m_UseShufti;
+
+	void buildPrefilter();
+	const uint8_t* skipToCandidate(const uint8_t* data, const uint8_t* end) const;
+	size_t reportMatches(uint32_t state, uint64_t endOffset, OnPatternMatch onMatch, void* userCookie) const;
+
+	// the matcher owns its table, prevent copies
+	PatternMatcher(const PatternMatcher& other);
+	PatternMatcher& operator=(const PatternMatcher& other);
+};
+
+#endif /* HTTPECHO_PATTERN_MATCHER */
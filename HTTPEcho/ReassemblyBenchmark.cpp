@@ -0,0 +1,347 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <vector>
+#include "ReassemblyBenchmark.h"
+#include "TcpStreamReassembly.h"
+#include "PacketBufferPool.h"
+#include "PacketDecoder.h"
+#include "header/PcapFileDevice.h"
+#include "header/Packet.h"
+#include "header/IPv4Layer.h"
+#include "header/IPv6Layer.h"
+#include "header/TcpLayer.h"
+#include "header/HttpLayer.h"
+
+// every mode runs at least this many rounds and at least this long, and the best round is reported
+#define BENCHMARK_MIN_ROUNDS 5
+#define BENCHMARK_MIN_DURATION_NSEC 1000000000ULL
+
+
+/**
+ * What the benchmark callbacks collect, mostly so the compiler can't drop the work
+ */
+struct BenchmarkCounters
+{
+	uint64_t numOfMessages;
+	uint64_t numOfBytes;
+	uint64_t numOfConnections;
+	uint64_t numOfPageFaults;
+	uint64_t numOfDtlbMisses;
+};
+
+
+/**
+ * What the decode rounds collect: the TCP packets decoded, their payload bytes and the payloads which start an HTTP message
+ */
+struct DecodeCounters
+{
+	uint64_t numOfTcpPackets;
+	uint64_t numOfPayloadBytes;
+	uint64_t numOfHttpStarts;
+};
+
+
+/**
+ * The decode paths which are compared
+ */
+enum DecodeMode
+{
+	// pcpp::Packet builds the whole layer chain, the layers are looked up with getLayerOfType()
+	DecodeWithPacket,
+	// the specialized stack up to TCP, as TcpStreamReassembly runs it
+	DecodeTcpStack,
+	// the specialized stack up to HTTP
+	DecodeHttpStack
+};
+
+
+/**
+ * A benchmarked configuration
+ */
+struct BenchmarkMode
+{
+	size_t batchSize;
+	bool useBufferPool;
+};
+
+
+static void benchmarkMsgReadyCallback(int sideIndex, const pcpp::TcpStreamData& tcpData, void* userCookie)
+{
+	BenchmarkCounters* counters = (BenchmarkCounters*)userCookie;
+	counters->numOfMessages++;
+	counters->numOfBytes += tcpData.getDataLength();
+}
+
+
+static void benchmarkConnectionStartCallback(const pcpp::ConnectionData& connectionData, void* userCookie)
+{
+	((BenchmarkCounters*)userCookie)->numOfConnections++;
+}
+
+
+static uint64_t getNumOfPageFaults()
+{
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (uint64_t)usage.ru_minflt + (uint64_t)usage.ru_majflt;
+}
+
+
+/**
+ * Open a counter of the data TLB load misses of this thread in user space, disabled. Returns -1 if the kernel or the CPU doesn't provide one
+ * (e.g. in a container, in a VM without a virtual PMU, or with kernel.perf_event_paranoid above 2)
+ */
+static int openDtlbMissCounter()
+{
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+
+static void startCounter(int counterFd)
+{
+	if (counterFd < 0)
+		return;
+
+	ioctl(counterFd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(counterFd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+
+static uint64_t stopCounter(int counterFd)
+{
+	if (counterFd < 0)
+		return 0;
+
+	ioctl(counterFd, PERF_EVENT_IOC_DISABLE, 0);
+	uint64_t value = 0;
+	if (read(counterFd, &value, sizeof(value)) != (ssize_t)sizeof(value))
+		return 0;
+
+	return value;
+}
+
+
+static uint64_t getMonotonicNsec()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+
+/**
+ * Reassemble all packets once with a fresh reassembler and return the time it took in nanoseconds.
+ * batchSize of 0 means pcpp::TcpReassembly, 1 means TcpStreamReassembly::reassemblePacket(), more means TcpStreamReassembly::reassemblePackets().
+ * If a buffer cache is given TcpStreamReassembly keeps out-of-order segments in it. The dTLB misses are counted with dtlbCounter, if it's open
+ */
+static uint64_t runRound(pcpp::RawPacket* const* packets, size_t numOfPackets, size_t batchSize, PacketBufferCache* bufferCache, int dtlbCounter,
+		BenchmarkCounters& counters)
+{
+	counters.numOfMessages = 0;
+	counters.numOfBytes = 0;
+	counters.numOfConnections = 0;
+
+	uint64_t startTime, endTime;
+	uint64_t startPageFaults = getNumOfPageFaults();
+
+	if (batchSize == 0)
+	{
+		pcpp::TcpReassembly tcpReassembly(benchmarkMsgReadyCallback, &counters, benchmarkConnectionStartCallback);
+		startCounter(dtlbCounter);
+		startTime = getMonotonicNsec();
+		for (size_t i = 0; i < numOfPackets; i++)
+			tcpReassembly.reassemblePacket(packets[i]);
+		endTime = getMonotonicNsec();
+		counters.numOfDtlbMisses = stopCounter(dtlbCounter);
+	}
+	else
+	{
+		TcpStreamReassembly tcpReassembly(benchmarkMsgReadyCallback, &counters, benchmarkConnectionStartCallback, NULL, NULL,
+				DEFAULT_CLOSED_CONNECTION_DELAY_SEC, bufferCache);
+		startCounter(dtlbCounter);
+		startTime = getMonotonicNsec();
+		if (batchSize == 1)
+		{
+			for (size_t i = 0; i < numOfPackets; i++)
+				tcpReassembly.reassemblePacket(packets[i]);
+		}
+		else
+		{
+			for (size_t i = 0; i < numOfPackets; i += batchSize)
+				tcpReassembly.reassemblePackets(packets + i, (numOfPackets - i < batchSize ? numOfPackets - i : batchSize));
+		}
+		endTime = getMonotonicNsec();
+		counters.numOfDtlbMisses = stopCounter(dtlbCounter);
+	}
+
+	counters.numOfPageFaults = getNumOfPageFaults() - startPageFaults;
+
+	// the reassembler's d'tor (freeing the connections) is not part of the measurement
+	return endTime - startTime;
+}
+
+
+/**
+ * Decode all packets once and return the time it took in nanoseconds
+ */
+static uint64_t runDecodeRound(pcpp::RawPacket* const* packets, size_t numOfPackets, DecodeMode mode, DecodeCounters& counters)
+{
+	counters.numOfTcpPackets = 0;
+	counters.numOfPayloadBytes = 0;
+	counters.numOfHttpStarts = 0;
+
+	uint64_t startTime = getMonotonicNsec();
+	for (size_t i = 0; i < numOfPackets; i++)
+	{
+		if (mode == DecodeWithPacket)
+		{
+			pcpp::Packet parsedPacket(packets[i], false);
+			pcpp::TcpLayer* tcpLayer = parsedPacket.getLayerOfType<pcpp::TcpLayer>();
+			if (tcpLayer == NULL || (parsedPacket.getLayerOfType<pcpp::IPv4Layer>() == NULL && parsedPacket.getLayerOfType<pcpp::IPv6Layer>() == NULL))
+				continue;
+
+			counters.numOfTcpPackets++;
+			counters.numOfPayloadBytes += tcpLayer->getLayerPayloadSize();
+			if (parsedPacket.getLayerOfType<pcpp::HttpRequestLayer>() != NULL || parsedPacket.getLayerOfType<pcpp::HttpResponseLayer>() != NULL)
+				counters.numOfHttpStarts++;
+		}
+		else
+		{
+			PacketView view;
+			bool decoded = (mode == DecodeTcpStack ? decodeTcpPacket<>(packets[i], view) : decodeTcpPacket<HttpDecoder>(packets[i], view));
+			if (!decoded)
+				continue;
+
+			counters.numOfTcpPackets++;
+			counters.numOfPayloadBytes += view.payloadLen;
+			if (mode == DecodeHttpStack && view.httpStart != HttpNoMessageStart)
+				counters.numOfHttpStarts++;
+		}
+	}
+
+	return getMonotonicNsec() - startTime;
+}
+
+
+/**
+ * Print the per-packet decode cost of pcpp::Packet and of the specialized decode stacks
+ */
+static void runDecodeBenchmark(const std::vector<pcpp::RawPacket*>& packets)
+{
+	printf("%-48s %10s %10s %12s %12s %12s\n", "Decode path", "ns/packet", "Mpps", "TCP packets", "MB payload", "HTTP starts");
+
+	const DecodeMode modes[] = { DecodeWithPacket, DecodeTcpStack, DecodeHttpStack };
+	const char* modeNames[] = { "pcpp::Packet + getLayerOfType()", "DecodeStack, up to TCP", "DecodeStack, up to HTTP" };
+	for (size_t mode = 0; mode < sizeof(modes) / sizeof(modes[0]); mode++)
+	{
+		DecodeCounters counters;
+		uint64_t bestRound = UINT64_MAX;
+		uint64_t totalTime = 0;
+		for (int round = 0; round < BENCHMARK_MIN_ROUNDS || totalTime < BENCHMARK_MIN_DURATION_NSEC; round++)
+		{
+			uint64_t roundTime = runDecodeRound(&packets[0], packets.size(), modes[mode], counters);
+			totalTime += roundTime;
+			if (roundTime < bestRound)
+				bestRound = roundTime;
+		}
+
+		// pcpp::Packet only parses HTTP on the well known HTTP ports, the HTTP stack looks at every payload
+		double nsPerPacket = (double)bestRound / (double)packets.size();
+		printf("%-48s %10.1f %10.2f %12llu %12.1f %12llu\n", modeNames[mode], nsPerPacket, 1000.0 / nsPerPacket,
+			(unsigned long long)counters.numOfTcpPackets, (double)counters.numOfPayloadBytes / 1e6, (unsigned long long)counters.numOfHttpStarts);
+	}
+
+	printf("\n");
+}
+
+
+bool runReassemblyBenchmark(const char* pcapFileName)
+{
+	pcpp::IFileReaderDevice* reader = pcpp::IFileReaderDevice::getReader(pcapFileName);
+	if (reader == NULL || !reader->open())
+	{
+		delete reader;
+		return false;
+	}
+
+	pcpp::RawPacketVector packetVec;
+	reader->getNextPackets(packetVec);
+	reader->close();
+	delete reader;
+
+	// the packets are fed straight from an array, the way the capture workers hand them over
+	std::vector<pcpp::RawPacket*> packets(packetVec.begin(), packetVec.end());
+	if (packets.empty())
+	{
+		printf("No packets in '%s'\n", pcapFileName);
+		return true;
+	}
+
+	printf("Decode and reassembly benchmark on %d packets from '%s'\n\n", (int)packets.size(), pcapFileName);
+	runDecodeBenchmark(packets);
+
+	// dTLB load misses show what the buffer pool's huge pages save. They need a hardware counter, without one the column is left empty
+	int dtlbCounter = openDtlbMissCounter();
+	if (dtlbCounter < 0)
+		printf("dTLB load misses aren't counted: perf_event_open() failed (%s)\n\n", strerror(errno));
+
+	printf("%-48s %10s %10s %12s %12s %12s %14s\n", "Mode", "ns/packet", "Mpps", "Messages", "Connections", "Page faults", "dTLB misses");
+
+	PacketBufferPool bufferPool;
+	PacketBufferCache bufferCache(&bufferPool);
+
+	const BenchmarkMode modes[] = { { 0, false }, { 1, false }, { 32, false }, { 64, false }, { 256, false }, { 1, true }, { 64, true } };
+	for (size_t mode = 0; mode < sizeof(modes) / sizeof(modes[0]); mode++)
+	{
+		size_t batchSize = modes[mode].batchSize;
+		PacketBufferCache* modeBufferCache = (modes[mode].useBufferPool ? &bufferCache : NULL);
+		BenchmarkCounters counters;
+		uint64_t bestRound = UINT64_MAX;
+		uint64_t totalTime = 0;
+		for (int round = 0; round < BENCHMARK_MIN_ROUNDS || totalTime < BENCHMARK_MIN_DURATION_NSEC; round++)
+		{
+			uint64_t roundTime = runRound(&packets[0], packets.size(), batchSize, modeBufferCache, dtlbCounter, counters);
+			totalTime += roundTime;
+			if (roundTime < bestRound)
+				bestRound = roundTime;
+		}
+
+		char modeName[64];
+		if (batchSize == 0)
+			snprintf(modeName, sizeof(modeName), "pcpp::TcpReassembly, per packet");
+		else if (batchSize == 1)
+			snprintf(modeName, sizeof(modeName), "TcpStreamReassembly, per packet%s", modeBufferCache != NULL ? ", buffer pool" : "");
+		else
+			snprintf(modeName, sizeof(modeName), "TcpStreamReassembly, burst of %d%s", (int)batchSize, modeBufferCache != NULL ? ", buffer pool" : "");
+
+		// page faults and dTLB misses are those of the last round, when the allocator (or the pool) is warm
+		char dtlbMisses[24] = "-";
+		if (dtlbCounter >= 0)
+			snprintf(dtlbMisses, sizeof(dtlbMisses), "%llu", (unsigned long long)counters.numOfDtlbMisses);
+		double nsPerPacket = (double)bestRound / (double)packets.size();
+		printf("%-48s %10.1f %10.2f %12llu %12llu %12llu %14s\n", modeName, nsPerPacket, 1000.0 / nsPerPacket,
+			(unsigned long long)counters.numOfMessages, (unsigned long long)counters.numOfConnections, (unsigned long long)counters.numOfPageFaults,
+			dtlbMisses);
+	}
+
+	if (dtlbCounter >= 0)
+		close(dtlbCounter);
+
+	return true;
+}
@@ -0,0 +1,14 @@
+#ifndef HTTPECHO_REASSEMBLY_BENCHMARK
+#define HTTPECHO_REASSEMBLY_BENCHMARK
+
+/**
+ * Measure packet decode and TCP reassembly throughput on the packets of a capture file. The file is loaded to memory once. The packets are first
+ * decoded with pcpp::Packet (looking the layers up with getLayerOfType()) and with the specialized stacks of PacketDecoder.h, up to TCP and up
+ * to HTTP. Then they are reassembled with pcpp::TcpReassembly and with TcpStreamReassembly one packet at a time and in bursts of 32, 64 and 256
+ * packets. The callbacks only count the delivered bytes so the numbers reflect the reassembly cost alone. Results are printed to stdout
+ * @param[in] pcapFileName The capture file (pcap or pcapng) to use
+ * @return True if the file could be read, false otherwise
+ */
+bool runReassemblyBenchmark(const char* pcapFileName);
+
+#endif /* HTTPECHO_REASSEMBLY_BENCHMARK */
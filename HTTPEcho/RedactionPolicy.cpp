@@ -0,0 +1,134 @@
+#include <string.h>
+#include <strings.h>
+#include <string>
+#include <random>
+#include "RedactionPolicy.h"
+
+// the headers "default" stands for
+static const char* s_DefaultHeaders[] = { "Cookie", "Set-Cookie", "Authorization", "Proxy-Authorization" };
+
+// the mask written for redacted bytes, in pieces of this size
+static const char s_Mask[] = "****************************************************************";
+
+
+RedactionPolicy::RedactionPolicy()
+{
+	m_HasQueryRules = false;
+
+	std::random_device randomDevice;
+	for (size_t i = 0; i < sizeof(m_HashKey); i += 4)
+	{
+		uint32_t random = randomDevice();
+		memcpy(m_HashKey + i, &random, 4);
+	}
+}
+
+
+bool RedactionPolicy::parse(const char* policy)
+{
+	std::vector<Rule> rules;
+	std::string policyText(policy);
+
+	size_t ruleStart = 0;
+	while (ruleStart <= policyText.size())
+	{
+		size_t ruleEnd = policyText.find(',', ruleStart);
+		if (ruleEnd == std::string::npos)
+			ruleEnd = policyText.size();
+		std::string ruleText = policyText.substr(ruleStart, ruleEnd - ruleStart);
+		ruleStart = ruleEnd + 1;
+
+		Rule rule;
+		rule.action = REDACT_MASK;
+		if (ruleText == "default")
+		{
+			for (size_t i = 0; i < sizeof(s_DefaultHeaders) / sizeof(s_DefaultHeaders[0]); i++)
+			{
+				rule.isHeader = true;
+				strcpy(rule.name, s_DefaultHeaders[i]);
+				rule.nameLen = strlen(rule.name);
+				rules.push_back(rule);
+			}
+			continue;
+		}
+
+		// header|query:name[:mask|hash]
+		size_t firstColon = ruleText.find(':');
+		if (firstColon == std::string::npos)
+			return false;
+		size_t secondColon = ruleText.find(':', firstColon + 1);
+		std::string target = ruleText.substr(0, firstColon);
+		std::string name = ruleText.substr(firstColon + 1, secondColon == std::string::npos ? std::string::npos : secondColon - firstColon - 1);
+
+		if (target != "header" && target != "query")
+			return false;
+		if (name.empty() || name.size() > REDACTION_MAX_NAME_LEN)
+			return false;
+		if (secondColon != std::string::npos)
+		{
+			std::string action = ruleText.substr(secondColon + 1);
+			if (action == "hash")
+				rule.action = REDACT_HASH;
+			else if (action != "mask")
+				return false;
+		}
+
+		rule.isHeader = (target == "header");
+		strcpy(rule.name, name.c_str());
+		rule.nameLen = name.size();
+		rules.push_back(rule);
+	}
+
+	for (size_t i = 0; i < rules.size(); i++)
+		addRule(rules[i].isHeader, rules[i].name, rules[i].action);
+	return true;
+}
+
+
+void RedactionPolicy::addRule(bool isHeader, const char* name, uint8_t action)
+{
+	Rule rule;
+	rule.isHeader = isHeader;
+	rule.name[0] = '\0';
+	strncat(rule.name, name, REDACTION_MAX_NAME_LEN);
+	rule.nameLen = strlen(rule.name);
+	rule.action = action;
+	m_Rules.push_back(rule);
+
+	if (!isHeader)
+		m_HasQueryRules = true;
+}
+
+
+int RedactionPolicy::findRule(bool isHeader, const char* name, size_t nameLen) const
+{
+	for (size_t i = 0; i < m_Rules.size(); i++)
+	{
+		const Rule& rule = m_Rules[i];
+		if (rule.isHeader == isHeader && rule.nameLen == nameLen && strncasecmp(rule.name, name, nameLen) == 0)
+			return rule.action;
+	}
+
+	return -1;
+}
+
+
+void RedactionPolicy::startDigest(Md5& digest) const
+{
+	digest.reset();
+	digest.update(m_HashKey, sizeof(m_HashKey));
+}
+
+
+void RedactionPolicy::writeReplacement(std::ostream& stream, const RedactedSpan& span)
+{
+	size_t maskLen = span.replacementLen - span.digestLen;
+	while (maskLen > 0)
+	{
+		size_t pieceLen = (maskLen < sizeof(s_Mask) - 1 ? maskLen : sizeof(s_Mask) - 1);
+		stream.write(s_Mask, pieceLen);
+		maskLen -= pieceLen;
+	}
+
+	stream.write(span.digest, span.digestLen);
+}
@@ -0,0 +1,116 @@
+#ifndef HTTPECHO_REDACTION_POLICY
+#define HTTPECHO_REDACTION_POLICY
+
+#include <stdint.h>
+#include <stddef.h>
+#include <ostream>
+#include <vector>
+#include "Md5.h"
+
+// the longest header / query parameter name a rule can match
+#define REDACTION_MAX_NAME_LEN 63
+
+// what a redacted value is replaced with: '*' for every byte, or a keyed digest (the rest of a value longer than the digest is masked)
+#define REDACT_MASK 0
+#define REDACT_HASH 1
+
+// the number of hex digest chars a hashed value ends with at most
+#define REDACTION_DIGEST_LEN 32
+
+
+/**
+ * @struct RedactedSpan
+ * A range of a chunk of stream data which is replaced when written, by replacementLen bytes: masks, except for the last digestLen, which are
+ * the first digestLen chars of digest. A hashed value split over chunks doesn't know its digest until it ends, so the last bytes of its earlier
+ * pieces are held back (replacementLen is shorter than length) and written with its last piece (replacementLen is longer). Over a whole value
+ * the two add up the same
+ */
+struct RedactedSpan
+{
+	uint32_t offset;
+	uint32_t length;
+	uint32_t replacementLen;
+	uint8_t digestLen;
+	char digest[REDACTION_DIGEST_LEN];
+};
+
+
+/**
+ * Decides which HTTP header values and request query parameter values are redacted in the capture files, and how. A policy is written as a comma
+ * separated list of "header:name[:action]" and "query:name[:action]" rules, where names are matched regardless of case and the action is "mask"
+ * (the default) or "hash". "default" stands for the Cookie, Set-Cookie, Authorization and Proxy-Authorization headers, masked.
+ * A hashed value becomes a digest of the value keyed with a random key picked at startup, so equal values (e.g. one session cookie) can still
+ * be told apart and followed within a run, but the value can't be looked up from its digest. The replacement always has the length of the
+ * value, so nothing after it in the file moves. A policy is read-only once parsed, so all capture workers can share one
+ */
+class RedactionPolicy
+{
+public:
+
+	/**
+	 * A c'tor for this class, creates an empty policy which redacts nothing and picks the hash key
+	 */
+	RedactionPolicy();
+
+	/**
+	 * Parse a policy and append its rules
+	 * @param[in] policy The policy
+	 * @return False if the policy is malformed, in which case no rule was added
+	 */
+	bool parse(const char* policy);
+
+	/**
+	 * Append a rule
+	 * @param[in] isHeader Whether the rule matches a header (or a query parameter)
+	 * @param[in] name The header / query parameter name, cut at REDACTION_MAX_NAME_LEN
+	 * @param[in] action REDACT_MASK or REDACT_HASH
+	 */
+	void addRule(bool isHeader, const char* name, uint8_t action);
+
+	/**
+	 * @param[in] isHeader Whether the name is a header name (or a query parameter name)
+	 * @param[in] name The name, not null-terminated
+	 * @param[in] nameLen The name length
+	 * @return The action of the first rule which matches the name, -1 if none does
+	 */
+	int findRule(bool isHeader, const char* name, size_t nameLen) const;
+
+	/**
+	 * Start the keyed digest of a value
+	 * @param[out] digest The digest to start
+	 */
+	void startDigest(Md5& digest) const;
+
+	/**
+	 * @return True if the policy has no rules, i.e. it redacts nothing
+	 */
+	bool isEmpty() const { return m_Rules.empty(); }
+
+	/**
+	 * @return True if the policy has query parameter rules, i.e. request lines have to be looked at
+	 */
+	bool hasQueryRules() const { return m_HasQueryRules; }
+
+	/**
+	 * Write the replacement of a redacted span
+	 * @param[in] stream The stream to write to
+	 * @param[in] span The span
+	 */
+	static void writeReplacement(std::ostream& stream, const RedactedSpan& span);
+
+private:
+
+	struct Rule
+	{
+		bool isHeader;
+		char name[REDACTION_MAX_NAME_LEN + 1];
+		size_t nameLen;
+		uint8_t action;
+	};
+
+	std::vector<Rule> m_Rules;
+	bool m_HasQueryRules;
+	uint8_t m_HashKey[16];
+};
+
+#endif /* HTTPECHO_REDACTION_POLICY */
@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <new>
+#include "ReplayCoordinator.h"
+#include "CpuTopology.h"
+
+
+/**
+ * @struct ReplayBarrier
+ * The start of the memory shared by the coordinator and the workers, followed by one ReplayWorkerResult per worker
+ */
+struct ReplayBarrier
+{
+	// the number of workers ready to start, and the start time the coordinator publishes once all are (0 until then)
+	std::atomic<uint32_t> numOfReady;
+	std::atomic<uint64_t> startTimeUsec;
+};
+
+
+static uint64_t getMonotonicUsec()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000ULL + (uint64_t)now.tv_nsec / 1000;
+}
+
+
+static ReplayWorkerResult* getWorkerResults(ReplayBarrier* barrier)
+{
+	size_t resultsOffset = (sizeof(ReplayBarrier) + 63) & ~(size_t)63;
+	return (ReplayWorkerResult*)((char*)barrier + resultsOffset);
+}
+
+
+/**
+ * @return The endpoint histograms of a worker, which follow the results of all workers
+ */
+static LatencyHistogram* getEndpointResponseTimes(ReplayBarrier* barrier, int numOfWorkers, size_t numOfEndpoints, int workerIndex)
+{
+	LatencyHistogram* endpointResponseTimes = (LatencyHistogram*)(getWorkerResults(barrier) + numOfWorkers);
+	return endpointResponseTimes + (size_t)workerIndex * numOfEndpoints;
+}
+
+
+/**
+ * The body of a worker process: set up, meet the others at the barrier, replay, and leave the result in shared memory
+ */
+static void runWorkerProcess(const ReplayCorpus& corpus, const ReplayConfig& config, ResponseVerifier* verifier, int workerIndex,
+	ReplayBarrier* barrier)
+{
+	if (!config.workerCores.empty())
+		pinCurrentThread(config.workerCores[workerIndex % config.workerCores.size()]);
+
+	ReplayWorkerResult& result = getWorkerResults(barrier)[workerIndex];
+	LatencyHistogram* endpointResponseTime = getEndpointResponseTimes(barrier, config.numOfWorkers, corpus.getNumOfEndpoints(), workerIndex);
+	ReplayWorker worker(corpus, (const sockaddr*)&config.target, config.targetLen, config.mode, config.connectionsPerWorker, config.schedule,
+		config.requestsPerSec, workerIndex, config.numOfWorkers, verifier);
+	bool ready = worker.init();
+
+	// a worker which failed still reports at the barrier, so the others aren't held up waiting for it
+	barrier->numOfReady.fetch_add(1);
+	uint64_t startTimeUsec;
+	while ((startTimeUsec = barrier->startTimeUsec.load()) == 0)
+		usleep(100);
+
+	if (ready)
+		worker.run(startTimeUsec, (uint64_t)config.durationSec * 1000000ULL, result, endpointResponseTime);
+	else
+		result.failed = true;
+}
+
+
+static void printEndpointLine(const char* name, const LatencyHistogram& responseTime)
+{
+	printf("%-40.40s %10llu %9llu %9llu %9llu %9llu\n", name, (unsigned long long)responseTime.getCount(),
+		(unsigned long long)responseTime.getValueAtPercentile(50), (unsigned long long)responseTime.getValueAtPercentile(99),
+		(unsigned long long)responseTime.getValueAtPercentile(99.9), (unsigned long long)responseTime.getMax());
+}
+
+
+static void printResultLine(const char* name, const ReplayWorkerResult& result)
+{
+	double seconds = (double)result.elapsedUsec / 1000000.0;
+	printf("%-8s %10llu %10llu %8llu %8llu %8llu %10llu %11.0f %9llu %9llu %9llu %9llu\n", name,
+		(unsigned long long)result.numOfRequests, (unsigned long long)result.numOfResponses, (unsigned long long)result.numOfServerErrors,
+		(unsigned long long)result.numOfBrokenConnections, (unsigned long long)result.numOfConnectFailures,
+		(unsigned long long)result.numOfUnfinished, seconds > 0 ? (double)result.numOfResponses / seconds : 0.0,
+		(unsigned long long)result.timeToFirstByte.getValueAtPercentile(50), (unsigned long long)result.timeToFirstByte.getValueAtPercentile(99),
+		(unsigned long long)result.responseTime.getValueAtPercentile(50), (unsigned long long)result.responseTime.getValueAtPercentile(99));
+}
+
+
+bool resolveReplayTarget(const char* target, ReplayConfig& config)
+{
+	std::string targetText(target);
+	size_t portSeparator = targetText.rfind(':');
+	if (portSeparator == std::string::npos || portSeparator == 0 || portSeparator + 1 == targetText.size())
+		return false;
+
+	std::string host = targetText.substr(0, portSeparator);
+	std::string port = targetText.substr(portSeparator + 1);
+	if (host.size() >= 2 && host[0] == '[' && host[host.size() - 1] == ']')
+		host = host.substr(1, host.size() - 2);
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo* addresses = NULL;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0 || addresses == NULL)
+		return false;
+
+	memset(&config.target, 0, sizeof(config.target));
+	memcpy(&config.target, addresses->ai_addr, addresses->ai_addrlen);
+	config.targetLen = addresses->ai_addrlen;
+	config.targetName = targetText;
+	freeaddrinfo(addresses);
+	return true;
+}
+
+
+bool runReplay(const ReplayCorpus& corpus, const ReplayConfig& config)
+{
+	int numOfWorkers = config.numOfWorkers;
+	size_t numOfEndpoints = corpus.getNumOfEndpoints();
+	size_t sharedSize = ((sizeof(ReplayBarrier) + 63) & ~(size_t)63) + numOfWorkers * sizeof(ReplayWorkerResult) +
+		numOfWorkers * numOfEndpoints * sizeof(LatencyHistogram);
+	void* sharedMemory = mmap(NULL, sharedSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (sharedMemory == MAP_FAILED)
+	{
+		printf("Couldn't map %d bytes of shared memory for the replay workers\n", (int)sharedSize);
+		return false;
+	}
+
+	ReplayBarrier* barrier = new (sharedMemory) ReplayBarrier();
+	barrier->numOfReady.store(0);
+	barrier->startTimeUsec.store(0);
+	ReplayWorkerResult* results = getWorkerResults(barrier);
+	for (int i = 0; i < numOfWorkers; i++)
+	{
+		new (&results[i]) ReplayWorkerResult();
+		results[i].clear();
+
+		LatencyHistogram* endpointResponseTimes = getEndpointResponseTimes(barrier, numOfWorkers, numOfEndpoints, i);
+		for (size_t endpoint = 0; endpoint < numOfEndpoints; endpoint++)
+			new (&endpointResponseTimes[endpoint]) LatencyHistogram();
+	}
+
+	// the captured responses are digested before forking, so the workers share the digests
+	ResponseVerifier verifier(config.ignoredHeaders);
+	if (config.verifyResponses)
+	{
+		if (!verifier.createDiffFile(config.diffFilePath))
+		{
+			printf("Couldn't create response diff file '%s'\n", config.diffFilePath.c_str());
+			munmap(sharedMemory, sharedSize);
+			return false;
+		}
+		verifier.loadCorpus(corpus);
+	}
+
+	printf("Replaying %d requests of %d connections to %s: %d worker%s x ", (int)corpus.getNumOfRequests(), (int)corpus.getNumOfConnections(),
+		config.targetName.c_str(), numOfWorkers, numOfWorkers > 1 ? "s" : "");
+	if (config.mode == ConnectionReplay)
+		printf("a connection per captured connection, with the captured %s", corpus.numOfTimedConnections > 0 ? "timing" : "order (no turn index)");
+	else
+		printf("%d connection%s", (int)config.connectionsPerWorker, config.connectionsPerWorker > 1 ? "s" : "");
+	if (config.schedule == CapturedSchedule)
+		printf(", requests sent at their captured times");
+	else if (config.schedule == PoissonSchedule)
+		printf(", Poisson arrivals at %.0f requests/s", config.requestsPerSec);
+	else if (config.schedule == FixedRateSchedule)
+		printf(", %.0f requests/s", config.requestsPerSec);
+	if (config.durationSec > 0)
+		printf(", for %s%u seconds\n", config.mode == ConnectionReplay ? "at most " : "", config.durationSec);
+	else
+		printf(", once\n");
+
+	// the children inherit the stdout buffer, it's emptied first so nothing is printed twice
+	fflush(stdout);
+
+	std::vector<pid_t> workerPids;
+	for (int i = 0; i < numOfWorkers; i++)
+	{
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			runWorkerProcess(corpus, config, config.verifyResponses ? &verifier : NULL, i, barrier);
+			_exit(0);
+		}
+
+		if (pid < 0)
+		{
+			printf("Couldn't start replay worker %d\n", i);
+			results[i].failed = true;
+			continue;
+		}
+
+		workerPids.push_back(pid);
+	}
+
+	// the barrier: wait for all workers to be ready (a worker which died on the way counts as ready), then publish the start time
+	size_t numOfExited = 0;
+	while (barrier->numOfReady.load() + numOfExited < workerPids.size())
+	{
+		int status;
+		if (waitpid(-1, &status, WNOHANG) > 0)
+			numOfExited++;
+		else
+			usleep(1000);
+	}
+	barrier->startTimeUsec.store(getMonotonicUsec() + REPLAY_START_DELAY_USEC);
+
+	while (numOfExited < workerPids.size())
+	{
+		int status;
+		if (waitpid(-1, &status, 0) > 0)
+			numOfExited++;
+	}
+
+	printf("\n%-8s %10s %10s %8s %8s %8s %10s %11s %9s %9s %9s %9s\n", "Worker", "Requests", "Responses", "5xx", "Broken", "No conn", "Unfinished",
+		"Responses/s", "TTFB p50", "TTFB p99", "Resp p50", "Resp p99");
+
+	ReplayWorkerResult total;
+	total.clear();
+	for (int i = 0; i < numOfWorkers; i++)
+	{
+		char name[16];
+		snprintf(name, sizeof(name), "%d", i);
+		if (results[i].failed)
+			printf("%-8s failed to start\n", name);
+		else
+			printResultLine(name, results[i]);
+		total.merge(results[i]);
+	}
+	printResultLine("All", total);
+	printf("\nLatencies in microseconds, from the last byte of the request sent. TTFB p90/max: %llu/%llu, response time p90/max: %llu/%llu. "
+		"%llu connections opened, %llu bytes sent, %llu received\n", (unsigned long long)total.timeToFirstByte.getValueAtPercentile(90),
+		(unsigned long long)total.timeToFirstByte.getMax(), (unsigned long long)total.responseTime.getValueAtPercentile(90),
+		(unsigned long long)total.responseTime.getMax(), (unsigned long long)total.numOfConnects, (unsigned long long)total.bytesSent,
+		(unsigned long long)total.bytesReceived);
+
+	// a closed loop sends each request when the one before it is done, so a stall of the server delays requests rather than showing in their latency
+	if (config.mode == PooledReplay && config.schedule == ClosedLoopSchedule)
+		printf("\nResponse time per endpoint in microseconds. Closed loop: a server stall holds the next requests back instead of showing in their "
+			"latency, use an open-loop schedule (-A) for the latency under a given load\n");
+	else
+		printf("\nResponse time per endpoint in microseconds, from the intended send time (corrected for coordinated omission). %llu requests "
+			"went out more than %d ms late\n", (unsigned long long)total.numOfLateRequests, REPLAY_LATE_SEND_USEC / 1000);
+	printf("%-40s %10s %9s %9s %9s %9s\n", "Endpoint", "Responses", "p50", "p99", "p99.9", "Max");
+
+	for (size_t endpoint = 0; endpoint < numOfEndpoints; endpoint++)
+	{
+		LatencyHistogram endpointTotal;
+		for (int i = 0; i < numOfWorkers; i++)
+			endpointTotal.merge(getEndpointResponseTimes(barrier, numOfWorkers, numOfEndpoints, i)[endpoint]);
+		if (endpointTotal.getCount() > 0)
+			printEndpointLine(corpus.getEndpointName(endpoint).c_str(), endpointTotal);
+	}
+	printEndpointLine("All", total.intendedResponseTime);
+
+	if (config.verifyResponses)
+		printf("\nVerified %llu responses against the capture: %llu differ (%llu by status, %llu by headers, %llu by body), diffs written to '%s'\n",
+			(unsigned long long)total.verify.numOfVerified, (unsigned long long)total.verify.numOfMismatches,
+			(unsigned long long)total.verify.numOfStatusMismatches, (unsigned long long)total.verify.numOfHeaderMismatches,
+			(unsigned long long)total.verify.numOfBodyMismatches, config.diffFilePath.c_str());
+
+	bool started = !workerPids.empty();
+	munmap(sharedMemory, sharedSize);
+	return started;
+}
@@ -0,0 +1,78 @@
+#ifndef HTTPECHO_REPLAY_COORDINATOR
+#define HTTPECHO_REPLAY_COORDINATOR
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <string>
+#include <vector>
+#include "ReplayCorpus.h"
+#include "ReplayWorker.h"
+
+// the max number of replay worker processes
+#define REPLAY_MAX_WORKERS 256
+
+// the coordinated start is set this far after the last worker reports ready, so every worker sees it before it's due
+#define REPLAY_START_DELAY_USEC 20000
+
+
+/**
+ * @struct ReplayConfig
+ * How a corpus is replayed
+ */
+struct ReplayConfig
+{
+	// the server to replay to, as given and resolved
+	std::string targetName;
+	sockaddr_storage target;
+	socklen_t targetLen;
+
+	// how the requests are put on connections
+	ReplayMode mode;
+
+	// when the requests are sent (PooledReplay only), and the rate of PoissonSchedule and FixedRateSchedule in requests per second for all
+	// workers together
+	ReplaySchedule schedule;
+	double requestsPerSec;
+
+	// the number of worker processes, and of connections each one keeps to the target (PooledReplay only)
+	int numOfWorkers;
+	size_t connectionsPerWorker;
+
+	// how long to replay (with PooledReplay the corpus is sent over and over), 0 to send it once
+	uint32_t durationSec;
+
+	// compare the responses with the captured ones (see ResponseVerifier): the headers not to compare (comma separated) and the file the
+	// differences are written to
+	bool verifyResponses;
+	std::string ignoredHeaders;
+	std::string diffFilePath;
+
+	// the cores the workers are pinned to, worker i on core i (wrapping around). Empty to leave them unpinned
+	std::vector<int> workerCores;
+};
+
+
+/**
+ * Resolve the target of a replay
+ * @param[in] target The target as host:port, [IPv6 address]:port or an IP address and port
+ * @param[out] config The config the target is set in
+ * @return False if the target is malformed or can't be resolved
+ */
+bool resolveReplayTarget(const char* target, ReplayConfig& config);
+
+/**
+ * Replay a corpus with several worker processes, shared-nothing: the corpus is split by captured connection and each worker (see ReplayWorker)
+ * replays its share with its own event loop and connection pool. The workers are forked once the corpus is loaded, so they share its pages
+ * without copying them. They meet at a barrier in shared memory: each one reports ready once its loop is set up, and when all are, the
+ * coordinator publishes a start time a little ahead, which they all wait out, so no worker runs ahead while others are still starting.
+ * Every worker writes its counters and latency histograms (overall and per endpoint) into its own slot of the shared memory, and when all have
+ * exited the coordinator merges the slots and prints the rate and latency of each worker and of all of them, then the latency of each endpoint
+ * measured from the intended send times, and what the response verification found
+ * @param[in] corpus The corpus
+ * @param[in] config How to replay it
+ * @return False if no worker could be started
+ */
+bool runReplay(const ReplayCorpus& corpus, const ReplayConfig& config);
+
+#endif /* HTTPECHO_REPLAY_COORDINATOR */
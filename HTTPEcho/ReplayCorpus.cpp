@@ -0,0 +1,306 @@
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include <fstream>
+#include <algorithm>
+#include "ReplayCorpus.h"
+#include "HttpMessageFramer.h"
+
+// the request methods a message has to start with to be replayed
+static const char* s_RequestMethods[] = { "GET ", "POST ", "PUT ", "HEAD ", "DELETE ", "OPTIONS ", "PATCH ", "CONNECT ", "TRACE " };
+
+// the size of a gap index record and of a turn index record (see writeGapIndex and writeTurnIndex in main.cpp)
+#define GAP_RECORD_SIZE 16
+#define TURN_RECORD_SIZE 32
+
+
+/**
+ * Read a little-endian number of 8 bytes
+ */
+static uint64_t readUInt64(const uint8_t* bytes)
+{
+	uint64_t value = 0;
+	for (int byte = 7; byte >= 0; byte--)
+		value = (value << 8) | bytes[byte];
+	return value;
+}
+
+
+/**
+ * @return The length of the request method the data starts with (including the space), 0 if it doesn't start with one
+ */
+static size_t getRequestMethodLen(const uint8_t* data, size_t dataLen)
+{
+	for (size_t i = 0; i < sizeof(s_RequestMethods) / sizeof(s_RequestMethods[0]); i++)
+	{
+		size_t methodLen = strlen(s_RequestMethods[i]);
+		if (dataLen >= methodLen && memcmp(data, s_RequestMethods[i], methodLen) == 0)
+			return methodLen;
+	}
+
+	return 0;
+}
+
+
+static bool hasSuffix(const std::string& str, const char* suffix)
+{
+	size_t suffixLen = strlen(suffix);
+	return str.size() >= suffixLen && str.compare(str.size() - suffixLen, suffixLen, suffix) == 0;
+}
+
+
+ReplayCorpus::ReplayCorpus()
+{
+	numOfSkippedFiles = 0;
+	numOfTruncatedFiles = 0;
+	numOfTimedConnections = 0;
+	m_FirstStartTimeUsec = 0;
+}
+
+
+bool ReplayCorpus::load(const char* dirName)
+{
+	DIR* dir = opendir(dirName);
+	if (dir == NULL)
+		return false;
+
+	std::vector<std::string> fileNames;
+	dirent* entry;
+	while ((entry = readdir(dir)) != NULL)
+	{
+		std::string fileName(entry->d_name);
+		if (hasSuffix(fileName, ".txt"))
+			fileNames.push_back(fileName);
+	}
+	closedir(dir);
+
+	// directory order is arbitrary, the corpus (and so the way it's partitioned) shouldn't be
+	std::sort(fileNames.begin(), fileNames.end());
+
+	for (size_t i = 0; i < fileNames.size(); i++)
+	{
+		if (!loadFile(std::string(dirName) + '/' + fileNames[i], fileNames[i]))
+			numOfSkippedFiles++;
+	}
+
+	return true;
+}
+
+
+uint64_t ReplayCorpus::readFirstGapOffset(const std::string& gapsFilePath) const
+{
+	std::ifstream gapsFile(gapsFilePath.c_str(), std::ios_base::binary);
+	uint64_t firstGapOffset = UINT64_MAX;
+	uint8_t record[GAP_RECORD_SIZE];
+	while (gapsFile.read((char*)record, sizeof(record)))
+	{
+		uint64_t fileOffset = readUInt64(record);
+		if (fileOffset < firstGapOffset)
+			firstGapOffset = fileOffset;
+	}
+
+	return firstGapOffset;
+}
+
+
+bool ReplayCorpus::loadFile(const std::string& filePath, const std::string& fileName)
+{
+	std::ifstream file(filePath.c_str(), std::ios_base::binary | std::ios_base::ate);
+	if (!file)
+		return false;
+
+	uint64_t fileSize = (uint64_t)file.tellg();
+	std::string gapsFilePath = filePath.substr(0, filePath.size() - 4) + ".gaps";
+	uint64_t firstGapOffset = readFirstGapOffset(gapsFilePath);
+	uint64_t usableSize = std::min(fileSize, firstGapOffset);
+	if (usableSize == 0)
+		return false;
+
+	uint64_t fileStart = m_Data.size();
+	m_Data.resize(fileStart + usableSize);
+	file.seekg(0);
+	if (!file.read(&m_Data[fileStart], usableSize))
+	{
+		m_Data.resize(fileStart);
+		return false;
+	}
+
+	ReplayConnection connection;
+	connection.fileName = fileName;
+	connection.firstRequest = (uint32_t)m_Requests.size();
+	connection.numOfRequests = 0;
+	connection.startTimeUsec = 0;
+	bool wholeFile = splitMessages(fileStart, fileStart + usableSize, connection) && usableSize == fileSize;
+	if (connection.numOfRequests == 0)
+	{
+		m_Data.resize(fileStart);
+		return false;
+	}
+
+	if (!wholeFile)
+		numOfTruncatedFiles++;
+
+	readTurnIndex(filePath.substr(0, filePath.size() - 4) + ".turns", fileStart, connection);
+
+	// the data after the last message is of no use
+	const ReplayRequest& lastRequest = m_Requests.back();
+	uint64_t dataEnd = std::max(lastRequest.offset + lastRequest.length, lastRequest.responseOffset + lastRequest.responseLength);
+	m_Data.resize(dataEnd);
+
+	m_Connections.push_back(connection);
+	return true;
+}
+
+
+bool ReplayCorpus::splitMessages(uint64_t fileStart, uint64_t fileEnd, ReplayConnection& connection)
+{
+	HttpMessageFramer framer;
+
+	// the requests still waiting for their final response, in order
+	std::vector<uint32_t> unanswered;
+	size_t nextUnanswered = 0;
+
+	uint64_t pos = fileStart;
+	while (pos < fileEnd)
+	{
+		const uint8_t* data = getData(pos);
+		size_t dataLen = (size_t)(fileEnd - pos);
+
+		if (dataLen >= 5 && memcmp(data, "HTTP/", 5) == 0)
+		{
+			bool noBody = (nextUnanswered < unanswered.size() && m_Requests[unanswered[nextUnanswered]].isHead);
+			framer.reset(false, noBody);
+			size_t messageLen = framer.feed(data, dataLen);
+			if (!framer.isComplete() && !framer.finish())
+				return false;
+
+			if (!framer.isInterim() && nextUnanswered < unanswered.size())
+			{
+				ReplayRequest& request = m_Requests[unanswered[nextUnanswered++]];
+				request.responseOffset = pos;
+				request.responseLength = (uint32_t)std::min(messageLen, (size_t)UINT32_MAX);
+			}
+
+			pos += messageLen;
+
+			// whatever follows 101 Switching Protocols isn't HTTP/1.x
+			if (framer.getStatusCode() == 101)
+				return pos == fileEnd;
+			continue;
+		}
+
+		// anything which doesn't start a message (e.g. the HTTP/2 connection preface) ends the replayable part
+		size_t methodLen = getRequestMethodLen(data, dataLen);
+		if (methodLen == 0)
+			return false;
+
+		// a CONNECT request turns the connection into a tunnel, there's nothing to replay from there
+		if (methodLen == 8 && memcmp(data, "CONNECT ", 8) == 0)
+			return false;
+
+		framer.reset(true, false);
+		size_t messageLen = framer.feed(data, dataLen);
+		if (!framer.isComplete() || messageLen > UINT32_MAX)
+			return false;
+
+		ReplayRequest request;
+		request.offset = pos;
+		request.length = (uint32_t)messageLen;
+		request.responseOffset = 0;
+		request.responseLength = 0;
+		request.captureTimeUsec = 0;
+		request.thinkTimeUsec = 0;
+		request.endpoint = getEndpoint(data, methodLen, messageLen);
+		request.isHead = (methodLen == 5 && memcmp(data, "HEAD ", 5) == 0);
+		unanswered.push_back((uint32_t)m_Requests.size());
+		m_Requests.push_back(request);
+		connection.numOfRequests++;
+
+		pos += messageLen;
+	}
+
+	return true;
+}
+
+
+void ReplayCorpus::readTurnIndex(const std::string& turnsFilePath, uint64_t fileStart, ReplayConnection& connection)
+{
+	std::ifstream turnsFile(turnsFilePath.c_str(), std::ios_base::binary);
+	std::vector<CapturedTurn> turns;
+	uint8_t record[TURN_RECORD_SIZE];
+	while (turnsFile.read((char*)record, sizeof(record)))
+	{
+		CapturedTurn turn;
+		turn.fileOffset = fileStart + readUInt64(record);
+		turn.firstByteUsec = readUInt64(record + 8);
+		turn.lastByteUsec = readUInt64(record + 16);
+		turns.push_back(turn);
+	}
+
+	if (turns.empty())
+		return;
+
+	// both lists are in file order, so each request's turn (the last one starting at or before it) is found in one pass
+	size_t turn = 0;
+	for (uint32_t i = 0; i < connection.numOfRequests; i++)
+	{
+		ReplayRequest& request = m_Requests[connection.firstRequest + i];
+		while (turn + 1 < turns.size() && turns[turn + 1].fileOffset <= request.offset)
+			turn++;
+		if (turns[turn].fileOffset > request.offset)
+			continue;
+
+		request.captureTimeUsec = turns[turn].firstByteUsec;
+		if (i == 0)
+			connection.startTimeUsec = turns[turn].firstByteUsec;
+
+		// a request which starts its turn waited from the end of the turn before it (the previous response). A pipelined one didn't wait
+		if (i > 0 && turn > 0 && turns[turn].fileOffset == request.offset && turns[turn].firstByteUsec > turns[turn - 1].lastByteUsec)
+			request.thinkTimeUsec = (uint32_t)std::min(turns[turn].firstByteUsec - turns[turn - 1].lastByteUsec, (uint64_t)UINT32_MAX);
+	}
+
+	if (connection.startTimeUsec == 0)
+		return;
+
+	numOfTimedConnections++;
+	if (m_FirstStartTimeUsec == 0 || connection.startTimeUsec < m_FirstStartTimeUsec)
+		m_FirstStartTimeUsec = connection.startTimeUsec;
+}
+
+
+uint16_t ReplayCorpus::getEndpoint(const uint8_t* requestLine, size_t methodLen, size_t dataLen)
+{
+	// the request target ends at the space before the version. The query string is dropped so the URIs of one endpoint aggregate together
+	const char* target = (const char*)requestLine + methodLen;
+	const char* lineEnd = (const char*)requestLine + dataLen;
+	const char* targetEnd = target;
+	while (targetEnd < lineEnd && *targetEnd != ' ' && *targetEnd != '?' && *targetEnd != '\r' && *targetEnd != '\n')
+		targetEnd++;
+
+	// absolute-form ("http://host/path") carries the host in the target
+	if (targetEnd - target > 7 && strncasecmp(target, "http://", 7) == 0)
+	{
+		const char* path = (const char*)memchr(target + 7, '/', targetEnd - target - 7);
+		target = (path != NULL ? path : targetEnd);
+	}
+
+	std::string name((const char*)requestLine, methodLen);
+	if (target == targetEnd)
+		name += '/';
+	else
+		name.append(target, targetEnd);
+
+	// the endpoints are few, a linear search over them is cheaper than keeping a map for the whole load
+	size_t numOfNamed = std::min(m_EndpointNames.size(), (size_t)REPLAY_MAX_ENDPOINTS - 1);
+	for (size_t i = 0; i < numOfNamed; i++)
+	{
+		if (m_EndpointNames[i] == name)
+			return (uint16_t)i;
+	}
+
+	if (m_EndpointNames.size() < REPLAY_MAX_ENDPOINTS - 1)
+		m_EndpointNames.push_back(name);
+	else if (m_EndpointNames.size() == REPLAY_MAX_ENDPOINTS - 1)
+		m_EndpointNames.push_back("other");
+	return (uint16_t)std::min(m_EndpointNames.size() - 1, (size_t)REPLAY_MAX_ENDPOINTS - 1);
+}
@@ -0,0 +1,156 @@
+#ifndef HTTPECHO_REPLAY_CORPUS
+#define HTTPECHO_REPLAY_CORPUS
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// the requests are grouped by endpoint (method and path) for the latency report, up to this many endpoints. The rest share one "other" endpoint
+#define REPLAY_MAX_ENDPOINTS 64
+
+
+/**
+ * @struct ReplayRequest
+ * A request of a captured connection, and the final response it got (a range of length 0 if the capture has none)
+ */
+struct ReplayRequest
+{
+	uint64_t offset;
+	uint32_t length;
+	uint32_t responseLength;
+	uint64_t responseOffset;
+
+	// the capture time of the request's first byte (or of the first byte of the requests pipelined with it) in microseconds since the epoch.
+	// 0 if the capture has no turn index
+	uint64_t captureTimeUsec;
+
+	// the time the client waited before sending the request: from the last byte the server sent before it to its first byte, in microseconds.
+	// 0 for a connection's first request, for a request pipelined behind another and if the capture has no turn index
+	uint32_t thinkTimeUsec;
+
+	// the request's endpoint, see ReplayCorpus::getEndpointName
+	uint16_t endpoint;
+
+	bool isHead;
+};
+
+
+/**
+ * @struct ReplayConnection
+ * A captured connection: its capture file and its requests, in the order they were sent
+ */
+struct ReplayConnection
+{
+	std::string fileName;
+	uint32_t firstRequest;
+	uint32_t numOfRequests;
+
+	// the capture time of the first request's first byte in microseconds since the epoch, 0 if the capture has no turn index
+	uint64_t startTimeUsec;
+};
+
+
+/**
+ * The HTTP/1.x requests of a directory of capture files, as written by the capture side (one <client IP>.<client port>.txt file per connection,
+ * holding both sides in the order they were seen, next to an optional .gaps index). Each file is split into messages with HttpMessageFramer:
+ * requests are told from responses by the "HTTP/" a response starts with, and every request is paired with its final response. A connection is
+ * read up to its first hole (any reason in the gap index) and up to a switch to another protocol (101, CONNECT or the HTTP/2 preface), since
+ * what follows can't be replayed as HTTP/1.x requests. If the capture wrote turn indexes (.turns, see -t), the connection's start time and the
+ * think time before each request are taken from them.
+ * All files are loaded into one buffer, so the corpus is a handful of allocations whatever the number of connections; it's read-only once loaded
+ * and replay workers forked after loading share its pages
+ */
+class ReplayCorpus
+{
+public:
+
+	/**
+	 * A c'tor for this class, creates an empty corpus
+	 */
+	ReplayCorpus();
+
+	/**
+	 * Load the capture files of a directory
+	 * @param[in] dirName The directory
+	 * @return False if the directory couldn't be read
+	 */
+	bool load(const char* dirName);
+
+	/**
+	 * @return The number of connections with at least one request
+	 */
+	size_t getNumOfConnections() const { return m_Connections.size(); }
+
+	/**
+	 * @return The number of requests of all connections
+	 */
+	size_t getNumOfRequests() const { return m_Requests.size(); }
+
+	/**
+	 * @param[in] index The index of a connection
+	 * @return The connection
+	 */
+	const ReplayConnection& getConnection(size_t index) const { return m_Connections[index]; }
+
+	/**
+	 * @param[in] index The index of a request (see ReplayConnection::firstRequest)
+	 * @return The request
+	 */
+	const ReplayRequest& getRequest(size_t index) const { return m_Requests[index]; }
+
+	/**
+	 * @param[in] offset An offset in the corpus, e.g. ReplayRequest::offset
+	 * @return The data at this offset
+	 */
+	const uint8_t* getData(uint64_t offset) const { return (const uint8_t*)&m_Data[0] + offset; }
+
+	/**
+	 * @return The earliest start time of the connections, in microseconds since the epoch. 0 if no connection has a turn index
+	 */
+	uint64_t getFirstStartTimeUsec() const { return m_FirstStartTimeUsec; }
+
+	/**
+	 * @return The number of endpoints the requests are grouped by (at most REPLAY_MAX_ENDPOINTS)
+	 */
+	size_t getNumOfEndpoints() const { return m_EndpointNames.size(); }
+
+	/**
+	 * @param[in] index The index of an endpoint (see ReplayRequest::endpoint)
+	 * @return The endpoint as method and path (without the query), e.g "GET /index.html", or "other" for the endpoints past the limit
+	 */
+	const std::string& getEndpointName(size_t index) const { return m_EndpointNames[index]; }
+
+	// stats: capture files which yielded no request, and files cut short by a hole, a protocol switch or data which isn't HTTP/1.x
+	uint32_t numOfSkippedFiles;
+	uint32_t numOfTruncatedFiles;
+
+	// stats: connections timed from a turn index
+	uint32_t numOfTimedConnections;
+
+private:
+
+	std::vector<char> m_Data;
+	std::vector<ReplayConnection> m_Connections;
+	std::vector<ReplayRequest> m_Requests;
+	std::vector<std::string> m_EndpointNames;
+	uint64_t m_FirstStartTimeUsec;
+
+	/**
+	 * A turn of the turn index: where it starts in the capture file and the capture times of its first and last bytes
+	 */
+	struct CapturedTurn
+	{
+		uint64_t fileOffset;
+		uint64_t firstByteUsec;
+		uint64_t lastByteUsec;
+	};
+
+	bool loadFile(const std::string& filePath, const std::string& fileName);
+	uint64_t readFirstGapOffset(const std::string& gapsFilePath) const;
+	bool splitMessages(uint64_t fileStart, uint64_t fileEnd, ReplayConnection& connection);
+	uint16_t getEndpoint(const uint8_t* requestLine, size_t methodLen, size_t dataLen);
+	void readTurnIndex(const std::string& turnsFilePath, uint64_t fileStart, ReplayConnection& connection);
+};
+
+#endif /* HTTPECHO_REPLAY_CORPUS */
@@ -0,0 +1,761 @@
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "ReplayWorker.h"
+
+// the epoll data of the timerfd, which no connection slot can have
+#define REPLAY_TIMER_EVENT UINT64_MAX
+
+
+static uint64_t getMonotonicUsec()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000ULL + (uint64_t)now.tv_nsec / 1000;
+}
+
+
+void ReplayWorkerResult::clear()
+{
+	timeToFirstByte.clear();
+	responseTime.clear();
+	intendedResponseTime.clear();
+	numOfRequests = 0;
+	numOfResponses = 0;
+	numOfServerErrors = 0;
+	numOfConnects = 0;
+	numOfConnectFailures = 0;
+	numOfBrokenConnections = 0;
+	numOfUnfinished = 0;
+	numOfLateRequests = 0;
+	memset(&verify, 0, sizeof(verify));
+	bytesSent = 0;
+	bytesReceived = 0;
+	elapsedUsec = 0;
+	failed = false;
+}
+
+
+void ReplayWorkerResult::merge(const ReplayWorkerResult& other)
+{
+	timeToFirstByte.merge(other.timeToFirstByte);
+	responseTime.merge(other.responseTime);
+	intendedResponseTime.merge(other.intendedResponseTime);
+	numOfRequests += other.numOfRequests;
+	numOfResponses += other.numOfResponses;
+	numOfServerErrors += other.numOfServerErrors;
+	numOfConnects += other.numOfConnects;
+	numOfConnectFailures += other.numOfConnectFailures;
+	numOfBrokenConnections += other.numOfBrokenConnections;
+	numOfUnfinished += other.numOfUnfinished;
+	numOfLateRequests += other.numOfLateRequests;
+	verify.numOfVerified += other.verify.numOfVerified;
+	verify.numOfMismatches += other.verify.numOfMismatches;
+	verify.numOfStatusMismatches += other.verify.numOfStatusMismatches;
+	verify.numOfHeaderMismatches += other.verify.numOfHeaderMismatches;
+	verify.numOfBodyMismatches += other.verify.numOfBodyMismatches;
+	bytesSent += other.bytesSent;
+	bytesReceived += other.bytesReceived;
+	if (other.elapsedUsec > elapsedUsec)
+		elapsedUsec = other.elapsedUsec;
+	failed = failed || other.failed;
+}
+
+
+ReplayWorker::ReplayWorker(const ReplayCorpus& corpus, const sockaddr* target, socklen_t targetLen, ReplayMode mode, size_t numOfConnections,
+		ReplaySchedule schedule, double requestsPerSec, int workerIndex, int numOfWorkers, ResponseVerifier* verifier) : m_Corpus(corpus)
+{
+	m_Mode = mode;
+	memset(&m_Target, 0, sizeof(m_Target));
+	memcpy(&m_Target, target, targetLen);
+	m_TargetLen = targetLen;
+	m_EpollFd = -1;
+	m_TimerFd = -1;
+	m_ArmedWakeUpUsec = 0;
+	m_NextRequest = 0;
+	m_Schedule = (mode == PooledReplay ? schedule : ClosedLoopSchedule);
+	m_OpenLoop = (m_Schedule != ClosedLoopSchedule);
+	m_StartTimeUsec = 0;
+	m_NextArrivalUsec = 0;
+	m_NumOfArrivals = 0;
+	m_Dispatching = false;
+	m_Repeat = false;
+	m_Stopping = false;
+	m_NumOfOpen = 0;
+	m_Result = NULL;
+	m_EndpointResponseTime = NULL;
+	m_Verifier = verifier;
+
+	// every worker takes an equal share of the rate, the fixed-rate arrivals of the workers interleaved rather than all at once.
+	// The random arrivals of each worker are seeded by its index, so a replay's schedule can be run again
+	m_ArrivalIntervalUsec = (requestsPerSec > 0 ? 1000000.0 * numOfWorkers / requestsPerSec : 0.0);
+	m_ArrivalPhaseUsec = m_ArrivalIntervalUsec * workerIndex / numOfWorkers;
+	m_Random.seed((uint64_t)workerIndex + 1);
+	m_InterArrivalTime = std::exponential_distribution<double>(m_ArrivalIntervalUsec > 0 ? 1.0 / m_ArrivalIntervalUsec : 1.0);
+
+	ClientConnection closedConnection;
+	closedConnection.fd = -1;
+	closedConnection.state = Closed;
+	closedConnection.reused = false;
+	closedConnection.available = false;
+	closedConnection.events = 0;
+	closedConnection.generation = 0;
+	closedConnection.request = 0;
+	closedConnection.sendOffset = 0;
+	closedConnection.intendedTimeUsec = 0;
+	closedConnection.sentTimeUsec = 0;
+	closedConnection.firstByteTimeUsec = 0;
+	closedConnection.nextRequest = 0;
+	closedConnection.endRequest = 0;
+	closedConnection.capturedConnection = 0;
+	if (m_Mode == PooledReplay)
+		m_Connections.resize(numOfConnections, closedConnection);
+
+	// the worker's share: whole captured connections, so their requests keep their order
+	for (size_t i = (size_t)workerIndex; i < corpus.getNumOfConnections(); i += (size_t)numOfWorkers)
+	{
+		const ReplayConnection& connection = corpus.getConnection(i);
+		for (uint32_t request = 0; request < connection.numOfRequests; request++)
+			m_RequestOrder.push_back(connection.firstRequest + request);
+
+		if (m_Mode == ConnectionReplay)
+		{
+			closedConnection.nextRequest = connection.firstRequest;
+			closedConnection.endRequest = connection.firstRequest + connection.numOfRequests;
+			closedConnection.capturedConnection = (uint32_t)i;
+			m_Connections.push_back(closedConnection);
+		}
+	}
+
+	// the captured schedule sends the share in the order it was captured in, across connections
+	if (m_Schedule == CapturedSchedule)
+	{
+		std::vector<std::pair<uint64_t, uint32_t> > arrivals;
+		for (size_t i = 0; i < m_RequestOrder.size(); i++)
+		{
+			uint64_t captureTimeUsec = corpus.getRequest(m_RequestOrder[i]).captureTimeUsec;
+			uint64_t offsetUsec = (captureTimeUsec > corpus.getFirstStartTimeUsec() ? captureTimeUsec - corpus.getFirstStartTimeUsec() : 0);
+			arrivals.push_back(std::make_pair(offsetUsec, m_RequestOrder[i]));
+		}
+		std::stable_sort(arrivals.begin(), arrivals.end());
+
+		for (size_t i = 0; i < arrivals.size(); i++)
+		{
+			m_ArrivalOffsets.push_back(arrivals[i].first);
+			m_RequestOrder[i] = arrivals[i].second;
+		}
+	}
+
+	// at most one timer per connection is pending
+	m_Timers.reserve(m_Connections.size());
+	m_FreeConnections.reserve(m_Connections.size());
+}
+
+
+ReplayWorker::~ReplayWorker()
+{
+	for (size_t i = 0; i < m_Connections.size(); i++)
+		closeConnection(m_Connections[i]);
+
+	if (m_TimerFd >= 0)
+		close(m_TimerFd);
+
+	if (m_EpollFd >= 0)
+		close(m_EpollFd);
+}
+
+
+bool ReplayWorker::init()
+{
+	m_EpollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (m_EpollFd < 0)
+		return false;
+
+	m_TimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (m_TimerFd < 0)
+		return false;
+
+	epoll_event event;
+	event.events = EPOLLIN;
+	event.data.u64 = REPLAY_TIMER_EVENT;
+	if (epoll_ctl(m_EpollFd, EPOLL_CTL_ADD, m_TimerFd, &event) < 0)
+		return false;
+
+	// every simulated connection is a socket, so the worker takes all the descriptors it's allowed
+	rlimit fileLimit;
+	if (getrlimit(RLIMIT_NOFILE, &fileLimit) == 0 && fileLimit.rlim_cur < fileLimit.rlim_max)
+	{
+		fileLimit.rlim_cur = fileLimit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &fileLimit);
+	}
+
+	// the verifier hashes the bodies as the framers find them
+	if (m_Verifier != NULL)
+	{
+		if (!m_Verifier->open(m_Connections.size()))
+			return false;
+		for (size_t i = 0; i < m_Connections.size(); i++)
+			m_Connections[i].framer.setBodyListener(m_Verifier->getBodyListener(i));
+	}
+
+	m_RecvBuffer.resize(REPLAY_RECV_BUFFER_SIZE);
+	return true;
+}
+
+
+bool ReplayWorker::takeNextRequest(ClientConnection& conn)
+{
+	if (m_Stopping)
+		return false;
+
+	if (m_Mode == ConnectionReplay)
+	{
+		if (conn.nextRequest == conn.endRequest)
+			return false;
+		conn.request = conn.nextRequest++;
+	}
+	else
+	{
+		if (m_RequestOrder.empty() || (m_NextRequest == m_RequestOrder.size() && !m_Repeat))
+			return false;
+		if (m_NextRequest == m_RequestOrder.size())
+			m_NextRequest = 0;
+		conn.request = m_RequestOrder[m_NextRequest++];
+	}
+
+	prepareRequest(conn, conn.request);
+	return true;
+}
+
+
+void ReplayWorker::prepareRequest(ClientConnection& conn, uint32_t request)
+{
+	conn.request = request;
+	conn.sendOffset = 0;
+	conn.firstByteTimeUsec = 0;
+	conn.framer.reset(false, m_Corpus.getRequest(request).isHead);
+	if (m_Verifier != NULL)
+		m_Verifier->startResponse(&conn - &m_Connections[0], request);
+}
+
+
+uint64_t ReplayWorker::getNextArrivalTime()
+{
+	if (m_Stopping || m_RequestOrder.empty() || (m_NextRequest == m_RequestOrder.size() && !m_Repeat))
+		return 0;
+	if (m_NextRequest == m_RequestOrder.size())
+		m_NextRequest = 0;
+
+	// fixed-rate arrivals are computed from the start rather than added up, so rounding doesn't drift the rate
+	if (m_Schedule == CapturedSchedule)
+		return m_StartTimeUsec + m_ArrivalOffsets[m_NextRequest];
+	if (m_Schedule == FixedRateSchedule)
+		return m_StartTimeUsec + (uint64_t)(m_ArrivalPhaseUsec + m_ArrivalIntervalUsec * (double)m_NumOfArrivals);
+
+	uint64_t lastArrivalUsec = (m_NumOfArrivals == 0 ? m_StartTimeUsec : m_NextArrivalUsec);
+	return lastArrivalUsec + (uint64_t)m_InterArrivalTime(m_Random);
+}
+
+
+void ReplayWorker::generateArrivals(uint64_t nowUsec)
+{
+	// every arrival that is due joins the backlog with its intended time, however late the loop got to it
+	while (m_NextArrivalUsec > 0 && m_NextArrivalUsec <= nowUsec)
+	{
+		PendingRequest pending;
+		pending.request = m_RequestOrder[m_NextRequest++];
+		pending.intendedTimeUsec = m_NextArrivalUsec;
+		m_Backlog.push_back(pending);
+		m_NumOfArrivals++;
+		m_NextArrivalUsec = getNextArrivalTime();
+	}
+
+	dispatchBacklog();
+
+	// once the schedule is used up and nothing waits, the free connections are of no more use
+	if (m_NextArrivalUsec == 0 && m_Backlog.empty())
+	{
+		for (size_t i = 0; i < m_FreeConnections.size(); i++)
+			closeConnection(m_Connections[m_FreeConnections[i]]);
+	}
+}
+
+
+void ReplayWorker::dispatchBacklog()
+{
+	// a request which fails right away frees its connection from inside this loop, the loop takes it again rather than recursing
+	if (m_Dispatching)
+		return;
+
+	m_Dispatching = true;
+	while (!m_Backlog.empty() && !m_FreeConnections.empty())
+	{
+		ClientConnection& conn = m_Connections[m_FreeConnections.back()];
+		m_FreeConnections.pop_back();
+		conn.available = false;
+
+		prepareRequest(conn, m_Backlog.front().request);
+		conn.intendedTimeUsec = m_Backlog.front().intendedTimeUsec;
+		m_Backlog.pop_front();
+		startRequest(conn);
+
+		// the connection couldn't even be opened, the request is lost (and counted) and the slot is free again
+		if (conn.fd < 0 && !conn.available)
+		{
+			conn.available = true;
+			m_FreeConnections.push_back((uint32_t)(&conn - &m_Connections[0]));
+		}
+	}
+	m_Dispatching = false;
+}
+
+
+void ReplayWorker::releaseConnection(ClientConnection& conn)
+{
+	if (conn.available)
+		return;
+
+	if (m_NextArrivalUsec == 0 && m_Backlog.empty())
+		closeConnection(conn);
+
+	// an open connection waits for the next request reading nothing but a close from the server
+	if (conn.fd >= 0)
+	{
+		conn.state = Idle;
+		setEvents(conn, EPOLLIN);
+	}
+
+	conn.available = true;
+	m_FreeConnections.push_back((uint32_t)(&conn - &m_Connections[0]));
+	dispatchBacklog();
+}
+
+
+void ReplayWorker::armTimerFd(uint64_t wakeUpUsec)
+{
+	if (wakeUpUsec == m_ArmedWakeUpUsec)
+		return;
+
+	// an absolute time on the monotonic clock, 0 disarms the timer
+	itimerspec timerSpec;
+	memset(&timerSpec, 0, sizeof(timerSpec));
+	timerSpec.it_value.tv_sec = (time_t)(wakeUpUsec / 1000000);
+	timerSpec.it_value.tv_nsec = (long)(wakeUpUsec % 1000000) * 1000;
+	timerfd_settime(m_TimerFd, TFD_TIMER_ABSTIME, &timerSpec, NULL);
+	m_ArmedWakeUpUsec = wakeUpUsec;
+}
+
+
+void ReplayWorker::setEvents(ClientConnection& conn, uint32_t events)
+{
+	if (conn.events == events)
+		return;
+
+	epoll_event event;
+	event.events = events;
+	event.data.u64 = ((uint64_t)conn.generation << 32) | (uint64_t)(&conn - &m_Connections[0]);
+	epoll_ctl(m_EpollFd, EPOLL_CTL_MOD, conn.fd, &event);
+	conn.events = events;
+}
+
+
+void ReplayWorker::addTimer(ClientConnection& conn, uint64_t timeUsec)
+{
+	ReplayTimer timer;
+	timer.timeUsec = timeUsec;
+	timer.connection = (uint32_t)(&conn - &m_Connections[0]);
+	m_Timers.push_back(timer);
+	std::push_heap(m_Timers.begin(), m_Timers.end());
+}
+
+
+void ReplayWorker::fireTimers(uint64_t nowUsec)
+{
+	while (!m_Timers.empty() && m_Timers.front().timeUsec <= nowUsec)
+	{
+		ClientConnection& conn = m_Connections[m_Timers.front().connection];
+		std::pop_heap(m_Timers.begin(), m_Timers.end());
+		m_Timers.pop_back();
+		startRequest(conn);
+	}
+}
+
+
+void ReplayWorker::openConnection(ClientConnection& conn)
+{
+	conn.fd = socket(m_Target.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (conn.fd < 0)
+	{
+		m_Result->numOfConnectFailures++;
+		return;
+	}
+
+	int noDelay = 1;
+	setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+	if (connect(conn.fd, (const sockaddr*)&m_Target, m_TargetLen) < 0 && errno != EINPROGRESS)
+	{
+		close(conn.fd);
+		conn.fd = -1;
+		m_Result->numOfConnectFailures++;
+		return;
+	}
+
+	conn.generation++;
+	conn.state = Connecting;
+	conn.reused = false;
+	conn.events = EPOLLOUT;
+
+	epoll_event event;
+	event.events = conn.events;
+	event.data.u64 = ((uint64_t)conn.generation << 32) | (uint64_t)(&conn - &m_Connections[0]);
+	epoll_ctl(m_EpollFd, EPOLL_CTL_ADD, conn.fd, &event);
+	m_NumOfOpen++;
+}
+
+
+void ReplayWorker::closeConnection(ClientConnection& conn)
+{
+	if (conn.fd < 0)
+		return;
+
+	// closing the socket also takes it out of the epoll set
+	close(conn.fd);
+	conn.fd = -1;
+	conn.state = Closed;
+	conn.events = 0;
+	m_NumOfOpen--;
+}
+
+
+void ReplayWorker::startRequest(ClientConnection& conn)
+{
+	if (getMonotonicUsec() > conn.intendedTimeUsec + REPLAY_LATE_SEND_USEC)
+		m_Result->numOfLateRequests++;
+
+	if (conn.fd < 0)
+		openConnection(conn);
+	else
+	{
+		conn.reused = true;
+		sendRequest(conn);
+	}
+}
+
+
+void ReplayWorker::scheduleRequest(ClientConnection& conn, uint64_t nowUsec)
+{
+	uint32_t thinkTimeUsec = (m_Mode == ConnectionReplay ? m_Corpus.getRequest(conn.request).thinkTimeUsec : 0);
+	conn.intendedTimeUsec = nowUsec + thinkTimeUsec;
+	if (thinkTimeUsec == 0)
+	{
+		startRequest(conn);
+		return;
+	}
+
+	// an open connection waits for the think time reading nothing but a close from the server
+	if (conn.fd >= 0)
+		conn.state = Idle;
+	addTimer(conn, nowUsec + thinkTimeUsec);
+}
+
+
+void ReplayWorker::sendRequest(ClientConnection& conn)
+{
+	const ReplayRequest& request = m_Corpus.getRequest(conn.request);
+	const uint8_t* data = m_Corpus.getData(request.offset);
+
+	conn.state = Sending;
+	while (conn.sendOffset < request.length)
+	{
+		ssize_t sent = send(conn.fd, data + conn.sendOffset, request.length - conn.sendOffset, MSG_NOSIGNAL);
+		if (sent < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				setEvents(conn, EPOLLOUT);
+			else if (errno != EINTR)
+				breakConnection(conn);
+			return;
+		}
+
+		conn.sendOffset += (uint32_t)sent;
+		m_Result->bytesSent += (uint64_t)sent;
+	}
+
+	m_Result->numOfRequests++;
+	conn.sentTimeUsec = getMonotonicUsec();
+	conn.state = Receiving;
+	setEvents(conn, EPOLLIN);
+}
+
+
+void ReplayWorker::receiveResponse(ClientConnection& conn)
+{
+	while (true)
+	{
+		ssize_t received = recv(conn.fd, &m_RecvBuffer[0], m_RecvBuffer.size(), 0);
+		if (received < 0)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				breakConnection(conn);
+			return;
+		}
+
+		uint64_t nowUsec = getMonotonicUsec();
+
+		// the server closed the connection, which ends a body delimited by the close
+		if (received == 0)
+		{
+			if (conn.framer.finish())
+				completeResponse(conn, nowUsec);
+			else
+				breakConnection(conn);
+			return;
+		}
+
+		m_Result->bytesReceived += (uint64_t)received;
+
+		size_t pos = 0;
+		while (pos < (size_t)received)
+		{
+			if (!conn.framer.isStarted())
+				conn.firstByteTimeUsec = nowUsec;
+
+			size_t messageLen = conn.framer.feed(&m_RecvBuffer[pos], (size_t)received - pos);
+			if (m_Verifier != NULL)
+				m_Verifier->feed(&conn - &m_Connections[0], &m_RecvBuffer[pos], messageLen);
+			pos += messageLen;
+			if (!conn.framer.isComplete())
+				break;
+
+			// the final response follows an interim one, and is timed from its own first byte
+			if (conn.framer.isInterim())
+			{
+				conn.framer.reset(false, m_Corpus.getRequest(conn.request).isHead);
+				if (m_Verifier != NULL)
+					m_Verifier->startResponse(&conn - &m_Connections[0], conn.request);
+				continue;
+			}
+
+			// anything after the final response wasn't asked for and is dropped
+			completeResponse(conn, nowUsec);
+			return;
+		}
+	}
+}
+
+
+void ReplayWorker::drainIdleConnection(ClientConnection& conn)
+{
+	ssize_t received = recv(conn.fd, &m_RecvBuffer[0], m_RecvBuffer.size(), 0);
+
+	// the server may close an idle keep-alive connection, the next request opens a new one. Anything it sends unasked is dropped
+	if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+	{
+		closeConnection(conn);
+		return;
+	}
+
+	if (received > 0)
+		m_Result->bytesReceived += (uint64_t)received;
+}
+
+
+void ReplayWorker::completeResponse(ClientConnection& conn, uint64_t nowUsec)
+{
+	m_Result->timeToFirstByte.record(conn.firstByteTimeUsec - conn.sentTimeUsec);
+	m_Result->responseTime.record(nowUsec - conn.sentTimeUsec);
+	m_Result->intendedResponseTime.record(nowUsec - conn.intendedTimeUsec);
+	if (m_EndpointResponseTime != NULL)
+		m_EndpointResponseTime[m_Corpus.getRequest(conn.request).endpoint].record(nowUsec - conn.intendedTimeUsec);
+	m_Result->numOfResponses++;
+	if (conn.framer.getStatusCode() >= 500)
+		m_Result->numOfServerErrors++;
+	if (m_Verifier != NULL)
+		m_Verifier->finishResponse(&conn - &m_Connections[0], conn.framer.getStatusCode(), m_Result->verify);
+
+	if (!conn.framer.isKeepAlive())
+		closeConnection(conn);
+
+	if (m_OpenLoop)
+	{
+		releaseConnection(conn);
+		return;
+	}
+
+	if (!takeNextRequest(conn))
+	{
+		closeConnection(conn);
+		return;
+	}
+
+	scheduleRequest(conn, nowUsec);
+}
+
+
+void ReplayWorker::breakConnection(ClientConnection& conn)
+{
+	// a keep-alive connection the server closed just as the request went out: the request gets a new connection, as a client would do
+	bool resend = (conn.reused && !conn.framer.isStarted() && !m_Stopping);
+
+	closeConnection(conn);
+	if (resend)
+	{
+		conn.sendOffset = 0;
+		conn.firstByteTimeUsec = 0;
+		openConnection(conn);
+		if (conn.fd < 0 && m_OpenLoop)
+			releaseConnection(conn);
+		return;
+	}
+
+	m_Result->numOfBrokenConnections++;
+	if (m_OpenLoop)
+		releaseConnection(conn);
+	else if (takeNextRequest(conn))
+		scheduleRequest(conn, getMonotonicUsec());
+}
+
+
+void ReplayWorker::handleEvent(ClientConnection& conn, uint32_t events)
+{
+	if (conn.state == Connecting)
+	{
+		int error = 0;
+		socklen_t errorLen = sizeof(error);
+		if (getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error, &errorLen) < 0 || error != 0)
+		{
+			// a closed-loop slot is retired, a target which refuses connections would otherwise be hammered. An open-loop one takes the next
+			// arrival: the schedule sets the pace either way
+			closeConnection(conn);
+			m_Result->numOfConnectFailures++;
+			if (m_OpenLoop)
+				releaseConnection(conn);
+			return;
+		}
+
+		m_Result->numOfConnects++;
+		sendRequest(conn);
+	}
+	else if (conn.state == Sending)
+		sendRequest(conn);
+	else if (conn.state == Receiving)
+		receiveResponse(conn);
+	else if (conn.state == Idle)
+		drainIdleConnection(conn);
+}
+
+
+void ReplayWorker::run(uint64_t startTimeUsec, uint64_t durationUsec, ReplayWorkerResult& result, LatencyHistogram* endpointResponseTime)
+{
+	m_Result = &result;
+	m_EndpointResponseTime = endpointResponseTime;
+	m_Repeat = (durationUsec > 0 && m_Schedule != CapturedSchedule);
+	m_Stopping = false;
+	m_NextRequest = 0;
+	m_StartTimeUsec = startTimeUsec;
+	m_NumOfArrivals = 0;
+
+	// the workers were all released by the coordinator, the last few microseconds are waited out here so they start together
+	while (getMonotonicUsec() < startTimeUsec)
+		;
+
+	// open-loop connections wait for the schedule's arrivals. Closed-loop pooled connections open right away, captured connections at their
+	// captured start (all at once if the capture has no turn index)
+	uint64_t deadlineUsec = (durationUsec > 0 ? startTimeUsec + durationUsec : 0);
+	for (size_t i = 0; i < m_Connections.size(); i++)
+	{
+		ClientConnection& conn = m_Connections[i];
+		if (m_OpenLoop)
+		{
+			conn.available = true;
+			m_FreeConnections.push_back((uint32_t)i);
+			continue;
+		}
+
+		if (!takeNextRequest(conn))
+			continue;
+
+		uint64_t capturedStartUsec = (m_Mode == ConnectionReplay ? m_Corpus.getConnection(conn.capturedConnection).startTimeUsec : 0);
+		conn.intendedTimeUsec = startTimeUsec;
+		if (capturedStartUsec > m_Corpus.getFirstStartTimeUsec())
+		{
+			conn.intendedTimeUsec += capturedStartUsec - m_Corpus.getFirstStartTimeUsec();
+			addTimer(conn, conn.intendedTimeUsec);
+		}
+		else
+			openConnection(conn);
+	}
+
+	if (m_OpenLoop)
+		m_NextArrivalUsec = getNextArrivalTime();
+
+	epoll_event events[REPLAY_MAX_EVENTS];
+	while (m_NumOfOpen > 0 || !m_Timers.empty() || m_NextArrivalUsec > 0 || !m_Backlog.empty())
+	{
+		uint64_t nowUsec = getMonotonicUsec();
+		if (deadlineUsec > 0 && nowUsec >= deadlineUsec)
+			break;
+
+		fireTimers(nowUsec);
+		if (m_OpenLoop)
+			generateArrivals(nowUsec);
+
+		// sleep until the next timer, the next arrival or the deadline, whichever comes first
+		uint64_t wakeUpUsec = deadlineUsec;
+		if (!m_Timers.empty() && (wakeUpUsec == 0 || m_Timers.front().timeUsec < wakeUpUsec))
+			wakeUpUsec = m_Timers.front().timeUsec;
+		if (m_NextArrivalUsec > 0 && (wakeUpUsec == 0 || m_NextArrivalUsec < wakeUpUsec))
+			wakeUpUsec = m_NextArrivalUsec;
+		armTimerFd(wakeUpUsec);
+
+		int numOfEvents = epoll_wait(m_EpollFd, events, REPLAY_MAX_EVENTS, -1);
+		if (numOfEvents < 0 && errno != EINTR)
+			break;
+
+		for (int i = 0; i < numOfEvents; i++)
+		{
+			// the timer only wakes the loop up, what is due is handled at the top of it
+			if (events[i].data.u64 == REPLAY_TIMER_EVENT)
+			{
+				uint64_t numOfExpirations;
+				if (read(m_TimerFd, &numOfExpirations, sizeof(numOfExpirations)) > 0)
+					m_ArmedWakeUpUsec = 0;
+				continue;
+			}
+
+			ClientConnection& conn = m_Connections[(uint32_t)events[i].data.u64];
+
+			// the socket the event was for may have been closed by an earlier event of this batch
+			if (conn.fd < 0 || conn.generation != (uint32_t)(events[i].data.u64 >> 32))
+				continue;
+			handleEvent(conn, events[i].events);
+		}
+	}
+
+	// when the time runs out, the requests still on the wire or waiting for a connection are counted and dropped
+	m_Stopping = true;
+	m_Timers.clear();
+	m_NextArrivalUsec = 0;
+	m_Result->numOfUnfinished += m_Backlog.size();
+	m_Backlog.clear();
+	armTimerFd(0);
+	for (size_t i = 0; i < m_Connections.size(); i++)
+	{
+		if (m_Connections[i].fd >= 0 && m_Connections[i].state != Idle)
+			m_Result->numOfUnfinished++;
+		closeConnection(m_Connections[i]);
+	}
+
+	if (m_Verifier != NULL)
+		m_Verifier->flush();
+
+	result.elapsedUsec = getMonotonicUsec() - startTimeUsec;
+}
@@ -0,0 +1,290 @@
+#ifndef HTTPECHO_REPLAY_WORKER
+#define HTTPECHO_REPLAY_WORKER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <vector>
+#include <deque>
+#include <random>
+#include "ReplayCorpus.h"
+#include "HttpMessageFramer.h"
+#include "LatencyHistogram.h"
+#include "ResponseVerifier.h"
+
+// the default number of connections each replay worker keeps to the target
+#define REPLAY_DEFAULT_CONNECTIONS 16
+
+// responses are read in pieces of this size
+#define REPLAY_RECV_BUFFER_SIZE (64 * 1024)
+
+// the max number of socket events handled per wait
+#define REPLAY_MAX_EVENTS 256
+
+// a request whose send starts more than this late (after its intended send time) is counted as late
+#define REPLAY_LATE_SEND_USEC 1000
+
+
+/**
+ * How a replay worker puts the requests on connections
+ */
+enum ReplayMode
+{
+	// the requests go out over a pool of connections, each one as soon as a connection is free
+	PooledReplay,
+	// each captured connection is replayed on a connection of its own, started at its captured start time, with its captured think times
+	ConnectionReplay
+};
+
+
+/**
+ * When a pooled replay sends its requests
+ */
+enum ReplaySchedule
+{
+	// closed loop: a request goes out as soon as a connection is free, so the server's pace sets the rate
+	ClosedLoopSchedule,
+	// open loop: each request at its captured send time, relative to the first captured connection (needs a turn index)
+	CapturedSchedule,
+	// open loop: requests arrive at random with exponential gaps, at a given mean rate
+	PoissonSchedule,
+	// open loop: requests arrive at a given rate, evenly spaced
+	FixedRateSchedule
+};
+
+
+/**
+ * @struct ReplayWorkerResult
+ * What a replay worker measured. Plain data, so it can live in memory shared with the coordinator and histograms of several workers can be merged
+ */
+struct ReplayWorkerResult
+{
+	// from the last byte of the request sent to the first / last byte of the final response
+	LatencyHistogram timeToFirstByte;
+	LatencyHistogram responseTime;
+
+	// from the time the request was meant to be sent to the last byte of the final response. With an open-loop schedule this includes the time a
+	// request waited for a free connection, so a server stall shows in the latency of every request it held up (no coordinated omission)
+	LatencyHistogram intendedResponseTime;
+
+	// requests sent whole, final responses read whole, and those with a 5xx status
+	uint64_t numOfRequests;
+	uint64_t numOfResponses;
+	uint64_t numOfServerErrors;
+
+	// connections opened, connections which couldn't be opened, and connections which broke before a response completed
+	uint64_t numOfConnects;
+	uint64_t numOfConnectFailures;
+	uint64_t numOfBrokenConnections;
+
+	// requests still waiting to be sent or for their response when the replay time ran out
+	uint64_t numOfUnfinished;
+
+	// requests which started going out more than REPLAY_LATE_SEND_USEC after their intended send time
+	uint64_t numOfLateRequests;
+
+	uint64_t bytesSent;
+	uint64_t bytesReceived;
+
+	// the comparison of the responses with the captured ones, if they were verified
+	VerifyCounters verify;
+
+	// from the coordinated start to the end of the worker's replay
+	uint64_t elapsedUsec;
+
+	// the worker couldn't start at all
+	bool failed;
+
+	void clear();
+	void merge(const ReplayWorkerResult& other);
+};
+
+
+/**
+ * Replays its share of a ReplayCorpus against a target server, with all its connections driven by one epoll loop. The worker's share is every
+ * numOfWorkers-th captured connection starting at workerIndex, so workers never touch the same connection's requests. A connection carries one
+ * request at a time. Responses are delimited with HttpMessageFramer, 1xx interim responses are skipped, and a connection the server closes (or
+ * asks to close) is reopened for the next request. A request which finds a reused connection already closed by the server is sent again on a
+ * new one, as a client would. Two modes:
+ * - PooledReplay: the share's requests are sent over a pool of keep-alive connections. With ClosedLoopSchedule they go in capture order, each
+ *   as soon as a connection is free. With an open-loop schedule each request gets an intended send time from the schedule whatever the server
+ *   does: a request which arrives while all connections are busy waits in a backlog, and the wait counts in its latency. Connections are opened
+ *   as the requests need them and kept open between requests
+ * - ConnectionReplay: each captured connection gets a client connection of its own, opened at the connection's captured start time (relative
+ *   to the corpus' first connection) and carrying the same requests, each sent the captured think time after the previous response. The state
+ *   of a simulated connection is a fixed ~100 byte slot, and waits are kept in one timer heap, so a worker holds hundreds of thousands of them
+ *   without allocating per connection or per request
+ * With a ResponseVerifier, every final response is compared with the captured one as it streams in (see ResponseVerifier).
+ * Every latency is also measured from the request's intended send time (see ReplayWorkerResult::intendedResponseTime), per endpoint too.
+ * Timers and arrivals wake the loop through a timerfd, so they're kept to the microsecond rather than to the epoll timeout's millisecond
+ * A worker shares nothing with the others: it owns its sockets, its loop and its result, so workers run as separate processes
+ */
+class ReplayWorker
+{
+public:
+
+	/**
+	 * A c'tor for this class
+	 * @param[in] corpus The requests to replay
+	 * @param[in] target The address of the server to replay to
+	 * @param[in] targetLen The address length
+	 * @param[in] mode How the requests are put on connections
+	 * @param[in] numOfConnections The number of pooled connections (PooledReplay only)
+	 * @param[in] schedule When the requests are sent (PooledReplay only)
+	 * @param[in] requestsPerSec The rate of PoissonSchedule and FixedRateSchedule, for all workers together. Each worker takes its share
+	 * @param[in] workerIndex The index of this worker
+	 * @param[in] numOfWorkers The number of workers the corpus is split between
+	 * @param[in] verifier The verifier of the responses, loaded with the corpus. NULL not to verify them
+	 */
+	ReplayWorker(const ReplayCorpus& corpus, const sockaddr* target, socklen_t targetLen, ReplayMode mode, size_t numOfConnections,
+			ReplaySchedule schedule, double requestsPerSec, int workerIndex, int numOfWorkers, ResponseVerifier* verifier);
+
+	~ReplayWorker();
+
+	/**
+	 * Set up the event loop, before the coordinated start
+	 * @return False if it couldn't be set up
+	 */
+	bool init();
+
+	/**
+	 * Replay the worker's share, starting at a given time
+	 * @param[in] startTimeUsec The time to start at, on the monotonic clock in microseconds. All workers are given the same time
+	 * @param[in] durationUsec How long to replay, 0 for no limit. With PooledReplay (except with CapturedSchedule) the share is sent over and
+	 * over until then, otherwise once at most
+	 * @param[out] result What the worker measured
+	 * @param[out] endpointResponseTime One histogram per endpoint of the corpus, where the response times from the intended send times are
+	 * recorded. NULL not to record them
+	 */
+	void run(uint64_t startTimeUsec, uint64_t durationUsec, ReplayWorkerResult& result, LatencyHistogram* endpointResponseTime);
+
+	/**
+	 * @return The number of requests in the worker's share
+	 */
+	size_t getNumOfRequests() const { return m_RequestOrder.size(); }
+
+private:
+
+	enum ConnectionState
+	{
+		Closed,
+		Connecting,
+		Sending,
+		Receiving,
+		// open, waiting for the think time before the next request
+		Idle
+	};
+
+	/**
+	 * A client connection and the request it carries
+	 */
+	struct ClientConnection
+	{
+		int fd;
+		uint8_t state;
+		bool reused;
+
+		// the events the socket is polled for, and a count of the sockets the slot had so events of a closed one are told apart
+		uint32_t events;
+		uint32_t generation;
+
+		// the slot is free for the next request of an open-loop schedule
+		bool available;
+
+		uint32_t request;
+		uint32_t sendOffset;
+		uint64_t intendedTimeUsec;
+		uint64_t sentTimeUsec;
+		uint64_t firstByteTimeUsec;
+		HttpMessageFramer framer;
+
+		// the captured connection's requests still to send (ConnectionReplay only)
+		uint32_t nextRequest;
+		uint32_t endRequest;
+		uint32_t capturedConnection;
+	};
+
+	/**
+	 * A connection waiting to be opened or to send its next request
+	 */
+	struct ReplayTimer
+	{
+		uint64_t timeUsec;
+		uint32_t connection;
+
+		// the heap is a max-heap, the earliest timer has to come out first
+		bool operator<(const ReplayTimer& other) const { return timeUsec > other.timeUsec; }
+	};
+
+	/**
+	 * A request of an open-loop schedule which arrived while no connection was free
+	 */
+	struct PendingRequest
+	{
+		uint32_t request;
+		uint64_t intendedTimeUsec;
+	};
+
+	const ReplayCorpus& m_Corpus;
+	sockaddr_storage m_Target;
+	socklen_t m_TargetLen;
+	int m_EpollFd;
+	int m_TimerFd;
+	uint64_t m_ArmedWakeUpUsec;
+	ReplayMode m_Mode;
+	std::vector<ClientConnection> m_Connections;
+	std::vector<ReplayTimer> m_Timers;
+	std::vector<uint32_t> m_RequestOrder;
+	size_t m_NextRequest;
+
+	// the open-loop schedule: the next arrival time (0 once the share is used up), the offsets of CapturedSchedule (by m_RequestOrder index),
+	// the gap between arrivals of FixedRateSchedule and PoissonSchedule (the mean gap of the latter), and the requests waiting for a connection
+	ReplaySchedule m_Schedule;
+	bool m_OpenLoop;
+	uint64_t m_StartTimeUsec;
+	uint64_t m_NextArrivalUsec;
+	uint64_t m_NumOfArrivals;
+	std::vector<uint64_t> m_ArrivalOffsets;
+	double m_ArrivalIntervalUsec;
+	double m_ArrivalPhaseUsec;
+	std::mt19937_64 m_Random;
+	std::exponential_distribution<double> m_InterArrivalTime;
+	std::deque<PendingRequest> m_Backlog;
+	std::vector<uint32_t> m_FreeConnections;
+	bool m_Dispatching;
+
+	bool m_Repeat;
+	bool m_Stopping;
+	size_t m_NumOfOpen;
+	std::vector<uint8_t> m_RecvBuffer;
+	ReplayWorkerResult* m_Result;
+	LatencyHistogram* m_EndpointResponseTime;
+	ResponseVerifier* m_Verifier;
+
+	bool takeNextRequest(ClientConnection& conn);
+	void prepareRequest(ClientConnection& conn, uint32_t request);
+	uint64_t getNextArrivalTime();
+	void generateArrivals(uint64_t nowUsec);
+	void dispatchBacklog();
+	void releaseConnection(ClientConnection& conn);
+	void armTimerFd(uint64_t wakeUpUsec);
+	void setEvents(ClientConnection& conn, uint32_t events);
+	void addTimer(ClientConnection& conn, uint64_t timeUsec);
+	void fireTimers(uint64_t nowUsec);
+	void openConnection(ClientConnection& conn);
+	void closeConnection(ClientConnection& conn);
+	void startRequest(ClientConnection& conn);
+	void scheduleRequest(ClientConnection& conn, uint64_t nowUsec);
+	void sendRequest(ClientConnection& conn);
+	void receiveResponse(ClientConnection& conn);
+	void drainIdleConnection(ClientConnection& conn);
+	void completeResponse(ClientConnection& conn, uint64_t nowUsec);
+	void breakConnection(ClientConnection& conn);
+	void handleEvent(ClientConnection& conn, uint32_t events);
+
+	// the worker owns its sockets, prevent copies
+	ReplayWorker(const ReplayWorker& other);
+	ReplayWorker& operator=(const ReplayWorker& other);
+};
+
+#endif /* HTTPECHO_REPLAY_WORKER */
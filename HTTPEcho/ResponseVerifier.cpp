@@ -0,0 +1,540 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include "ResponseVerifier.h"
+
+// the headers which frame the message rather than carry content, never compared (a server may chunk a body another one sent by length)
+static const char* s_FramingHeaders[] = { "content-length", "transfer-encoding", "connection", "keep-alive" };
+
+// FNV-1a, for header names and values
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+// the multipliers of StreamingHash
+#define STREAM_HASH_K1 0x87c37b91114253d5ULL
+#define STREAM_HASH_K2 0x4cf5ad432745937fULL
+
+// the states of a ResponseCheck
+#define CHECK_START_LINE 0
+#define CHECK_HEADER_NAME 1
+#define CHECK_HEADER_VALUE 2
+#define CHECK_BODY 3
+#define CHECK_SKIPPED 4
+
+
+static inline uint64_t rotateLeft(uint64_t value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+
+static inline uint64_t mixWord(uint64_t state, uint64_t word)
+{
+	return rotateLeft(state ^ (word * STREAM_HASH_K1), 31) * STREAM_HASH_K2;
+}
+
+
+static inline uint64_t hashNameByte(uint64_t hash, uint8_t c)
+{
+	if (c >= 'A' && c <= 'Z')
+		c += 'a' - 'A';
+	return (hash ^ c) * FNV_PRIME;
+}
+
+
+/**
+ * Hash the next byte of a header value, leaving out the white space around it and folding each run of white space inside it into one space.
+ * A run is only hashed once a byte follows it, so trailing white space never is
+ */
+static inline void hashValueByte(uint64_t& hash, bool& started, bool& pendingSpace, uint8_t c)
+{
+	if (c == ' ' || c == '\t')
+	{
+		pendingSpace = started;
+		return;
+	}
+
+	if (pendingSpace)
+		hash = (hash ^ ' ') * FNV_PRIME;
+	hash = (hash ^ c) * FNV_PRIME;
+	started = true;
+	pendingSpace = false;
+}
+
+
+static uint64_t hashName(const char* name, size_t nameLen)
+{
+	uint64_t hash = FNV_OFFSET_BASIS;
+	for (size_t i = 0; i < nameLen; i++)
+		hash = hashNameByte(hash, (uint8_t)name[i]);
+	return hash;
+}
+
+
+/**
+ * Copy a value into a diff cell: tabs and control bytes would break the row, they're replaced with spaces
+ */
+static void appendCell(std::string& row, const char* data, size_t dataLen)
+{
+	for (size_t i = 0; i < dataLen; i++)
+		row += ((uint8_t)data[i] < 0x20 || data[i] == 0x7f) ? ' ' : data[i];
+}
+
+
+void StreamingHash::clear()
+{
+	m_State = 0x9e3779b97f4a7c15ULL;
+	m_Tail = 0;
+	m_Length = 0;
+}
+
+
+void StreamingHash::add(const uint8_t* data, size_t dataLen)
+{
+	size_t pos = 0;
+
+	// complete the word the last piece left partial
+	while ((m_Length & 7) != 0 && pos < dataLen)
+	{
+		m_Tail |= (uint64_t)data[pos++] << ((m_Length & 7) * 8);
+		m_Length++;
+		if ((m_Length & 7) == 0)
+		{
+			m_State = mixWord(m_State, m_Tail);
+			m_Tail = 0;
+		}
+	}
+
+	// whole words, which is nearly all of a body. Words are read little-endian like the partial ones, whatever the host
+	while (dataLen - pos >= 8)
+	{
+		uint64_t word = 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		memcpy(&word, data + pos, 8);
+#else
+		for (int byte = 7; byte >= 0; byte--)
+			word = (word << 8) | data[pos + byte];
+#endif
+		m_State = mixWord(m_State, word);
+		pos += 8;
+		m_Length += 8;
+	}
+
+	while (pos < dataLen)
+	{
+		m_Tail |= (uint64_t)data[pos++] << ((m_Length & 7) * 8);
+		m_Length++;
+	}
+}
+
+
+uint64_t StreamingHash::getHash() const
+{
+	// the length tells apart streams which differ only by trailing zero bytes, the final mix (MurmurHash3's) spreads every bit
+	uint64_t hash = mixWord(m_State, m_Tail) ^ m_Length;
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+
+ResponseVerifier::ResponseVerifier(const std::string& ignoredHeaders)
+{
+	m_Corpus = NULL;
+	m_DiffFd = -1;
+	m_NumOfDiffed = 0;
+
+	for (size_t i = 0; i < sizeof(s_FramingHeaders) / sizeof(s_FramingHeaders[0]); i++)
+		m_IgnoredHeaders.push_back(hashName(s_FramingHeaders[i], strlen(s_FramingHeaders[i])));
+
+	size_t start = 0;
+	while (start <= ignoredHeaders.size())
+	{
+		size_t end = ignoredHeaders.find(',', start);
+		if (end == std::string::npos)
+			end = ignoredHeaders.size();
+		if (end > start)
+			m_IgnoredHeaders.push_back(hashName(ignoredHeaders.c_str() + start, end - start));
+		start = end + 1;
+	}
+}
+
+
+ResponseVerifier::~ResponseVerifier()
+{
+	if (m_DiffFd >= 0)
+	{
+		flush();
+		close(m_DiffFd);
+	}
+}
+
+
+bool ResponseVerifier::isIgnored(uint64_t nameHash) const
+{
+	for (size_t i = 0; i < m_IgnoredHeaders.size(); i++)
+	{
+		if (m_IgnoredHeaders[i] == nameHash)
+			return true;
+	}
+
+	return false;
+}
+
+
+void ResponseVerifier::loadCorpus(const ReplayCorpus& corpus)
+{
+	m_Corpus = &corpus;
+	m_Expected.resize(corpus.getNumOfRequests());
+
+	// the body is hashed the way a replayed one is: through a framer, so chunked framing is left out
+	ResponseCheck bodyCheck;
+	HttpMessageFramer framer;
+	framer.setBodyListener(&bodyCheck);
+
+	for (size_t i = 0; i < corpus.getNumOfRequests(); i++)
+	{
+		const ReplayRequest& request = corpus.getRequest(i);
+		ExpectedResponse& expected = m_Expected[i];
+		expected.bodyHash = 0;
+		expected.bodyLength = 0;
+		expected.firstHeader = (uint32_t)m_ExpectedHeaders.size();
+		expected.numOfHeaders = 0;
+		expected.statusCode = 0;
+
+		// "HTTP/1.x nnn"
+		const char* data = (const char*)corpus.getData(request.responseOffset);
+		if (request.responseLength < 12)
+			continue;
+		for (int digit = 9; digit < 12; digit++)
+			expected.statusCode = expected.statusCode * 10 + (data[digit] - '0');
+
+		// the header lines, up to the empty one
+		const char* end = data + request.responseLength;
+		const char* line = (const char*)memchr(data, '\n', request.responseLength);
+		while (line != NULL && ++line < end)
+		{
+			const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+			if (lineEnd == NULL)
+				lineEnd = end;
+			size_t lineLen = lineEnd - line;
+			if (lineLen > 0 && line[lineLen - 1] == '\r')
+				lineLen--;
+			if (lineLen == 0)
+				break;
+
+			const char* colon = (const char*)memchr(line, ':', lineLen);
+			uint64_t nameHash = (colon != NULL ? hashName(line, colon - line) : 0);
+			if (colon != NULL && !isIgnored(nameHash) && expected.numOfHeaders < VERIFY_MAX_HEADERS)
+			{
+				ExpectedHeader header;
+				header.nameHash = nameHash;
+				header.valueHash = FNV_OFFSET_BASIS;
+				bool started = false;
+				bool pendingSpace = false;
+				for (const char* c = colon + 1; c < line + lineLen; c++)
+					hashValueByte(header.valueHash, started, pendingSpace, (uint8_t)*c);
+				header.lineOffset = request.responseOffset + (uint64_t)(line - data);
+				header.lineLen = (uint32_t)lineLen;
+				m_ExpectedHeaders.push_back(header);
+				expected.numOfHeaders++;
+			}
+
+			line = (lineEnd < end ? lineEnd : NULL);
+		}
+
+		bodyCheck.body.clear();
+		framer.reset(false, request.isHead);
+		framer.feed((const uint8_t*)data, request.responseLength);
+		framer.finish();
+		expected.bodyHash = bodyCheck.body.getHash();
+		expected.bodyLength = bodyCheck.body.getLength();
+	}
+}
+
+
+bool ResponseVerifier::createDiffFile(const std::string& filePath)
+{
+	m_DiffFilePath = filePath;
+	FILE* diffFile = fopen(filePath.c_str(), "w");
+	if (diffFile == NULL)
+		return false;
+
+	fprintf(diffFile, "connection\trequest\tendpoint\tpart\tcaptured\treplayed\n");
+	fclose(diffFile);
+	return true;
+}
+
+
+bool ResponseVerifier::open(size_t numOfConnections)
+{
+	// every worker appends whole rows with single writes, so the rows of several workers never interleave
+	m_DiffFd = ::open(m_DiffFilePath.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+	if (m_DiffFd < 0)
+		return false;
+
+	ResponseCheck check;
+	memset(check.name, 0, sizeof(check.name));
+	memset(check.value, 0, sizeof(check.value));
+	check.request = 0;
+	check.state = CHECK_SKIPPED;
+	m_Checks.resize(numOfConnections, check);
+	m_PendingRows.reserve(VERIFY_FLUSH_SIZE * 2);
+	return true;
+}
+
+
+void ResponseVerifier::startResponse(size_t connection, uint32_t request)
+{
+	ResponseCheck& check = m_Checks[connection];
+	check.request = request;
+	check.state = (m_Expected[request].statusCode != 0 ? CHECK_START_LINE : CHECK_SKIPPED);
+	check.body.clear();
+	check.matchedHeaders = 0;
+	check.nameLen = 0;
+	check.valueLen = 0;
+	check.headerMismatch = false;
+	check.diffed = false;
+}
+
+
+void ResponseVerifier::feed(size_t connection, const uint8_t* data, size_t dataLen)
+{
+	ResponseCheck& check = m_Checks[connection];
+	for (size_t pos = 0; pos < dataLen && check.state < CHECK_BODY; pos++)
+	{
+		uint8_t c = data[pos];
+		if (check.state == CHECK_START_LINE)
+		{
+			// "HTTP/1.x 1nn": an interim response, the final one is verified once it follows
+			if (check.valueLen == 9 && c == '1')
+				check.state = CHECK_SKIPPED;
+			else if (c == '\n')
+			{
+				check.state = CHECK_HEADER_NAME;
+				check.nameLen = 0;
+				check.nameHash = FNV_OFFSET_BASIS;
+			}
+			if (check.valueLen < UINT8_MAX)
+				check.valueLen++;
+		}
+		else if (check.state == CHECK_HEADER_NAME)
+		{
+			if (c == '\r')
+				continue;
+
+			// an empty line ends the headers, a line without a colon is skipped
+			if (c == '\n')
+			{
+				if (check.nameLen == 0)
+					check.state = CHECK_BODY;
+				check.nameLen = 0;
+				check.nameHash = FNV_OFFSET_BASIS;
+			}
+			else if (c == ':')
+			{
+				check.ignored = isIgnored(check.nameHash);
+				check.valueHash = FNV_OFFSET_BASIS;
+				check.valueLen = 0;
+				check.pendingSpace = false;
+				check.state = CHECK_HEADER_VALUE;
+			}
+			else
+			{
+				check.nameHash = hashNameByte(check.nameHash, c);
+				if (check.nameLen < VERIFY_MAX_NAME_LEN)
+					check.name[check.nameLen] = (char)c;
+				if (check.nameLen < UINT8_MAX)
+					check.nameLen++;
+			}
+		}
+		else
+		{
+			if (c == '\n')
+			{
+				endHeaderLine(check);
+				check.state = CHECK_HEADER_NAME;
+				check.nameLen = 0;
+				check.nameHash = FNV_OFFSET_BASIS;
+			}
+			else if (c != '\r' && !check.ignored)
+			{
+				// the hash starts at the basis, so whether the value started is whether a byte other than white space was hashed
+				bool started = (check.valueLen > 0);
+				hashValueByte(check.valueHash, started, check.pendingSpace, c);
+				if (started)
+				{
+					if (check.valueLen < VERIFY_MAX_VALUE_LEN)
+						check.value[check.valueLen] = (char)c;
+					if (check.valueLen < UINT8_MAX)
+						check.valueLen++;
+				}
+			}
+		}
+	}
+}
+
+
+void ResponseVerifier::endHeaderLine(ResponseCheck& check)
+{
+	if (check.ignored)
+		return;
+
+	const ExpectedResponse& expected = m_Expected[check.request];
+	const ExpectedHeader* headers = &m_ExpectedHeaders[expected.firstHeader];
+
+	// a header may repeat, each replayed one takes the first captured one of its name not matched yet, preferring one with its value
+	int sameName = -1;
+	for (int i = 0; i < expected.numOfHeaders; i++)
+	{
+		if ((check.matchedHeaders & (1ULL << i)) != 0 || headers[i].nameHash != check.nameHash)
+			continue;
+
+		if (headers[i].valueHash == check.valueHash)
+		{
+			check.matchedHeaders |= (1ULL << i);
+			return;
+		}
+
+		if (sameName < 0)
+			sameName = i;
+	}
+
+	std::string replayed;
+	appendCell(replayed, check.name, std::min((size_t)check.nameLen, (size_t)VERIFY_MAX_NAME_LEN));
+	replayed += ": ";
+	appendCell(replayed, check.value, std::min((size_t)check.valueLen, (size_t)VERIFY_MAX_VALUE_LEN));
+	if (check.nameLen > VERIFY_MAX_NAME_LEN || check.valueLen > VERIFY_MAX_VALUE_LEN)
+		replayed += "...";
+
+	check.headerMismatch = true;
+	if (sameName >= 0)
+	{
+		check.matchedHeaders |= (1ULL << sameName);
+		addDiffRow(check, "header", getCapturedHeaderLine(headers[sameName]), replayed);
+	}
+	else
+		addDiffRow(check, "header", "", replayed);
+}
+
+
+void ResponseVerifier::finishResponse(size_t connection, int statusCode, VerifyCounters& counters)
+{
+	ResponseCheck& check = m_Checks[connection];
+	if (m_Expected[check.request].statusCode == 0)
+		return;
+
+	const ExpectedResponse& expected = m_Expected[check.request];
+	counters.numOfVerified++;
+
+	bool statusMismatch = (statusCode != expected.statusCode);
+	if (statusMismatch)
+	{
+		char captured[16], replayed[16];
+		snprintf(captured, sizeof(captured), "%d", (int)expected.statusCode);
+		snprintf(replayed, sizeof(replayed), "%d", statusCode);
+		addDiffRow(check, "status", captured, replayed);
+	}
+
+	// the captured headers no replayed one matched were left out by the server
+	for (int i = 0; i < expected.numOfHeaders; i++)
+	{
+		if ((check.matchedHeaders & (1ULL << i)) == 0)
+		{
+			check.headerMismatch = true;
+			addDiffRow(check, "header", getCapturedHeaderLine(m_ExpectedHeaders[expected.firstHeader + i]), "");
+		}
+	}
+
+	bool bodyMismatch = (check.body.getLength() != expected.bodyLength || check.body.getHash() != expected.bodyHash);
+	if (bodyMismatch)
+	{
+		char captured[64], replayed[64];
+		snprintf(captured, sizeof(captured), "%llu bytes, hash %016llx", (unsigned long long)expected.bodyLength,
+			(unsigned long long)expected.bodyHash);
+		snprintf(replayed, sizeof(replayed), "%llu bytes, hash %016llx", (unsigned long long)check.body.getLength(),
+			(unsigned long long)check.body.getHash());
+		addDiffRow(check, "body", captured, replayed);
+	}
+
+	if (statusMismatch || check.headerMismatch || bodyMismatch)
+	{
+		counters.numOfMismatches++;
+		counters.numOfStatusMismatches += (statusMismatch ? 1 : 0);
+		counters.numOfHeaderMismatches += (check.headerMismatch ? 1 : 0);
+		counters.numOfBodyMismatches += (bodyMismatch ? 1 : 0);
+	}
+
+	check.state = CHECK_SKIPPED;
+	if (m_PendingRows.size() >= VERIFY_FLUSH_SIZE)
+		flush();
+}
+
+
+std::string ResponseVerifier::getCapturedHeaderLine(const ExpectedHeader& header) const
+{
+	std::string line;
+	size_t lineLen = std::min((size_t)header.lineLen, (size_t)(VERIFY_MAX_NAME_LEN + VERIFY_MAX_VALUE_LEN));
+	appendCell(line, (const char*)m_Corpus->getData(header.lineOffset), lineLen);
+	if (lineLen < header.lineLen)
+		line += "...";
+	return line;
+}
+
+
+void ResponseVerifier::addDiffRow(ResponseCheck& check, const char* part, const std::string& captured, const std::string& replayed)
+{
+	// the diffs of a response are all written or none are, past the limit the mismatches are only counted
+	if (!check.diffed)
+	{
+		if (m_NumOfDiffed >= VERIFY_MAX_DIFFED_RESPONSES)
+			return;
+		m_NumOfDiffed++;
+		check.diffed = true;
+	}
+
+	// the connection the request is in: the connections hold consecutive ranges of requests, in order
+	size_t low = 0, high = m_Corpus->getNumOfConnections();
+	while (high - low > 1)
+	{
+		size_t middle = (low + high) / 2;
+		if (m_Corpus->getConnection(middle).firstRequest <= check.request)
+			low = middle;
+		else
+			high = middle;
+	}
+	const ReplayConnection& connection = m_Corpus->getConnection(low);
+
+	char requestNumber[16];
+	snprintf(requestNumber, sizeof(requestNumber), "%u", check.request - connection.firstRequest + 1);
+
+	m_PendingRows += connection.fileName;
+	m_PendingRows += '\t';
+	m_PendingRows += requestNumber;
+	m_PendingRows += '\t';
+	m_PendingRows += m_Corpus->getEndpointName(m_Corpus->getRequest(check.request).endpoint);
+	m_PendingRows += '\t';
+	m_PendingRows += part;
+	m_PendingRows += '\t';
+	m_PendingRows += captured;
+	m_PendingRows += '\t';
+	m_PendingRows += replayed;
+	m_PendingRows += '\n';
+}
+
+
+void ResponseVerifier::flush()
+{
+	// the pending rows always end with a whole row, so each write appends whole rows
+	if (m_DiffFd < 0 || m_PendingRows.empty())
+		return;
+
+	if (write(m_DiffFd, m_PendingRows.data(), m_PendingRows.size()) < 0)
+		perror("Couldn't write response diffs");
+	m_PendingRows.clear();
+}
@@ -0,0 +1,231 @@
+#ifndef HTTPECHO_RESPONSE_VERIFIER
+#define HTTPECHO_RESPONSE_VERIFIER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "ReplayCorpus.h"
+#include "HttpMessageFramer.h"
+
+// the headers of a captured response compared one by one, the rest are left out of the comparison
+#define VERIFY_MAX_HEADERS 64
+
+// the bytes of a replayed header name and value kept for the diff of a header which doesn't match
+#define VERIFY_MAX_NAME_LEN 32
+#define VERIFY_MAX_VALUE_LEN 48
+
+// the mismatching responses a worker writes diffs for, the ones after them are only counted
+#define VERIFY_MAX_DIFFED_RESPONSES 10000
+
+// the diff rows are written out once this many bytes of them are pending
+#define VERIFY_FLUSH_SIZE (64 * 1024)
+
+// the headers which change from one response to the next whatever the server does, left out of the comparison unless others are given
+#define VERIFY_DEFAULT_IGNORED_HEADERS "date,age,expires,set-cookie"
+
+
+/**
+ * @struct VerifyCounters
+ * What the verification of a worker found
+ */
+struct VerifyCounters
+{
+	// replayed responses compared with a captured one, and those which differ from it
+	uint64_t numOfVerified;
+	uint64_t numOfMismatches;
+
+	// the responses which differ, by what differs (a response may count in several)
+	uint64_t numOfStatusMismatches;
+	uint64_t numOfHeaderMismatches;
+	uint64_t numOfBodyMismatches;
+};
+
+
+/**
+ * A 64-bit hash of a byte stream which can be fed in pieces of any size and gives the same hash however it's split. Bytes are taken 8 at a time
+ * (a multiply and a rotate each) and a final mix spreads the last bits, so hashing keeps up with the network. It tells different content apart,
+ * it isn't meant to resist someone crafting collisions
+ */
+class StreamingHash
+{
+public:
+	StreamingHash() { clear(); }
+
+	void clear();
+	void add(const uint8_t* data, size_t dataLen);
+
+	/**
+	 * @return The hash of all bytes added so far
+	 */
+	uint64_t getHash() const;
+
+	/**
+	 * @return The number of bytes added so far
+	 */
+	uint64_t getLength() const { return m_Length; }
+
+private:
+	uint64_t m_State;
+	uint64_t m_Tail;
+	uint64_t m_Length;
+};
+
+
+/**
+ * Compares the responses of a replay with the ones HTTPEcho captured, while they stream in. The captured responses are digested once, before the
+ * replay starts: the status code, a hash of each header value (by header name) and a StreamingHash of the body. A replayed response is digested
+ * on the fly, with a small fixed state per connection and without keeping its bytes: its header lines are hashed a byte at a time and matched
+ * against the captured headers as each line ends, and its body (without the chunked framing, through HttpBodyListener) is hashed as it arrives.
+ * Header names are compared regardless of case, and values regardless of the white space around and inside them. The framing headers
+ * (Content-Length, Transfer-Encoding, Connection, Keep-Alive) and the ignored ones (volatile headers like Date) aren't compared.
+ * Only the differences are written, one tab-separated row per difference: the captured connection, the request's number in it, its endpoint,
+ * the part (status, header or body) and the captured and replayed values. An empty captured value is a header the server added, an empty replayed
+ * one a header it left out
+ */
+class ResponseVerifier
+{
+public:
+
+	/**
+	 * A c'tor for this class
+	 * @param[in] ignoredHeaders The names of the headers not to compare, comma separated
+	 */
+	ResponseVerifier(const std::string& ignoredHeaders);
+
+	~ResponseVerifier();
+
+	/**
+	 * Digest the captured responses of a corpus. Done once before the workers are forked, so they share the digests
+	 * @param[in] corpus The corpus, which has to outlive the verifier
+	 */
+	void loadCorpus(const ReplayCorpus& corpus);
+
+	/**
+	 * Create (or empty) the file the differences are written to and write its header row
+	 * @param[in] filePath The file path
+	 * @return False if the file couldn't be created
+	 */
+	bool createDiffFile(const std::string& filePath);
+
+	/**
+	 * Get ready to verify the responses of a worker's connections: open the diff file for appending and set up a state per connection. Each
+	 * worker process does this on its own copy of the verifier
+	 * @param[in] numOfConnections The number of connection slots of the worker
+	 * @return False if the diff file couldn't be opened
+	 */
+	bool open(size_t numOfConnections);
+
+	/**
+	 * @param[in] connection A connection slot
+	 * @return The listener the connection's framer passes the body bytes to
+	 */
+	HttpBodyListener* getBodyListener(size_t connection) { return &m_Checks[connection]; }
+
+	/**
+	 * Start verifying the next response of a connection, or the final response after an interim one
+	 * @param[in] connection The connection slot
+	 * @param[in] request The request the response is for, an index in the corpus
+	 */
+	void startResponse(size_t connection, uint32_t request);
+
+	/**
+	 * Feed the bytes of a response, as they arrive. Only the start line and the headers are looked at here, the body comes through the listener
+	 * @param[in] connection The connection slot
+	 * @param[in] data The response data
+	 * @param[in] dataLen The response data length
+	 */
+	void feed(size_t connection, const uint8_t* data, size_t dataLen);
+
+	/**
+	 * Finish verifying a response whose last byte arrived: compare what's left and write the differences
+	 * @param[in] connection The connection slot
+	 * @param[in] statusCode The status code of the response
+	 * @param[out] counters The counters to update
+	 */
+	void finishResponse(size_t connection, int statusCode, VerifyCounters& counters);
+
+	/**
+	 * Write the pending diff rows to the file
+	 */
+	void flush();
+
+	/**
+	 * @return The number of header names not compared
+	 */
+	size_t getNumOfIgnoredHeaders() const { return m_IgnoredHeaders.size(); }
+
+private:
+
+	/**
+	 * A header of a captured response: the hashes of its name and value and where its line is in the corpus (for the diff)
+	 */
+	struct ExpectedHeader
+	{
+		uint64_t nameHash;
+		uint64_t valueHash;
+		uint64_t lineOffset;
+		uint32_t lineLen;
+	};
+
+	/**
+	 * The digest of a captured response. A status code of 0 means the request has no captured response to compare with
+	 */
+	struct ExpectedResponse
+	{
+		uint64_t bodyHash;
+		uint64_t bodyLength;
+		uint32_t firstHeader;
+		uint16_t numOfHeaders;
+		uint16_t statusCode;
+	};
+
+	/**
+	 * The state of the response a connection is receiving
+	 */
+	class ResponseCheck : public HttpBodyListener
+	{
+	public:
+		void onBodyData(const uint8_t* data, size_t dataLen) { body.add(data, dataLen); }
+
+		StreamingHash body;
+
+		// the captured headers matched so far, and those whose replayed value differs
+		uint64_t matchedHeaders;
+
+		// the header being read: its name and value hashes and their first bytes
+		uint64_t nameHash;
+		uint64_t valueHash;
+		uint32_t request;
+		uint8_t state;
+		uint8_t nameLen;
+		uint8_t valueLen;
+		bool pendingSpace;
+		bool ignored;
+		bool headerMismatch;
+		bool diffed;
+		char name[VERIFY_MAX_NAME_LEN];
+		char value[VERIFY_MAX_VALUE_LEN];
+	};
+
+	const ReplayCorpus* m_Corpus;
+	std::vector<uint64_t> m_IgnoredHeaders;
+	std::vector<ExpectedResponse> m_Expected;
+	std::vector<ExpectedHeader> m_ExpectedHeaders;
+	std::vector<ResponseCheck> m_Checks;
+	std::string m_DiffFilePath;
+	std::string m_PendingRows;
+	int m_DiffFd;
+	uint64_t m_NumOfDiffed;
+
+	bool isIgnored(uint64_t nameHash) const;
+	void endHeaderLine(ResponseCheck& check);
+	void addDiffRow(ResponseCheck& check, const char* part, const std::string& captured, const std::string& replayed);
+	std::string getCapturedHeaderLine(const ExpectedHeader& header) const;
+
+	// the verifier owns the diff file, prevent copies
+	ResponseVerifier(const ResponseVerifier& other);
+	ResponseVerifier& operator=(const ResponseVerifier& other);
+};
+
+#endif /* HTTPECHO_RESPONSE_VERIFIER */
@@ -0,0 +1,355 @@
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "StreamingSketches.h"
+
+
+uint64_t hashSketchKey(const void* data, size_t dataLen)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < dataLen; i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+
+	// splitmix64 finalizer
+	hash ^= hash >> 30;
+	hash *= 0xbf58476d1ce4e5b9ULL;
+	hash ^= hash >> 27;
+	hash *= 0x94d049bb133111ebULL;
+	hash ^= hash >> 31;
+
+	return hash;
+}
+
+
+/**
+ * A counter collected while merging two summaries
+ */
+struct MergedCounter
+{
+	const char* key;
+	uint64_t hash;
+	uint64_t count;
+	uint64_t error;
+};
+
+static bool compareMergedCounters(const MergedCounter& first, const MergedCounter& second)
+{
+	return first.count > second.count;
+}
+
+
+TopKCounter::TopKCounter(size_t capacity)
+{
+	m_Capacity = (capacity > 0 ? capacity : 1);
+	m_Counters = new Counter[m_Capacity];
+	m_Heap = new uint32_t[m_Capacity];
+
+	size_t numOfSlots = 16;
+	while (numOfSlots < m_Capacity * 2)
+		numOfSlots <<= 1;
+	m_Slots = new int32_t[numOfSlots];
+	m_SlotMask = numOfSlots - 1;
+
+	clear();
+}
+
+
+TopKCounter::~TopKCounter()
+{
+	delete [] m_Counters;
+	delete [] m_Heap;
+	delete [] m_Slots;
+}
+
+
+void TopKCounter::clear()
+{
+	m_NumOfCounters = 0;
+	m_TotalCount = 0;
+	for (size_t i = 0; i <= m_SlotMask; i++)
+		m_Slots[i] = -1;
+}
+
+
+int32_t TopKCounter::findCounter(const char* key, uint64_t hash) const
+{
+	size_t index = (size_t)hash & m_SlotMask;
+	while (m_Slots[index] >= 0)
+	{
+		const Counter& counter = m_Counters[m_Slots[index]];
+		if (counter.hash == hash && strncmp(counter.key, key, TOP_K_MAX_KEY_LEN) == 0)
+			return m_Slots[index];
+
+		index = (index + 1) & m_SlotMask;
+	}
+
+	return -1;
+}
+
+
+void TopKCounter::insertSlot(uint32_t counterIndex)
+{
+	size_t index = (size_t)m_Counters[counterIndex].hash & m_SlotMask;
+	while (m_Slots[index] >= 0)
+		index = (index + 1) & m_SlotMask;
+
+	m_Slots[index] = (int32_t)counterIndex;
+}
+
+
+void TopKCounter::eraseSlot(uint32_t counterIndex)
+{
+	size_t index = (size_t)m_Counters[counterIndex].hash & m_SlotMask;
+	while (m_Slots[index] != (int32_t)counterIndex)
+		index = (index + 1) & m_SlotMask;
+
+	// backward shift deletion, so lookups never need tombstones
+	size_t hole = index;
+	size_t next = (hole + 1) & m_SlotMask;
+	while (m_Slots[next] >= 0)
+	{
+		size_t home = (size_t)m_Counters[m_Slots[next]].hash & m_SlotMask;
+		if (((next - home) & m_SlotMask) >= ((next - hole) & m_SlotMask))
+		{
+			m_Slots[hole] = m_Slots[next];
+			hole = next;
+		}
+		next = (next + 1) & m_SlotMask;
+	}
+
+	m_Slots[hole] = -1;
+}
+
+
+void TopKCounter::swapHeap(uint32_t posA, uint32_t posB)
+{
+	uint32_t counterA = m_Heap[posA];
+	uint32_t counterB = m_Heap[posB];
+	m_Heap[posA] = counterB;
+	m_Heap[posB] = counterA;
+	m_Counters[counterB].heapPos = posA;
+	m_Counters[counterA].heapPos = posB;
+}
+
+
+void TopKCounter::siftDown(uint32_t heapPos)
+{
+	while (true)
+	{
+		uint32_t smallest = heapPos;
+		uint32_t left = heapPos * 2 + 1;
+		uint32_t right = left + 1;
+
+		if (left < m_NumOfCounters && m_Counters[m_Heap[left]].count < m_Counters[m_Heap[smallest]].count)
+			smallest = left;
+		if (right < m_NumOfCounters && m_Counters[m_Heap[right]].count < m_Counters[m_Heap[smallest]].count)
+			smallest = right;
+
+		if (smallest == heapPos)
+			return;
+
+		swapHeap(heapPos, smallest);
+		heapPos = smallest;
+	}
+}
+
+
+void TopKCounter::siftUp(uint32_t heapPos)
+{
+	while (heapPos > 0)
+	{
+		uint32_t parent = (heapPos - 1) / 2;
+		if (m_Counters[m_Heap[parent]].count <= m_Counters[m_Heap[heapPos]].count)
+			return;
+
+		swapHeap(heapPos, parent);
+		heapPos = parent;
+	}
+}
+
+
+void TopKCounter::add(const char* key, uint64_t hash, uint64_t count, uint64_t error)
+{
+	int32_t counterIndex = findCounter(key, hash);
+	if (counterIndex >= 0)
+	{
+		Counter& counter = m_Counters[counterIndex];
+		counter.count += count;
+		counter.error += error;
+		siftDown(counter.heapPos);
+		return;
+	}
+
+	uint32_t newIndex;
+	if (m_NumOfCounters < m_Capacity)
+	{
+		newIndex = (uint32_t)m_NumOfCounters;
+		m_Counters[newIndex].heapPos = (uint32_t)m_NumOfCounters;
+		m_Heap[m_NumOfCounters] = newIndex;
+		m_NumOfCounters++;
+		m_Counters[newIndex].count = 0;
+		m_Counters[newIndex].error = 0;
+	}
+	else
+	{
+		// take over the counter with the lowest count, its count is the most the new key may have occurred before
+		newIndex = m_Heap[0];
+		eraseSlot(newIndex);
+		m_Counters[newIndex].error = m_Counters[newIndex].count;
+	}
+
+	Counter& counter = m_Counters[newIndex];
+	size_t keyLen = strlen(key);
+	if (keyLen > TOP_K_MAX_KEY_LEN)
+		keyLen = TOP_K_MAX_KEY_LEN;
+	memcpy(counter.key, key, keyLen);
+	counter.key[keyLen] = '\0';
+	counter.hash = hash;
+	counter.count += count;
+	counter.error += error;
+	insertSlot(newIndex);
+
+	siftUp(counter.heapPos);
+	siftDown(counter.heapPos);
+}
+
+
+void TopKCounter::offer(const char* key)
+{
+	size_t keyLen = strlen(key);
+	if (keyLen > TOP_K_MAX_KEY_LEN)
+		keyLen = TOP_K_MAX_KEY_LEN;
+
+	add(key, hashSketchKey(key, keyLen), 1, 0);
+	m_TotalCount++;
+}
+
+
+void TopKCounter::merge(const TopKCounter& other)
+{
+	// a key missing from a full summary may have occurred up to that summary's lowest count
+	uint64_t thisMin = (m_NumOfCounters == m_Capacity ? m_Counters[m_Heap[0]].count : 0);
+	uint64_t otherMin = (other.m_NumOfCounters == other.m_Capacity ? other.m_Counters[other.m_Heap[0]].count : 0);
+
+	std::vector<MergedCounter> merged;
+	merged.reserve(m_NumOfCounters + other.m_NumOfCounters);
+
+	for (size_t i = 0; i < m_NumOfCounters; i++)
+	{
+		const Counter& counter = m_Counters[i];
+		int32_t otherIndex = other.findCounter(counter.key, counter.hash);
+		MergedCounter entry = { counter.key, counter.hash, counter.count, counter.error };
+		entry.count += (otherIndex >= 0 ? other.m_Counters[otherIndex].count : otherMin);
+		entry.error += (otherIndex >= 0 ? other.m_Counters[otherIndex].error : otherMin);
+		merged.push_back(entry);
+	}
+
+	for (size_t i = 0; i < other.m_NumOfCounters; i++)
+	{
+		const Counter& counter = other.m_Counters[i];
+		if (findCounter(counter.key, counter.hash) >= 0)
+			continue;
+
+		MergedCounter entry = { counter.key, counter.hash, counter.count + thisMin, counter.error + thisMin };
+		merged.push_back(entry);
+	}
+
+	// keep the K highest counts. The keys point into both summaries, so copy them out before this one is rebuilt
+	std::sort(merged.begin(), merged.end(), compareMergedCounters);
+	if (merged.size() > m_Capacity)
+		merged.resize(m_Capacity);
+
+	std::vector<char> keys(merged.size() * (TOP_K_MAX_KEY_LEN + 1));
+	for (size_t i = 0; i < merged.size(); i++)
+	{
+		char* key = &keys[i * (TOP_K_MAX_KEY_LEN + 1)];
+		strncpy(key, merged[i].key, TOP_K_MAX_KEY_LEN);
+		key[TOP_K_MAX_KEY_LEN] = '\0';
+		merged[i].key = key;
+	}
+
+	uint64_t totalCount = m_TotalCount + other.m_TotalCount;
+	clear();
+	m_TotalCount = totalCount;
+	for (size_t i = 0; i < merged.size(); i++)
+		add(merged[i].key, merged[i].hash, merged[i].count, merged[i].error);
+}
+
+
+size_t TopKCounter::getTopKeys(Entry* entries, size_t maxEntries) const
+{
+	std::vector<MergedCounter> sorted(m_NumOfCounters);
+	for (size_t i = 0; i < m_NumOfCounters; i++)
+	{
+		sorted[i].key = m_Counters[i].key;
+		sorted[i].hash = m_Counters[i].hash;
+		sorted[i].count = m_Counters[i].count;
+		sorted[i].error = m_Counters[i].error;
+	}
+
+	std::sort(sorted.begin(), sorted.end(), compareMergedCounters);
+
+	size_t numOfEntries = (sorted.size() < maxEntries ? sorted.size() : maxEntries);
+	for (size_t i = 0; i < numOfEntries; i++)
+	{
+		strcpy(entries[i].key, sorted[i].key);
+		entries[i].count = sorted[i].count;
+		entries[i].error = sorted[i].error;
+	}
+
+	return numOfEntries;
+}
+
+
+void HyperLogLog::clear()
+{
+	memset(m_Registers, 0, sizeof(m_Registers));
+}
+
+
+void HyperLogLog::addHash(uint64_t hash)
+{
+	// the top bits pick the register, the register keeps the longest run of leading zeros seen in the rest
+	uint32_t index = (uint32_t)(hash >> (64 - HYPERLOGLOG_PRECISION));
+	uint64_t rest = (hash << HYPERLOGLOG_PRECISION) | (1ULL << (HYPERLOGLOG_PRECISION - 1));
+	uint8_t rank = (uint8_t)(__builtin_clzll(rest) + 1);
+
+	if (rank > m_Registers[index])
+		m_Registers[index] = rank;
+}
+
+
+void HyperLogLog::merge(const HyperLogLog& other)
+{
+	for (size_t i = 0; i < HYPERLOGLOG_NUM_OF_REGISTERS; i++)
+	{
+		if (other.m_Registers[i] > m_Registers[i])
+			m_Registers[i] = other.m_Registers[i];
+	}
+}
+
+
+uint64_t HyperLogLog::estimate() const
+{
+	const double numOfRegisters = (double)HYPERLOGLOG_NUM_OF_REGISTERS;
+
+	double sum = 0;
+	size_t numOfZeros = 0;
+	for (size_t i = 0; i < HYPERLOGLOG_NUM_OF_REGISTERS; i++)
+	{
+		sum += ldexp(1.0, -(int)m_Registers[i]);
+		if (m_Registers[i] == 0)
+			numOfZeros++;
+	}
+
+	double alpha = 0.7213 / (1.0 + 1.079 / numOfRegisters);
+	double estimate = alpha * numOfRegisters * numOfRegisters / sum;
+
+	// small cardinalities are estimated more accurately by linear counting of the empty registers
+	if (estimate <= 2.5 * numOfRegisters && numOfZeros > 0)
+		estimate = numOfRegisters * log(numOfRegisters / (double)numOfZeros);
+
+	return (uint64_t)(estimate + 0.5);
+}
@@ -0,0 +1,170 @@
+#ifndef HTTPECHO_STREAMING_SKETCHES
+#define HTTPECHO_STREAMING_SKETCHES
+
+#include <stdint.h>
+#include <stddef.h>
+
+// max length of a key kept by TopKCounter, longer keys are truncated
+#define TOP_K_MAX_KEY_LEN 127
+
+// HyperLogLog precision: 2^14 one-byte registers (16KB), ~0.8% standard error
+#define HYPERLOGLOG_PRECISION 14
+#define HYPERLOGLOG_NUM_OF_REGISTERS (1 << HYPERLOGLOG_PRECISION)
+
+
+/**
+ * A 64-bit hash of a byte string, used by the sketches (FNV-1a followed by a strong final mix so all bits are usable)
+ */
+uint64_t hashSketchKey(const void* data, size_t dataLen);
+
+
+/**
+ * Finds the most frequent keys of an unbounded stream with fixed memory, using the Space-Saving algorithm: K counters are kept, a key which
+ * isn't counted yet takes over the counter with the lowest count (and inherits that count as its possible over-estimation).
+ * Every key which occurred more than N/K times (N = total count) is guaranteed to be in the summary.
+ * Counters are looked up through a small hash index and kept in a min-heap, so counting a key is O(1) for known keys and O(log K) otherwise.
+ * Two summaries can be merged (e.g to combine several capture workers), the merged summary keeps the same guarantees
+ */
+class TopKCounter
+{
+public:
+
+	/**
+	 * A single counted key as reported by getTopKeys()
+	 */
+	struct Entry
+	{
+		// the key (null terminated)
+		char key[TOP_K_MAX_KEY_LEN + 1];
+
+		// the estimated count, never lower than the true count
+		uint64_t count;
+
+		// the max over-estimation of the count
+		uint64_t error;
+	};
+
+	/**
+	 * A c'tor for this class, all memory is allocated here
+	 * @param[in] capacity The number of counters (K)
+	 */
+	TopKCounter(size_t capacity);
+
+	/**
+	 * A d'tor for this class
+	 */
+	~TopKCounter();
+
+	/**
+	 * Count one occurrence of a key
+	 * @param[in] key The key (null terminated)
+	 */
+	void offer(const char* key);
+
+	/**
+	 * Add the counts of another summary (of any capacity) to this one
+	 * @param[in] other The summary to merge
+	 */
+	void merge(const TopKCounter& other);
+
+	/**
+	 * Remove all keys
+	 */
+	void clear();
+
+	/**
+	 * Get the counted keys sorted by count, highest first
+	 * @param[out] entries An array of at least maxEntries entries
+	 * @param[in] maxEntries The max number of keys to return
+	 * @return The number of keys returned
+	 */
+	size_t getTopKeys(Entry* entries, size_t maxEntries) const;
+
+	/**
+	 * @return The total number of occurrences counted
+	 */
+	uint64_t getTotalCount() const { return m_TotalCount; }
+
+private:
+
+	struct Counter
+	{
+		uint64_t count;
+		uint64_t error;
+		uint64_t hash;
+		uint32_t heapPos;
+		char key[TOP_K_MAX_KEY_LEN + 1];
+	};
+
+	Counter* m_Counters;
+	size_t m_Capacity;
+	size_t m_NumOfCounters;
+	uint64_t m_TotalCount;
+
+	// min-heap of counter indices ordered by count
+	uint32_t* m_Heap;
+
+	// hash index: key hash -> counter index (-1 for an empty slot)
+	int32_t* m_Slots;
+	size_t m_SlotMask;
+
+	int32_t findCounter(const char* key, uint64_t hash) const;
+	void insertSlot(uint32_t counterIndex);
+	void eraseSlot(uint32_t counterIndex);
+	void siftDown(uint32_t heapPos);
+	void siftUp(uint32_t heapPos);
+	void swapHeap(uint32_t posA, uint32_t posB);
+	void add(const char* key, uint64_t hash, uint64_t count, uint64_t error);
+
+	TopKCounter(const TopKCounter&);
+	TopKCounter& operator=(const TopKCounter&);
+};
+
+
+/**
+ * Estimates the number of distinct keys of an unbounded stream in 16KB (HyperLogLog with 2^14 registers, linear counting for small cardinalities).
+ * Merging two sketches gives exactly the sketch of the union of their streams
+ */
+class HyperLogLog
+{
+public:
+
+	/**
+	 * A c'tor for this class, creates an empty sketch
+	 */
+	HyperLogLog() { clear(); }
+
+	/**
+	 * Add a key
+	 * @param[in] data The key bytes
+	 * @param[in] dataLen The key length
+	 */
+	void add(const void* data, size_t dataLen) { addHash(hashSketchKey(data, dataLen)); }
+
+	/**
+	 * Add a key by its 64-bit hash
+	 * @param[in] hash The hash of the key, as returned by hashSketchKey()
+	 */
+	void addHash(uint64_t hash);
+
+	/**
+	 * Add all keys of another sketch to this one
+	 * @param[in] other The sketch to merge
+	 */
+	void merge(const HyperLogLog& other);
+
+	/**
+	 * Remove all keys
+	 */
+	void clear();
+
+	/**
+	 * @return The estimated number of distinct keys
+	 */
+	uint64_t estimate() const;
+
+private:
+	uint8_t m_Registers[HYPERLOGLOG_NUM_OF_REGISTERS];
+};
+
+#endif /* HTTPECHO_STREAMING_SKETCHES */
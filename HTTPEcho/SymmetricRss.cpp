@@ -0,0 +1,86 @@
+#include <string.h>
+#include "PacketDecoder.h"
+#include "SymmetricRss.h"
+
+static uint8_t s_SymmetricRssKey[RSS_KEY_LEN] = {
+	0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+	0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+	0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+	0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a
+};
+
+// the Toeplitz hash is linear in its input, and with a key of period 16 bits input bit i adds the same key window as bit (i % 16). So the hash
+// of an input is the hash of its 16-bit words XORed together: s_FoldedHashTable[0] holds it for the high byte of that word, [1] for the low byte
+static uint32_t s_FoldedHashTable[2][256];
+
+
+static bool buildFoldedHashTable()
+{
+	for (int value = 0; value < 256; value++)
+	{
+		uint8_t highByte[2] = { (uint8_t)value, 0 };
+		uint8_t lowByte[2] = { 0, (uint8_t)value };
+		s_FoldedHashTable[0][value] = computeToeplitzHash(s_SymmetricRssKey, sizeof(s_SymmetricRssKey), highByte, sizeof(highByte));
+		s_FoldedHashTable[1][value] = computeToeplitzHash(s_SymmetricRssKey, sizeof(s_SymmetricRssKey), lowByte, sizeof(lowByte));
+	}
+
+	return true;
+}
+
+// built before main() runs, so the workers only ever read it
+static bool s_FoldedHashTableBuilt = buildFoldedHashTable();
+
+
+uint8_t* getSymmetricRssKey()
+{
+	return s_SymmetricRssKey;
+}
+
+
+uint32_t computeToeplitzHash(const uint8_t* key, size_t keyLen, const uint8_t* input, size_t inputLen)
+{
+	// the 32-bit key window starting at the current input bit
+	uint32_t window = ((uint32_t)key[0] << 24) | ((uint32_t)key[1] << 16) | ((uint32_t)key[2] << 8) | key[3];
+	uint32_t hash = 0;
+
+	for (size_t i = 0; i < inputLen; i++)
+	{
+		uint8_t nextKeyByte = (i + 4 < keyLen ? key[i + 4] : 0);
+		for (int bit = 7; bit >= 0; bit--)
+		{
+			if (input[i] & (1 << bit))
+				hash ^= window;
+			window = (window << 1) | ((nextKeyByte >> bit) & 1);
+		}
+	}
+
+	return hash;
+}
+
+
+uint32_t computeSymmetricRssHash(const uint8_t* srcIP, const uint8_t* dstIP, size_t ipAddrLen)
+{
+	// XOR the addresses 32 bits at a time, then fold the two 16-bit words of the result. The bytes stay in network order throughout
+	uint32_t folded = 0;
+	for (size_t i = 0; i < ipAddrLen; i += 4)
+	{
+		uint32_t srcWord, dstWord;
+		memcpy(&srcWord, srcIP + i, sizeof(srcWord));
+		memcpy(&dstWord, dstIP + i, sizeof(dstWord));
+		folded ^= srcWord ^ dstWord;
+	}
+
+	uint8_t bytes[4];
+	memcpy(bytes, &folded, sizeof(bytes));
+	return s_FoldedHashTable[0][bytes[0] ^ bytes[2]] ^ s_FoldedHashTable[1][bytes[1] ^ bytes[3]];
+}
+
+
+uint32_t computeSymmetricRssHash(pcpp::RawPacket* packet)
+{
+	PacketView view;
+	if (!decodeIPPacket<>(packet, view))
+		return 0;
+
+	return computeSymmetricRssHash(view.srcIP, view.dstIP, view.ipAddrLen);
+}
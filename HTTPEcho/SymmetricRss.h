@@ -0,0 +1,62 @@
+#ifndef HTTPECHO_SYMMETRIC_RSS
+#define HTTPECHO_SYMMETRIC_RSS
+
+#include <stdint.h>
+#include <stddef.h>
+#include "header/RawPacket.h"
+
+// the length of the Toeplitz key NICs take for RSS
+#define RSS_KEY_LEN 40
+
+// the redirection table size assumed when the NIC's isn't known. The low bits of the hash select an entry of the table, and entry i holds
+// queue (i % number of queues)
+#define DEFAULT_RSS_RETA_SIZE 128
+
+
+/**
+ * @return The symmetric Toeplitz key: one 16-bit pattern repeated, so (src, dst) and (dst, src) hash to the same value. It's the key the
+ * DPDK ports are configured with, so the software hash below and the NIC's agree
+ */
+uint8_t* getSymmetricRssKey();
+
+/**
+ * The Toeplitz hash of the NICs, bit by bit. It's the reference the lookup tables of the symmetric hash are built from
+ * @param[in] key The key, at least 4 bytes longer than the input
+ * @param[in] keyLen The key length
+ * @param[in] input The hashed fields, in network order
+ * @param[in] inputLen The input length
+ * @return The hash
+ */
+uint32_t computeToeplitzHash(const uint8_t* key, size_t keyLen, const uint8_t* input, size_t inputLen);
+
+/**
+ * The Toeplitz hash of a pair of IP addresses with the symmetric key, as the NIC computes it with the RSS_IPV4 / RSS_IPV6 hash fields.
+ * With a key that repeats every 16 bits the hash only depends on the XOR of the input's 16-bit words, so it's 2 table lookups instead of
+ * a pass over every input bit
+ * @param[in] srcIP The source address, in network order
+ * @param[in] dstIP The destination address, in network order
+ * @param[in] ipAddrLen The address length: 4 or 16
+ * @return The hash, the same for both directions
+ */
+uint32_t computeSymmetricRssHash(const uint8_t* srcIP, const uint8_t* dstIP, size_t ipAddrLen);
+
+/**
+ * The symmetric RSS hash of a packet's IP addresses. IP fragments hash with the rest of their flow since the ports aren't hashed
+ * @param[in] packet The packet
+ * @return The hash, 0 if the packet isn't IP (NICs send those to the queue of entry 0)
+ */
+uint32_t computeSymmetricRssHash(pcpp::RawPacket* packet);
+
+/**
+ * The queue a NIC delivers a hash to, with the redirection table HTTPEcho programs (and that drivers fill by default)
+ * @param[in] hash The RSS hash
+ * @param[in] numOfQueues The number of queues
+ * @param[in] retaSize The redirection table size, a power of 2
+ * @return The queue
+ */
+inline uint16_t getRssQueue(uint32_t hash, uint16_t numOfQueues, uint16_t retaSize = DEFAULT_RSS_RETA_SIZE)
+{
+	return (uint16_t)((hash & (uint32_t)(retaSize - 1)) % numOfQueues);
+}
+
+#endif /* HTTPECHO_SYMMETRIC_RSS */
@@ -0,0 +1,584 @@
+#include <string.h>
+#include <arpa/inet.h>
+#include "TcpStreamReassembly.h"
+#include "PacketDecoder.h"
+#include "header/IpAddress.h"
+
+// initial number of buckets in the connection table (must be a power of 2)
+#define INITIAL_NUM_OF_BUCKETS 1024
+
+#define TCP_FLAG_FIN 0x01
+#define TCP_FLAG_SYN 0x02
+#define TCP_FLAG_RST 0x04
+
+#define prefetchForRead(addr) __builtin_prefetch((addr), 0, 3)
+#define prefetchForWrite(addr) __builtin_prefetch((addr), 1, 3)
+
+
+// TCP sequence comparisons which are correct across the 32-bit wrap
+static inline bool seqLessOrEqual(uint32_t a, uint32_t b) { return (int32_t)(a - b) <= 0; }
+static inline bool seqGreater(uint32_t a, uint32_t b) { return (int32_t)(a - b) > 0; }
+
+
+TcpStreamReassembly::TcpStreamReassembly(pcpp::TcpReassembly::OnTcpMessageReady onMessageReadyCallback, void* userCookie,
+		pcpp::TcpReassembly::OnTcpConnectionStart onConnectionStartCallback, pcpp::TcpReassembly::OnTcpConnectionEnd onConnectionEndCallback,
+		OnTcpStreamGap onStreamGapCallback, uint32_t closedConnectionDelay, PacketBufferCache* bufferCache) :
+	m_OwnBufferCache(NULL)
+{
+	m_OnMessageReadyCallback = onMessageReadyCallback;
+	m_OnConnStart = onConnectionStartCallback;
+	m_OnConnEnd = onConnectionEndCallback;
+	m_OnStreamGap = onStreamGapCallback;
+	m_UserCookie = userCookie;
+	m_ClosedConnectionDelay = closedConnectionDelay;
+	m_BufferCache = (bufferCache != NULL ? bufferCache : &m_OwnBufferCache);
+
+	m_Buckets = new FlowBucket[INITIAL_NUM_OF_BUCKETS];
+	memset(m_Buckets, 0, INITIAL_NUM_OF_BUCKETS * sizeof(FlowBucket));
+	m_BucketMask = INITIAL_NUM_OF_BUCKETS - 1;
+	m_NumOfConnections = 0;
+
+	m_CurrentTime = 0;
+	m_LastPurgeTime = 0;
+}
+
+
+TcpStreamReassembly::~TcpStreamReassembly()
+{
+	for (size_t i = 0; i <= m_BucketMask; i++)
+	{
+		if (m_Buckets[i].conn != NULL)
+			freeConnection(m_Buckets[i].conn);
+	}
+
+	delete [] m_Buckets;
+}
+
+
+bool TcpStreamReassembly::parsePacket(pcpp::RawPacket* packet, PacketInfo& info)
+{
+	PacketView view;
+	if (!decodeTcpPacket<>(packet, view))
+		return false;
+
+	info.srcIsEndpointA = makeFlowKey(view.srcIP, view.dstIP, view.ipAddrLen, view.srcPort, view.dstPort, view.ipVersion, info.key);
+	info.hash = hashKey(info.key);
+
+	info.sequence = view.sequence;
+	info.tcpFlags = view.tcpFlags;
+	info.payload = view.payload;
+	info.payloadLen = view.payloadLen;
+	info.timestamp = packet->getPacketTimeStamp();
+	info.conn = NULL;
+
+	return true;
+}
+
+
+bool TcpStreamReassembly::makeFlowKey(const uint8_t* srcIP, const uint8_t* dstIP, size_t ipAddrLen, uint16_t srcPort, uint16_t dstPort, uint8_t ipVersion,
+		FlowKey& key)
+{
+	// order the endpoints so both directions of the connection get the same key
+	int cmp = memcmp(srcIP, dstIP, ipAddrLen);
+	bool srcIsEndpointA = (cmp < 0 || (cmp == 0 && srcPort <= dstPort));
+
+	memset(&key, 0, sizeof(FlowKey));
+	memcpy(key.ipA, srcIsEndpointA ? srcIP : dstIP, ipAddrLen);
+	memcpy(key.ipB, srcIsEndpointA ? dstIP : srcIP, ipAddrLen);
+	key.portA = srcIsEndpointA ? srcPort : dstPort;
+	key.portB = srcIsEndpointA ? dstPort : srcPort;
+	key.ipVersion = ipVersion;
+
+	return srcIsEndpointA;
+}
+
+
+uint32_t TcpStreamReassembly::hashKey(const FlowKey& key)
+{
+	// the key is a fixed 40 bytes, mix it a word at a time and finish with the murmur3 avalanche
+	uint32_t words[sizeof(FlowKey) / 4];
+	memcpy(words, &key, sizeof(FlowKey));
+
+	uint32_t hash = 0x2545f491;
+	for (size_t i = 0; i < sizeof(FlowKey) / 4; i++)
+	{
+		hash ^= words[i];
+		hash *= 0x9e3779b1;
+		hash = (hash << 13) | (hash >> 19);
+	}
+
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+
+TcpStreamReassembly::Connection* TcpStreamReassembly::findConnection(const FlowKey& key, uint32_t hash) const
+{
+	size_t index = hash & m_BucketMask;
+	while (m_Buckets[index].conn != NULL)
+	{
+		if (m_Buckets[index].hash == hash && memcmp(&m_Buckets[index].conn->key, &key, sizeof(FlowKey)) == 0)
+			return m_Buckets[index].conn;
+
+		index = (index + 1) & m_BucketMask;
+	}
+
+	return NULL;
+}
+
+
+TcpStreamReassembly::Connection* TcpStreamReassembly::findOpenConnection(const pcpp::ConnectionData& connData) const
+{
+	if (connData.srcIP == NULL || connData.dstIP == NULL || connData.srcIP->getType() != connData.dstIP->getType())
+		return NULL;
+
+	// the full key is compared, not only the flow key (which is just its hash) - two connections may share a flow key
+	uint8_t srcIP[16];
+	uint8_t dstIP[16];
+	size_t ipAddrLen;
+	uint8_t ipVersion;
+	if (connData.srcIP->getType() == pcpp::IPAddress::IPv4AddressType)
+	{
+		uint32_t srcAddr = ((pcpp::IPv4Address*)connData.srcIP)->toInt();
+		uint32_t dstAddr = ((pcpp::IPv4Address*)connData.dstIP)->toInt();
+		memcpy(srcIP, &srcAddr, 4);
+		memcpy(dstIP, &dstAddr, 4);
+		ipAddrLen = 4;
+		ipVersion = 4;
+	}
+	else
+	{
+		((pcpp::IPv6Address*)connData.srcIP)->copyTo(srcIP);
+		((pcpp::IPv6Address*)connData.dstIP)->copyTo(dstIP);
+		ipAddrLen = 16;
+		ipVersion = 6;
+	}
+
+	FlowKey key;
+	makeFlowKey(srcIP, dstIP, ipAddrLen, connData.srcPort, connData.dstPort, ipVersion, key);
+	Connection* conn = findConnection(key, hashKey(key));
+	return (conn != NULL && !conn->closed ? conn : NULL);
+}
+
+
+TcpStreamReassembly::Connection* TcpStreamReassembly::createConnection(const PacketInfo& info)
+{
+	Connection* conn = new Connection();
+	conn->key = info.key;
+	conn->hash = info.hash;
+	conn->side0IsEndpointA = info.srcIsEndpointA;
+	conn->closed = false;
+	conn->numOfSides = 1;
+	conn->prevSide = -1;
+	conn->closeTime = 0;
+	for (int i = 0; i < 2; i++)
+	{
+		conn->sides[i].sequenceKnown = false;
+		conn->sides[i].gotFinOrRst = false;
+		conn->sides[i].sequence = 0;
+	}
+
+	// the source of the first packet is the connection's source (side 0)
+	const uint8_t* srcIP = info.srcIsEndpointA ? info.key.ipA : info.key.ipB;
+	const uint8_t* dstIP = info.srcIsEndpointA ? info.key.ipB : info.key.ipA;
+	if (info.key.ipVersion == 4)
+	{
+		uint32_t srcAddr, dstAddr;
+		memcpy(&srcAddr, srcIP, 4);
+		memcpy(&dstAddr, dstIP, 4);
+		pcpp::IPv4Address srcAddress(srcAddr);
+		pcpp::IPv4Address dstAddress(dstAddr);
+		conn->connData.setSrcIpAddress(&srcAddress);
+		conn->connData.setDstIpAddress(&dstAddress);
+	}
+	else
+	{
+		pcpp::IPv6Address srcAddress((uint8_t*)srcIP);
+		pcpp::IPv6Address dstAddress((uint8_t*)dstIP);
+		conn->connData.setSrcIpAddress(&srcAddress);
+		conn->connData.setDstIpAddress(&dstAddress);
+	}
+
+	conn->connData.srcPort = info.srcIsEndpointA ? info.key.portA : info.key.portB;
+	conn->connData.dstPort = info.srcIsEndpointA ? info.key.portB : info.key.portA;
+	conn->connData.flowKey = info.hash;
+	conn->connData.setStartTime(info.timestamp);
+	conn->connData.setEndTime(info.timestamp);
+
+	insertConnection(conn);
+
+	if (m_OnConnStart != NULL)
+		m_OnConnStart(conn->connData, m_UserCookie);
+
+	return conn;
+}
+
+
+void TcpStreamReassembly::insertConnection(Connection* conn)
+{
+	// keep the load factor at most 0.5 so probe sequences stay short
+	if ((m_NumOfConnections + 1) * 2 > m_BucketMask + 1)
+		growTable();
+
+	size_t index = conn->hash & m_BucketMask;
+	while (m_Buckets[index].conn != NULL)
+		index = (index + 1) & m_BucketMask;
+
+	m_Buckets[index].hash = conn->hash;
+	m_Buckets[index].conn = conn;
+	m_NumOfConnections++;
+}
+
+
+void TcpStreamReassembly::eraseConnection(Connection* conn)
+{
+	size_t index = conn->hash & m_BucketMask;
+	while (m_Buckets[index].conn != conn)
+	{
+		if (m_Buckets[index].conn == NULL)
+			return;
+		index = (index + 1) & m_BucketMask;
+	}
+
+	// backward shift deletion: move up following entries whose home bucket is at or before the hole, so no tombstones are needed
+	size_t hole = index;
+	size_t next = (hole + 1) & m_BucketMask;
+	while (m_Buckets[next].conn != NULL)
+	{
+		size_t home = m_Buckets[next].hash & m_BucketMask;
+		if (((next - home) & m_BucketMask) >= ((next - hole) & m_BucketMask))
+		{
+			m_Buckets[hole] = m_Buckets[next];
+			hole = next;
+		}
+		next = (next + 1) & m_BucketMask;
+	}
+
+	m_Buckets[hole].conn = NULL;
+	m_Buckets[hole].hash = 0;
+	m_NumOfConnections--;
+}
+
+
+void TcpStreamReassembly::growTable()
+{
+	FlowBucket* oldBuckets = m_Buckets;
+	size_t oldNumOfBuckets = m_BucketMask + 1;
+
+	m_BucketMask = oldNumOfBuckets * 2 - 1;
+	m_Buckets = new FlowBucket[m_BucketMask + 1];
+	memset(m_Buckets, 0, (m_BucketMask + 1) * sizeof(FlowBucket));
+
+	for (size_t i = 0; i < oldNumOfBuckets; i++)
+	{
+		if (oldBuckets[i].conn == NULL)
+			continue;
+
+		size_t index = oldBuckets[i].hash & m_BucketMask;
+		while (m_Buckets[index].conn != NULL)
+			index = (index + 1) & m_BucketMask;
+		m_Buckets[index] = oldBuckets[i];
+	}
+
+	delete [] oldBuckets;
+}
+
+
+void TcpStreamReassembly::reassemblePacket(pcpp::RawPacket* packet)
+{
+	PacketInfo info;
+	if (parsePacket(packet, info))
+		processPacket(info);
+
+	purgeClosedConnections();
+}
+
+
+void TcpStreamReassembly::reassemblePackets(pcpp::RawPacket* const* packets, size_t numOfPackets)
+{
+	PacketInfo infos[MAX_REASSEMBLY_BATCH_SIZE];
+
+	while (numOfPackets > 0)
+	{
+		size_t batchSize = (numOfPackets < MAX_REASSEMBLY_BATCH_SIZE ? numOfPackets : MAX_REASSEMBLY_BATCH_SIZE);
+		size_t numOfTcpPackets = 0;
+
+		// stage 1: classify the whole batch and prefetch the home bucket of each flow
+		for (size_t i = 0; i < batchSize; i++)
+		{
+			PacketInfo& info = infos[numOfTcpPackets];
+			if (!parsePacket(packets[i], info))
+				continue;
+
+			prefetchForRead(&m_Buckets[info.hash & m_BucketMask]);
+			numOfTcpPackets++;
+		}
+
+		// stage 2: look the flows up (the buckets are in cache by now) and prefetch their connection state
+		for (size_t i = 0; i < numOfTcpPackets; i++)
+		{
+			Connection* conn = findConnection(infos[i].key, infos[i].hash);
+			if (conn == NULL)
+				continue;
+
+			infos[i].conn = conn;
+			prefetchForWrite(conn);
+			prefetchForWrite(&conn->sides[0]);
+		}
+
+		// stage 3: process the packets in arrival order. Packets of flows created earlier in this batch look their connection up again.
+		// Closed connections are only freed between batches so the pointers found in stage 2 stay valid
+		for (size_t i = 0; i < numOfTcpPackets; i++)
+			processPacket(infos[i]);
+
+		packets += batchSize;
+		numOfPackets -= batchSize;
+	}
+
+	purgeClosedConnections();
+}
+
+
+void TcpStreamReassembly::processPacket(PacketInfo& info)
+{
+	Connection* conn = info.conn;
+	if (conn == NULL)
+	{
+		conn = findConnection(info.key, info.hash);
+		if (conn == NULL)
+			conn = createConnection(info);
+	}
+
+	m_CurrentTime = info.timestamp.tv_sec;
+
+	// packets of a connection which was already closed are ignored until the connection is purged
+	if (conn->closed)
+		return;
+
+	conn->connData.setEndTime(info.timestamp);
+
+	int sideIndex = (info.srcIsEndpointA == conn->side0IsEndpointA ? 0 : 1);
+	if (sideIndex == 1)
+		conn->numOfSides = 2;
+
+	TcpOneSide& side = conn->sides[sideIndex];
+
+	// this side already sent FIN or RST and is considered closed
+	if (side.gotFinOrRst)
+		return;
+
+	// SYN occupies one sequence number, data starts right after it
+	uint32_t dataSequence = info.sequence + ((info.tcpFlags & TCP_FLAG_SYN) ? 1 : 0);
+	if (!side.sequenceKnown)
+	{
+		side.sequence = dataSequence;
+		side.sequenceKnown = true;
+	}
+
+	if (info.payloadLen > 0)
+	{
+		// data from the other side means the previous side finished talking, flush what it has queued
+		if (conn->prevSide != -1 && conn->prevSide != sideIndex)
+			checkOutOfOrderFragments(conn, conn->prevSide, true);
+		conn->prevSide = sideIndex;
+
+		uint32_t dataEnd = dataSequence + (uint32_t)info.payloadLen;
+		if (seqLessOrEqual(dataSequence, side.sequence))
+		{
+			// in order, or a retransmission which may carry some new data at its end
+			if (seqGreater(dataEnd, side.sequence))
+			{
+				size_t offset = side.sequence - dataSequence;
+				side.sequence = dataEnd;
+				deliverData(conn, sideIndex, info.payload + offset, info.payloadLen - offset);
+				checkOutOfOrderFragments(conn, sideIndex, false);
+			}
+		}
+		else
+		{
+			// out of order, keep a copy until the gap is filled
+			TcpFragment fragment;
+			fragment.sequence = dataSequence;
+			fragment.dataLength = (uint32_t)info.payloadLen;
+			fragment.data = m_BufferCache->allocate(info.payloadLen);
+			memcpy(fragment.data, info.payload, info.payloadLen);
+			side.fragments.push_back(fragment);
+		}
+	}
+
+	if (info.tcpFlags & (TCP_FLAG_FIN | TCP_FLAG_RST))
+		handleFinOrRst(conn, sideIndex, (info.tcpFlags & TCP_FLAG_RST) != 0);
+}
+
+
+void TcpStreamReassembly::deliverData(Connection* conn, int sideIndex, const uint8_t* data, size_t dataLen)
+{
+	if (m_OnMessageReadyCallback == NULL || conn->closed)
+		return;
+
+	pcpp::TcpStreamData streamData(data, dataLen, conn->connData);
+	m_OnMessageReadyCallback(sideIndex, streamData, m_UserCookie);
+}
+
+
+void TcpStreamReassembly::reportGap(Connection* conn, int sideIndex, uint32_t missingDataLen)
+{
+	if (m_OnStreamGap == NULL || conn->closed)
+		return;
+
+	m_OnStreamGap(sideIndex, conn->connData, missingDataLen, m_UserCookie);
+}
+
+
+void TcpStreamReassembly::checkOutOfOrderFragments(Connection* conn, int sideIndex, bool cleanWholeFragList)
+{
+	TcpOneSide& side = conn->sides[sideIndex];
+
+	bool foundSomething;
+	do
+	{
+		foundSomething = false;
+
+		// deliver the first fragment which starts at or before the expected sequence, drop the ones which are entirely old
+		for (size_t i = 0; i < side.fragments.size(); i++)
+		{
+			TcpFragment fragment = side.fragments[i];
+			if (!seqLessOrEqual(fragment.sequence, side.sequence))
+				continue;
+
+			side.fragments[i] = side.fragments.back();
+			side.fragments.pop_back();
+
+			uint32_t fragmentEnd = fragment.sequence + fragment.dataLength;
+			if (seqGreater(fragmentEnd, side.sequence))
+			{
+				uint32_t offset = side.sequence - fragment.sequence;
+				side.sequence = fragmentEnd;
+				deliverData(conn, sideIndex, fragment.data + offset, fragment.dataLength - offset);
+			}
+
+			m_BufferCache->release(fragment.data);
+			foundSomething = true;
+			break;
+		}
+
+		if (foundSomething || !cleanWholeFragList || side.fragments.empty())
+			continue;
+
+		// nothing continues the stream, skip the gap to the closest fragment
+		size_t closest = 0;
+		for (size_t i = 1; i < side.fragments.size(); i++)
+		{
+			if (seqGreater(side.fragments[closest].sequence, side.fragments[i].sequence))
+				closest = i;
+		}
+
+		reportGap(conn, sideIndex, side.fragments[closest].sequence - side.sequence);
+		side.sequence = side.fragments[closest].sequence;
+		foundSomething = true;
+
+	} while (foundSomething);
+}
+
+
+void TcpStreamReassembly::handleFinOrRst(Connection* conn, int sideIndex, bool isRst)
+{
+	TcpOneSide& side = conn->sides[sideIndex];
+	if (side.gotFinOrRst || conn->closed)
+		return;
+
+	side.gotFinOrRst = true;
+
+	// RST, or FIN from both sides, ends the connection
+	if (isRst || conn->sides[1 - sideIndex].gotFinOrRst)
+	{
+		closeConnectionInternal(conn, pcpp::TcpReassembly::TcpReassemblyConnectionClosedByFIN_RST);
+		return;
+	}
+
+	checkOutOfOrderFragments(conn, sideIndex, true);
+}
+
+
+void TcpStreamReassembly::closeConnectionInternal(Connection* conn, pcpp::TcpReassembly::ConnectionEndReason reason)
+{
+	if (conn->closed)
+		return;
+
+	checkOutOfOrderFragments(conn, 0, true);
+	checkOutOfOrderFragments(conn, 1, true);
+
+	if (m_OnConnEnd != NULL)
+		m_OnConnEnd(conn->connData, reason, m_UserCookie);
+
+	conn->closed = true;
+	conn->closeTime = m_CurrentTime;
+	m_ClosedConnections.push_back(conn);
+}
+
+
+void TcpStreamReassembly::closeConnection(const pcpp::ConnectionData& connData)
+{
+	Connection* conn = findOpenConnection(connData);
+	if (conn != NULL)
+		closeConnectionInternal(conn, pcpp::TcpReassembly::TcpReassemblyConnectionClosedManually);
+}
+
+
+void TcpStreamReassembly::skipStreamData(const pcpp::ConnectionData& connData, int side, uint32_t numOfBytes)
+{
+	Connection* conn = findOpenConnection(connData);
+
+	// moving the expected sequence past the skipped bytes makes every segment inside them look like an old retransmission,
+	// queued segments inside them are dropped the same way the next time the queue is checked
+	if (conn != NULL && conn->sides[side].sequenceKnown)
+		conn->sides[side].sequence += numOfBytes;
+}
+
+
+void TcpStreamReassembly::closeAllConnections()
+{
+	for (size_t i = 0; i <= m_BucketMask; i++)
+	{
+		if (m_Buckets[i].conn != NULL && !m_Buckets[i].conn->closed)
+			closeConnectionInternal(m_Buckets[i].conn, pcpp::TcpReassembly::TcpReassemblyConnectionClosedManually);
+	}
+}
+
+
+void TcpStreamReassembly::purgeClosedConnections()
+{
+	// once a second at most, closed connections are in close order so the scan stops at the first one which is still fresh
+	if (m_ClosedConnections.empty() || m_CurrentTime == m_LastPurgeTime)
+		return;
+
+	m_LastPurgeTime = m_CurrentTime;
+
+	while (!m_ClosedConnections.empty())
+	{
+		Connection* conn = m_ClosedConnections.front();
+		if (conn->closeTime + (time_t)m_ClosedConnectionDelay > m_CurrentTime)
+			break;
+
+		m_ClosedConnections.pop_front();
+		eraseConnection(conn);
+		freeConnection(conn);
+	}
+}
+
+
+void TcpStreamReassembly::freeConnection(Connection* conn)
+{
+	for (int i = 0; i < 2; i++)
+	{
+		for (size_t j = 0; j < conn->sides[i].fragments.size(); j++)
+			m_BufferCache->release(conn->sides[i].fragments[j].data);
+	}
+
+	delete conn;
+}
@@ -0,0 +1,215 @@
+#ifndef HTTPECHO_TCP_STREAM_REASSEMBLY
+#define HTTPECHO_TCP_STREAM_REASSEMBLY
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <deque>
+#include "header/TcpReassembly.h"
+#include "PacketBufferPool.h"
+
+// how long (in seconds, packet time) a closed connection is remembered, so late packets don't open a new connection
+#define DEFAULT_CLOSED_CONNECTION_DELAY_SEC 5
+
+// max number of packets classified together by reassemblePackets(). Longer bursts are handled in chunks of this size
+#define MAX_REASSEMBLY_BATCH_SIZE 256
+
+
+/**
+ * @typedef OnTcpStreamGap
+ * A callback invoked when one side of a connection has a hole in its stream which won't be filled (the missing segments were lost or never
+ * captured). It is invoked in stream order: data delivered before it precedes the hole, data delivered after it follows the hole
+ * @param[in] side The side of the connection (0 or 1)
+ * @param[in] connectionData The connection
+ * @param[in] missingDataLen The number of bytes missing from the stream
+ * @param[in] userCookie A pointer to the cookie provided by the user in the TcpStreamReassembly c'tor (or NULL if no cookie provided)
+ */
+typedef void (*OnTcpStreamGap)(int side, const pcpp::ConnectionData& connectionData, uint32_t missingDataLen, void* userCookie);
+
+
+/**
+ * A TCP reassembly engine with the same behavior and callbacks as pcpp::TcpReassembly (it reuses its OnTcpMessageReady, OnTcpConnectionStart
+ * and OnTcpConnectionEnd callback types, ConnectionData and TcpStreamData), built for the capture hot path:
+ * - Packets are classified straight from the raw frame (no pcpp::Packet / layers are built)
+ * - Connections are kept in a flat open-addressing table instead of std::map
+ * - reassemblePackets() takes a whole burst: it first classifies every packet and prefetches the table buckets, then looks up the connections
+ *   and prefetches their state, and only then processes the packets in arrival order, so by the time a packet is processed its flow state is in cache
+ *
+ * As in pcpp::TcpReassembly: side 0 of a connection is the side of the first packet seen, data is delivered in sequence order, out-of-order
+ * data is queued until the gap is filled or until data arrives on the other side / the side is closed, and closed connections are kept for a while
+ * so packets arriving after FIN/RST are ignored. ConnectionData::endTime is updated with the timestamp of every packet of the connection.
+ * Unlike pcpp::TcpReassembly, missing data is never delivered as a "[X bytes missing]" text message: the stream data stays exactly what was on
+ * the wire and holes are reported through the optional OnTcpStreamGap callback
+ */
+class TcpStreamReassembly
+{
+public:
+
+	/**
+	 * A c'tor for this class
+	 * @param[in] onMessageReadyCallback The callback to be invoked when new data arrives
+	 * @param[in] userCookie A pointer which is passed to all callbacks
+	 * @param[in] onConnectionStartCallback The callback to be invoked when a new connection is identified. Optional
+	 * @param[in] onConnectionEndCallback The callback to be invoked when a connection is terminated. Optional
+	 * @param[in] onStreamGapCallback The callback to be invoked when data is missing from a stream. Optional
+	 * @param[in] closedConnectionDelay How long (in seconds, packet time) a closed connection is remembered
+	 * @param[in] bufferCache The cache out-of-order segments are copied into. Optional, if NULL they are allocated with new[]
+	 */
+	TcpStreamReassembly(pcpp::TcpReassembly::OnTcpMessageReady onMessageReadyCallback, void* userCookie = NULL,
+			pcpp::TcpReassembly::OnTcpConnectionStart onConnectionStartCallback = NULL, pcpp::TcpReassembly::OnTcpConnectionEnd onConnectionEndCallback = NULL,
+			OnTcpStreamGap onStreamGapCallback = NULL, uint32_t closedConnectionDelay = DEFAULT_CLOSED_CONNECTION_DELAY_SEC,
+			PacketBufferCache* bufferCache = NULL);
+
+	/**
+	 * A d'tor for this class. Frees all connections. Connections which are still open are dropped without invoking the connection end callback
+	 */
+	~TcpStreamReassembly();
+
+	/**
+	 * Process a single packet. Non-TCP packets and IP fragments are ignored (fragments should be reassembled before this stage)
+	 * @param[in] packet The packet to process
+	 */
+	void reassemblePacket(pcpp::RawPacket* packet);
+
+	/**
+	 * Process a burst of packets, in order. Classifies the burst and prefetches the flow state first. Produces the same callbacks as calling
+	 * reassemblePacket() for each packet, except that closed connections are only purged between bursts: a packet of a connection whose
+	 * closed connection delay ends inside the burst is ignored as a late packet, where per-packet processing would open a new connection for it
+	 * @param[in] packets An array of packets
+	 * @param[in] numOfPackets The number of packets in the array
+	 */
+	void reassemblePackets(pcpp::RawPacket* const* packets, size_t numOfPackets);
+
+	/**
+	 * Close a connection manually, the connection end callback is invoked with TcpReassemblyConnectionClosedManually
+	 * @param[in] connData The connection (its 5-tuple is looked up, not only its flow key)
+	 */
+	void closeConnection(const pcpp::ConnectionData& connData);
+
+	/**
+	 * Tell the reassembler that the next bytes of one side's stream aren't needed. They are never delivered and segments carrying only such
+	 * bytes are dropped on arrival instead of being copied and queued, so a stream being discarded costs just the sequence tracking. Meant to be
+	 * called from the message ready callback, right after the data which precedes the skipped bytes was delivered
+	 * @param[in] connData The connection (its 5-tuple is looked up, not only its flow key)
+	 * @param[in] side The side of the connection (0 or 1)
+	 * @param[in] numOfBytes The number of bytes to skip, must be less than 2^31
+	 */
+	void skipStreamData(const pcpp::ConnectionData& connData, int side, uint32_t numOfBytes);
+
+	/**
+	 * Close all open connections manually
+	 */
+	void closeAllConnections();
+
+	/**
+	 * @return The number of connections currently tracked (open connections and closed ones which weren't purged yet)
+	 */
+	size_t getNumOfConnections() const { return m_NumOfConnections; }
+
+private:
+
+	/**
+	 * The 5-tuple of a connection in canonical order (endpoint A is the lower of the two), so both directions map to the same key
+	 */
+	struct FlowKey
+	{
+		uint8_t ipA[16];
+		uint8_t ipB[16];
+		uint16_t portA;
+		uint16_t portB;
+		uint8_t ipVersion;
+		uint8_t reserved[3];
+	};
+
+	struct TcpFragment
+	{
+		uint32_t sequence;
+		uint32_t dataLength;
+		uint8_t* data;
+	};
+
+	struct TcpOneSide
+	{
+		bool sequenceKnown;
+		bool gotFinOrRst;
+		uint32_t sequence;
+		std::vector<TcpFragment> fragments;
+	};
+
+	struct Connection
+	{
+		FlowKey key;
+		uint32_t hash;
+		bool side0IsEndpointA;
+		bool closed;
+		int numOfSides;
+		int prevSide;
+		time_t closeTime;
+		TcpOneSide sides[2];
+		pcpp::ConnectionData connData;
+	};
+
+	/**
+	 * What the classification stage extracts from a packet
+	 */
+	struct PacketInfo
+	{
+		FlowKey key;
+		uint32_t hash;
+		bool srcIsEndpointA;
+		uint8_t tcpFlags;
+		uint32_t sequence;
+		const uint8_t* payload;
+		size_t payloadLen;
+		timeval timestamp;
+		Connection* conn;
+	};
+
+	struct FlowBucket
+	{
+		uint32_t hash;
+		Connection* conn;
+	};
+
+	pcpp::TcpReassembly::OnTcpMessageReady m_OnMessageReadyCallback;
+	pcpp::TcpReassembly::OnTcpConnectionStart m_OnConnStart;
+	pcpp::TcpReassembly::OnTcpConnectionEnd m_OnConnEnd;
+	OnTcpStreamGap m_OnStreamGap;
+	void* m_UserCookie;
+	uint32_t m_ClosedConnectionDelay;
+
+	// where out-of-order segments are kept, the own cache (without a pool) is used if none was given
+	PacketBufferCache m_OwnBufferCache;
+	PacketBufferCache* m_BufferCache;
+
+	FlowBucket* m_Buckets;
+	size_t m_BucketMask;
+	size_t m_NumOfConnections;
+
+	std::deque<Connection*> m_ClosedConnections;
+	time_t m_CurrentTime;
+	time_t m_LastPurgeTime;
+
+	static bool parsePacket(pcpp::RawPacket* packet, PacketInfo& info);
+	static bool makeFlowKey(const uint8_t* srcIP, const uint8_t* dstIP, size_t ipAddrLen, uint16_t srcPort, uint16_t dstPort, uint8_t ipVersion,
+			FlowKey& key);
+	static uint32_t hashKey(const FlowKey& key);
+
+	Connection* findConnection(const FlowKey& key, uint32_t hash) const;
+	Connection* findOpenConnection(const pcpp::ConnectionData& connData) const;
+	Connection* createConnection(const PacketInfo& info);
+	void insertConnection(Connection* conn);
+	void eraseConnection(Connection* conn);
+	void growTable();
+
+	void processPacket(PacketInfo& info);
+	void deliverData(Connection* conn, int sideIndex, const uint8_t* data, size_t dataLen);
+	void reportGap(Connection* conn, int sideIndex, uint32_t missingDataLen);
+	void checkOutOfOrderFragments(Connection* conn, int sideIndex, bool cleanWholeFragList);
+	void handleFinOrRst(Connection* conn, int sideIndex, bool isRst);
+	void closeConnectionInternal(Connection* conn, pcpp::TcpReassembly::ConnectionEndReason reason);
+	void purgeClosedConnections();
+	void freeConnection(Connection* conn);
+};
+
+#endif /* HTTPECHO_TCP_STREAM_REASSEMBLY */
@@ -0,0 +1,521 @@
+#include <stdio.h>
+#include <string.h>
+#include "TlsMetadata.h"
+#include "header/SSLCommon.h"
+#include "Md5.h"
+
+#define TLS_VERSION_1_3 0x0304
+
+// the extensions which aren't defined in SSLCommon.h
+#define TLS_EXT_SUPPORTED_VERSIONS 43
+
+// max lengths of the JA3 string parts
+#define JA3_MAX_LIST_LEN 1024
+#define JA3_MAX_LEN (4 * JA3_MAX_LIST_LEN)
+
+
+/**
+ * GREASE values (RFC 8701) are ignored by JA3: 0x0a0a, 0x1a1a, ..., 0xfafa
+ */
+static inline bool isGreaseValue(uint16_t value)
+{
+	return (value & 0x0f0f) == 0x0a0a && (value >> 8) == (value & 0xff);
+}
+
+static inline uint16_t read16(const uint8_t* ptr)
+{
+	return (uint16_t)((ptr[0] << 8) | ptr[1]);
+}
+
+static inline uint32_t read24(const uint8_t* ptr)
+{
+	return ((uint32_t)ptr[0] << 16) | ((uint32_t)ptr[1] << 8) | ptr[2];
+}
+
+
+/**
+ * A fixed size string builder for the JA3 fields. Appending past the capacity silently truncates
+ */
+template<size_t Capacity>
+struct FixedStringBuilder
+{
+	char buffer[Capacity];
+	size_t len;
+
+	FixedStringBuilder() : len(0) { buffer[0] = '\0'; }
+
+	void append(const char* str, size_t strLen)
+	{
+		if (len + strLen >= Capacity)
+			strLen = Capacity - 1 - len;
+		memcpy(buffer + len, str, strLen);
+		len += strLen;
+		buffer[len] = '\0';
+	}
+
+	void appendDecimal(uint32_t value)
+	{
+		char digits[10];
+		size_t numOfDigits = 0;
+		do
+		{
+			digits[numOfDigits++] = (char)('0' + value % 10);
+			value /= 10;
+		} while (value > 0);
+
+		char reversed[10];
+		for (size_t i = 0; i < numOfDigits; i++)
+			reversed[i] = digits[numOfDigits - 1 - i];
+		append(reversed, numOfDigits);
+	}
+
+	// append a value to a dash separated list
+	void appendListValue(uint32_t value)
+	{
+		if (len > 0)
+			append("-", 1);
+		appendDecimal(value);
+	}
+};
+
+
+/**
+ * Copy a length-prefixed string into a fixed buffer, appending it to a comma separated list if the buffer isn't empty
+ */
+static void appendToList(char* list, size_t listCapacity, const uint8_t* str, size_t strLen)
+{
+	size_t curLen = strlen(list);
+	if (curLen > 0 && curLen + 1 < listCapacity)
+		list[curLen++] = ',';
+
+	if (curLen + strLen >= listCapacity)
+		strLen = listCapacity - 1 - curLen;
+
+	memcpy(list + curLen, str, strLen);
+	list[curLen + strLen] = '\0';
+}
+
+
+void TlsMetadata::clear()
+{
+	gotClientHello = false;
+	gotServerHello = false;
+	clientVersion = 0;
+	clientMaxSupportedVersion = 0;
+	serverVersion = 0;
+	numOfCipherSuites = 0;
+	selectedCipherSuite = 0;
+	serverName[0] = '\0';
+	alpn[0] = '\0';
+	selectedAlpn[0] = '\0';
+	ja3[0] = '\0';
+	ja3s[0] = '\0';
+}
+
+
+TlsHandshakeParser::TlsHandshakeParser()
+{
+	memset(m_Sides, 0, sizeof(m_Sides));
+}
+
+
+TlsHandshakeParser::~TlsHandshakeParser()
+{
+	delete [] m_Sides[0].messageBuffer;
+	delete [] m_Sides[1].messageBuffer;
+}
+
+
+void TlsHandshakeParser::feed(int side, const uint8_t* data, size_t dataLen)
+{
+	SideState& state = m_Sides[side];
+
+	if (state.done)
+		return;
+
+	// fast path: nothing collected yet and the chunk holds a whole record with a whole hello message - parse it in place
+	if (state.recordHeaderLen == 0 && state.recordRemaining == 0 && state.handshakeHeaderLen == 0 && dataLen >= 9 && data[0] == pcpp::SSL_HANDSHAKE)
+	{
+		size_t recordLen = read16(data + 3);
+		size_t messageLen = read24(data + 6);
+		if (messageLen + 4 <= recordLen && 5 + recordLen <= dataLen)
+		{
+			parseHandshakeMessage(data[5], data + 9, messageLen);
+			state.done = true;
+			return;
+		}
+	}
+
+	while (dataLen > 0 && !state.done)
+	{
+		// collect the record header
+		if (state.recordRemaining == 0)
+		{
+			size_t toCopy = 5 - state.recordHeaderLen;
+			if (toCopy > dataLen)
+				toCopy = dataLen;
+			memcpy(state.recordHeader + state.recordHeaderLen, data, toCopy);
+			state.recordHeaderLen += toCopy;
+			data += toCopy;
+			dataLen -= toCopy;
+
+			if (state.recordHeaderLen < 5)
+				return;
+
+			// this side doesn't start with a handshake record - nothing to extract
+			if (state.recordHeader[0] != pcpp::SSL_HANDSHAKE)
+			{
+				state.done = true;
+				return;
+			}
+
+			state.recordRemaining = read16(state.recordHeader + 3);
+			state.recordHeaderLen = 0;
+			continue;
+		}
+
+		size_t chunkLen = (dataLen < state.recordRemaining ? dataLen : state.recordRemaining);
+		consumeHandshakeBytes(state, data, chunkLen);
+		state.recordRemaining -= chunkLen;
+		data += chunkLen;
+		dataLen -= chunkLen;
+	}
+}
+
+
+void TlsHandshakeParser::skipMissingData(int side)
+{
+	SideState& state = m_Sides[side];
+
+	delete [] state.messageBuffer;
+	state.messageBuffer = NULL;
+	state.done = true;
+}
+
+
+void TlsHandshakeParser::consumeHandshakeBytes(SideState& side, const uint8_t* data, size_t dataLen)
+{
+	// collect the 4 byte handshake header (type + 24-bit length)
+	if (side.handshakeHeaderLen < 4)
+	{
+		size_t toCopy = 4 - side.handshakeHeaderLen;
+		if (toCopy > dataLen)
+			toCopy = dataLen;
+		memcpy(side.handshakeHeader + side.handshakeHeaderLen, data, toCopy);
+		side.handshakeHeaderLen += toCopy;
+		data += toCopy;
+		dataLen -= toCopy;
+
+		if (side.handshakeHeaderLen < 4)
+			return;
+
+		uint8_t type = side.handshakeHeader[0];
+		side.messageLen = read24(side.handshakeHeader + 1);
+		if ((type != pcpp::SSL_CLIENT_HELLO && type != pcpp::SSL_SERVER_HELLO) || side.messageLen > TLS_MAX_HELLO_MESSAGE_LEN)
+		{
+			side.done = true;
+			return;
+		}
+
+		side.messageBuffer = new uint8_t[side.messageLen > 0 ? side.messageLen : 1];
+		side.messageFilled = 0;
+	}
+
+	size_t toCopy = side.messageLen - side.messageFilled;
+	if (toCopy > dataLen)
+		toCopy = dataLen;
+	memcpy(side.messageBuffer + side.messageFilled, data, toCopy);
+	side.messageFilled += toCopy;
+
+	if (side.messageFilled < side.messageLen)
+		return;
+
+	parseHandshakeMessage(side.handshakeHeader[0], side.messageBuffer, side.messageLen);
+
+	delete [] side.messageBuffer;
+	side.messageBuffer = NULL;
+	side.done = true;
+}
+
+
+void TlsHandshakeParser::parseHandshakeMessage(uint8_t type, const uint8_t* body, size_t bodyLen)
+{
+	if (type == pcpp::SSL_CLIENT_HELLO)
+		parseClientHello(body, bodyLen);
+	else if (type == pcpp::SSL_SERVER_HELLO)
+		parseServerHello(body, bodyLen);
+}
+
+
+void TlsHandshakeParser::parseClientHello(const uint8_t* body, size_t bodyLen)
+{
+	const uint8_t* pos = body;
+	const uint8_t* end = body + bodyLen;
+
+	// version + random + session ID length
+	if (end - pos < 2 + 32 + 1)
+		return;
+
+	m_Metadata.clientVersion = read16(pos);
+	m_Metadata.clientMaxSupportedVersion = m_Metadata.clientVersion;
+	pos += 34;
+	pos += 1 + pos[0];
+
+	// cipher suites
+	if (end - pos < 2)
+		return;
+	size_t cipherSuitesLen = read16(pos);
+	pos += 2;
+	if ((size_t)(end - pos) < cipherSuitesLen)
+		return;
+
+	FixedStringBuilder<JA3_MAX_LIST_LEN> ciphers;
+	for (size_t i = 0; i + 1 < cipherSuitesLen; i += 2)
+	{
+		uint16_t cipherSuite = read16(pos + i);
+		if (isGreaseValue(cipherSuite))
+			continue;
+		ciphers.appendListValue(cipherSuite);
+		m_Metadata.numOfCipherSuites++;
+	}
+	pos += cipherSuitesLen;
+
+	// compression methods
+	if (end - pos < 1)
+		return;
+	pos += 1 + pos[0];
+
+	FixedStringBuilder<JA3_MAX_LIST_LEN> extensions;
+	FixedStringBuilder<JA3_MAX_LIST_LEN> curves;
+	FixedStringBuilder<JA3_MAX_LIST_LEN> pointFormats;
+
+	if (end - pos >= 2)
+	{
+		size_t extensionsLen = read16(pos);
+		pos += 2;
+		if ((size_t)(end - pos) < extensionsLen)
+			extensionsLen = end - pos;
+		const uint8_t* extEnd = pos + extensionsLen;
+
+		while (extEnd - pos >= 4)
+		{
+			uint16_t extType = read16(pos);
+			size_t extLen = read16(pos + 2);
+			const uint8_t* extData = pos + 4;
+			if ((size_t)(extEnd - extData) < extLen)
+				break;
+			pos = extData + extLen;
+
+			if (isGreaseValue(extType))
+				continue;
+
+			extensions.appendListValue(extType);
+
+			switch (extType)
+			{
+			case pcpp::SSL_EXT_SERVER_NAME:
+			{
+				// server name list: list length, then (type, length, name) entries. Take the first host name
+				const uint8_t* entry = extData + 2;
+				const uint8_t* listEnd = extData + extLen;
+				while (listEnd - entry >= 3)
+				{
+					size_t nameLen = read16(entry + 1);
+					if ((size_t)(listEnd - entry - 3) < nameLen)
+						break;
+					if (entry[0] == 0 && m_Metadata.serverName[0] == '\0')
+						appendToList(m_Metadata.serverName, sizeof(m_Metadata.serverName), entry + 3, nameLen);
+					entry += 3 + nameLen;
+				}
+				break;
+			}
+
+			case pcpp::SSL_EXT_ELLIPTIC_CURVES:
+			{
+				for (size_t i = 2; i + 1 < extLen; i += 2)
+				{
+					uint16_t curve = read16(extData + i);
+					if (!isGreaseValue(curve))
+						curves.appendListValue(curve);
+				}
+				break;
+			}
+
+			case pcpp::SSL_EXT_EC_POINT_FORMATS:
+			{
+				for (size_t i = 1; i < extLen; i++)
+					pointFormats.appendListValue(extData[i]);
+				break;
+			}
+
+			case pcpp::SSL_EXT_APPLICATION_LAYER_PROTOCOL_NEGOTIATION:
+			{
+				const uint8_t* entry = extData + 2;
+				const uint8_t* listEnd = extData + extLen;
+				while (entry < listEnd && (size_t)(listEnd - entry - 1) >= entry[0])
+				{
+					appendToList(m_Metadata.alpn, sizeof(m_Metadata.alpn), entry + 1, entry[0]);
+					entry += 1 + entry[0];
+				}
+				break;
+			}
+
+			case TLS_EXT_SUPPORTED_VERSIONS:
+			{
+				for (size_t i = 1; i + 1 < extLen; i += 2)
+				{
+					uint16_t version = read16(extData + i);
+					if (!isGreaseValue(version) && version > m_Metadata.clientMaxSupportedVersion)
+						m_Metadata.clientMaxSupportedVersion = version;
+				}
+				break;
+			}
+
+			default:
+				break;
+			}
+		}
+	}
+
+	// JA3 = SSLVersion,Ciphers,Extensions,EllipticCurves,EllipticCurvePointFormats
+	FixedStringBuilder<JA3_MAX_LEN> ja3;
+	ja3.appendDecimal(m_Metadata.clientVersion);
+	ja3.append(",", 1);
+	ja3.append(ciphers.buffer, ciphers.len);
+	ja3.append(",", 1);
+	ja3.append(extensions.buffer, extensions.len);
+	ja3.append(",", 1);
+	ja3.append(curves.buffer, curves.len);
+	ja3.append(",", 1);
+	ja3.append(pointFormats.buffer, pointFormats.len);
+	Md5::hexDigest((const uint8_t*)ja3.buffer, ja3.len, m_Metadata.ja3);
+
+	m_Metadata.gotClientHello = true;
+}
+
+
+void TlsHandshakeParser::parseServerHello(const uint8_t* body, size_t bodyLen)
+{
+	const uint8_t* pos = body;
+	const uint8_t* end = body + bodyLen;
+
+	// version + random + session ID length
+	if (end - pos < 2 + 32 + 1)
+		return;
+
+	uint16_t legacyVersion = read16(pos);
+	m_Metadata.serverVersion = legacyVersion;
+	pos += 34;
+	pos += 1 + pos[0];
+
+	// selected cipher suite + compression method
+	if (end - pos < 3)
+		return;
+	m_Metadata.selectedCipherSuite = read16(pos);
+	pos += 3;
+
+	FixedStringBuilder<JA3_MAX_LIST_LEN> extensions;
+
+	if (end - pos >= 2)
+	{
+		size_t extensionsLen = read16(pos);
+		pos += 2;
+		if ((size_t)(end - pos) < extensionsLen)
+			extensionsLen = end - pos;
+		const uint8_t* extEnd = pos + extensionsLen;
+
+		while (extEnd - pos >= 4)
+		{
+			uint16_t extType = read16(pos);
+			size_t extLen = read16(pos + 2);
+			const uint8_t* extData = pos + 4;
+			if ((size_t)(extEnd - extData) < extLen)
+				break;
+			pos = extData + extLen;
+
+			if (isGreaseValue(extType))
+				continue;
+
+			extensions.appendListValue(extType);
+
+			if (extType == TLS_EXT_SUPPORTED_VERSIONS && extLen == 2)
+				m_Metadata.serverVersion = read16(extData);
+			else if (extType == pcpp::SSL_EXT_APPLICATION_LAYER_PROTOCOL_NEGOTIATION && extLen >= 3 && (size_t)(extLen - 3) >= extData[2])
+				appendToList(m_Metadata.selectedAlpn, sizeof(m_Metadata.selectedAlpn), extData + 3, extData[2]);
+		}
+	}
+
+	// JA3S = SSLVersion,Cipher,SSLExtension
+	FixedStringBuilder<JA3_MAX_LEN> ja3s;
+	ja3s.appendDecimal(legacyVersion);
+	ja3s.append(",", 1);
+	ja3s.appendDecimal(m_Metadata.selectedCipherSuite);
+	ja3s.append(",", 1);
+	ja3s.append(extensions.buffer, extensions.len);
+	Md5::hexDigest((const uint8_t*)ja3s.buffer, ja3s.len, m_Metadata.ja3s);
+
+	m_Metadata.gotServerHello = true;
+}
+
+
+const char* tlsVersionToString(uint16_t version)
+{
+	switch (version)
+	{
+	case pcpp::SSL2:
+		return "SSLv2";
+	case pcpp::SSL3:
+		return "SSLv3";
+	case pcpp::TLS1_0:
+		return "TLSv1.0";
+	case pcpp::TLS1_1:
+		return "TLSv1.1";
+	case pcpp::TLS1_2:
+		return "TLSv1.2";
+	case TLS_VERSION_1_3:
+		return "TLSv1.3";
+	case 0:
+		return "-";
+	default:
+		return "unknown";
+	}
+}
+
+
+/**
+ * An empty string field is written as "-" so every line keeps the same number of columns
+ */
+static inline const char* fieldOrDash(const char* field)
+{
+	return field[0] != '\0' ? field : "-";
+}
+
+
+void writeTlsMetadataRecord(std::ostream& stream, const pcpp::ConnectionData& connData, const TlsMetadata& metadata, uint16_t tlsPort, const char* dnsName)
+{
+	// the side connecting to the TLS port is the client
+	bool srcIsClient = (connData.dstPort == tlsPort || connData.srcPort != tlsPort);
+	std::string clientIP = (srcIsClient ? connData.srcIP : connData.dstIP)->toString();
+	std::string serverIP = (srcIsClient ? connData.dstIP : connData.srcIP)->toString();
+	uint16_t clientPort = (srcIsClient ? connData.srcPort : connData.dstPort);
+	uint16_t serverPort = (srcIsClient ? connData.dstPort : connData.srcPort);
+
+	// prefer the version the server actually selected
+	uint16_t version = metadata.gotServerHello ? metadata.serverVersion : metadata.clientMaxSupportedVersion;
+
+	char line[1024];
+	int lineLen = snprintf(line, sizeof(line), "%ld.%06ld\t%s\t%u\t%s\t%u\t%s\t%s\t%s\t%s\t%u\t0x%04x\t%s\t%s\t%s\n",
+			(long)connData.startTime.tv_sec, (long)connData.startTime.tv_usec,
+			clientIP.c_str(), clientPort, serverIP.c_str(), serverPort,
+			tlsVersionToString(version),
+			fieldOrDash(metadata.serverName), fieldOrDash(metadata.alpn), fieldOrDash(metadata.selectedAlpn),
+			metadata.numOfCipherSuites, metadata.selectedCipherSuite,
+			fieldOrDash(metadata.ja3), fieldOrDash(metadata.ja3s), fieldOrDash(dnsName));
+
+	if (lineLen < 0)
+		return;
+	if (lineLen >= (int)sizeof(line))
+		lineLen = (int)sizeof(line) - 1;
+
+	stream.write(line, lineLen);
+}
@@ -0,0 +1,152 @@
+#ifndef HTTPECHO_TLS_METADATA
+#define HTTPECHO_TLS_METADATA
+
+#include <stdint.h>
+#include <stddef.h>
+#include <ostream>
+#include "header/TcpReassembly.h"
+
+// the default port TLS metadata is extracted on
+#define DEFAULT_TLS_PORT 443
+
+// max length of a server name (SNI) kept in a record
+#define TLS_MAX_SERVER_NAME_LEN 255
+
+// max length of the comma separated ALPN protocol list kept in a record
+#define TLS_MAX_ALPN_LEN 127
+
+// hello messages longer than this are not parsed
+#define TLS_MAX_HELLO_MESSAGE_LEN 16384
+
+
+/**
+ * The metadata extracted from the ClientHello and ServerHello of a single TLS connection. All fields are fixed size so a record never allocates
+ */
+struct TlsMetadata
+{
+	// flags indicating which hello messages were parsed
+	bool gotClientHello;
+	bool gotServerHello;
+
+	// the legacy version field of the ClientHello and the highest version offered in the supported_versions extension (if present)
+	uint16_t clientVersion;
+	uint16_t clientMaxSupportedVersion;
+
+	// the version selected by the server (taken from the supported_versions extension if present)
+	uint16_t serverVersion;
+
+	// number of (non-GREASE) cipher suites offered by the client and the one selected by the server
+	uint16_t numOfCipherSuites;
+	uint16_t selectedCipherSuite;
+
+	// server name indication and ALPN protocols offered by the client / selected by the server
+	char serverName[TLS_MAX_SERVER_NAME_LEN + 1];
+	char alpn[TLS_MAX_ALPN_LEN + 1];
+	char selectedAlpn[TLS_MAX_ALPN_LEN + 1];
+
+	// JA3 (client) and JA3S (server) fingerprints as MD5 hex digests
+	char ja3[33];
+	char ja3s[33];
+
+	/**
+	 * The default constructor
+	 */
+	TlsMetadata() { clear(); }
+
+	/**
+	 * Clear all data
+	 */
+	void clear();
+};
+
+
+/**
+ * Extracts TlsMetadata from the two reassembled byte streams of a TLS connection.
+ * It knows the same wire format as pcpp::SSLHandshakeLayer / pcpp::SSLClientHelloMessage but parses the hello messages directly from the
+ * stream bytes: no layers, SSLExtension objects or strings are created. A hello which arrives whole in one chunk (the common case) is parsed in
+ * place, a hello which spans several TCP segments or TLS records is collected into a buffer first. Once both hellos were seen the parser
+ * ignores the rest of the connection
+ */
+class TlsHandshakeParser
+{
+public:
+
+	/**
+	 * A c'tor for this class
+	 */
+	TlsHandshakeParser();
+
+	/**
+	 * A d'tor for this class
+	 */
+	~TlsHandshakeParser();
+
+	/**
+	 * Feed the next chunk of stream data from one side of the connection
+	 * @param[in] side The side of the connection (0 or 1) as reported by TcpReassembly
+	 * @param[in] data The stream data
+	 * @param[in] dataLen The stream data length
+	 */
+	void feed(int side, const uint8_t* data, size_t dataLen);
+
+	/**
+	 * Report that data is missing from one side's stream. The side's hello can't be recovered anymore, so the side is considered handled
+	 * @param[in] side The side of the connection (0 or 1)
+	 */
+	void skipMissingData(int side);
+
+	/**
+	 * @return True if both sides were handled (their hello parsed, or found not to be a TLS handshake), meaning no more data is needed
+	 */
+	bool isDone() const { return m_Sides[0].done && m_Sides[1].done; }
+
+	/**
+	 * @return The metadata extracted so far
+	 */
+	const TlsMetadata& getMetadata() const { return m_Metadata; }
+
+private:
+
+	/**
+	 * The parsing state of one side of the connection
+	 */
+	struct SideState
+	{
+		bool done;
+		uint8_t recordHeader[5];
+		uint8_t recordHeaderLen;
+		uint32_t recordRemaining;
+		uint8_t handshakeHeader[4];
+		uint8_t handshakeHeaderLen;
+		uint8_t* messageBuffer;
+		uint32_t messageLen;
+		uint32_t messageFilled;
+	};
+
+	SideState m_Sides[2];
+	TlsMetadata m_Metadata;
+
+	void consumeHandshakeBytes(SideState& side, const uint8_t* data, size_t dataLen);
+	void parseHandshakeMessage(uint8_t type, const uint8_t* body, size_t bodyLen);
+	void parseClientHello(const uint8_t* body, size_t bodyLen);
+	void parseServerHello(const uint8_t* body, size_t bodyLen);
+};
+
+
+/**
+ * Get a short string representation of a TLS version (e.g "TLSv1.3")
+ */
+const char* tlsVersionToString(uint16_t version);
+
+
+/**
+ * Write a TLS metadata record as one tab separated line. Client and server are told apart by the TLS port
+ * @param[in] stream The stream to write to
+ * @param[in] connData The connection the metadata belongs to
+ * @param[in] metadata The metadata to write
+ * @param[in] tlsPort The server side port
+ * @param[in] dnsName The name the server's address was resolved from, as seen by the passive DNS cache (empty if it wasn't seen)
+ */
+void writeTlsMetadataRecord(std::ostream& stream, const pcpp::ConnectionData& connData, const TlsMetadata& metadata, uint16_t tlsPort, const char* dnsName);
+
+#endif /* HTTPECHO_TLS_METADATA */
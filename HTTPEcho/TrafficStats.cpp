@@ -0,0 +1,99 @@
+#include <string.h>
+#include <stdio.h>
+#include <vector>
+#include "TrafficStats.h"
+
+
+TrafficStats::TrafficStats(size_t numOfTopUris, size_t numOfTopHosts) :
+	m_TopUris(numOfTopUris), m_TopHosts(numOfTopHosts)
+{
+	numOfRequests = 0;
+	numOfRedactedHeaders = 0;
+	numOfRedactedQueryParameters = 0;
+	numOfDroppedHeaderBlocks = 0;
+}
+
+
+void TrafficStats::recordRequest(const char* host, const char* uri)
+{
+	numOfRequests++;
+
+	if (host[0] == '\0')
+		host = "-";
+
+	// URIs are counted with their host, "/" alone would mean something else on every server
+	char hostAndUri[TOP_K_MAX_KEY_LEN + 1];
+	snprintf(hostAndUri, sizeof(hostAndUri), "%s%s", host, uri);
+
+	m_TopHosts.offer(host);
+	m_TopUris.offer(hostAndUri);
+	m_DistinctUris.add(hostAndUri, strlen(hostAndUri));
+}
+
+
+void TrafficStats::recordClient(const uint8_t* ipAddress, size_t ipAddressLen)
+{
+	m_DistinctClients.add(ipAddress, ipAddressLen);
+}
+
+
+void TrafficStats::recordRedaction(bool isHeader)
+{
+	if (isHeader)
+		numOfRedactedHeaders++;
+	else
+		numOfRedactedQueryParameters++;
+}
+
+
+void TrafficStats::merge(const TrafficStats& other)
+{
+	m_TopUris.merge(other.m_TopUris);
+	m_TopHosts.merge(other.m_TopHosts);
+	m_DistinctClients.merge(other.m_DistinctClients);
+	m_DistinctUris.merge(other.m_DistinctUris);
+	numOfRequests += other.numOfRequests;
+	numOfRedactedHeaders += other.numOfRedactedHeaders;
+	numOfRedactedQueryParameters += other.numOfRedactedQueryParameters;
+	numOfDroppedHeaderBlocks += other.numOfDroppedHeaderBlocks;
+}
+
+
+void TrafficStats::clear()
+{
+	m_TopUris.clear();
+	m_TopHosts.clear();
+	m_DistinctClients.clear();
+	m_DistinctUris.clear();
+	numOfRequests = 0;
+	numOfRedactedHeaders = 0;
+	numOfRedactedQueryParameters = 0;
+	numOfDroppedHeaderBlocks = 0;
+}
+
+
+void TrafficStats::writeTopKeys(std::ostream& stream, const char* statName, const TopKCounter& counter, size_t topN)
+{
+	std::vector<TopKCounter::Entry> entries(topN);
+	size_t numOfEntries = counter.getTopKeys(topN > 0 ? &entries[0] : NULL, topN);
+
+	for (size_t i = 0; i < numOfEntries; i++)
+		stream << statName << '\t' << entries[i].key << '\t' << entries[i].count << '\t' << entries[i].error << '\n';
+}
+
+
+void TrafficStats::writeReport(std::ostream& stream, size_t topN) const
+{
+	stream << "stat\tkey\tcount\tmax_overcount\n";
+	stream << "requests\t-\t" << numOfRequests << "\t0\n";
+	stream << "distinct_clients\t-\t" << m_DistinctClients.estimate() << "\t-\n";
+	stream << "distinct_uris\t-\t" << m_DistinctUris.estimate() << "\t-\n";
+	stream << "redacted_headers\t-\t" << numOfRedactedHeaders << "\t0\n";
+	stream << "redacted_query_parameters\t-\t" << numOfRedactedQueryParameters << "\t0\n";
+	stream << "dropped_header_blocks\t-\t" << numOfDroppedHeaderBlocks << "\t0\n";
+
+	writeTopKeys(stream, "top_host", m_TopHosts, topN);
+	writeTopKeys(stream, "top_uri", m_TopUris, topN);
+
+	stream.flush();
+}
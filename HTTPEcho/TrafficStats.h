@@ -0,0 +1,97 @@
+#ifndef HTTPECHO_TRAFFIC_STATS
+#define HTTPECHO_TRAFFIC_STATS
+
+#include <stdint.h>
+#include <stddef.h>
+#include <ostream>
+#include "StreamingSketches.h"
+
+// number of counters kept for the top URIs / hosts. A key which makes more than 1/K of the requests is always among them
+#define DEFAULT_TOP_K_URIS 4096
+#define DEFAULT_TOP_K_HOSTS 1024
+
+// number of top URIs / hosts written to the report
+#define DEFAULT_TRAFFIC_REPORT_TOP_N 100
+
+
+/**
+ * Streaming HTTP traffic statistics in fixed memory (about 1MB with the default sizes): the most requested URIs and hosts (Space-Saving) and the
+ * number of distinct clients and URIs (HyperLogLog). Fed by the HTTP parser; each capture worker owns one instance and the instances are merged
+ * for a report
+ */
+class TrafficStats
+{
+public:
+
+	/**
+	 * A c'tor for this class
+	 * @param[in] numOfTopUris The number of URI counters
+	 * @param[in] numOfTopHosts The number of host counters
+	 */
+	TrafficStats(size_t numOfTopUris = DEFAULT_TOP_K_URIS, size_t numOfTopHosts = DEFAULT_TOP_K_HOSTS);
+
+	/**
+	 * Count a request
+	 * @param[in] host The Host of the request (may be empty)
+	 * @param[in] uri The URI path of the request
+	 */
+	void recordRequest(const char* host, const char* uri);
+
+	/**
+	 * Count a client (once per connection)
+	 * @param[in] ipAddress The client IP address bytes (4 for IPv4, 16 for IPv6)
+	 * @param[in] ipAddressLen The number of address bytes
+	 */
+	void recordClient(const uint8_t* ipAddress, size_t ipAddressLen);
+
+	/**
+	 * Count a value redacted from the capture files
+	 * @param[in] isHeader Whether the value is a header value (or a query parameter value)
+	 */
+	void recordRedaction(bool isHeader);
+
+	/**
+	 * Count an HTTP/2 header block left out of the capture files because it can't be redacted in place
+	 */
+	void recordDroppedHeaderBlock() { numOfDroppedHeaderBlocks++; }
+
+	/**
+	 * Add the statistics of another instance to this one
+	 * @param[in] other The instance to merge
+	 */
+	void merge(const TrafficStats& other);
+
+	/**
+	 * Clear all statistics
+	 */
+	void clear();
+
+	/**
+	 * Write the statistics as tab separated lines (with a header line): the request count, the distinct client and URI estimates, the redaction
+	 * counts, and the top hosts and URIs with their counts and max over-estimation
+	 * @param[in] stream The stream to write to
+	 * @param[in] topN The number of top hosts / URIs to write
+	 */
+	void writeReport(std::ostream& stream, size_t topN = DEFAULT_TRAFFIC_REPORT_TOP_N) const;
+
+	// number of requests counted
+	uint64_t numOfRequests;
+
+	// number of header values and query parameter values redacted, and of HTTP/2 header blocks left out instead
+	uint64_t numOfRedactedHeaders;
+	uint64_t numOfRedactedQueryParameters;
+	uint64_t numOfDroppedHeaderBlocks;
+
+private:
+	TopKCounter m_TopUris;
+	TopKCounter m_TopHosts;
+	HyperLogLog m_DistinctClients;
+	HyperLogLog m_DistinctUris;
+
+	static void writeTopKeys(std::ostream& stream, const char* statName, const TopKCounter& counter, size_t topN);
+
+	TrafficStats(const TrafficStats&);
+	TrafficStats& operator=(const TrafficStats&);
+};
+
+#endif /* HTTPECHO_TRAFFIC_STATS */
@@ -0,0 +1,242 @@
+#include <string.h>
+#include "TransactionExport.h"
+
+
+/**
+ * Append an unsigned integer of numOfBytes bytes, little endian
+ */
+static void appendUInt(std::string& out, uint64_t value, int numOfBytes)
+{
+	for (int byte = 0; byte < numOfBytes; byte++)
+		out.push_back((char)(uint8_t)(value >> (8 * byte)));
+}
+
+
+template<typename T>
+static void appendColumn(std::string& out, const std::vector<T>& values)
+{
+	for (size_t i = 0; i < values.size(); i++)
+		appendUInt(out, (uint64_t)values[i], sizeof(T));
+}
+
+
+template<typename T>
+static void getFixedColumnView(const std::vector<T>& values, ExportColumnView& view)
+{
+	view.values = values.data();
+	view.valueSize = sizeof(T);
+	view.dictionarySize = 0;
+	view.dictionaryOffsets = NULL;
+	view.dictionaryValues = NULL;
+}
+
+
+/**
+ * The schema of every record group, in column order
+ */
+struct ExportColumn
+{
+	uint8_t type;
+	const char* name;
+};
+
+static const ExportColumn s_ExportColumns[] = {
+	{ EXPORT_COLUMN_INT64, "request_time_us" },
+	{ EXPORT_COLUMN_DICT_STRING, "client_ip" },
+	{ EXPORT_COLUMN_UINT16, "client_port" },
+	{ EXPORT_COLUMN_DICT_STRING, "server_ip" },
+	{ EXPORT_COLUMN_UINT16, "server_port" },
+	{ EXPORT_COLUMN_DICT_STRING, "server_name" },
+	{ EXPORT_COLUMN_DICT_STRING, "method" },
+	{ EXPORT_COLUMN_DICT_STRING, "host" },
+	{ EXPORT_COLUMN_DICT_STRING, "uri" },
+	{ EXPORT_COLUMN_UINT16, "status" },
+	{ EXPORT_COLUMN_UINT64, "request_body_bytes" },
+	{ EXPORT_COLUMN_UINT64, "response_body_bytes" },
+	{ EXPORT_COLUMN_UINT64, "ttfb_us" },
+	{ EXPORT_COLUMN_UINT64, "response_time_us" },
+	{ EXPORT_COLUMN_UINT64, "pattern_matches" },
+	{ EXPORT_COLUMN_DICT_STRING, "matched_pattern" }
+};
+
+
+void TransactionColumnBatch::DictionaryColumn::append(const char* value)
+{
+	std::pair<std::unordered_map<std::string, uint32_t>::iterator, bool> result = codes.insert(std::make_pair(std::string(value), (uint32_t)codes.size()));
+	if (result.second)
+	{
+		values.append(value);
+		offsets.push_back((uint32_t)values.size());
+	}
+
+	rows.push_back(result.first->second);
+}
+
+
+void TransactionColumnBatch::DictionaryColumn::encode(std::string& out) const
+{
+	appendUInt(out, codes.size(), 4);
+	appendColumn(out, offsets);
+	out.append(values);
+
+	// the narrowest code which fits the dictionary
+	int codeWidth = (codes.size() <= 0x100 ? 1 : (codes.size() <= 0x10000 ? 2 : 4));
+	appendUInt(out, codeWidth, 1);
+	for (size_t i = 0; i < rows.size(); i++)
+		appendUInt(out, rows[i], codeWidth);
+}
+
+
+void TransactionColumnBatch::DictionaryColumn::getView(ExportColumnView& view) const
+{
+	view.values = rows.data();
+	view.valueSize = sizeof(uint32_t);
+	view.dictionarySize = codes.size();
+	view.dictionaryOffsets = offsets.data();
+	view.dictionaryValues = values.data();
+}
+
+
+void TransactionColumnBatch::DictionaryColumn::clear()
+{
+	codes.clear();
+	offsets.clear();
+	offsets.push_back(0);
+	values.clear();
+	rows.clear();
+}
+
+
+TransactionColumnBatch::TransactionColumnBatch(size_t maxRows)
+{
+	m_MaxRows = (maxRows > 0 ? maxRows : 1);
+}
+
+
+void TransactionColumnBatch::append(const HttpTransaction& transaction)
+{
+	m_RequestTime.push_back((int64_t)transaction.requestTime.tv_sec * 1000000 + (int64_t)transaction.requestTime.tv_usec);
+	m_ClientIP.append(transaction.clientIP);
+	m_ClientPort.push_back(transaction.clientPort);
+	m_ServerIP.append(transaction.serverIP);
+	m_ServerPort.push_back(transaction.serverPort);
+	m_ServerName.append(transaction.serverName);
+	m_Method.append(transaction.method);
+	m_Host.append(transaction.host);
+	m_Uri.append(transaction.uri);
+	m_StatusCode.push_back(transaction.statusCode);
+	m_RequestBodyBytes.push_back(transaction.requestBodyBytes);
+	m_ResponseBodyBytes.push_back(transaction.responseBodyBytes);
+	m_TimeToFirstByte.push_back(transaction.timeToFirstByteUsec);
+	m_ResponseTime.push_back(transaction.responseTimeUsec);
+	m_PatternMatches.push_back(transaction.patternMatches);
+	m_MatchedPattern.append(transaction.matchedPattern);
+}
+
+
+void TransactionColumnBatch::encode(std::string& out) const
+{
+	out.append(EXPORT_GROUP_MAGIC, 4);
+	appendUInt(out, getNumOfRows(), 4);
+
+	// the group length is patched in once the columns are encoded
+	size_t lengthOffset = out.size();
+	appendUInt(out, 0, 8);
+
+	appendColumn(out, m_RequestTime);
+	m_ClientIP.encode(out);
+	appendColumn(out, m_ClientPort);
+	m_ServerIP.encode(out);
+	appendColumn(out, m_ServerPort);
+	m_ServerName.encode(out);
+	m_Method.encode(out);
+	m_Host.encode(out);
+	m_Uri.encode(out);
+	appendColumn(out, m_StatusCode);
+	appendColumn(out, m_RequestBodyBytes);
+	appendColumn(out, m_ResponseBodyBytes);
+	appendColumn(out, m_TimeToFirstByte);
+	appendColumn(out, m_ResponseTime);
+	appendColumn(out, m_PatternMatches);
+	m_MatchedPattern.encode(out);
+
+	uint64_t groupLength = out.size() - lengthOffset - 8;
+	for (int byte = 0; byte < 8; byte++)
+		out[lengthOffset + byte] = (char)(uint8_t)(groupLength >> (8 * byte));
+}
+
+
+void TransactionColumnBatch::clear()
+{
+	m_RequestTime.clear();
+	m_ClientIP.clear();
+	m_ClientPort.clear();
+	m_ServerIP.clear();
+	m_ServerPort.clear();
+	m_ServerName.clear();
+	m_Method.clear();
+	m_Host.clear();
+	m_Uri.clear();
+	m_StatusCode.clear();
+	m_RequestBodyBytes.clear();
+	m_ResponseBodyBytes.clear();
+	m_TimeToFirstByte.clear();
+	m_ResponseTime.clear();
+	m_PatternMatches.clear();
+	m_MatchedPattern.clear();
+}
+
+
+void TransactionColumnBatch::encodeFileHeader(std::string& out)
+{
+	size_t numOfColumns = getNumOfColumns();
+
+	out.append(EXPORT_FILE_MAGIC, 8);
+	appendUInt(out, numOfColumns, 4);
+	for (size_t i = 0; i < numOfColumns; i++)
+	{
+		size_t nameLen = strlen(s_ExportColumns[i].name);
+		appendUInt(out, s_ExportColumns[i].type, 1);
+		appendUInt(out, nameLen, 1);
+		out.append(s_ExportColumns[i].name, nameLen);
+	}
+}
+
+
+size_t TransactionColumnBatch::getNumOfColumns()
+{
+	return sizeof(s_ExportColumns) / sizeof(s_ExportColumns[0]);
+}
+
+
+const char* TransactionColumnBatch::getColumnName(size_t index)
+{
+	return s_ExportColumns[index].name;
+}
+
+
+void TransactionColumnBatch::getColumn(size_t index, ExportColumnView& view) const
+{
+	switch (index)
+	{
+	case 0: getFixedColumnView(m_RequestTime, view); break;
+	case 1: m_ClientIP.getView(view); break;
+	case 2: getFixedColumnView(m_ClientPort, view); break;
+	case 3: m_ServerIP.getView(view); break;
+	case 4: getFixedColumnView(m_ServerPort, view); break;
+	case 5: m_ServerName.getView(view); break;
+	case 6: m_Method.getView(view); break;
+	case 7: m_Host.getView(view); break;
+	case 8: m_Uri.getView(view); break;
+	case 9: getFixedColumnView(m_StatusCode, view); break;
+	case 10: getFixedColumnView(m_RequestBodyBytes, view); break;
+	case 11: getFixedColumnView(m_ResponseBodyBytes, view); break;
+	case 12: getFixedColumnView(m_TimeToFirstByte, view); break;
+	case 13: getFixedColumnView(m_ResponseTime, view); break;
+	case 14: getFixedColumnView(m_PatternMatches, view); break;
+	default: m_MatchedPattern.getView(view); break;
+	}
+
+	view.name = s_ExportColumns[index].name;
+	view.type = s_ExportColumns[index].type;
+}
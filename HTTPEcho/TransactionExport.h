@@ -0,0 +1,162 @@
+#ifndef HTTPECHO_TRANSACTION_EXPORT
+#define HTTPECHO_TRANSACTION_EXPORT
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "HttpTransactionTracker.h"
+
+// the number of transactions written together as one record group
+#define DEFAULT_EXPORT_ROWS_PER_GROUP 16384
+
+// the magic (and format version) which opens an export file, and the one which opens each record group
+#define EXPORT_FILE_MAGIC "HECOL001"
+#define EXPORT_GROUP_MAGIC "RGRP"
+
+// the column types of the export format
+#define EXPORT_COLUMN_INT64 1
+#define EXPORT_COLUMN_UINT16 2
+#define EXPORT_COLUMN_UINT64 3
+#define EXPORT_COLUMN_DICT_STRING 4
+
+
+/**
+ * @struct ExportColumnView
+ * A column of a TransactionColumnBatch where it sits in memory, so its rows can be handed to other code (e.g. through Python's buffer protocol)
+ * without copying them. Valid until the batch changes
+ */
+struct ExportColumnView
+{
+	const char* name;
+	uint8_t type;
+
+	// the rows, valueSize bytes each. The rows of a DICT_STRING column are the uint32 codes of their dictionary values
+	const void* values;
+	size_t valueSize;
+
+	// DICT_STRING only: the number of dictionary values, where each one starts in the value bytes (dictionarySize + 1 offsets) and the value bytes
+	size_t dictionarySize;
+	const uint32_t* dictionaryOffsets;
+	const char* dictionaryValues;
+};
+
+
+/**
+ * Collects completed HTTP transactions column by column and encodes them as record groups of a columnar file, so analytics tools can scan a
+ * single column of a day of traffic without touching the rest (python/read_transactions.py reads the format).
+ * All integers are little endian. A file is the file header followed by any number of record groups:
+ * - File header: the 8-byte EXPORT_FILE_MAGIC, a uint32 column count, then per column a uint8 type and a uint8 length prefixed name
+ * - Record group: the 4-byte EXPORT_GROUP_MAGIC, a uint32 row count, a uint64 length of the rest of the group, then every column in schema order
+ * - INT64 / UINT64 / UINT16 column: the raw values, one per row
+ * - DICT_STRING column: a uint32 dictionary size N, N+1 uint32 offsets into the value bytes, the value bytes, a uint8 code width (1, 2 or 4)
+ *   and one code per row. Dictionaries are local to the record group, so a writer never holds more than one group in memory
+ *
+ * Each group is self contained, so groups encoded by different threads can be appended to the same file in any order
+ */
+class TransactionColumnBatch
+{
+public:
+
+	/**
+	 * A c'tor for this class
+	 * @param[in] maxRows The number of rows after which the batch reports it's full
+	 */
+	TransactionColumnBatch(size_t maxRows = DEFAULT_EXPORT_ROWS_PER_GROUP);
+
+	/**
+	 * Add a transaction as the next row
+	 * @param[in] transaction The transaction
+	 */
+	void append(const HttpTransaction& transaction);
+
+	/**
+	 * Encode the rows as one record group, appended to a buffer. The batch isn't cleared
+	 * @param[out] out The buffer
+	 */
+	void encode(std::string& out) const;
+
+	/**
+	 * Remove all rows
+	 */
+	void clear();
+
+	/**
+	 * @return The number of rows in the batch
+	 */
+	size_t getNumOfRows() const { return m_RequestTime.size(); }
+
+	/**
+	 * @return True if the batch reached its row count and should be written out
+	 */
+	bool isFull() const { return getNumOfRows() >= m_MaxRows; }
+
+	/**
+	 * Encode the file header, which describes the columns of every record group
+	 * @param[out] out The buffer the header is appended to
+	 */
+	static void encodeFileHeader(std::string& out);
+
+	/**
+	 * @return The number of columns of every batch
+	 */
+	static size_t getNumOfColumns();
+
+	/**
+	 * @param[in] index The column index, in schema order
+	 * @return The column name, as in the file header
+	 */
+	static const char* getColumnName(size_t index);
+
+	/**
+	 * Get a column of the batch without copying it
+	 * @param[in] index The column index, in schema order (as in the file header)
+	 * @param[out] view The column
+	 */
+	void getColumn(size_t index, ExportColumnView& view) const;
+
+private:
+
+	/**
+	 * A string column: every distinct value is stored once, the rows hold codes
+	 */
+	struct DictionaryColumn
+	{
+		std::unordered_map<std::string, uint32_t> codes;
+		std::vector<uint32_t> offsets;
+		std::string values;
+		std::vector<uint32_t> rows;
+
+		DictionaryColumn() { offsets.push_back(0); }
+		void append(const char* value);
+		void encode(std::string& out) const;
+		void clear();
+		void getView(ExportColumnView& view) const;
+	};
+
+	size_t m_MaxRows;
+
+	std::vector<int64_t> m_RequestTime;
+	DictionaryColumn m_ClientIP;
+	std::vector<uint16_t> m_ClientPort;
+	DictionaryColumn m_ServerIP;
+	std::vector<uint16_t> m_ServerPort;
+	DictionaryColumn m_ServerName;
+	DictionaryColumn m_Method;
+	DictionaryColumn m_Host;
+	DictionaryColumn m_Uri;
+	std::vector<uint16_t> m_StatusCode;
+	std::vector<uint64_t> m_RequestBodyBytes;
+	std::vector<uint64_t> m_ResponseBodyBytes;
+	std::vector<uint64_t> m_TimeToFirstByte;
+	std::vector<uint64_t> m_ResponseTime;
+	std::vector<uint64_t> m_PatternMatches;
+	DictionaryColumn m_MatchedPattern;
+
+	// batches are large, prevent copies
+	TransactionColumnBatch(const TransactionColumnBatch& other);
+	TransactionColumnBatch& operator=(const TransactionColumnBatch& other);
+};
+
+#endif /* HTTPECHO_TRANSACTION_EXPORT */
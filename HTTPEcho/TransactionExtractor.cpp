@@ -0,0 +1,126 @@
+#include "TransactionExtractor.h"
+
+
+TransactionExtractor::TransactionExtractor(TransactionColumnBatch* batch, uint16_t serverPort) :
+	m_TcpReassembly(onMessageReady, this, NULL, onConnectionEnd, onStreamGap)
+{
+	m_Batch = batch;
+	m_ServerPort = serverPort;
+	numOfPackets = 0;
+	numOfTransactions = 0;
+}
+
+
+TransactionExtractor::~TransactionExtractor()
+{
+	for (std::unordered_map<uint32_t, HttpTransactionTracker*>::iterator iter = m_Trackers.begin(); iter != m_Trackers.end(); iter++)
+		delete iter->second;
+}
+
+
+bool TransactionExtractor::isHttpConnection(const pcpp::ConnectionData& connData) const
+{
+	return connData.dstPort == m_ServerPort || connData.srcPort == m_ServerPort;
+}
+
+
+void TransactionExtractor::processPacket(pcpp::RawPacket* packet)
+{
+	numOfPackets++;
+
+	IPDefragmenter::Status status;
+	pcpp::RawPacket* packetToReassemble = m_IPDefragmenter.processPacket(packet, status);
+	if (packetToReassemble != NULL)
+		m_TcpReassembly.reassemblePacket(packetToReassemble);
+}
+
+
+void TransactionExtractor::processPackets(pcpp::RawPacket* const* packets, size_t numOfPackets)
+{
+	this->numOfPackets += numOfPackets;
+
+	pcpp::RawPacket* packetsToReassemble[MAX_REASSEMBLY_BATCH_SIZE];
+	size_t numOfPacketsToReassemble = 0;
+
+	for (size_t i = 0; i < numOfPackets; i++)
+	{
+		IPDefragmenter::Status status;
+		pcpp::RawPacket* packetToReassemble = m_IPDefragmenter.processPacket(packets[i], status);
+		if (packetToReassemble == NULL)
+			continue;
+
+		// a reassembled datagram is only valid until the next fragment is processed, so the packets before it are flushed and it goes alone
+		if (status == IPDefragmenter::Reassembled)
+		{
+			m_TcpReassembly.reassemblePackets(packetsToReassemble, numOfPacketsToReassemble);
+			numOfPacketsToReassemble = 0;
+			m_TcpReassembly.reassemblePacket(packetToReassemble);
+			continue;
+		}
+
+		packetsToReassemble[numOfPacketsToReassemble++] = packetToReassemble;
+		if (numOfPacketsToReassemble == MAX_REASSEMBLY_BATCH_SIZE)
+		{
+			m_TcpReassembly.reassemblePackets(packetsToReassemble, numOfPacketsToReassemble);
+			numOfPacketsToReassemble = 0;
+		}
+	}
+
+	m_TcpReassembly.reassemblePackets(packetsToReassemble, numOfPacketsToReassemble);
+}
+
+
+void TransactionExtractor::finish()
+{
+	m_TcpReassembly.closeAllConnections();
+}
+
+
+void TransactionExtractor::onMessageReady(int side, const pcpp::TcpStreamData& tcpData, void* userCookie)
+{
+	TransactionExtractor* extractor = (TransactionExtractor*)userCookie;
+	const pcpp::ConnectionData& connData = tcpData.getConnectionData();
+	if (!extractor->isHttpConnection(connData))
+		return;
+
+	HttpTransactionTracker*& tracker = extractor->m_Trackers[connData.flowKey];
+	if (tracker == NULL)
+	{
+		int clientSide = (connData.dstPort == extractor->m_ServerPort ? 0 : 1);
+		tracker = new HttpTransactionTracker(connData, clientSide, &extractor->m_LatencyTable, NULL, onTransactionComplete, extractor);
+	}
+
+	// the connection's end time is the timestamp of the packet which carried the data
+	tracker->feed(side, tcpData.getData(), tcpData.getDataLength(), connData.endTime);
+}
+
+
+void TransactionExtractor::onConnectionEnd(const pcpp::ConnectionData& connData, pcpp::TcpReassembly::ConnectionEndReason reason, void* userCookie)
+{
+	TransactionExtractor* extractor = (TransactionExtractor*)userCookie;
+	std::unordered_map<uint32_t, HttpTransactionTracker*>::iterator iter = extractor->m_Trackers.find(connData.flowKey);
+	if (iter == extractor->m_Trackers.end())
+		return;
+
+	// a response delimited by the connection close ends here
+	iter->second->finish();
+	delete iter->second;
+	extractor->m_Trackers.erase(iter);
+}
+
+
+void TransactionExtractor::onStreamGap(int side, const pcpp::ConnectionData& connData, uint32_t missingDataLen, void* userCookie)
+{
+	TransactionExtractor* extractor = (TransactionExtractor*)userCookie;
+	std::unordered_map<uint32_t, HttpTransactionTracker*>::iterator iter = extractor->m_Trackers.find(connData.flowKey);
+	if (iter != extractor->m_Trackers.end())
+		iter->second->skipMissingData(side, missingDataLen);
+}
+
+
+void TransactionExtractor::onTransactionComplete(const HttpTransaction& transaction, void* userCookie)
+{
+	TransactionExtractor* extractor = (TransactionExtractor*)userCookie;
+	extractor->m_Batch->append(transaction);
+	extractor->numOfTransactions++;
+}
@@ -0,0 +1,102 @@
+#ifndef HTTPECHO_TRANSACTION_EXTRACTOR
+#define HTTPECHO_TRANSACTION_EXTRACTOR
+
+#include <stdint.h>
+#include <stddef.h>
+#include <unordered_map>
+#include "header/RawPacket.h"
+#include "IPDefragmenter.h"
+#include "TcpStreamReassembly.h"
+#include "HttpTransactionTracker.h"
+#include "HttpLatencyTable.h"
+#include "TransactionExport.h"
+
+// the server port whose connections are parsed as HTTP unless another one is given
+#define DEFAULT_EXTRACTOR_SERVER_PORT 80
+
+
+/**
+ * The HTTP transaction path of the capture pipeline on its own, for embedding HTTPEcho in other programs (the Python module in python/httpecho
+ * runs it): packets go through IP defragmentation and TCP reassembly, the connections to the server port are parsed by an HttpTransactionTracker
+ * each, and every completed transaction is appended as a row to a TransactionColumnBatch. Nothing is written to files and no other protocol is
+ * decoded. The extractor isn't thread safe, each thread runs its own
+ */
+class TransactionExtractor
+{
+public:
+
+	/**
+	 * A c'tor for this class
+	 * @param[in] batch The batch the transactions are appended to
+	 * @param[in] serverPort The port of the HTTP servers, connections which don't have it on one of their sides are ignored
+	 */
+	TransactionExtractor(TransactionColumnBatch* batch, uint16_t serverPort = DEFAULT_EXTRACTOR_SERVER_PORT);
+
+	/**
+	 * A d'tor for this class. Connections which are still open are dropped, their pending transactions aren't appended
+	 */
+	~TransactionExtractor();
+
+	/**
+	 * Process a single packet
+	 * @param[in] packet The packet
+	 */
+	void processPacket(pcpp::RawPacket* packet);
+
+	/**
+	 * Process a burst of packets, in order. The packets which aren't fragments are reassembled as one burst (see TcpStreamReassembly)
+	 * @param[in] packets An array of packets
+	 * @param[in] numOfPackets The number of packets in the array
+	 */
+	void processPackets(pcpp::RawPacket* const* packets, size_t numOfPackets);
+
+	/**
+	 * Close all open connections, which completes the responses delimited by the connection close. Call it at the end of the input
+	 */
+	void finish();
+
+	/**
+	 * Switch to another batch, e.g. after the current one was handed over
+	 * @param[in] batch The batch the next transactions are appended to
+	 */
+	void setBatch(TransactionColumnBatch* batch) { m_Batch = batch; }
+
+	/**
+	 * @return The batch the transactions are appended to
+	 */
+	TransactionColumnBatch* getBatch() const { return m_Batch; }
+
+	/**
+	 * @return The number of HTTP connections currently parsed
+	 */
+	size_t getNumOfHttpConnections() const { return m_Trackers.size(); }
+
+	// stats: the packets processed and the transactions appended
+	uint64_t numOfPackets;
+	uint64_t numOfTransactions;
+
+private:
+	TransactionColumnBatch* m_Batch;
+	uint16_t m_ServerPort;
+	IPDefragmenter m_IPDefragmenter;
+	TcpStreamReassembly m_TcpReassembly;
+
+	// the tracker needs a latency table, the transactions are only recorded in it in passing
+	HttpLatencyTable m_LatencyTable;
+
+	// the HTTP connections by flow key
+	std::unordered_map<uint32_t, HttpTransactionTracker*> m_Trackers;
+
+	bool isHttpConnection(const pcpp::ConnectionData& connData) const;
+
+	static void onMessageReady(int side, const pcpp::TcpStreamData& tcpData, void* userCookie);
+	static void onConnectionEnd(const pcpp::ConnectionData& connData, pcpp::TcpReassembly::ConnectionEndReason reason, void* userCookie);
+	static void onStreamGap(int side, const pcpp::ConnectionData& connData, uint32_t missingDataLen, void* userCookie);
+	static void onTransactionComplete(const HttpTransaction& transaction, void* userCookie);
+
+	// the extractor owns the trackers, prevent copies
+	TransactionExtractor(const TransactionExtractor& other);
+	TransactionExtractor& operator=(const TransactionExtractor& other);
+};
+
+#endif /* HTTPECHO_TRANSACTION_EXTRACTOR */
@@ -0,0 +1,311 @@
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "WebSocketDecoder.h"
+
+
+WebSocketDecoder::WebSocketDecoder(OnWebSocketMessage onMessage, void* userCookie, size_t maxMessageLen)
+{
+	numOfFrames = 0;
+	numOfMessages = 0;
+	numOfTruncatedMessages = 0;
+	numOfProtocolErrors = 0;
+
+	m_OnMessage = onMessage;
+	m_UserCookie = userCookie;
+	m_MaxMessageLen = maxMessageLen;
+
+	for (int side = 0; side < 2; side++)
+	{
+		FrameParser& parser = m_Parsers[side];
+		parser.state = FrameHeader;
+		parser.frameHeaderLen = 0;
+		parser.opcode = 0;
+		parser.isFinal = false;
+		parser.isMasked = false;
+		parser.payloadLen = 0;
+		parser.payloadRemaining = 0;
+		parser.inMessage = false;
+		parser.messagePayloadLost = false;
+		parser.controlLen = 0;
+		parser.controlFlags = 0;
+		parser.lastByteTime.tv_sec = 0;
+		parser.lastByteTime.tv_usec = 0;
+	}
+}
+
+
+void WebSocketDecoder::unmask(uint8_t* data, size_t dataLen, const uint8_t* maskKey, uint64_t maskOffset)
+{
+	// the key rotated to line up with data[0], then repeated to the width of the XOR
+	uint8_t key[4];
+	for (int i = 0; i < 4; i++)
+		key[i] = maskKey[(maskOffset + i) & 3];
+
+	uint32_t key32;
+	memcpy(&key32, key, sizeof(key32));
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	__m128i key128 = _mm_set1_epi32((int)key32);
+	for (; i + 16 <= dataLen; i += 16)
+	{
+		__m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+		_mm_storeu_si128((__m128i*)(data + i), _mm_xor_si128(block, key128));
+	}
+#endif
+
+	uint64_t key64 = ((uint64_t)key32 << 32) | key32;
+	for (; i + 8 <= dataLen; i += 8)
+	{
+		uint64_t block;
+		memcpy(&block, data + i, sizeof(block));
+		block ^= key64;
+		memcpy(data + i, &block, sizeof(block));
+	}
+
+	for (; i < dataLen; i++)
+		data[i] ^= key[i & 3];
+}
+
+
+size_t WebSocketDecoder::getFrameHeaderLen(const FrameParser& parser) const
+{
+	// the 7-bit length is followed by a 16-bit length if it's 126 and by a 64-bit length if it's 127
+	uint8_t shortLen = parser.frameHeader[1] & 0x7f;
+	size_t headerLen = 2 + (shortLen == 126 ? 2 : (shortLen == 127 ? 8 : 0));
+	if (parser.frameHeader[1] & 0x80)
+		headerLen += 4;
+	return headerLen;
+}
+
+
+void WebSocketDecoder::setLost(FrameParser& parser)
+{
+	parser.state = Lost;
+	parser.inMessage = false;
+}
+
+
+void WebSocketDecoder::handleFrameHeader(int side, FrameParser& parser)
+{
+	const uint8_t* header = parser.frameHeader;
+	size_t headerLen = getFrameHeaderLen(parser);
+	bool isCompressed = (header[0] & 0x40) != 0;
+	parser.isFinal = (header[0] & 0x80) != 0;
+	parser.opcode = header[0] & 0x0f;
+	parser.isMasked = (header[1] & 0x80) != 0;
+
+	uint8_t shortLen = header[1] & 0x7f;
+	if (shortLen < 126)
+		parser.payloadLen = shortLen;
+	else
+	{
+		parser.payloadLen = 0;
+		for (size_t i = 2; i < (shortLen == 126 ? 4U : 10U); i++)
+			parser.payloadLen = (parser.payloadLen << 8) | header[i];
+	}
+
+	if (parser.isMasked)
+		memcpy(parser.maskKey, header + headerLen - 4, 4);
+
+	parser.payloadRemaining = parser.payloadLen;
+	parser.frameHeaderLen = 0;
+	parser.state = FramePayload;
+	numOfFrames++;
+
+	if (isControlFrame(parser))
+	{
+		if (!parser.isFinal || parser.payloadLen > WEBSOCKET_MAX_CONTROL_PAYLOAD_LEN)
+		{
+			numOfProtocolErrors++;
+			setLost(parser);
+			return;
+		}
+
+		parser.controlLen = 0;
+		parser.controlFlags = 0;
+		return;
+	}
+
+	// a continuation frame adds to the message in progress, any other data frame starts a new one
+	if (parser.opcode == WEBSOCKET_OPCODE_CONTINUATION && parser.inMessage)
+		return;
+
+	if (parser.inMessage)
+		numOfProtocolErrors++;
+
+	parser.inMessage = true;
+	parser.messagePayloadLost = false;
+	parser.messageData.clear();
+	parser.message.side = side;
+	parser.message.opcode = parser.opcode;
+	parser.message.flags = (isCompressed ? WEBSOCKET_MESSAGE_COMPRESSED : 0);
+	parser.message.messageLen = 0;
+	parser.message.firstByteTime = parser.frameStartTime;
+
+	// the decoder started in the middle of a fragmented message, its beginning is missing
+	if (parser.opcode == WEBSOCKET_OPCODE_CONTINUATION)
+		parser.message.flags |= WEBSOCKET_MESSAGE_INCOMPLETE;
+}
+
+
+void WebSocketDecoder::handleFramePayload(FrameParser& parser, const uint8_t* data, size_t dataLen)
+{
+	uint64_t payloadOffset = parser.payloadLen - parser.payloadRemaining;
+
+	if (isControlFrame(parser))
+	{
+		if (parser.controlFlags & WEBSOCKET_MESSAGE_INCOMPLETE)
+			return;
+
+		memcpy(parser.controlData + parser.controlLen, data, dataLen);
+		if (parser.isMasked)
+			unmask(parser.controlData + parser.controlLen, dataLen, parser.maskKey, payloadOffset);
+		parser.controlLen += dataLen;
+		return;
+	}
+
+	parser.message.messageLen += dataLen;
+	if (parser.messagePayloadLost)
+		return;
+
+	size_t toKeep = m_MaxMessageLen - parser.messageData.size();
+	if (toKeep < dataLen)
+		parser.message.flags |= WEBSOCKET_MESSAGE_TRUNCATED;
+	else
+		toKeep = dataLen;
+
+	if (toKeep == 0)
+		return;
+
+	size_t keptLen = parser.messageData.size();
+	parser.messageData.insert(parser.messageData.end(), data, data + toKeep);
+	if (parser.isMasked)
+		unmask(&parser.messageData[keptLen], toKeep, parser.maskKey, payloadOffset);
+}
+
+
+void WebSocketDecoder::handleFrameEnd(int side, FrameParser& parser, const timeval& timestamp)
+{
+	if (isControlFrame(parser))
+	{
+		WebSocketMessage message;
+		message.side = side;
+		message.opcode = parser.opcode;
+		message.flags = parser.controlFlags;
+		message.payload = parser.controlData;
+		message.payloadLen = parser.controlLen;
+		message.messageLen = parser.payloadLen;
+		message.firstByteTime = parser.frameStartTime;
+		message.lastByteTime = timestamp;
+		numOfMessages++;
+		m_OnMessage(message, m_UserCookie);
+		return;
+	}
+
+	if (!parser.isFinal)
+		return;
+
+	WebSocketMessage& message = parser.message;
+	message.payload = (parser.messageData.empty() ? NULL : &parser.messageData[0]);
+	message.payloadLen = parser.messageData.size();
+	message.lastByteTime = timestamp;
+	parser.inMessage = false;
+
+	if (message.flags & WEBSOCKET_MESSAGE_TRUNCATED)
+		numOfTruncatedMessages++;
+	numOfMessages++;
+	m_OnMessage(message, m_UserCookie);
+}
+
+
+void WebSocketDecoder::feed(int side, const uint8_t* data, size_t dataLen, const timeval& timestamp)
+{
+	FrameParser& parser = m_Parsers[side];
+	parser.lastByteTime = timestamp;
+
+	while (dataLen > 0)
+	{
+		size_t consumed = 0;
+
+		switch (parser.state)
+		{
+		case FrameHeader:
+		{
+			// a message is timed from the packet which carried the first byte of its first frame
+			if (parser.frameHeaderLen == 0)
+				parser.frameStartTime = timestamp;
+
+			// the first 2 bytes tell how long the rest of the header is
+			size_t headerLen = (parser.frameHeaderLen < 2 ? 2 : getFrameHeaderLen(parser));
+			consumed = headerLen - parser.frameHeaderLen;
+			if (consumed > dataLen)
+				consumed = dataLen;
+			memcpy(parser.frameHeader + parser.frameHeaderLen, data, consumed);
+			parser.frameHeaderLen += consumed;
+			if (parser.frameHeaderLen < 2 || parser.frameHeaderLen < getFrameHeaderLen(parser))
+				break;
+
+			handleFrameHeader(side, parser);
+			if (parser.state == FramePayload && parser.payloadRemaining == 0)
+			{
+				parser.state = FrameHeader;
+				handleFrameEnd(side, parser, timestamp);
+			}
+			break;
+		}
+
+		case FramePayload:
+		{
+			consumed = (dataLen < parser.payloadRemaining ? dataLen : (size_t)parser.payloadRemaining);
+			handleFramePayload(parser, data, consumed);
+			parser.payloadRemaining -= consumed;
+			if (parser.payloadRemaining == 0)
+			{
+				parser.state = FrameHeader;
+				handleFrameEnd(side, parser, timestamp);
+			}
+			break;
+		}
+
+		case Lost:
+			return;
+		}
+
+		data += consumed;
+		dataLen -= consumed;
+	}
+}
+
+
+void WebSocketDecoder::skipMissingData(int side, uint32_t missingDataLen)
+{
+	FrameParser& parser = m_Parsers[side];
+	if (parser.state == Lost)
+		return;
+
+	// the hole is inside a frame's payload - skip it and stay in sync
+	if (parser.state == FramePayload && missingDataLen <= parser.payloadRemaining)
+	{
+		if (isControlFrame(parser))
+			parser.controlFlags |= WEBSOCKET_MESSAGE_INCOMPLETE;
+		else
+		{
+			parser.message.flags |= WEBSOCKET_MESSAGE_INCOMPLETE;
+			parser.message.messageLen += missingDataLen;
+			parser.messagePayloadLost = true;
+		}
+
+		parser.payloadRemaining -= missingDataLen;
+		if (parser.payloadRemaining == 0)
+		{
+			parser.state = FrameHeader;
+			handleFrameEnd(side, parser, parser.lastByteTime);
+		}
+		return;
+	}
+
+	setLost(parser);
+}
@@ -0,0 +1,170 @@
+#ifndef HTTPECHO_WEBSOCKET_DECODER
+#define HTTPECHO_WEBSOCKET_DECODER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include <vector>
+
+// the part of a message which is kept for the message record, the rest of a longer message is only counted
+#define DEFAULT_WEBSOCKET_MAX_MESSAGE_LEN (1024 * 1024)
+
+// the longest frame header: 2 bytes, a 64-bit extended length and the masking key
+#define WEBSOCKET_MAX_FRAME_HEADER_LEN 14
+
+// control frames (close, ping, pong) carry at most 125 bytes and are never fragmented
+#define WEBSOCKET_MAX_CONTROL_PAYLOAD_LEN 125
+
+// opcodes (RFC 6455 section 5.2)
+#define WEBSOCKET_OPCODE_CONTINUATION 0x0
+#define WEBSOCKET_OPCODE_TEXT 0x1
+#define WEBSOCKET_OPCODE_BINARY 0x2
+#define WEBSOCKET_OPCODE_CLOSE 0x8
+#define WEBSOCKET_OPCODE_PING 0x9
+#define WEBSOCKET_OPCODE_PONG 0xa
+
+// message flags
+#define WEBSOCKET_MESSAGE_TRUNCATED 0x01	// longer than the max message length, the payload is cut
+#define WEBSOCKET_MESSAGE_COMPRESSED 0x02	// RSV1 was set on the first frame (permessage-deflate), the payload is still compressed
+#define WEBSOCKET_MESSAGE_INCOMPLETE 0x04	// bytes of the message were lost in a stream hole, the payload ends where they went missing
+
+
+/**
+ * @struct WebSocketMessage
+ * A complete message, as handed to the OnWebSocketMessage callback. The payload is unmasked and owned by the decoder, it's only valid during the
+ * callback
+ */
+struct WebSocketMessage
+{
+	// the side of the connection (0 or 1) which sent the message
+	int side;
+
+	// the opcode of the message's first frame
+	uint8_t opcode;
+
+	// WEBSOCKET_MESSAGE_* flags
+	uint8_t flags;
+
+	// the kept payload, and the length of the whole message
+	const uint8_t* payload;
+	size_t payloadLen;
+	uint64_t messageLen;
+
+	// the capture time of the first byte of the message's first frame and of the last byte of its last frame
+	timeval firstByteTime;
+	timeval lastByteTime;
+};
+
+
+/**
+ * @typedef OnWebSocketMessage
+ * A callback invoked by WebSocketDecoder for every complete message, control messages included
+ * @param[in] message The message
+ * @param[in] userCookie The cookie given to the decoder
+ */
+typedef void (*OnWebSocketMessage)(const WebSocketMessage& message, void* userCookie);
+
+
+/**
+ * Decodes the WebSocket (RFC 6455) frames of both sides of an upgraded connection as they stream in. Payloads are unmasked in place with a
+ * vectorized XOR, fragmented messages are put back together (control frames in between them are delivered on their own) and every complete
+ * message is handed to a callback with its timestamps. A hole inside a frame's payload is skipped and marks the message incomplete, any other hole
+ * loses the frame boundaries, so nothing more is decoded on that side
+ */
+class WebSocketDecoder
+{
+public:
+
+	/**
+	 * A c'tor for this class
+	 * @param[in] onMessage The callback to invoke for every complete message
+	 * @param[in] userCookie A cookie passed to the callback
+	 * @param[in] maxMessageLen The part of a message which is kept for the callback
+	 */
+	WebSocketDecoder(OnWebSocketMessage onMessage, void* userCookie, size_t maxMessageLen = DEFAULT_WEBSOCKET_MAX_MESSAGE_LEN);
+
+	/**
+	 * Feed the next chunk of stream data from one side of the connection
+	 * @param[in] side The side of the connection (0 or 1)
+	 * @param[in] data The stream data
+	 * @param[in] dataLen The stream data length
+	 * @param[in] timestamp The capture time of the packet which carried the data
+	 */
+	void feed(int side, const uint8_t* data, size_t dataLen, const timeval& timestamp);
+
+	/**
+	 * Report that data is missing from one side's stream
+	 * @param[in] side The side of the connection (0 or 1)
+	 * @param[in] missingDataLen The number of bytes missing
+	 */
+	void skipMissingData(int side, uint32_t missingDataLen);
+
+	/**
+	 * XOR data with a masking key, 16 bytes at a time where SSE2 is available and 8 bytes at a time otherwise
+	 * @param[in,out] data The data to unmask
+	 * @param[in] dataLen The data length
+	 * @param[in] maskKey The frame's masking key
+	 * @param[in] maskOffset The offset of the data within the frame's payload, which selects the key byte data[0] is XORed with
+	 */
+	static void unmask(uint8_t* data, size_t dataLen, const uint8_t* maskKey, uint64_t maskOffset);
+
+	// stats: frames and messages decoded, messages cut at the max message length and frames which broke the protocol
+	uint32_t numOfFrames;
+	uint32_t numOfMessages;
+	uint32_t numOfTruncatedMessages;
+	uint32_t numOfProtocolErrors;
+
+private:
+
+	enum ParserState
+	{
+		FrameHeader,
+		FramePayload,
+		// lost the frame boundaries, nothing more is decoded on this side
+		Lost
+	};
+
+	/**
+	 * The streaming decoder state of one direction
+	 */
+	struct FrameParser
+	{
+		ParserState state;
+		uint8_t frameHeader[WEBSOCKET_MAX_FRAME_HEADER_LEN];
+		size_t frameHeaderLen;
+		uint8_t opcode;
+		bool isFinal;
+		bool isMasked;
+		uint8_t maskKey[4];
+		uint64_t payloadLen;
+		uint64_t payloadRemaining;
+		timeval frameStartTime;
+
+		// the data message being put together from its frames. After a hole nothing more of it is kept
+		bool inMessage;
+		bool messagePayloadLost;
+		WebSocketMessage message;
+		std::vector<uint8_t> messageData;
+
+		// the payload of the current control frame
+		uint8_t controlData[WEBSOCKET_MAX_CONTROL_PAYLOAD_LEN];
+		size_t controlLen;
+		uint8_t controlFlags;
+
+		timeval lastByteTime;
+	};
+
+	OnWebSocketMessage m_OnMessage;
+	void* m_UserCookie;
+	size_t m_MaxMessageLen;
+	FrameParser m_Parsers[2];
+
+	bool isControlFrame(const FrameParser& parser) const { return (parser.opcode & 0x08) != 0; }
+	size_t getFrameHeaderLen(const FrameParser& parser) const;
+	void handleFrameHeader(int side, FrameParser& parser);
+	void handleFramePayload(FrameParser& parser, const uint8_t* data, size_t dataLen);
+	void handleFrameEnd(int side, FrameParser& parser, const timeval& timestamp);
+	void setLost(FrameParser& parser);
+};
+
+#endif /* HTTPECHO_WEBSOCKET_DECODER */
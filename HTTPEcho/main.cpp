@@ -1,10 +1,15 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <signal.h>
+#include <strings.h>
 #include <map>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <vector>
+#include <mutex>
+#include <thread>
 #include "header/TcpReassembly.h"
 #include "header/PcapLiveDeviceList.h"
 #include "header/PcapFileDevice.h"
@@ -12,6 +17,26 @@
 #include "header/SystemUtils.h"
 #include "header/PcapPlusPlusVersion.h"
 #include "header/LRUList.h"
+#include "IPDefragmenter.h"
+#include "TcpStreamReassembly.h"
+#include "TlsMetadata.h"
+#include "HttpTransactionTracker.h"
+#include "Http2TransactionTracker.h"
+#include "WebSocketDecoder.h"
+#include "PassiveDnsCache.h"
+#include "TrafficStats.h"
+#include "TransactionExport.h"
+#include "PacketBufferPool.h"
+#include "CaptureMerger.h"
+#include "FlightRecorder.h"
+#include "PatternMatcher.h"
+#include "CpuTopology.h"
+#include "BodyCapturePolicy.h"
+#include "RedactionPolicy.h"
+#include "DpdkCapture.h"
+#include "ReassemblyBenchmark.h"
+#include "ReplayCoordinator.h"
+#include "ReplayWorker.h"
 #include <getopt.h>
 
 using namespace pcpp;
@@ -21,6 +46,115 @@ using namespace pcpp;
 #define DEFAULT_MAX_NUMBER_OF_CONCURRENT_OPEN_FILES 500
 
 
+// the port HTTP traffic is captured on
+#define DEFAULT_HTTP_PORT 80
+
+// the WebSocket message records of a connection are written to its .ws file once they add up to this size, and when the connection ends
+#define WEBSOCKET_RECORDS_FLUSH_SIZE (64 * 1024)
+
+
+#define EXIT_WITH_ERROR(reason, ...) do { \
+	printf("\nError: " reason "\n\n", ## __VA_ARGS__); \
+	printUsage(); \
+	exit(1); \
+	} while(0)
+
+
+static struct option HttpEchoOptions[] =
+{
+	{"interface",  required_argument, 0, 'i'},
+	{"read-file", required_argument, 0, 'r'},
+	{"output-dir", required_argument, 0, 'o'},
+	{"write-to-console", no_argument, 0, 'c'},
+	{"max-file-desc", required_argument, 0, 'f'},
+	{"dpdk-port", required_argument, 0, 'd'},
+	{"dpdk-workers", required_argument, 0, 'w'},
+	{"rss-check", no_argument, 0, 'S'},
+	{"benchmark", required_argument, 0, 'b'},
+	{"snapshot-interval", required_argument, 0, 's'},
+	{"capture-cores", required_argument, 0, 'p'},
+	{"main-core", required_argument, 0, 'm'},
+	{"body-policy", required_argument, 0, 'k'},
+	{"redact", required_argument, 0, 'x'},
+	{"flight-recorder", required_argument, 0, 'R'},
+	{"error-trigger", required_argument, 0, 'E'},
+	{"patterns", required_argument, 0, 'M'},
+	{"caseless", no_argument, 0, 'N'},
+	{"matched-only", no_argument, 0, 'O'},
+	{"turn-index", no_argument, 0, 't'},
+	{"replay", required_argument, 0, 'P'},
+	{"replay-target", required_argument, 0, 'T'},
+	{"replay-workers", required_argument, 0, 'W'},
+	{"replay-connections", required_argument, 0, 'C'},
+	{"replay-duration", required_argument, 0, 'D'},
+	{"replay-connection-timing", no_argument, 0, 'F'},
+	{"replay-arrivals", required_argument, 0, 'A'},
+	{"verify-responses", no_argument, 0, 'V'},
+	{"verify-ignore-headers", required_argument, 0, 'I'},
+	{"help", no_argument, 0, 'h'},
+	{0, 0, 0, 0}
+};
+
+
+/**
+ * Print application usage
+ */
+void printUsage()
+{
+	printf("\nUsage:\n"
+			"------\n"
+			"%s [-i interface_ip[,...] | -r pcap_file[,...]] [-o output_dir] [-c] [-f max_files] [-d dpdk_port [-w num_of_workers] [-S]] [-p core_list] [-m core] [-k body_policy] [-x redaction_policy] [-R size_mb[:seconds] [-E errors:seconds]] [-M patterns_file [-N] [-O]] [-t] [-s seconds] [-b pcap_file] [-h]\n"
+			"%s -P capture_dir -T host:port [-W num_of_workers] [-C connections] [-D seconds] [-F | -A arrivals] [-V [-I headers]] [-o output_dir] [-p core_list]\n"
+			"\nOptions:\n\n"
+			"    -i interface_ip : IP address of the interface to capture on. Several comma separated interfaces are captured at the same time and\n"
+			"                      their packets are merged by timestamp into one pipeline\n"
+			"    -r pcap_file    : Read capture files instead of capturing live. Several comma separated files are merged by timestamp\n"
+			"    -o output_dir   : The directory to write capture files to (default: captureFiles)\n"
+			"    -c              : Write captured data to console instead of files\n"
+			"    -f max_files    : Max number of files open at the same time (default: %d)\n"
+			"    -d dpdk_port    : Capture from this DPDK port instead of a libpcap interface (requires a DPDK build)\n"
+			"    -w num_workers  : Number of DPDK RX queues, each handled by its own reassembly worker on cores 1..num_workers (default: 1)\n"
+			"    -S              : Check that the NIC puts every packet on the DPDK worker the software RSS hash picks, and report the packets it\n"
+			"                      doesn't. Hashes every packet a second time, so it's meant for validating a NIC setup\n"
+			"    -p core_list    : Pin the capture thread (libpcap) or the DPDK workers, one per listed core, to these cores, e.g. 2,4-7. Each pipeline's\n"
+			"                      memory is allocated on the NUMA node of its core (default: not pinned, DPDK workers on cores 1..num_workers).\n"
+			"                      When packets are merged, the first core runs the merge and the pipeline and the next ones the interfaces' capture threads\n"
+			"    -m core         : Pin the main thread, which writes the reports (and is DPDK's master core), to this core (default: not pinned / core 0)\n"
+			"    -k body_policy  : Limit the body bytes written per direction and content type, as comma separated direction:content-type:max-bytes\n"
+			"                      rules, e.g. request:*:64K,response:image/*:0 (default: bodies are written whole)\n"
+			"    -x redaction    : Redact header and query parameter values in the capture files, as comma separated header:name[:mask|hash] and\n"
+			"                      query:name[:mask|hash] rules. 'default' stands for the Cookie, Set-Cookie, Authorization and Proxy-Authorization headers\n"
+			"    -R size_mb[:sec]: Keep the last packets captured in a flight recorder of this many MB (split between the pipelines), at most sec seconds of\n"
+			"                      them if given. SIGUSR1 dumps them to a pcap-ng file in the output dir while the capture goes on\n"
+			"    -E errors:sec   : Also dump the flight recorder when more than this many HTTP 5xx responses are seen within sec seconds (up to %d)\n"
+			"    -M patterns_file: Look for the literal patterns of this file (one per line, as label<TAB>pattern) in the HTTP streams. Matches are\n"
+			"                      written to pattern_matches.tsv and counted in the transaction export\n"
+			"    -N              : Match the patterns regardless of letter case\n"
+			"    -O              : Only write the capture files of connections a pattern matched in\n"
+			"    -t              : Write a turn index (.turns) next to each capture file, with the capture times of each side's turns, so a\n"
+			"                      replay can keep the connection's timing\n"
+			"    -s seconds      : Rewrite the HTTP latency and traffic statistics reports every this many seconds while capturing (default: only at exit)\n"
+			"    -b pcap_file    : Benchmark packet decoding and TCP reassembly (per packet and in bursts) on the packets of a capture file and exit\n"
+			"    -P capture_dir  : Replay the HTTP requests of the capture files of this directory (written by an earlier capture) and exit\n"
+			"    -T host:port    : The server to replay to\n"
+			"    -W num_workers  : Number of replay worker processes, the captured connections are split between them (default: 1, up to %d).\n"
+			"                      With -p, worker i is pinned to the i-th listed core\n"
+			"    -C connections  : Number of connections each replay worker keeps to the server (default: %d)\n"
+			"    -D seconds      : Replay the requests over and over for this many seconds (default: once). With -F, stop after this many seconds\n"
+			"    -F              : Replay each captured connection on a connection of its own, with the captured start times and think times\n"
+			"                      (taken from the turn indexes, see -t) instead of over a pool of connections. -C is ignored\n"
+			"    -A arrivals     : Send the pooled requests open loop, on a schedule rather than when a connection is free, and measure the latency\n"
+			"                      from the scheduled times: 'captured' (the captured send times, needs turn indexes), 'poisson:<requests/s>'\n"
+			"                      or 'rate:<requests/s>' (for all workers together)\n"
+			"    -V              : Compare each replayed response with the captured one (status, headers and body) and write the differences\n"
+			"                      to replay_diffs.tsv in the output dir\n"
+			"    -I headers      : The headers -V doesn't compare, comma separated (default: %s)\n"
+			"    -h              : Display this help message and exit\n\n", AppName::get().c_str(), AppName::get().c_str(),
+			DEFAULT_MAX_NUMBER_OF_CONCURRENT_OPEN_FILES, FLIGHT_RECORDER_MAX_ERROR_WINDOW_SEC, REPLAY_MAX_WORKERS, REPLAY_DEFAULT_CONNECTIONS,
+			VERIFY_DEFAULT_IGNORED_HEADERS);
+}
+
+
 /**
  * This class contains all the flags indicated by the user
  */
@@ -31,11 +165,44 @@ private:
 	/**
 	 * A private constructor
 	 */
-	GlobalConfig() { outputDir = ""; writeToConsole = false; separateSides = false; maxOpenFiles = DEFAULT_MAX_NUMBER_OF_CONCURRENT_OPEN_FILES; m_RecentConnsWithActivity = NULL; }
+	GlobalConfig() { outputDir = ""; writeToConsole = false; separateSides = false; maxOpenFiles = DEFAULT_MAX_NUMBER_OF_CONCURRENT_OPEN_FILES; tlsPort = DEFAULT_TLS_PORT; snapshotInterval = 0; flightRecorderSize = 0; flightRecorderMaxAge = 0; errorTriggerCount = 0; errorTriggerWindow = 0; patternMatcher = NULL; captureMatchedOnly = false; writeTurnIndex = false; m_TlsRecordStream = NULL; m_TransactionStream = NULL; m_PatternMatchStream = NULL; }
 
-	// A least-recently-used (LRU) list of all connections seen so far. Each connection is represented by its flow key. This LRU list is used to decide which connection was seen least
-	// recently in case we reached max number of open file descriptors and we need to decide which files to close
-	LRUList<uint32_t>* m_RecentConnsWithActivity;
+	// the stream TLS metadata records are written to. All TLS connections (of all capture workers) share one file
+	std::ostream* m_TlsRecordStream;
+
+	// the stream HTTP transactions are exported to, shared by all capture workers like the TLS records
+	std::ostream* m_TransactionStream;
+
+	// the stream payload pattern matches are written to, shared the same way
+	std::ostream* m_PatternMatchStream;
+
+	// serializes writes to the shared record streams when several capture workers are running
+	std::mutex m_RecordStreamMutex;
+
+
+	/**
+	 * Return the stream TLS metadata records are written to. The file is opened on first use
+	 */
+	std::ostream* getTlsRecordStream()
+	{
+		if (m_TlsRecordStream == NULL)
+			m_TlsRecordStream = openFileStream(getOutputFilePath("tls_metadata.tsv"), true);
+
+		return m_TlsRecordStream;
+	}
+
+
+	/**
+	 * Return the path of a file in the output directory
+	 */
+	std::string getOutputFilePath(const char* fileName)
+	{
+		std::stringstream stream;
+		if (outputDir != "")
+			stream << outputDir << '/';
+		stream << fileName;
+		return stream.str();
+	}
 
 public:
 
@@ -51,6 +218,34 @@ public:
 	// max number of allowed open files in each point in time
 	size_t maxOpenFiles;
 
+	// connections on this port are handled as TLS: their hello messages are summarized into TLS metadata records instead of being written to files
+	uint16_t tlsPort;
+
+	// every how many seconds the reports are rewritten during the capture, 0 means only when the capture ends
+	uint32_t snapshotInterval;
+
+	// the memory of the flight recorder in bytes (0 turns it off) and the max age of the packets it dumps in seconds (0 for no limit)
+	size_t flightRecorderSize;
+	uint32_t flightRecorderMaxAge;
+
+	// the flight recorder is dumped when more than this many HTTP 5xx responses are seen within this many seconds (a window of 0 turns it off)
+	uint32_t errorTriggerCount;
+	uint32_t errorTriggerWindow;
+
+	// how many body bytes of each HTTP message are written to the capture files
+	BodyCapturePolicy bodyPolicy;
+
+	// which header and query parameter values are redacted in the capture files
+	RedactionPolicy redactionPolicy;
+
+	// the payload patterns HTTP streams are scanned for (NULL if there are none), and whether only the capture files of connections one of them
+	// matched in are written
+	PatternMatcher* patternMatcher;
+	bool captureMatchedOnly;
+
+	// whether each capture file gets a turn index with the capture times of its data
+	bool writeTurnIndex;
+
 
 	/**
 	 * A method getting connection parameters as input and returns a filename and file path as output.
@@ -114,15 +309,85 @@ public:
 
 
 	/**
-	 * Return a pointer to the least-recently-used (LRU) list of connections
+	 * Write a TLS metadata record, with the name the server's address was resolved from. Safe to call from several capture workers at the same time
+	 */
+	void writeTlsRecord(const ConnectionData& connData, const TlsMetadata& metadata, const char* dnsName)
+	{
+		std::lock_guard<std::mutex> lock(m_RecordStreamMutex);
+		writeTlsMetadataRecord(*getTlsRecordStream(), connData, metadata, tlsPort, dnsName);
+	}
+
+
+	/**
+	 * Append a batch of HTTP transactions to the columnar export file as one record group. The file is created (replacing a previous one) on first
+	 * use. Safe to call from several capture workers at the same time
+	 */
+	void writeTransactionGroup(const TransactionColumnBatch& batch)
+	{
+		if (writeToConsole || batch.getNumOfRows() == 0)
+			return;
+
+		// encode outside the lock, the workers only serialize on the file write
+		std::string group;
+		batch.encode(group);
+
+		std::lock_guard<std::mutex> lock(m_RecordStreamMutex);
+		if (m_TransactionStream == NULL)
+		{
+			m_TransactionStream = openFileStream(getOutputFilePath("http_transactions.hcol"), false);
+			std::string fileHeader;
+			TransactionColumnBatch::encodeFileHeader(fileHeader);
+			m_TransactionStream->write(fileHeader.data(), fileHeader.size());
+		}
+
+		m_TransactionStream->write(group.data(), group.size());
+		m_TransactionStream->flush();
+	}
+
+
+	/**
+	 * Write a payload pattern match record: capture time, client IP and port, server IP and port, the server's DNS name, direction (request or
+	 * response), the stream offset right after the match and the pattern's label. Safe to call from several capture workers at the same time
+	 */
+	void writePatternMatch(const ConnectionData& connData, int clientSide, int sideIndex, uint64_t endOffset, const char* label, const char* serverName)
+	{
+		const IPAddress* clientIP = (clientSide == 0 ? connData.srcIP : connData.dstIP);
+		const IPAddress* serverIP = (clientSide == 0 ? connData.dstIP : connData.srcIP);
+		char timestamp[32];
+		snprintf(timestamp, sizeof(timestamp), "%ld.%06ld", (long)connData.endTime.tv_sec, (long)connData.endTime.tv_usec);
+
+		// format outside the lock, like the transaction groups
+		std::stringstream record;
+		record << timestamp << '\t' << (clientIP != NULL ? clientIP->toString() : "") << '\t' << (clientSide == 0 ? connData.srcPort : connData.dstPort)
+			<< '\t' << (serverIP != NULL ? serverIP->toString() : "") << '\t' << (clientSide == 0 ? connData.dstPort : connData.srcPort)
+			<< '\t' << serverName << '\t' << (sideIndex == clientSide ? "request" : "response") << '\t' << endOffset << '\t' << label << '\n';
+
+		std::lock_guard<std::mutex> lock(m_RecordStreamMutex);
+		if (m_PatternMatchStream == NULL)
+			m_PatternMatchStream = openFileStream(getOutputFilePath("pattern_matches.tsv"), false);
+		*m_PatternMatchStream << record.str();
+	}
+
+
+	/**
+	 * Write the HTTP latency report (replacing the previous one)
 	 */
-	LRUList<uint32_t>* getRecentConnsWithActivity()
+	void writeLatencyReport(const HttpLatencyTable& latencyTable)
 	{
-		if (m_RecentConnsWithActivity == NULL)
-			m_RecentConnsWithActivity = new LRUList<uint32_t>(maxOpenFiles);
+		std::ostream* reportStream = openFileStream(getOutputFilePath("http_latency.tsv"), false);
+		latencyTable.writeReport(*reportStream);
+		closeFileSteam(reportStream);
+	}
+
 
-		// return the pointer
-		return m_RecentConnsWithActivity;
+	/**
+	 * Write the traffic statistics report (replacing the previous one)
+	 */
+	void writeTrafficStatsReport(const TrafficStats& trafficStats)
+	{
+		std::ostream* reportStream = openFileStream(getOutputFilePath("traffic_stats.tsv"), false);
+		trafficStats.writeReport(*reportStream);
+		closeFileSteam(reportStream);
 	}
 
 
@@ -140,11 +405,71 @@ public:
 	 */
 	~GlobalConfig()
 	{
-		delete m_RecentConnsWithActivity;
+		if (m_TlsRecordStream != NULL)
+			closeFileSteam(m_TlsRecordStream);
+		if (m_TransactionStream != NULL)
+			closeFileSteam(m_TransactionStream);
+		if (m_PatternMatchStream != NULL)
+			closeFileSteam(m_PatternMatchStream);
+		delete patternMatcher;
 	}
 };
 
 
+// why data is missing from a capture file: it was never captured, the body capture policy left it out, it came before the first pattern
+// match of a connection captured in matched-only mode, or it's an HTTP/2 header block the redaction policy couldn't redact in place
+#define STREAM_GAP_LOST 0
+#define STREAM_GAP_TRUNCATED 1
+#define STREAM_GAP_UNMATCHED 2
+#define STREAM_GAP_REDACTED 3
+
+
+/**
+ * A hole in the data of a capture file, kept instead of writing any marker into the file itself
+ */
+struct StreamGap
+{
+	// the offset in the capture file where the missing data belongs
+	uint64_t fileOffset;
+
+	// the number of bytes missing
+	uint32_t missingBytes;
+
+	// the side of the connection the data is missing from
+	uint8_t side;
+
+	// one of the STREAM_GAP_* reasons
+	uint8_t reason;
+};
+
+
+/**
+ * A stretch of a capture file written from one side without the other side writing in between, e.g. a request or a run of pipelined requests
+ */
+struct StreamTurn
+{
+	// the offset in the capture file where the turn starts
+	uint64_t fileOffset;
+
+	// the capture times of the packets which carried the turn's first and last bytes
+	timeval firstByteTime;
+	timeval lastByteTime;
+
+	// the side of the connection which wrote the turn
+	uint8_t side;
+};
+
+
+/**
+ * A payload pattern match found in a chunk of stream data
+ */
+struct PatternHit
+{
+	uint32_t patternId;
+	uint64_t endOffset;
+};
+
+
 /**
  * A struct to contain all data save on a specific connection. It contains the file streams to write to and also stats data on the connection
  */
@@ -164,10 +489,41 @@ struct TcpReassemblyData
 	int numOfMessagesFromSide[2];
 	int bytesFromSide[2];
 
+	// the TLS handshake parser, only allocated for connections on the TLS port
+	TlsHandshakeParser* tlsParser;
+
+	// a flag indicating whether the TLS metadata record of this connection was already written
+	bool tlsRecordWritten;
+
+	// holes in the connection's capture file(s), written to the gap index file when the connection ends
+	std::vector<StreamGap> gaps;
+
+	// the turns of the connection's capture file, written to the turn index file when the connection ends (only with -t)
+	std::vector<StreamTurn> turns;
+
+	// pairs the requests and responses of an HTTP connection and times them, allocated on the connection's first data
+	HttpTransactionTracker* httpTracker;
+
+	// does the same for a connection which speaks HTTP/2, allocated when the client sends the HTTP/2 connection preface
+	Http2TransactionTracker* http2Tracker;
+
+	// decodes the frames of a connection upgraded to WebSocket, allocated on the 101 response. Its message records wait in webSocketRecords
+	// until they're written to the connection's .ws file
+	WebSocketDecoder* webSocketDecoder;
+	std::string webSocketRecords;
+	bool webSocketFileWritten;
+
+	// the name the server's address was resolved from, looked up in the passive DNS cache when the connection starts (empty if it wasn't seen)
+	char serverName[DNS_CACHE_MAX_NAME_LEN + 1];
+
+	// where each side's stream is in the payload pattern automaton, and whether any pattern matched in the connection yet
+	PatternMatchState matchStates[2];
+	bool patternMatched;
+
 	/**
 	 * the default constructor
 	 */
-	TcpReassemblyData() { fileStreams[0] = NULL; fileStreams[1] = NULL; clear(); }
+	TcpReassemblyData() { fileStreams[0] = NULL; fileStreams[1] = NULL; tlsParser = NULL; httpTracker = NULL; http2Tracker = NULL; webSocketDecoder = NULL; clear(); }
 
 	/**
 	 * destructor
@@ -180,6 +536,11 @@ struct TcpReassemblyData
 
 		if (fileStreams[1] != NULL)
 			GlobalConfig::getInstance().closeFileSteam(fileStreams[1]);
+
+		delete tlsParser;
+		delete httpTracker;
+		delete http2Tracker;
+		delete webSocketDecoder;
 	}
 
 	/**
@@ -200,6 +561,24 @@ struct TcpReassemblyData
 			fileStreams[1] = NULL;
 		}
 
+		delete tlsParser;
+		tlsParser = NULL;
+		tlsRecordWritten = false;
+		gaps.clear();
+		turns.clear();
+		delete httpTracker;
+		httpTracker = NULL;
+		delete http2Tracker;
+		http2Tracker = NULL;
+		delete webSocketDecoder;
+		webSocketDecoder = NULL;
+		webSocketRecords.clear();
+		webSocketFileWritten = false;
+		serverName[0] = '\0';
+		matchStates[0] = PatternMatchState();
+		matchStates[1] = PatternMatchState();
+		patternMatched = false;
+
 		reopenFileStreams[0] = false;
 		reopenFileStreams[1] = false;
 		numOfDataPackets[0] = 0;
@@ -219,217 +598,1462 @@ typedef std::map<uint32_t, TcpReassemblyData>::iterator TcpReassemblyConnMgrIter
 
 
 /**
- * The callback being called by the TCP reassembly module whenever new data arrives on a certain connection
+ * The stages every captured packet goes through (IP defragmentation and then TCP reassembly) together with the connections they manage.
+ * Each capture worker owns one pipeline, so workers never share per-connection state. The pipeline is the user cookie of its TCP reassembly callbacks
  */
-static void tcpReassemblyMsgReadyCallback(int sideIndex, const TcpStreamData& tcpData, void* userCookie)
+struct PacketPipeline
 {
-	// extract the connection manager from the user cookie
-	TcpReassemblyConnMgr* connMgr = (TcpReassemblyConnMgr*)userCookie;
+	// the object which manages info on all connections of this pipeline
+	TcpReassemblyConnMgr connMgr;
 
-	// check if this flow already appears in the connection manager. If not add it
-	TcpReassemblyConnMgrIter iter = connMgr->find(tcpData.getConnectionData().flowKey);
-	if (iter == connMgr->end())
-	{
-		connMgr->insert(std::make_pair(tcpData.getConnectionData().flowKey, TcpReassemblyData()));
-		iter = connMgr->find(tcpData.getConnectionData().flowKey);
-	}
+	// A least-recently-used (LRU) list of all connections seen so far. Each connection is represented by its flow key. This LRU list is used to decide which connection was seen least
+	// recently in case we reached max number of open file descriptors and we need to decide which files to close
+	LRUList<uint32_t> recentConnsWithActivity;
 
-	int side;
+	// latency metrics of the HTTP transactions seen by this pipeline
+	HttpLatencyTable latencyTable;
 
-	// if the user wants to write each side in a different file - set side as the sideIndex, otherwise write everything to the same file ("side 0")
-	if (GlobalConfig::getInstance().separateSides)
-		side = sideIndex;
-	else
-		side = 0;
+	// top URIs / hosts and distinct clients seen by this pipeline
+	TrafficStats trafficStats;
 
-	// if the file stream on the relevant side isn't open yet (meaning it's the first data on this connection)
-	if (iter->second.fileStreams[side] == NULL)
-	{
-		// add the flow key of this connection to the list of open connections. If the return value isn't NULL it means that there are too many open files
-		// and we need to close the connection with least recently used file(s) in order to open a new one.
-		// The connection with the least recently used file is the return value
-		uint32_t flowKeyToCloseFiles;
-		int result = GlobalConfig::getInstance().getRecentConnsWithActivity()->put(tcpData.getConnectionData().flowKey, &flowKeyToCloseFiles);
+	// a copy of the metrics above which the main thread can read while the pipeline keeps running. Updated every snapshot interval
+	HttpLatencyTable publishedLatencyTable;
+	TrafficStats publishedTrafficStats;
+	std::mutex publishMutex;
+	time_t lastPublishTime;
 
-		// if result equals to 1 it means we need to close the open files in this connection (the one with the least recently used files)
-		if (result == 1)
-		{
-			// find the connection from the flow key
-			TcpReassemblyConnMgrIter iter2 = connMgr->find(flowKeyToCloseFiles);
-			if (iter2 != connMgr->end())
-			{
-				// close files on both sides (if they're open)
-				for (int index = 0; index < 2; index++)
-				{
-					if (iter2->second.fileStreams[index] != NULL)
-					{
-						// close the file
-						GlobalConfig::getInstance().closeFileSteam(iter2->second.fileStreams[index]);
-						iter2->second.fileStreams[index] = NULL;
+	// the HTTP transactions completed since the last record group was exported
+	TransactionColumnBatch transactionBatch;
 
-						// set the reopen flag to true to indicate that next time this file will be opened it will be opened in append mode (and not overwrite mode)
-						iter2->second.reopenFileStreams[index] = true;
-					}
-				}
-			}
-		}
+	// the core the thread running this pipeline should be pinned to (-1 if it isn't pinned), and whether that thread was pinned already
+	int coreId;
+	bool threadPinned;
 
-		// get the file name according to the 5-tuple etc.
-		std::string fileName = GlobalConfig::getInstance().getFileName(tcpData.getConnectionData(), sideIndex, GlobalConfig::getInstance().separateSides) + ".txt";
+	// this pipeline's share of the packet buffer pool, out-of-order TCP segments are kept in it
+	PacketBufferCache bufferCache;
 
-		// open the file in overwrite mode (if this is the first time the file is opened) or in append mode (if it was already opened before)
-		iter->second.fileStreams[side] = GlobalConfig::getInstance().openFileStream(fileName, iter->second.reopenFileStreams[side]);
+	// the passive DNS cache shared by all pipelines. Any of them feeds it the DNS responses it captures and labels its new connections from it
+	PassiveDnsCache* dnsCache;
+
+	// the flight recorder shared by all pipelines (NULL if it's off), and this pipeline's lane in it
+	FlightRecorder* flightRecorder;
+	int recorderLane;
+
+	// the IP defragmentation stage which runs ahead of TCP reassembly
+	IPDefragmenter ipDefragmenter;
+
+	// the TCP reassembly instance
+	TcpStreamReassembly tcpReassembly;
+
+	// scratch lists of the parts of a chunk of HTTP data the body capture policy drops (or, for HTTP/2, the redaction policy) and of the values
+	// the redaction policy replaces
+	std::vector<StreamSpan> droppedSpans;
+	std::vector<RedactedSpan> redactedSpans;
+
+	// scratch list of the payload pattern matches in a chunk of HTTP data
+	std::vector<PatternHit> patternHits;
+
+	// stats: payload pattern matches and the connections with at least one
+	uint64_t numOfPatternMatches;
+	uint64_t numOfMatchedConnections;
+
+	/**
+	 * A c'tor for this struct
+	 * @param[in] maxOpenFiles The max number of files this pipeline may keep open at the same time
+	 * @param[in] bufferPool The pool retained packet data is allocated from
+	 * @param[in] dnsCache The passive DNS cache
+	 * @param[in] flightRecorder The flight recorder to add a lane to, or NULL
+	 */
+	PacketPipeline(size_t maxOpenFiles, PacketBufferPool* bufferPool, PassiveDnsCache* dnsCache, FlightRecorder* flightRecorder);
+
+	/**
+	 * Export the pending HTTP transactions as a record group
+	 */
+	void flushTransactions()
+	{
+		GlobalConfig::getInstance().writeTransactionGroup(transactionBatch);
+		transactionBatch.clear();
 	}
 
-	// if this messages comes on a different side than previous message seen on this connection
-	if (sideIndex != iter->second.curSide)
+	/**
+	 * Copy the metrics to the published copy and export the pending transactions. Must be called from the thread which runs the pipeline
+	 * (or after it stopped)
+	 */
+	void publishSnapshot()
 	{
-		// count number of message in each side
-		iter->second.numOfMessagesFromSide[sideIndex]++;
+		flushTransactions();
 
-		// set side index as the current active side
-		iter->second.curSide = sideIndex;
+		std::lock_guard<std::mutex> lock(publishMutex);
+		publishedLatencyTable.clear();
+		publishedLatencyTable.merge(latencyTable);
+		publishedTrafficStats.clear();
+		publishedTrafficStats.merge(trafficStats);
 	}
 
-	// count number of packets and bytes in each side of the connection
-	iter->second.numOfDataPackets[sideIndex]++;
-	iter->second.bytesFromSide[sideIndex] += (int)tcpData.getDataLength();
+	/**
+	 * Publish the metrics if the snapshot interval passed since they were last published
+	 * @param[in] now The current time (in seconds)
+	 */
+	void publishSnapshotIfDue(time_t now)
+	{
+		uint32_t snapshotInterval = GlobalConfig::getInstance().snapshotInterval;
+		if (snapshotInterval == 0 || now < lastPublishTime + (time_t)snapshotInterval)
+			return;
+
+		publishSnapshot();
+		lastPublishTime = now;
+	}
+};
 
-	// write the new data to the file
-	iter->second.fileStreams[side]->write((char*)tcpData.getData(), tcpData.getDataLength());
+
+/**
+ * Returns true if the connection runs on the TLS port
+ */
+static inline bool isTlsConnection(const ConnectionData& connData)
+{
+	uint16_t tlsPort = GlobalConfig::getInstance().tlsPort;
+	return connData.dstPort == tlsPort || connData.srcPort == tlsPort;
 }
 
 
 /**
- * The callback being called by the TCP reassembly module whenever a new connection is found. This method adds the connection to the connection manager
+ * Write the TLS metadata record of a connection if it has one which wasn't written yet
  */
-static void tcpReassemblyConnectionStartCallback(const ConnectionData& connectionData, void* userCookie)
+static void writeTlsRecordIfReady(const ConnectionData& connData, TcpReassemblyData& reassemblyData)
 {
-	// get a pointer to the connection manager
-	TcpReassemblyConnMgr* connMgr = (TcpReassemblyConnMgr*)userCookie;
+	if (reassemblyData.tlsRecordWritten || reassemblyData.tlsParser == NULL || !reassemblyData.tlsParser->getMetadata().gotClientHello)
+		return;
 
-	// look for the connection in the connection manager
-	TcpReassemblyConnMgrIter iter = connMgr->find(connectionData.flowKey);
+	GlobalConfig::getInstance().writeTlsRecord(connData, reassemblyData.tlsParser->getMetadata(), reassemblyData.serverName);
+	reassemblyData.tlsRecordWritten = true;
 
-	// assuming it's a new connection
-	if (iter == connMgr->end())
-	{
-		// add it to the connection manager
-		connMgr->insert(std::make_pair(connectionData.flowKey, TcpReassemblyData()));
-	}
+	// the parser isn't needed anymore
+	delete reassemblyData.tlsParser;
+	reassemblyData.tlsParser = NULL;
 }
 
 
 /**
- * The callback being called by the TCP reassembly module whenever a connection is ending.
+ * Handle new data on a TLS connection: feed it to the connection's TLS handshake parser until both hello messages were seen
  */
-static void tcpReassemblyConnectionEndCallback(const ConnectionData& connectionData, TcpReassembly::ConnectionEndReason reason, void* userCookie)
+static void handleTlsData(int sideIndex, const TcpStreamData& tcpData, TcpReassemblyData& reassemblyData)
 {
-	// get a pointer to the connection manager
-	TcpReassemblyConnMgr* connMgr = (TcpReassemblyConnMgr*)userCookie;
+	// the handshake was already summarized - the rest of the connection is encrypted and ignored
+	if (reassemblyData.tlsRecordWritten)
+		return;
 
-	// find the connection in the connection manager by the flow key
-	TcpReassemblyConnMgrIter iter = connMgr->find(connectionData.flowKey);
+	if (reassemblyData.tlsParser == NULL)
+		reassemblyData.tlsParser = new TlsHandshakeParser();
 
-	// connection wasn't found
-	if (iter == connMgr->end())
-		return;
+	reassemblyData.tlsParser->feed(sideIndex, tcpData.getData(), tcpData.getDataLength());
 
-	// remove the connection from the connection manager
-	connMgr->erase(iter);
+	if (reassemblyData.tlsParser->isDone())
+		writeTlsRecordIfReady(tcpData.getConnectionData(), reassemblyData);
 }
 
 
 /**
- * The callback to be called when application is terminated by ctrl-c. Stops the endless while loop
+ * Label a new connection with the name its server's address was resolved from - a single lookup in the passive DNS cache
  */
-static void onApplicationInterrupted(void* cookie)
+static void labelConnection(const PacketPipeline* pipeline, const ConnectionData& connData, TcpReassemblyData& reassemblyData)
 {
-	bool* shouldStop = (bool*)cookie;
-	*shouldStop = true;
+	// the server is the side on the HTTP or TLS port, or else the side which was connected to
+	uint16_t tlsPort = GlobalConfig::getInstance().tlsPort;
+	bool srcIsServer = (connData.srcPort == DEFAULT_HTTP_PORT || connData.srcPort == tlsPort) && connData.dstPort != DEFAULT_HTTP_PORT && connData.dstPort != tlsPort;
+	const IPAddress* serverIP = (srcIsServer ? connData.srcIP : connData.dstIP);
+	if (serverIP != NULL)
+		pipeline->dnsCache->lookup(serverIP, connData.startTime.tv_sec, reassemblyData.serverName);
 }
 
 
 /**
- * packet capture callback - called whenever a packet arrives on the live device
+ * Count a client IP address in the traffic statistics
  */
-static void onPacketArrives(RawPacket* packet, PcapLiveDevice* dev, void* tcpReassemblyCookie)
+static void recordClient(TrafficStats& trafficStats, const IPAddress* clientIP)
 {
-	// get a pointer to the TCP reassembly instance and feed the packet arrived to it
-	TcpReassembly* tcpReassembly = (TcpReassembly*)tcpReassemblyCookie;
-	tcpReassembly->reassemblePacket(packet);
+	if (clientIP->getType() == IPAddress::IPv4AddressType)
+	{
+		uint32_t address = ((const IPv4Address*)clientIP)->toInt();
+		trafficStats.recordClient((const uint8_t*)&address, sizeof(address));
+	}
+	else
+		trafficStats.recordClient((const uint8_t*)((const IPv6Address*)clientIP)->toIn6Addr(), 16);
 }
 
 
 /**
- * The method responsible for TCP reassembly on live traffic
+ * Remember a hole at the current end of the capture file a side is written to. Consecutive truncations of the same side are merged into one
  */
-void liveTcpReassembly(PcapLiveDevice* dev, TcpReassembly& tcpReassembly)
+static void addStreamGap(TcpReassemblyData& reassemblyData, int sideIndex, uint32_t numOfBytes, uint8_t reason)
 {
+	StreamGap gap;
+	if (GlobalConfig::getInstance().separateSides)
+		gap.fileOffset = (uint64_t)reassemblyData.bytesFromSide[sideIndex];
+	else
+		gap.fileOffset = (uint64_t)reassemblyData.bytesFromSide[0] + (uint64_t)reassemblyData.bytesFromSide[1];
+	gap.missingBytes = numOfBytes;
+	gap.side = (uint8_t)sideIndex;
+	gap.reason = reason;
 
-	printf("Starting packet capture\n");
-
-	// start capturing packets. Each packet arrived will be handled by onPacketArrives method
-	dev->startCapture(onPacketArrives, &tcpReassembly);
-
-	// register the on app close event to print summary stats on app termination
-	bool shouldStop = false;
-	ApplicationEventHandler::getInstance().onApplicationInterrupted(onApplicationInterrupted, &shouldStop);
-
-	// run in an endless loop until the user presses ctrl+c
-	while(!shouldStop)
-		PCAP_SLEEP(1);
-
-	// stop capturing and close the live device
-	dev->stopCapture();
-	dev->close();
-
-	// close all connections which are still opened
-	tcpReassembly.closeAllConnections();
+	if (reason == STREAM_GAP_TRUNCATED && !reassemblyData.gaps.empty())
+	{
+		StreamGap& lastGap = reassemblyData.gaps.back();
+		if (lastGap.reason == STREAM_GAP_TRUNCATED && lastGap.side == gap.side && lastGap.fileOffset == gap.fileOffset &&
+				(uint64_t)lastGap.missingBytes + numOfBytes <= UINT32_MAX)
+		{
+			lastGap.missingBytes += numOfBytes;
+			return;
+		}
+	}
 
-	printf("Finished capture\n");
+	reassemblyData.gaps.push_back(gap);
 }
 
 
 /**
- * main method 
+ * Note data of a connection which is about to be written to its capture file in the connection's turn index: it starts a new turn if the
+ * other side wrote last, otherwise it extends the current turn
  */
-int main(int argc, char* argv[])
+static void addStreamTurn(TcpReassemblyData& reassemblyData, int sideIndex, const timeval& timestamp)
 {
-	
-	//IMPORTANT: Change this to your own IP
-	std::string devIP = "10.128.0.3";
-
-	//initialize device
-	pcpp::PcapLiveDevice* dev = pcpp::PcapLiveDeviceList::getInstance().getPcapLiveDeviceByIp(devIP.c_str());
-	
-	//check to see if the device initialized correctly
-	if(dev == NULL)
+	if (!reassemblyData.turns.empty() && reassemblyData.turns.back().side == (uint8_t)sideIndex)
 	{
-		printf("dev is null\n");
-		exit(1);
+		reassemblyData.turns.back().lastByteTime = timestamp;
+		return;
 	}
 
-	//print dev name
-	printf("Interface name: %s\n", dev->getName());
+	StreamTurn turn;
+	if (GlobalConfig::getInstance().separateSides)
+		turn.fileOffset = (uint64_t)reassemblyData.bytesFromSide[sideIndex];
+	else
+		turn.fileOffset = (uint64_t)reassemblyData.bytesFromSide[0] + (uint64_t)reassemblyData.bytesFromSide[1];
+	turn.firstByteTime = timestamp;
+	turn.lastByteTime = timestamp;
+	turn.side = (uint8_t)sideIndex;
+	reassemblyData.turns.push_back(turn);
+}
 
-	//attempt to open the device
-	if(!dev->open())
-	{
-		printf("cannot open device\n");
-		exit(1);
-	}
 
-	//create a port filter because we want to filter by port 80
-	pcpp::PortFilter portFilter(80, pcpp::SRC_OR_DST);
-	
-	//create the 'ANDFilter'
-	pcpp::AndFilter filter;
-	//add the port filter to the ANDFilter
-	filter.addFilter(&portFilter);
+/**
+ * The callback being called by the pattern matcher for every match, collects the match into the pipeline's scratch list
+ */
+static void onPatternMatch(uint32_t patternId, uint64_t endOffset, void* userCookie)
+{
+	PatternHit hit;
+	hit.patternId = patternId;
+	hit.endOffset = endOffset;
+	((std::vector<PatternHit>*)userCookie)->push_back(hit);
+}
+
+
+/**
+ * Scan new data of a connection for the payload patterns, leaving the matches in the pipeline's scratch list, and write a record for each.
+ * In matched-only mode, the first match of a connection accounts for everything that wasn't written before it with a gap per side
+ */
+static void scanForPatterns(PacketPipeline* pipeline, int sideIndex, const TcpStreamData& tcpData, TcpReassemblyData& reassemblyData)
+{
+	const PatternMatcher* patternMatcher = GlobalConfig::getInstance().patternMatcher;
+	pipeline->patternHits.clear();
+	if (patternMatcher == NULL)
+		return;
+
+	uint64_t chunkOffset = reassemblyData.matchStates[sideIndex].offset;
+	if (patternMatcher->scan(reassemblyData.matchStates[sideIndex], tcpData.getData(), tcpData.getDataLength(), onPatternMatch, &pipeline->patternHits) == 0)
+		return;
+
+	const ConnectionData& connData = tcpData.getConnectionData();
+	int clientSide = (connData.dstPort == DEFAULT_HTTP_PORT ? 0 : 1);
+	for (size_t i = 0; i < pipeline->patternHits.size(); i++)
+	{
+		const PatternHit& hit = pipeline->patternHits[i];
+		GlobalConfig::getInstance().writePatternMatch(connData, clientSide, sideIndex, hit.endOffset, patternMatcher->getLabel(hit.patternId),
+				reassemblyData.serverName);
+	}
+	pipeline->numOfPatternMatches += pipeline->patternHits.size();
+
+	if (reassemblyData.patternMatched)
+		return;
+
+	reassemblyData.patternMatched = true;
+	pipeline->numOfMatchedConnections++;
+
+	// nothing was written so far, the holes noted until now are part of the unwritten data
+	if (GlobalConfig::getInstance().captureMatchedOnly)
+	{
+		reassemblyData.gaps.clear();
+		for (int side = 0; side < 2; side++)
+		{
+			uint64_t unmatchedBytes = (side == sideIndex ? chunkOffset : reassemblyData.matchStates[side].offset);
+			for (; unmatchedBytes > 0; unmatchedBytes -= std::min(unmatchedBytes, (uint64_t)UINT32_MAX))
+				addStreamGap(reassemblyData, side, (uint32_t)std::min(unmatchedBytes, (uint64_t)UINT32_MAX), STREAM_GAP_UNMATCHED);
+		}
+	}
+}
+
+
+/**
+ * The callback being called by the HTTP transaction tracker of a connection whenever a response completes a transaction
+ */
+static void onHttpTransactionComplete(const HttpTransaction& transaction, void* userCookie)
+{
+	PacketPipeline* pipeline = (PacketPipeline*)userCookie;
+
+	pipeline->transactionBatch.append(transaction);
+	if (pipeline->transactionBatch.isFull())
+		pipeline->flushTransactions();
+
+	if (pipeline->flightRecorder != NULL)
+	{
+		uint64_t responseEndUsec = (uint64_t)transaction.requestTime.tv_usec + transaction.responseTimeUsec;
+		pipeline->flightRecorder->onHttpResponse(transaction.statusCode, transaction.requestTime.tv_sec + (time_t)(responseEndUsec / 1000000));
+	}
+}
+
+
+/**
+ * The callback being called by the WebSocket decoder of a connection for every complete message. Appends a little-endian record to the
+ * connection's pending records: the capture time of the message's first and last byte in microseconds since the epoch (8 bytes each), side
+ * (1 byte), opcode (1 byte), flags (1 byte, WEBSOCKET_MESSAGE_*), a reserved byte, the length of the kept payload (4 bytes) and of the whole
+ * message (8 bytes), then the kept payload itself (unmasked)
+ */
+static void onWebSocketMessage(const WebSocketMessage& message, void* userCookie)
+{
+	std::string& records = ((TcpReassemblyData*)userCookie)->webSocketRecords;
+
+	uint8_t header[32] = { 0 };
+	uint64_t firstByteUsec = (uint64_t)message.firstByteTime.tv_sec * 1000000 + message.firstByteTime.tv_usec;
+	uint64_t lastByteUsec = (uint64_t)message.lastByteTime.tv_sec * 1000000 + message.lastByteTime.tv_usec;
+	for (int byte = 0; byte < 8; byte++)
+	{
+		header[byte] = (uint8_t)(firstByteUsec >> (8 * byte));
+		header[8 + byte] = (uint8_t)(lastByteUsec >> (8 * byte));
+		header[24 + byte] = (uint8_t)(message.messageLen >> (8 * byte));
+	}
+	header[16] = (uint8_t)message.side;
+	header[17] = message.opcode;
+	header[18] = message.flags;
+	for (int byte = 0; byte < 4; byte++)
+		header[20 + byte] = (uint8_t)(message.payloadLen >> (8 * byte));
+
+	records.append((const char*)header, sizeof(header));
+	if (message.payloadLen > 0)
+		records.append((const char*)message.payload, message.payloadLen);
+}
+
+
+/**
+ * Append the pending WebSocket message records of a connection to its .ws file
+ */
+static void flushWebSocketRecords(const ConnectionData& connData, TcpReassemblyData& reassemblyData)
+{
+	if (reassemblyData.webSocketRecords.empty())
+		return;
+
+	if (!GlobalConfig::getInstance().writeToConsole)
+	{
+		std::string fileName = GlobalConfig::getInstance().getFileName(connData, 0, GlobalConfig::getInstance().separateSides) + ".ws";
+		std::ostream* recordStream = GlobalConfig::getInstance().openFileStream(fileName, reassemblyData.webSocketFileWritten);
+		recordStream->write(reassemblyData.webSocketRecords.data(), reassemblyData.webSocketRecords.size());
+		GlobalConfig::getInstance().closeFileSteam(recordStream);
+		reassemblyData.webSocketFileWritten = true;
+	}
+
+	reassemblyData.webSocketRecords.clear();
+}
+
+
+/**
+ * Write a range of a chunk of stream data to a capture file, with the redacted values in it replaced. The redacted spans are taken in order,
+ * from nextSpan on
+ */
+static void writeStreamRange(std::ostream* stream, const char* data, size_t start, size_t end, const std::vector<RedactedSpan>& redactedSpans, size_t& nextSpan)
+{
+	while (nextSpan < redactedSpans.size() && redactedSpans[nextSpan].offset < end)
+	{
+		const RedactedSpan& span = redactedSpans[nextSpan++];
+		stream->write(data + start, span.offset - start);
+		RedactionPolicy::writeReplacement(*stream, span);
+		start = span.offset + span.length;
+	}
+
+	stream->write(data + start, end - start);
+}
+
+
+/**
+ * Write the bytes of a hashed value which the connection's end cut short, masked. The HTTP tracker held them back until the value's digest
+ * would be known
+ */
+static void writeHeldRedactedBytes(const ConnectionData& connData, TcpReassemblyData& reassemblyData)
+{
+	if (reassemblyData.httpTracker == NULL || (GlobalConfig::getInstance().captureMatchedOnly && !reassemblyData.patternMatched))
+		return;
+
+	for (int sideIndex = 0; sideIndex < 2; sideIndex++)
+	{
+		RedactedSpan span;
+		span.offset = 0;
+		span.length = 0;
+		span.replacementLen = reassemblyData.httpTracker->getHeldRedactedBytes(sideIndex);
+		span.digestLen = 0;
+		if (span.replacementLen == 0)
+			continue;
+
+		// the file may have been closed since to make room for others
+		int side = (GlobalConfig::getInstance().separateSides ? sideIndex : 0);
+		std::ostream* stream = reassemblyData.fileStreams[side];
+		if (stream == NULL)
+		{
+			std::string fileName = GlobalConfig::getInstance().getFileName(connData, sideIndex, GlobalConfig::getInstance().separateSides) + ".txt";
+			stream = GlobalConfig::getInstance().openFileStream(fileName, true);
+		}
+
+		RedactionPolicy::writeReplacement(*stream, span);
+		if (reassemblyData.fileStreams[side] == NULL)
+			GlobalConfig::getInstance().closeFileSteam(stream);
+	}
+}
+
+
+/**
+ * Replace the HTTP/1.x tracker of a connection which was just upgraded to h2c by an HTTP/2 one, and feed it the server's frames which came in
+ * the data of the 101 response. Their header blocks are added to the pipeline's dropped spans when values are redacted
+ */
+static void switchToHttp2(PacketPipeline* pipeline, int sideIndex, const TcpStreamData& tcpData, int clientSide, TcpReassemblyData& reassemblyData,
+		uint8_t& droppedReason)
+{
+	HttpTransactionTracker* httpTracker = reassemblyData.httpTracker;
+	reassemblyData.http2Tracker = new Http2TransactionTracker(tcpData.getConnectionData(), clientSide, &pipeline->latencyTable, &pipeline->trafficStats,
+			onHttpTransactionComplete, pipeline);
+	reassemblyData.http2Tracker->setServerName(reassemblyData.serverName);
+
+	HttpTransaction upgradeRequest;
+	timeval requestLastByteTime;
+	if (httpTracker->getUpgradeRequest(upgradeRequest, requestLastByteTime))
+		reassemblyData.http2Tracker->addUpgradeRequest(upgradeRequest, requestLastByteTime);
+
+	size_t upgradeOffset = httpTracker->getUpgradeOffset();
+	delete httpTracker;
+	reassemblyData.httpTracker = NULL;
+
+	size_t numOfSpans = pipeline->droppedSpans.size();
+	bool redacting = !GlobalConfig::getInstance().redactionPolicy.isEmpty();
+	reassemblyData.http2Tracker->feed(sideIndex, tcpData.getData() + upgradeOffset, tcpData.getDataLength() - upgradeOffset,
+			tcpData.getConnectionData().endTime, redacting ? &pipeline->droppedSpans : NULL);
+	for (size_t i = numOfSpans; i < pipeline->droppedSpans.size(); i++)
+		pipeline->droppedSpans[i].offset += (uint32_t)upgradeOffset;
+	if (pipeline->droppedSpans.size() > numOfSpans)
+		droppedReason = STREAM_GAP_REDACTED;
+}
+
+
+/**
+ * The callback being called by the TCP reassembly module whenever new data arrives on a certain connection
+ */
+static void tcpReassemblyMsgReadyCallback(int sideIndex, const TcpStreamData& tcpData, void* userCookie)
+{
+	// extract the pipeline and its connection manager from the user cookie
+	PacketPipeline* pipeline = (PacketPipeline*)userCookie;
+	TcpReassemblyConnMgr* connMgr = &pipeline->connMgr;
+
+	// check if this flow already appears in the connection manager. If not add it
+	TcpReassemblyConnMgrIter iter = connMgr->find(tcpData.getConnectionData().flowKey);
+	if (iter == connMgr->end())
+	{
+		connMgr->insert(std::make_pair(tcpData.getConnectionData().flowKey, TcpReassemblyData()));
+		iter = connMgr->find(tcpData.getConnectionData().flowKey);
+		labelConnection(pipeline, tcpData.getConnectionData(), iter->second);
+	}
+
+	// TLS connections only produce metadata records
+	if (isTlsConnection(tcpData.getConnectionData()))
+	{
+		handleTlsData(sideIndex, tcpData, iter->second);
+		return;
+	}
+
+	// capture backends without a BPF filter (DPDK) deliver every connection - only HTTP is written to files
+	if (tcpData.getConnectionData().dstPort != DEFAULT_HTTP_PORT && tcpData.getConnectionData().srcPort != DEFAULT_HTTP_PORT)
+		return;
+
+	// the patterns are looked for in whatever the connection carries, WebSocket frames and HTTP/2 included
+	scanForPatterns(pipeline, sideIndex, tcpData, iter->second);
+
+	// once the connection switched to WebSocket its frames become message records, they aren't written to the capture file
+	if (iter->second.webSocketDecoder != NULL)
+	{
+		iter->second.webSocketDecoder->feed(sideIndex, tcpData.getData(), tcpData.getDataLength(), tcpData.getConnectionData().endTime);
+		if (iter->second.webSocketRecords.size() >= WEBSOCKET_RECORDS_FLUSH_SIZE)
+			flushWebSocketRecords(tcpData.getConnectionData(), iter->second);
+		return;
+	}
+
+	// a client which opens with the HTTP/2 connection preface (prior knowledge) is tracked as HTTP/2 from here on
+	int clientSide = (tcpData.getConnectionData().dstPort == DEFAULT_HTTP_PORT ? 0 : 1);
+	HttpTransactionTracker* httpTracker = iter->second.httpTracker;
+	if (iter->second.http2Tracker == NULL && sideIndex == clientSide && Http2TransactionTracker::isConnectionPreface(tcpData.getData(), tcpData.getDataLength()) &&
+			(httpTracker == NULL || httpTracker->isUpgraded() || httpTracker->numOfTransactions == 0))
+	{
+		if (httpTracker == NULL)
+			recordClient(pipeline->trafficStats, clientSide == 0 ? tcpData.getConnectionData().srcIP : tcpData.getConnectionData().dstIP);
+		delete httpTracker;
+		iter->second.httpTracker = NULL;
+		iter->second.http2Tracker = new Http2TransactionTracker(tcpData.getConnectionData(), clientSide, &pipeline->latencyTable, &pipeline->trafficStats,
+				onHttpTransactionComplete, pipeline);
+		iter->second.http2Tracker->setServerName(iter->second.serverName);
+	}
+
+	// pair requests with responses. The connection's end time is the timestamp of the packet which carried this data.
+	// The body capture policy only applies to HTTP/1.x. HTTP/2 frames are written whole, except for the header blocks when values are redacted
+	pipeline->droppedSpans.clear();
+	pipeline->redactedSpans.clear();
+	uint8_t droppedReason = STREAM_GAP_TRUNCATED;
+	if (iter->second.http2Tracker != NULL)
+	{
+		for (size_t i = 0; i < pipeline->patternHits.size(); i++)
+			iter->second.http2Tracker->addPatternMatch(GlobalConfig::getInstance().patternMatcher->getLabel(pipeline->patternHits[i].patternId));
+		bool redacting = !GlobalConfig::getInstance().redactionPolicy.isEmpty();
+		iter->second.http2Tracker->feed(sideIndex, tcpData.getData(), tcpData.getDataLength(), tcpData.getConnectionData().endTime,
+				redacting ? &pipeline->droppedSpans : NULL);
+		droppedReason = STREAM_GAP_REDACTED;
+	}
+	else
+	{
+		if (iter->second.httpTracker == NULL)
+		{
+			iter->second.httpTracker = new HttpTransactionTracker(tcpData.getConnectionData(), clientSide, &pipeline->latencyTable, &pipeline->trafficStats,
+					onHttpTransactionComplete, pipeline, &GlobalConfig::getInstance().bodyPolicy, &GlobalConfig::getInstance().redactionPolicy);
+			iter->second.httpTracker->setServerName(iter->second.serverName);
+			recordClient(pipeline->trafficStats, clientSide == 0 ? tcpData.getConnectionData().srcIP : tcpData.getConnectionData().dstIP);
+		}
+		for (size_t i = 0; i < pipeline->patternHits.size(); i++)
+			iter->second.httpTracker->addPatternMatch(GlobalConfig::getInstance().patternMatcher->getLabel(pipeline->patternHits[i].patternId));
+		iter->second.httpTracker->feed(sideIndex, tcpData.getData(), tcpData.getDataLength(), tcpData.getConnectionData().endTime, &pipeline->droppedSpans,
+				&pipeline->redactedSpans);
+
+		// the 101 response of an h2c upgrade switches both sides to HTTP/2, and may be followed by the server's first frames in the same data.
+		// The request which asked for the upgrade is answered on stream 1
+		if (iter->second.httpTracker->isUpgraded() && strcasecmp(iter->second.httpTracker->getUpgradeProtocol(), "h2c") == 0)
+			switchToHttp2(pipeline, sideIndex, tcpData, clientSide, iter->second, droppedReason);
+	}
+
+	// the 101 response which switches to WebSocket may be followed by the first frames in the same data
+	size_t dataLen = tcpData.getDataLength();
+	if (iter->second.httpTracker != NULL && iter->second.httpTracker->isUpgraded() && strcasecmp(iter->second.httpTracker->getUpgradeProtocol(), "websocket") == 0)
+	{
+		dataLen = iter->second.httpTracker->getUpgradeOffset();
+		iter->second.webSocketDecoder = new WebSocketDecoder(onWebSocketMessage, &iter->second);
+		iter->second.webSocketDecoder->feed(sideIndex, tcpData.getData() + dataLen, tcpData.getDataLength() - dataLen, tcpData.getConnectionData().endTime);
+	}
+
+	// in matched-only mode, the data of a connection no pattern matched in yet isn't written
+	bool writeData = (!GlobalConfig::getInstance().captureMatchedOnly || iter->second.patternMatched);
+
+	int side;
+
+	// if the user wants to write each side in a different file - set side as the sideIndex, otherwise write everything to the same file ("side 0")
+	if (GlobalConfig::getInstance().separateSides)
+		side = sideIndex;
+	else
+		side = 0;
+
+	// if the file stream on the relevant side isn't open yet (meaning it's the first data on this connection)
+	if (writeData && iter->second.fileStreams[side] == NULL)
+	{
+		// add the flow key of this connection to the list of open connections. If the return value isn't NULL it means that there are too many open files
+		// and we need to close the connection with least recently used file(s) in order to open a new one.
+		// The connection with the least recently used file is the return value
+		uint32_t flowKeyToCloseFiles;
+		int result = pipeline->recentConnsWithActivity.put(tcpData.getConnectionData().flowKey, &flowKeyToCloseFiles);
+
+		// if result equals to 1 it means we need to close the open files in this connection (the one with the least recently used files)
+		if (result == 1)
+		{
+			// find the connection from the flow key
+			TcpReassemblyConnMgrIter iter2 = connMgr->find(flowKeyToCloseFiles);
+			if (iter2 != connMgr->end())
+			{
+				// close files on both sides (if they're open)
+				for (int index = 0; index < 2; index++)
+				{
+					if (iter2->second.fileStreams[index] != NULL)
+					{
+						// close the file
+						GlobalConfig::getInstance().closeFileSteam(iter2->second.fileStreams[index]);
+						iter2->second.fileStreams[index] = NULL;
+
+						// set the reopen flag to true to indicate that next time this file will be opened it will be opened in append mode (and not overwrite mode)
+						iter2->second.reopenFileStreams[index] = true;
+					}
+				}
+			}
+		}
+
+		// get the file name according to the 5-tuple etc.
+		std::string fileName = GlobalConfig::getInstance().getFileName(tcpData.getConnectionData(), sideIndex, GlobalConfig::getInstance().separateSides) + ".txt";
+
+		// open the file in overwrite mode (if this is the first time the file is opened) or in append mode (if it was already opened before)
+		iter->second.fileStreams[side] = GlobalConfig::getInstance().openFileStream(fileName, iter->second.reopenFileStreams[side]);
+	}
+
+	// if this messages comes on a different side than previous message seen on this connection
+	if (sideIndex != iter->second.curSide)
+	{
+		// count number of message in each side
+		iter->second.numOfMessagesFromSide[sideIndex]++;
+
+		// set side index as the current active side
+		iter->second.curSide = sideIndex;
+	}
+
+	// count number of packets in each side of the connection
+	iter->second.numOfDataPackets[sideIndex]++;
+
+	// write the new data to the file, with the redacted values replaced and without the bytes a policy drops. Those are noted in the gap index
+	// instead
+	if (writeData)
+	{
+		if (GlobalConfig::getInstance().writeTurnIndex)
+			addStreamTurn(iter->second, sideIndex, tcpData.getConnectionData().endTime);
+
+		const char* data = (const char*)tcpData.getData();
+		size_t written = 0;
+		size_t nextRedactedSpan = 0;
+		for (size_t i = 0; i < pipeline->droppedSpans.size(); i++)
+		{
+			const StreamSpan& span = pipeline->droppedSpans[i];
+			writeStreamRange(iter->second.fileStreams[side], data, written, span.offset, pipeline->redactedSpans, nextRedactedSpan);
+			iter->second.bytesFromSide[sideIndex] += (int)(span.offset - written);
+			addStreamGap(iter->second, sideIndex, span.length, droppedReason);
+			written = span.offset + span.length;
+		}
+		writeStreamRange(iter->second.fileStreams[side], data, written, dataLen, pipeline->redactedSpans, nextRedactedSpan);
+		iter->second.bytesFromSide[sideIndex] += (int)(dataLen - written);
+	}
+
+	// the rest of a truncated body needn't even reach this callback
+	uint32_t discardable = (iter->second.httpTracker != NULL ? iter->second.httpTracker->getDiscardableBytes(sideIndex) : 0);
+	if (discardable > 0)
+	{
+		pipeline->tcpReassembly.skipStreamData(tcpData.getConnectionData(), sideIndex, discardable);
+		iter->second.httpTracker->discardData(sideIndex, discardable);
+		PatternMatcher::skipMissingData(iter->second.matchStates[sideIndex], discardable);
+		addStreamGap(iter->second, sideIndex, discardable, STREAM_GAP_TRUNCATED);
+	}
+}
+
+
+/**
+ * The callback being called by the TCP reassembly module whenever data is missing from a stream. The capture file is left untouched (so it only
+ * holds bytes which were actually on the wire) and the hole is remembered for the connection's gap index
+ */
+static void tcpReassemblyStreamGapCallback(int sideIndex, const ConnectionData& connectionData, uint32_t missingDataLen, void* userCookie)
+{
+	TcpReassemblyConnMgr* connMgr = &((PacketPipeline*)userCookie)->connMgr;
+
+	TcpReassemblyConnMgrIter iter = connMgr->find(connectionData.flowKey);
+	if (iter == connMgr->end())
+		return;
+
+	// a TLS hello which lost bytes can't be parsed anymore
+	if (isTlsConnection(connectionData))
+	{
+		if (iter->second.tlsParser != NULL)
+		{
+			iter->second.tlsParser->skipMissingData(sideIndex);
+			if (iter->second.tlsParser->isDone())
+				writeTlsRecordIfReady(connectionData, iter->second);
+		}
+		return;
+	}
+
+	if (connectionData.dstPort != DEFAULT_HTTP_PORT && connectionData.srcPort != DEFAULT_HTTP_PORT)
+		return;
+
+	// a pattern can't match across the hole
+	PatternMatcher::skipMissingData(iter->second.matchStates[sideIndex], missingDataLen);
+
+	// a hole in a WebSocket stream shows up as an incomplete message record, not in the capture file
+	if (iter->second.webSocketDecoder != NULL)
+	{
+		iter->second.webSocketDecoder->skipMissingData(sideIndex, missingDataLen);
+		return;
+	}
+
+	if (iter->second.httpTracker != NULL)
+		iter->second.httpTracker->skipMissingData(sideIndex, missingDataLen);
+	if (iter->second.http2Tracker != NULL)
+		iter->second.http2Tracker->skipMissingData(sideIndex, missingDataLen);
+
+	// the hole is at the current end of the file this side is written to
+	addStreamGap(iter->second, sideIndex, missingDataLen, STREAM_GAP_LOST);
+}
+
+
+/**
+ * Write the gap index of a connection next to its capture file: one 16-byte little-endian record per hole -
+ * file offset (8 bytes), number of missing bytes (4 bytes), side (1 byte), reason (1 byte: STREAM_GAP_LOST / STREAM_GAP_TRUNCATED /
+ * STREAM_GAP_UNMATCHED / STREAM_GAP_REDACTED) and 2 reserved bytes. Connections without holes, and connections with no capture file in matched-only mode, get no index
+ */
+static void writeGapIndex(const ConnectionData& connData, const TcpReassemblyData& reassemblyData)
+{
+	if (reassemblyData.gaps.empty() || GlobalConfig::getInstance().writeToConsole)
+		return;
+
+	if (GlobalConfig::getInstance().captureMatchedOnly && !reassemblyData.patternMatched)
+		return;
+
+	std::string fileName = GlobalConfig::getInstance().getFileName(connData, 0, GlobalConfig::getInstance().separateSides) + ".gaps";
+	std::ostream* gapStream = GlobalConfig::getInstance().openFileStream(fileName, false);
+
+	for (size_t i = 0; i < reassemblyData.gaps.size(); i++)
+	{
+		const StreamGap& gap = reassemblyData.gaps[i];
+		uint8_t record[16] = { 0 };
+		for (int byte = 0; byte < 8; byte++)
+			record[byte] = (uint8_t)(gap.fileOffset >> (8 * byte));
+		for (int byte = 0; byte < 4; byte++)
+			record[8 + byte] = (uint8_t)(gap.missingBytes >> (8 * byte));
+		record[12] = gap.side;
+		record[13] = gap.reason;
+
+		gapStream->write((const char*)record, sizeof(record));
+	}
+
+	GlobalConfig::getInstance().closeFileSteam(gapStream);
+}
+
+
+/**
+ * Write the turn index of a connection next to its capture file: one 32-byte little-endian record per turn - file offset (8 bytes), capture
+ * time of the turn's first byte and of its last byte (8 bytes each, microseconds since the epoch), side (1 byte) and 7 reserved bytes.
+ * Only written with -t, and like the gap index not for connections with no capture file in matched-only mode
+ */
+static void writeTurnIndex(const ConnectionData& connData, const TcpReassemblyData& reassemblyData)
+{
+	if (reassemblyData.turns.empty() || GlobalConfig::getInstance().writeToConsole)
+		return;
+
+	if (GlobalConfig::getInstance().captureMatchedOnly && !reassemblyData.patternMatched)
+		return;
+
+	std::string fileName = GlobalConfig::getInstance().getFileName(connData, 0, GlobalConfig::getInstance().separateSides) + ".turns";
+	std::ostream* turnStream = GlobalConfig::getInstance().openFileStream(fileName, false);
+
+	for (size_t i = 0; i < reassemblyData.turns.size(); i++)
+	{
+		const StreamTurn& turn = reassemblyData.turns[i];
+		uint64_t firstByteUsec = (uint64_t)turn.firstByteTime.tv_sec * 1000000ULL + (uint64_t)turn.firstByteTime.tv_usec;
+		uint64_t lastByteUsec = (uint64_t)turn.lastByteTime.tv_sec * 1000000ULL + (uint64_t)turn.lastByteTime.tv_usec;
+		uint8_t record[32] = { 0 };
+		for (int byte = 0; byte < 8; byte++)
+		{
+			record[byte] = (uint8_t)(turn.fileOffset >> (8 * byte));
+			record[8 + byte] = (uint8_t)(firstByteUsec >> (8 * byte));
+			record[16 + byte] = (uint8_t)(lastByteUsec >> (8 * byte));
+		}
+		record[24] = turn.side;
+
+		turnStream->write((const char*)record, sizeof(record));
+	}
+
+	GlobalConfig::getInstance().closeFileSteam(turnStream);
+}
+
+
+/**
+ * The callback being called by the TCP reassembly module whenever a new connection is found. This method adds the connection to the connection manager
+ */
+static void tcpReassemblyConnectionStartCallback(const ConnectionData& connectionData, void* userCookie)
+{
+	// get a pointer to the connection manager
+	PacketPipeline* pipeline = (PacketPipeline*)userCookie;
+	TcpReassemblyConnMgr* connMgr = &pipeline->connMgr;
+
+	// look for the connection in the connection manager
+	TcpReassemblyConnMgrIter iter = connMgr->find(connectionData.flowKey);
+
+	// assuming it's a new connection
+	if (iter == connMgr->end())
+	{
+		// add it to the connection manager and label it with its server's name
+		iter = connMgr->insert(std::make_pair(connectionData.flowKey, TcpReassemblyData())).first;
+		labelConnection(pipeline, connectionData, iter->second);
+	}
+}
+
+
+/**
+ * The callback being called by the TCP reassembly module whenever a connection is ending.
+ */
+static void tcpReassemblyConnectionEndCallback(const ConnectionData& connectionData, TcpReassembly::ConnectionEndReason reason, void* userCookie)
+{
+	// get a pointer to the connection manager
+	TcpReassemblyConnMgr* connMgr = &((PacketPipeline*)userCookie)->connMgr;
+
+	// find the connection in the connection manager by the flow key
+	TcpReassemblyConnMgrIter iter = connMgr->find(connectionData.flowKey);
+
+	// connection wasn't found
+	if (iter == connMgr->end())
+		return;
+
+	// a TLS connection which ended before the server hello was seen still gets a record for its client hello
+	writeTlsRecordIfReady(connectionData, iter->second);
+
+	writeGapIndex(connectionData, iter->second);
+	writeTurnIndex(connectionData, iter->second);
+	flushWebSocketRecords(connectionData, iter->second);
+	writeHeldRedactedBytes(connectionData, iter->second);
+
+	// a response delimited by the connection close ends here
+	if (iter->second.httpTracker != NULL)
+		iter->second.httpTracker->finish();
+	if (iter->second.http2Tracker != NULL)
+		iter->second.http2Tracker->finish();
+
+	// remove the connection from the connection manager
+	connMgr->erase(iter);
+}
+
+
+/**
+ * The callback to be called when application is terminated by ctrl-c. Stops the endless while loop
+ */
+static void onApplicationInterrupted(void* cookie)
+{
+	bool* shouldStop = (bool*)cookie;
+	*shouldStop = true;
+}
+
+
+PacketPipeline::PacketPipeline(size_t maxOpenFiles, PacketBufferPool* bufferPool, PassiveDnsCache* dnsCache, FlightRecorder* flightRecorder) :
+	recentConnsWithActivity(maxOpenFiles), lastPublishTime(0), coreId(-1), threadPinned(false), bufferCache(bufferPool), dnsCache(dnsCache),
+	flightRecorder(flightRecorder), recorderLane(-1),
+	tcpReassembly(tcpReassemblyMsgReadyCallback, this, tcpReassemblyConnectionStartCallback, tcpReassemblyConnectionEndCallback, tcpReassemblyStreamGapCallback,
+			DEFAULT_CLOSED_CONNECTION_DELAY_SEC, &bufferCache), numOfPatternMatches(0), numOfMatchedConnections(0)
+{
+	// the lane is allocated here, so like the rest of the pipeline it lands on the node of the pipeline's core
+	if (flightRecorder != NULL)
+		recorderLane = flightRecorder->addLane();
+}
+
+
+/**
+ * Feed a single packet through the pipeline. Unfragmented packets go straight to TCP reassembly, fragments are held until their datagram is complete
+ */
+static void processPacket(RawPacket* packet, PacketPipeline* pipeline)
+{
+	if (pipeline->recorderLane >= 0)
+		pipeline->flightRecorder->record(pipeline->recorderLane, packet);
+
+	IPDefragmenter::Status status;
+	RawPacket* packetToReassemble = pipeline->ipDefragmenter.processPacket(packet, status);
+
+	// the packet is a fragment which was stored (or dropped) - nothing to reassemble yet
+	if (packetToReassemble == NULL)
+		return;
+
+	// DNS responses only feed the passive DNS cache
+	if (!pipeline->dnsCache->processPacket(packetToReassemble))
+		pipeline->tcpReassembly.reassemblePacket(packetToReassemble);
+
+	pipeline->publishSnapshotIfDue(packet->getPacketTimeStamp().tv_sec);
+}
+
+
+/**
+ * Print the IP defragmentation stats of a pipeline
+ */
+static void printDefragmentationStats(const IPDefragmenter& ipDefragmenter)
+{
+	printf("IP fragments: %llu, reassembled datagrams: %llu, malformed: %llu, timed out/evicted: %llu\n",
+		(unsigned long long)ipDefragmenter.numOfFragments, (unsigned long long)ipDefragmenter.numOfReassembled,
+		(unsigned long long)ipDefragmenter.numOfMalformed, (unsigned long long)ipDefragmenter.numOfEvicted);
+}
+
+
+/**
+ * Print how often a pipeline's retained packet data didn't fit the packet buffer pool
+ */
+static void printBufferCacheStats(const PacketBufferCache& bufferCache)
+{
+	printf("Packet buffers allocated outside the pool: %llu oversized, %llu while the pool was exhausted\n",
+		(unsigned long long)bufferCache.numOfOversizedAllocations, (unsigned long long)bufferCache.numOfExhaustedAllocations);
+}
+
+
+/**
+ * Print what the passive DNS cache collected
+ */
+static void printDnsCacheStats(const PassiveDnsCache& dnsCache)
+{
+	printf("Passive DNS: %llu responses, %llu address records cached, %llu entries evicted, %llu updates dropped\n",
+		(unsigned long long)dnsCache.numOfResponses.load(), (unsigned long long)dnsCache.numOfRecords.load(),
+		(unsigned long long)dnsCache.numOfEvictions.load(), (unsigned long long)dnsCache.numOfDroppedUpdates.load());
+}
+
+
+/**
+ * Print the payload pattern match stats of a pipeline, if patterns are matched
+ */
+static void printPatternMatchStats(const PacketPipeline& pipeline)
+{
+	if (GlobalConfig::getInstance().patternMatcher != NULL)
+		printf("Pattern matching: %llu matches in %llu connections\n", (unsigned long long)pipeline.numOfPatternMatches,
+			(unsigned long long)pipeline.numOfMatchedConnections);
+}
+
+
+// the flight recorder the dump signal triggers
+static FlightRecorder* s_FlightRecorder = NULL;
+
+
+/**
+ * SIGUSR1 handler - dumps the flight recorder. Triggering only sets a flag, so it's safe from a signal handler
+ */
+static void onDumpSignal(int signal)
+{
+	if (s_FlightRecorder != NULL)
+		s_FlightRecorder->trigger("SIGUSR1");
+}
+
+
+/**
+ * Create the flight recorder if it's on. The memory is split evenly between the pipelines, each adds its lane when it's created. SIGUSR1
+ * dumps it
+ * @param[in] numOfPipelines The number of pipelines which will record
+ * @return The recorder, or NULL if the flight recorder is off
+ */
+static FlightRecorder* createFlightRecorder(size_t numOfPipelines)
+{
+	GlobalConfig& config = GlobalConfig::getInstance();
+	if (config.flightRecorderSize == 0)
+		return NULL;
+
+	FlightRecorder* flightRecorder = new FlightRecorder(config.flightRecorderSize / numOfPipelines, config.flightRecorderMaxAge);
+	flightRecorder->setErrorRateTrigger(config.errorTriggerCount, config.errorTriggerWindow);
+
+	s_FlightRecorder = flightRecorder;
+	signal(SIGUSR1, onDumpSignal);
+
+	printf("Flight recorder: %dMB per pipeline, dump it with 'kill -USR1 %d'\n", (int)((config.flightRecorderSize / numOfPipelines) >> 20), (int)getpid());
+	return flightRecorder;
+}
+
+
+/**
+ * Start the flight recorder's dump thread, once all pipelines added their lanes
+ */
+static void startFlightRecorder(FlightRecorder* flightRecorder)
+{
+	if (flightRecorder != NULL)
+		flightRecorder->start(GlobalConfig::getInstance().outputDir);
+}
+
+
+/**
+ * Stop the flight recorder (after the pending dump is written), print its stats and delete it
+ */
+static void destroyFlightRecorder(FlightRecorder* flightRecorder)
+{
+	if (flightRecorder == NULL)
+		return;
+
+	signal(SIGUSR1, SIG_DFL);
+	s_FlightRecorder = NULL;
+	flightRecorder->stop();
+
+	printf("Flight recorder: %llu packets recorded, %llu dumps with %llu packets, %llu packets overwritten before a dump read them, %llu triggers coalesced\n",
+		(unsigned long long)flightRecorder->getNumOfRecordedPackets(), (unsigned long long)flightRecorder->numOfDumps,
+		(unsigned long long)flightRecorder->numOfDumpedPackets, (unsigned long long)flightRecorder->numOfOverwrittenPackets,
+		(unsigned long long)flightRecorder->numOfCoalescedTriggers.load());
+	delete flightRecorder;
+}
+
+
+/**
+ * Create a packet buffer pool. Its memory is pre-faulted, so it lands on the NUMA node preferred by the calling thread
+ */
+static PacketBufferPool* createBufferPool()
+{
+	PacketBufferPool* bufferPool = new PacketBufferPool();
+	printf("Packet buffer pool: %d buffers of %d bytes (%s)\n", (int)bufferPool->getNumOfBuffers(), PACKET_BUFFER_SIZE,
+		bufferPool->isHugePageBacked() ? "huge pages" : "regular pages, transparent huge pages requested");
+	return bufferPool;
+}
+
+
+/**
+ * Merge the metrics published by all pipelines and write the HTTP latency and traffic statistics reports
+ */
+static void writeReports(const std::vector<PacketPipeline*>& pipelines, bool printSummary)
+{
+	HttpLatencyTable latencyTable;
+	TrafficStats trafficStats;
+
+	for (size_t i = 0; i < pipelines.size(); i++)
+	{
+		std::lock_guard<std::mutex> lock(pipelines[i]->publishMutex);
+		latencyTable.merge(pipelines[i]->publishedLatencyTable);
+		trafficStats.merge(pipelines[i]->publishedTrafficStats);
+	}
+
+	GlobalConfig::getInstance().writeLatencyReport(latencyTable);
+	GlobalConfig::getInstance().writeTrafficStatsReport(trafficStats);
+
+	if (printSummary)
+		printf("HTTP requests: %llu, transactions: %llu (%llu aggregated into the overflow entry)\n",
+			(unsigned long long)trafficStats.numOfRequests, (unsigned long long)latencyTable.numOfTransactions,
+			(unsigned long long)latencyTable.numOfOverflowTransactions);
+}
+
+
+/**
+ * Run until the user presses ctrl+c. If a snapshot interval is set, the reports are rewritten every interval from the metrics the pipelines published
+ */
+static void runUntilInterrupted(const std::vector<PacketPipeline*>& pipelines)
+{
+	// register the on app close event to print summary stats on app termination
+	bool shouldStop = false;
+	ApplicationEventHandler::getInstance().onApplicationInterrupted(onApplicationInterrupted, &shouldStop);
+
+	uint32_t snapshotInterval = GlobalConfig::getInstance().snapshotInterval;
+	uint32_t secondsSinceSnapshot = 0;
+
+	// run in an endless loop until the user presses ctrl+c
+	while(!shouldStop)
+	{
+		PCAP_SLEEP(1);
+
+		if (snapshotInterval > 0 && ++secondsSinceSnapshot >= snapshotInterval)
+		{
+			writeReports(pipelines, false);
+			secondsSinceSnapshot = 0;
+		}
+	}
+}
+
+
+/**
+ * Split a comma separated list
+ */
+static void splitList(const std::string& list, std::vector<std::string>& items)
+{
+	std::stringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ','))
+	{
+		if (!item.empty())
+			items.push_back(item);
+	}
+}
+
+
+/**
+ * Pin the main thread, which only writes the reports
+ */
+static void pinMainThread(int mainCore)
+{
+	if (mainCore < 0)
+		return;
+
+	if (!pinCurrentThread(mainCore))
+		EXIT_WITH_ERROR("Couldn't pin the main thread to core %d", mainCore);
+	printf("Main thread: core %d\n", mainCore);
+}
+
+
+/**
+ * packet capture callback - called whenever a packet arrives on the live device
+ */
+static void onPacketArrives(RawPacket* packet, PcapLiveDevice* dev, void* pipelineCookie)
+{
+	// get a pointer to the packet pipeline and feed the packet arrived to it
+	PacketPipeline* pipeline = (PacketPipeline*)pipelineCookie;
+
+	// the capture thread is created inside PcapPlusPlus, so it pins itself on its first packet
+	if (!pipeline->threadPinned)
+	{
+		if (pipeline->coreId >= 0 && !pinCurrentThread(pipeline->coreId))
+			printf("Couldn't pin the capture thread to core %d\n", pipeline->coreId);
+		pipeline->threadPinned = true;
+	}
+
+	processPacket(packet, pipeline);
+}
+
+
+/**
+ * A live device whose packets are merged with the packets of other devices. Its capture thread only copies the packets into the merger
+ */
+struct MergedDeviceContext
+{
+	CaptureMerger* merger;
+	int source;
+
+	// the core the device's capture thread should be pinned to (-1 if it isn't pinned), and whether that thread was pinned already
+	int coreId;
+	bool threadPinned;
+};
+
+
+/**
+ * packet capture callback of a merged device - called on the device's capture thread whenever a packet arrives
+ */
+static void onMergedDevicePacketArrives(RawPacket* packet, PcapLiveDevice* dev, void* contextCookie)
+{
+	MergedDeviceContext* context = (MergedDeviceContext*)contextCookie;
+
+	if (!context->threadPinned)
+	{
+		if (context->coreId >= 0 && !pinCurrentThread(context->coreId))
+			printf("Couldn't pin the capture thread of %s to core %d\n", dev->getName(), context->coreId);
+		context->threadPinned = true;
+	}
+
+	context->merger->push(context->source, packet);
+}
+
+
+/**
+ * The capture merger callback - called on the merge thread for every packet, in timestamp order
+ */
+static void onMergedPacket(RawPacket* packet, void* pipelineCookie)
+{
+	processPacket(packet, (PacketPipeline*)pipelineCookie);
+}
+
+
+/**
+ * Print how the packets of the merged sources were ordered
+ */
+static void printMergeStats(const CaptureMerger& merger)
+{
+	printf("Merged packets: %llu, handed out after waiting the max delay for an idle source: %llu, out of timestamp order: %llu\n",
+		(unsigned long long)merger.numOfMergedPackets, (unsigned long long)merger.numOfTimedOutPackets, (unsigned long long)merger.numOfOutOfOrderPackets);
+}
+
+
+/**
+ * Print the final stats of a pipeline and write the reports. The pipeline's thread must have stopped
+ */
+static void finishPipeline(PacketPipeline& pipeline)
+{
+	printDefragmentationStats(pipeline.ipDefragmenter);
+	printBufferCacheStats(pipeline.bufferCache);
+	printDnsCacheStats(*pipeline.dnsCache);
+	printPatternMatchStats(pipeline);
+
+	// the thread which ran the pipeline stopped, publish the final metrics from here
+	pipeline.publishSnapshot();
+	std::vector<PacketPipeline*> pipelines(1, &pipeline);
+	writeReports(pipelines, true);
+}
+
+
+/**
+ * The method responsible for TCP reassembly on live traffic
+ */
+void liveTcpReassembly(PcapLiveDevice* dev, PacketPipeline& pipeline)
+{
+
+	printf("Starting packet capture\n");
+
+	// start capturing packets. Each packet arrived will be handled by onPacketArrives method
+	dev->startCapture(onPacketArrives, &pipeline);
+
+	std::vector<PacketPipeline*> pipelines(1, &pipeline);
+	runUntilInterrupted(pipelines);
+
+	// stop capturing and close the live device
+	dev->stopCapture();
+	dev->close();
+
+	// close all connections which are still opened
+	pipeline.tcpReassembly.closeAllConnections();
+
+	printf("Finished capture\n");
+
+	finishPipeline(pipeline);
+}
+
+
+/**
+ * The method responsible for TCP reassembly on live traffic from several devices. Each device is captured by its own thread, and the merger
+ * feeds their packets to the pipeline in timestamp order on its merge thread, so connections which cross devices are reassembled whole
+ * @param[in] devices The devices, opened and filtered
+ * @param[in] deviceCores The core each device's capture thread is pinned to (-1 if it isn't pinned)
+ * @param[in] pipeline The pipeline, run on the merge thread (pinned to the pipeline's core)
+ * @param[in] bufferPool The pool packets wait for the merge in
+ */
+void mergedLiveTcpReassembly(const std::vector<PcapLiveDevice*>& devices, const std::vector<int>& deviceCores, PacketPipeline& pipeline,
+		PacketBufferPool* bufferPool)
+{
+	CaptureMerger merger(bufferPool);
+	std::vector<MergedDeviceContext> contexts(devices.size());
+	for (size_t i = 0; i < devices.size(); i++)
+	{
+		contexts[i].merger = &merger;
+		contexts[i].source = merger.addSource(true);
+		contexts[i].coreId = deviceCores[i];
+		contexts[i].threadPinned = false;
+	}
+
+	merger.start(onMergedPacket, &pipeline, pipeline.coreId);
+
+	printf("Starting packet capture on %d interfaces\n", (int)devices.size());
+
+	for (size_t i = 0; i < devices.size(); i++)
+		devices[i]->startCapture(onMergedDevicePacketArrives, &contexts[i]);
+
+	std::vector<PacketPipeline*> pipelines(1, &pipeline);
+	runUntilInterrupted(pipelines);
+
+	// once a device stopped capturing its source is done, the merge thread ends when it handed out what's left
+	for (size_t i = 0; i < devices.size(); i++)
+	{
+		devices[i]->stopCapture();
+		devices[i]->close();
+		merger.closeSource(contexts[i].source);
+	}
+	merger.join();
+
+	// close all connections which are still opened
+	pipeline.tcpReassembly.closeAllConnections();
+
+	printf("Finished capture\n");
+
+	for (size_t i = 0; i < devices.size(); i++)
+		printf("Interface %s: %llu packets, %llu dropped while waiting for the merge\n", devices[i]->getName(),
+			(unsigned long long)merger.getNumOfPackets(contexts[i].source), (unsigned long long)merger.getNumOfDroppedPackets(contexts[i].source));
+	printMergeStats(merger);
+
+	finishPipeline(pipeline);
+}
+
+
+/**
+ * A capture file reader thread: copies the file's packets into the merger, waiting whenever the merge is behind
+ */
+static void readCaptureFile(IFileReaderDevice* reader, CaptureMerger* merger, int source)
+{
+	RawPacket packet;
+	while (reader->getNextPacket(packet))
+		merger->push(source, &packet);
+
+	merger->closeSource(source);
+}
+
+
+/**
+ * The method responsible for TCP reassembly on capture files. Each file is read by its own thread and the merger feeds their packets to the
+ * pipeline in exact timestamp order, as if they were captured together
+ * @param[in] readers The capture files, opened
+ * @param[in] pipeline The pipeline, run on the merge thread (pinned to the pipeline's core)
+ * @param[in] bufferPool The pool packets wait for the merge in
+ */
+void fileTcpReassembly(const std::vector<IFileReaderDevice*>& readers, PacketPipeline& pipeline, PacketBufferPool* bufferPool)
+{
+	CaptureMerger merger(bufferPool);
+	std::vector<int> sources;
+	for (size_t i = 0; i < readers.size(); i++)
+		sources.push_back(merger.addSource(false));
+
+	merger.start(onMergedPacket, &pipeline, pipeline.coreId);
+
+	printf("Reading %d capture files\n", (int)readers.size());
+
+	std::vector<std::thread> readerThreads;
+	for (size_t i = 0; i < readers.size(); i++)
+		readerThreads.push_back(std::thread(readCaptureFile, readers[i], &merger, sources[i]));
+
+	for (size_t i = 0; i < readerThreads.size(); i++)
+		readerThreads[i].join();
+	merger.join();
+
+	// close all connections which are still opened
+	pipeline.tcpReassembly.closeAllConnections();
+
+	printf("Finished reading capture files: %llu packets\n", (unsigned long long)merger.numOfMergedPackets);
+	printMergeStats(merger);
+
+	finishPipeline(pipeline);
+}
+
 
-	//set the filter on the device to the filter we just created
-	dev->setFilter(filter);
+#ifdef USE_DPDK
+
+/**
+ * DPDK burst callback - called on a worker's core for every burst read from the worker's RX queue
+ */
+static void onDpdkBurstArrives(MBufRawPacket** packets, uint16_t numOfPackets, void* pipelineCookie)
+{
+	PacketPipeline* pipeline = (PacketPipeline*)pipelineCookie;
+
+	// collect the packets which are ready for TCP reassembly and hand them over as one batch
+	RawPacket* packetsToReassemble[DPDK_RX_BURST_SIZE];
+	size_t numOfPacketsToReassemble = 0;
+
+	for (uint16_t i = 0; i < numOfPackets; i++)
+	{
+		if (pipeline->recorderLane >= 0)
+			pipeline->flightRecorder->record(pipeline->recorderLane, packets[i]);
+
+		IPDefragmenter::Status status;
+		RawPacket* packetToReassemble = pipeline->ipDefragmenter.processPacket(packets[i], status);
+		if (packetToReassemble == NULL || pipeline->dnsCache->processPacket(packetToReassemble))
+			continue;
+
+		if (status == IPDefragmenter::Reassembled)
+		{
+			// a reassembled datagram is only valid until the next fragment is processed, so it can't wait in the batch.
+			// Flush the packets before it first to keep the packet order
+			pipeline->tcpReassembly.reassemblePackets(packetsToReassemble, numOfPacketsToReassemble);
+			numOfPacketsToReassemble = 0;
+			pipeline->tcpReassembly.reassemblePacket(packetToReassemble);
+			continue;
+		}
+
+		packetsToReassemble[numOfPacketsToReassemble++] = packetToReassemble;
+	}
+
+	pipeline->tcpReassembly.reassemblePackets(packetsToReassemble, numOfPacketsToReassemble);
+
+	pipeline->publishSnapshotIfDue(time(NULL));
+}
+
+
+/**
+ * The method responsible for TCP reassembly on a DPDK port. The port is opened with one RX queue per worker and symmetric RSS, so each
+ * connection is reassembled entirely on one worker core which owns its own pipeline. Each pipeline (and the buffer pool it uses) is allocated
+ * on the NUMA node of its worker's core
+ * @param[in] portId The DPDK port
+ * @param[in] workerCores The cores of the workers, in ascending order (DPDK starts the workers on the cores of a core mask in ascending order)
+ * @param[in] masterCore DPDK's master core, which runs the main thread
+ * @param[in] checkRssSteering Whether the workers check each packet against the software RSS hash
+ */
+void dpdkTcpReassembly(int portId, const std::vector<int>& workerCores, int masterCore, bool checkRssSteering)
+{
+	uint16_t numOfWorkers = (uint16_t)workerCores.size();
+	if (numOfWorkers == 0)
+		EXIT_WITH_ERROR("At least one DPDK worker is needed");
+
+	CoreMask workersCoreMask = 0;
+	for (uint16_t i = 0; i < numOfWorkers; i++)
+	{
+		if (workerCores[i] >= getNumOfCores() || workerCores[i] == masterCore)
+			EXIT_WITH_ERROR("DPDK workers must run on cores 0..%d other than the master core %d", getNumOfCores() - 1, masterCore);
+		workersCoreMask |= SystemCores::IdToSystemCore[workerCores[i]].Mask;
+	}
+
+	if (!DpdkDeviceList::initDpdk(workersCoreMask | SystemCores::IdToSystemCore[masterCore].Mask, DEFAULT_DPDK_MBUF_POOL_SIZE, (uint8_t)masterCore))
+		EXIT_WITH_ERROR("Couldn't initialize DPDK");
+
+	DpdkDevice* device = DpdkDeviceList::getInstance().getDeviceByPort(portId);
+	if (device == NULL)
+		EXIT_WITH_ERROR("Couldn't find DPDK port %d", portId);
+
+	if (device->getTotalNumOfRxQueues() < numOfWorkers)
+		EXIT_WITH_ERROR("DPDK port %d has only %d RX queues", portId, (int)device->getTotalNumOfRxQueues());
+
+	if (!device->openMultiQueues(numOfWorkers, 1, createSymmetricRssConfiguration()))
+		EXIT_WITH_ERROR("Couldn't open DPDK port %d", portId);
+
+	printf("DPDK port %d (%s, PMD: %s) opened with %d RX queues\n", portId, device->getDeviceName().c_str(), device->getPMDName().c_str(), (int)numOfWorkers);
+
+	// with this table the software RSS hash puts every packet on the queue the NIC delivers it to
+	uint16_t retaSize = setRssRedirectionTable(device, numOfWorkers);
+
+	int deviceNumaNode = getNumaNodeOfDevice("/sys/bus/pci/devices/" + device->getPciAddress());
+	printf("Port %d is attached to NUMA node %d, the main thread runs on core %d\n", portId, deviceNumaNode, masterCore);
+
+	// each worker gets its own pipeline and its share of the open files budget. Workers on the same NUMA node share a buffer pool on that node,
+	// all of them share the passive DNS cache
+	PassiveDnsCache* dnsCache = new PassiveDnsCache();
+	FlightRecorder* flightRecorder = createFlightRecorder(numOfWorkers);
+	size_t maxOpenFilesPerWorker = std::max((size_t)1, GlobalConfig::getInstance().maxOpenFiles / numOfWorkers);
+	std::vector<PacketBufferPool*> bufferPools(getNumOfNumaNodes(), (PacketBufferPool*)NULL);
+	std::vector<PacketPipeline*> pipelines;
+	std::vector<DpdkWorkerThread*> workers;
+	for (uint16_t queue = 0; queue < numOfWorkers; queue++)
+	{
+		int numaNode = getNumaNodeOfCore(workerCores[queue]);
+		printf("Worker %d (RX queue %d): core %d, NUMA node %d%s\n", (int)queue, (int)queue, workerCores[queue], numaNode,
+			(deviceNumaNode >= 0 && numaNode != deviceNumaNode ? " - not the port's node, packets cross the interconnect" : ""));
+
+		setPreferredNumaNode(numaNode);
+		if (bufferPools[numaNode] == NULL)
+			bufferPools[numaNode] = createBufferPool();
+		PacketPipeline* pipeline = new PacketPipeline(maxOpenFilesPerWorker, bufferPools[numaNode], dnsCache, flightRecorder);
+		setPreferredNumaNode(-1);
+
+		pipeline->coreId = workerCores[queue];
+		pipelines.push_back(pipeline);
+		DpdkCaptureWorker* worker = new DpdkCaptureWorker(device, queue, onDpdkBurstArrives, pipeline);
+		if (checkRssSteering)
+			worker->setRssSteeringCheck(numOfWorkers, retaSize);
+		workers.push_back(worker);
+	}
+
+	startFlightRecorder(flightRecorder);
+
+	if (!DpdkDeviceList::getInstance().startDpdkWorkerThreads(workersCoreMask, workers))
+		EXIT_WITH_ERROR("Couldn't start DPDK worker threads");
+
+	printf("Starting packet capture\n");
+
+	runUntilInterrupted(pipelines);
+
+	DpdkDeviceList::getInstance().stopDpdkWorkerThreads();
+	device->close();
+
+	printf("Finished capture\n");
+
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		// the worker threads stopped, so closing the remaining connections from this thread is safe
+		pipelines[i]->tcpReassembly.closeAllConnections();
+
+		DpdkCaptureWorker* worker = (DpdkCaptureWorker*)workers[i];
+		printf("Worker on core %d (RX queue %d): %llu packets. ", (int)worker->getCoreId(), (int)worker->getRxQueueId(), (unsigned long long)worker->getNumOfPackets());
+		if (checkRssSteering)
+			printf("%llu off their software RSS queue. ", (unsigned long long)worker->getNumOfMisdirectedPackets());
+		printDefragmentationStats(pipelines[i]->ipDefragmenter);
+		printBufferCacheStats(pipelines[i]->bufferCache);
+		printPatternMatchStats(*pipelines[i]);
+		pipelines[i]->publishSnapshot();
+
+		delete worker;
+	}
+
+	printDnsCacheStats(*dnsCache);
+	destroyFlightRecorder(flightRecorder);
+
+	// each worker measured its own connections, the reports cover all of them
+	writeReports(pipelines, true);
+
+	for (size_t i = 0; i < pipelines.size(); i++)
+		delete pipelines[i];
+
+	for (size_t i = 0; i < bufferPools.size(); i++)
+		delete bufferPools[i];
+
+	delete dnsCache;
+}
+
+#endif /* USE_DPDK */
+
+
+/**
+ * main method 
+ */
+int main(int argc, char* argv[])
+{
+	AppName::init(argc, argv);
+
+	//IMPORTANT: Change this to your own IP (or use -i)
+	std::string devIP = "10.128.0.3";
 
 	//outputDir and writeToConsole are both for writing to file instead of outputting to console
 	std::string inputPcapFileName = "";
@@ -437,19 +2061,399 @@ int main(int argc, char* argv[])
 	bool writeToConsole = false;
 	bool separateSides = false;
 	size_t maxOpenFiles = DEFAULT_MAX_NUMBER_OF_CONCURRENT_OPEN_FILES;
-	
+	int dpdkPort = -1;
+#ifdef USE_DPDK
+	int dpdkWorkers = 1;
+	bool checkRssSteering = false;
+#endif
+	std::string benchmarkPcapFileName = "";
+	uint32_t snapshotInterval = 0;
+	std::vector<int> captureCores;
+	int mainCore = -1;
+	std::string patternsFileName = "";
+	bool caselessPatterns = false;
+	bool captureMatchedOnly = false;
+	std::string replayDir = "";
+	std::string replayTarget = "";
+	int replayWorkers = 1;
+	int replayConnections = REPLAY_DEFAULT_CONNECTIONS;
+	uint32_t replayDuration = 0;
+	bool replayConnectionTiming = false;
+	std::string replayArrivals = "";
+	bool verifyResponses = false;
+	std::string verifyIgnoredHeaders = VERIFY_DEFAULT_IGNORED_HEADERS;
+
+	int optionIndex = 0;
+	int opt = 0;
+
+	while((opt = getopt_long(argc, argv, "i:r:o:cf:d:w:Sb:s:p:m:k:x:R:E:M:NOtP:T:W:C:D:FA:VI:h", HttpEchoOptions, &optionIndex)) != -1)
+	{
+		switch (opt)
+		{
+			case 0:
+				break;
+			case 'i':
+				devIP = optarg;
+				break;
+			case 'r':
+				inputPcapFileName = optarg;
+				break;
+			case 'o':
+				outputDir = optarg;
+				break;
+			case 'c':
+				writeToConsole = true;
+				break;
+			case 'f':
+				maxOpenFiles = (size_t)atoi(optarg);
+				break;
+			case 'd':
+				dpdkPort = atoi(optarg);
+				break;
+			case 'w':
+				// without DPDK support -d exits with an error, so the worker count is never needed
+#ifdef USE_DPDK
+				dpdkWorkers = atoi(optarg);
+#endif
+				break;
+			case 'S':
+#ifdef USE_DPDK
+				checkRssSteering = true;
+#endif
+				break;
+			case 'b':
+				benchmarkPcapFileName = optarg;
+				break;
+			case 's':
+				snapshotInterval = (uint32_t)atoi(optarg);
+				break;
+			case 'p':
+				if (!parseCoreList(optarg, captureCores) || captureCores.empty())
+					EXIT_WITH_ERROR("Malformed core list '%s'", optarg);
+				break;
+			case 'm':
+				mainCore = atoi(optarg);
+				break;
+			case 'k':
+				if (!GlobalConfig::getInstance().bodyPolicy.parse(optarg))
+					EXIT_WITH_ERROR("Malformed body policy '%s'", optarg);
+				break;
+			case 'x':
+				if (!GlobalConfig::getInstance().redactionPolicy.parse(optarg))
+					EXIT_WITH_ERROR("Malformed redaction policy '%s'", optarg);
+				break;
+			case 'R':
+			{
+				unsigned int sizeMB = 0, maxAge = 0;
+				if (sscanf(optarg, "%u:%u", &sizeMB, &maxAge) < 1 || sizeMB == 0)
+					EXIT_WITH_ERROR("Malformed flight recorder size '%s'", optarg);
+				GlobalConfig::getInstance().flightRecorderSize = (size_t)sizeMB << 20;
+				GlobalConfig::getInstance().flightRecorderMaxAge = maxAge;
+				break;
+			}
+			case 'E':
+			{
+				unsigned int errors = 0, window = 0;
+				if (sscanf(optarg, "%u:%u", &errors, &window) != 2 || window == 0 || window > FLIGHT_RECORDER_MAX_ERROR_WINDOW_SEC)
+					EXIT_WITH_ERROR("Malformed error trigger '%s'", optarg);
+				GlobalConfig::getInstance().errorTriggerCount = errors;
+				GlobalConfig::getInstance().errorTriggerWindow = window;
+				break;
+			}
+			case 'M':
+				patternsFileName = optarg;
+				break;
+			case 'N':
+				caselessPatterns = true;
+				break;
+			case 'O':
+				captureMatchedOnly = true;
+				break;
+			case 't':
+				GlobalConfig::getInstance().writeTurnIndex = true;
+				break;
+			case 'P':
+				replayDir = optarg;
+				break;
+			case 'T':
+				replayTarget = optarg;
+				break;
+			case 'W':
+				replayWorkers = atoi(optarg);
+				break;
+			case 'C':
+				replayConnections = atoi(optarg);
+				break;
+			case 'D':
+				replayDuration = (uint32_t)atoi(optarg);
+				break;
+			case 'F':
+				replayConnectionTiming = true;
+				break;
+			case 'A':
+				replayArrivals = optarg;
+				break;
+			case 'V':
+				verifyResponses = true;
+				break;
+			case 'I':
+				verifyIgnoredHeaders = optarg;
+				break;
+			case 'h':
+				printUsage();
+				exit(0);
+			default:
+				printUsage();
+				exit(-1);
+		}
+	}
+
 	// set global config
 	GlobalConfig::getInstance().outputDir = outputDir;
 	GlobalConfig::getInstance().writeToConsole = writeToConsole;
 	GlobalConfig::getInstance().separateSides = separateSides;
 	GlobalConfig::getInstance().maxOpenFiles = maxOpenFiles;
+	GlobalConfig::getInstance().snapshotInterval = snapshotInterval;
+	GlobalConfig::getInstance().captureMatchedOnly = captureMatchedOnly;
 
-	// create the object which manages info on all connections
-	TcpReassemblyConnMgr connMgr;
+	// the automaton is compiled once, all pipelines share it
+	if (patternsFileName != "")
+	{
+		PatternMatcher* patternMatcher = new PatternMatcher(caselessPatterns);
+		if (!patternMatcher->loadPatterns(patternsFileName.c_str()) || !patternMatcher->compile())
+			EXIT_WITH_ERROR("Couldn't load payload patterns from '%s'", patternsFileName.c_str());
+		printf("Pattern matcher: %d patterns, %d states (%s prefilter)\n", (int)patternMatcher->getNumOfPatterns(), (int)patternMatcher->getNumOfStates(),
+			patternMatcher->isVectorized() ? "SSSE3" : "scalar");
+		GlobalConfig::getInstance().patternMatcher = patternMatcher;
+	}
+	else if (captureMatchedOnly)
+		EXIT_WITH_ERROR("-O needs payload patterns (-M)");
+
+	// benchmark reassembly on a capture file instead of capturing
+	if (benchmarkPcapFileName != "")
+	{
+		if (!runReassemblyBenchmark(benchmarkPcapFileName.c_str()))
+			EXIT_WITH_ERROR("Couldn't read capture file '%s'", benchmarkPcapFileName.c_str());
+		return 0;
+	}
+
+	printCpuTopology();
+
+	for (size_t i = 0; i < captureCores.size(); i++)
+	{
+		if (captureCores[i] >= getNumOfCores())
+			EXIT_WITH_ERROR("Core %d doesn't exist, the cores are 0..%d", captureCores[i], getNumOfCores() - 1);
+	}
+
+	if (mainCore >= getNumOfCores())
+		EXIT_WITH_ERROR("Core %d doesn't exist, the cores are 0..%d", mainCore, getNumOfCores() - 1);
+
+	// replay the requests of earlier capture files instead of capturing
+	if (replayDir != "")
+	{
+		ReplayConfig replayConfig;
+		if (replayTarget == "" || !resolveReplayTarget(replayTarget.c_str(), replayConfig))
+			EXIT_WITH_ERROR("Replay needs a target server as host:port (-T)");
+		if (replayWorkers < 1 || replayWorkers > REPLAY_MAX_WORKERS)
+			EXIT_WITH_ERROR("Between 1 and %d replay workers can be run", REPLAY_MAX_WORKERS);
+		if (replayConnections < 1)
+			EXIT_WITH_ERROR("Replay workers need at least 1 connection");
+		replayConfig.mode = replayConnectionTiming ? ConnectionReplay : PooledReplay;
+		replayConfig.schedule = ClosedLoopSchedule;
+		replayConfig.requestsPerSec = 0;
+		if (replayArrivals != "")
+		{
+			if (replayConnectionTiming)
+				EXIT_WITH_ERROR("-A schedules the pooled replay, it can't be used with -F");
+
+			size_t rateSeparator = replayArrivals.find(':');
+			std::string schedule = replayArrivals.substr(0, rateSeparator);
+			if (rateSeparator != std::string::npos)
+				replayConfig.requestsPerSec = atof(replayArrivals.c_str() + rateSeparator + 1);
+
+			if (schedule == "captured" && rateSeparator == std::string::npos)
+				replayConfig.schedule = CapturedSchedule;
+			else if (schedule == "poisson" && replayConfig.requestsPerSec > 0)
+				replayConfig.schedule = PoissonSchedule;
+			else if (schedule == "rate" && replayConfig.requestsPerSec > 0)
+				replayConfig.schedule = FixedRateSchedule;
+			else
+				EXIT_WITH_ERROR("Replay arrivals are 'captured', 'poisson:<requests/s>' or 'rate:<requests/s>'");
+		}
+		replayConfig.numOfWorkers = replayWorkers;
+		replayConfig.connectionsPerWorker = (size_t)replayConnections;
+		replayConfig.durationSec = replayDuration;
+		replayConfig.workerCores = captureCores;
+		replayConfig.verifyResponses = verifyResponses;
+		replayConfig.ignoredHeaders = verifyIgnoredHeaders;
+		replayConfig.diffFilePath = (outputDir != "" ? outputDir + "/" : "") + "replay_diffs.tsv";
+
+		ReplayCorpus corpus;
+		if (!corpus.load(replayDir.c_str()))
+			EXIT_WITH_ERROR("Couldn't read capture directory '%s'", replayDir.c_str());
+		printf("Replay corpus: %d requests of %d connections (%d files without requests, %d files replayed only up to a hole or a protocol switch, "
+			"%d connections with a turn index)\n", (int)corpus.getNumOfRequests(), (int)corpus.getNumOfConnections(), (int)corpus.numOfSkippedFiles,
+			(int)corpus.numOfTruncatedFiles, (int)corpus.numOfTimedConnections);
+		if (corpus.getNumOfRequests() == 0)
+			EXIT_WITH_ERROR("No HTTP requests to replay in '%s'", replayDir.c_str());
+		if (replayConfig.schedule == CapturedSchedule && corpus.numOfTimedConnections == 0)
+			EXIT_WITH_ERROR("The captured arrivals need turn indexes (-t) in '%s'", replayDir.c_str());
+
+		// the main thread isn't pinned here: the workers are forked from it and would inherit its core
+		if (!runReplay(corpus, replayConfig))
+			exit(1);
+		return 0;
+	}
+
+	// capture from a DPDK port with one reassembly worker per RX queue
+	if (dpdkPort >= 0)
+	{
+#ifdef USE_DPDK
+		// listed cores set the number of workers, otherwise the workers run on the cores following the master core
+		int masterCore = (mainCore >= 0 ? mainCore : 0);
+		std::vector<int> workerCores(captureCores);
+		if (workerCores.empty())
+		{
+			for (int core = 0; core < dpdkWorkers; core++)
+				workerCores.push_back((masterCore + 1 + core) % getNumOfCores());
+		}
+		std::sort(workerCores.begin(), workerCores.end());
+		workerCores.erase(std::unique(workerCores.begin(), workerCores.end()), workerCores.end());
+
+		dpdkTcpReassembly(dpdkPort, workerCores, masterCore, checkRssSteering);
+		return 0;
+#else
+		EXIT_WITH_ERROR("HTTPEcho was built without DPDK support (rebuild with 'make USE_DPDK=1')");
+#endif
+	}
+
+	// read capture files instead of capturing live
+	if (inputPcapFileName != "")
+	{
+		std::vector<std::string> fileNames;
+		splitList(inputPcapFileName, fileNames);
+		if (fileNames.empty() || fileNames.size() > CAPTURE_MERGE_MAX_SOURCES)
+			EXIT_WITH_ERROR("Between 1 and %d capture files can be read", CAPTURE_MERGE_MAX_SOURCES);
+
+		std::vector<IFileReaderDevice*> readers;
+		for (size_t i = 0; i < fileNames.size(); i++)
+		{
+			IFileReaderDevice* reader = IFileReaderDevice::getReader(fileNames[i].c_str());
+			if (reader == NULL || !reader->open())
+				EXIT_WITH_ERROR("Couldn't open capture file '%s'", fileNames[i].c_str());
+			readers.push_back(reader);
+		}
+
+		pinMainThread(mainCore);
+
+		// the pipeline runs on the merge thread, its memory goes on the node of the merge thread's core
+		int mergeCore = (captureCores.empty() ? -1 : captureCores[0]);
+		setPreferredNumaNode(mergeCore >= 0 ? getNumaNodeOfCore(mergeCore) : -1);
+		PacketBufferPool* bufferPool = createBufferPool();
+		PassiveDnsCache* dnsCache = new PassiveDnsCache();
+		FlightRecorder* flightRecorder = createFlightRecorder(1);
+		PacketPipeline* pipeline = new PacketPipeline(maxOpenFiles, bufferPool, dnsCache, flightRecorder);
+		pipeline->coreId = mergeCore;
+		setPreferredNumaNode(-1);
+
+		startFlightRecorder(flightRecorder);
+		fileTcpReassembly(readers, *pipeline, bufferPool);
+		destroyFlightRecorder(flightRecorder);
+
+		for (size_t i = 0; i < readers.size(); i++)
+		{
+			readers[i]->close();
+			delete readers[i];
+		}
+		delete pipeline;
+		delete dnsCache;
+		delete bufferPool;
+		return 0;
+	}
+
+	std::vector<std::string> devIPs;
+	splitList(devIP, devIPs);
+	if (devIPs.empty() || devIPs.size() > CAPTURE_MERGE_MAX_SOURCES)
+		EXIT_WITH_ERROR("Between 1 and %d interfaces can be captured", CAPTURE_MERGE_MAX_SOURCES);
+
+	//create port filters because we want HTTP on port 80, TLS on port 443 and the DNS responses for the passive DNS cache
+	pcpp::PortFilter portFilter(DEFAULT_HTTP_PORT, pcpp::SRC_OR_DST);
+	pcpp::PortFilter tlsPortFilter(DEFAULT_TLS_PORT, pcpp::SRC_OR_DST);
+	pcpp::PortFilter dnsPortFilter(DNS_PORT, pcpp::SRC);
+
+	//create the 'ORFilter'
+	pcpp::OrFilter filter;
+	//add the port filters to the ORFilter
+	filter.addFilter(&portFilter);
+	filter.addFilter(&tlsPortFilter);
+	filter.addFilter(&dnsPortFilter);
+
+	std::vector<pcpp::PcapLiveDevice*> devices;
+	for (size_t i = 0; i < devIPs.size(); i++)
+	{
+		//initialize device
+		pcpp::PcapLiveDevice* dev = pcpp::PcapLiveDeviceList::getInstance().getPcapLiveDeviceByIp(devIPs[i].c_str());
+
+		//check to see if the device initialized correctly
+		if(dev == NULL)
+		{
+			printf("dev is null\n");
+			exit(1);
+		}
+
+		//print dev name
+		printf("Interface name: %s\n", dev->getName());
+
+		//attempt to open the device
+		if(!dev->open())
+		{
+			printf("cannot open device\n");
+			exit(1);
+		}
+
+		//set the filter on the device to the filter we just created
+		dev->setFilter(filter);
+		devices.push_back(dev);
+	}
+
+	pinMainThread(mainCore);
 
-	// create the TCP reassembly instance
-	TcpReassembly tcpReassembly(tcpReassemblyMsgReadyCallback, &connMgr, tcpReassemblyConnectionStartCallback, tcpReassemblyConnectionEndCallback);
+	// the pipeline's memory goes on the capture core's NUMA node, or on the (first) interface's node if the capture thread isn't pinned
+	int captureCore = (captureCores.empty() ? -1 : captureCores[0]);
+	int deviceNumaNode = getNumaNodeOfDevice(std::string("/sys/class/net/") + devices[0]->getName() + "/device");
+	int numaNode = (captureCore >= 0 ? getNumaNodeOfCore(captureCore) : deviceNumaNode);
+	if (captureCore >= 0)
+		printf("%s thread: core %d, NUMA node %d (interface on NUMA node %d)\n", (devices.size() > 1 ? "Merge" : "Capture"), captureCore, numaNode,
+			deviceNumaNode);
+	else
+		printf("%s thread: not pinned, memory on NUMA node %d (the interface's node)\n", (devices.size() > 1 ? "Merge" : "Capture"), numaNode);
+
+	// create the packet pipeline: IP defragmentation, the passive DNS cache, TCP reassembly and the connection manager
+	setPreferredNumaNode(numaNode);
+	PacketBufferPool* bufferPool = createBufferPool();
+	PassiveDnsCache* dnsCache = new PassiveDnsCache();
+	FlightRecorder* flightRecorder = createFlightRecorder(1);
+	PacketPipeline* pipeline = new PacketPipeline(maxOpenFiles, bufferPool, dnsCache, flightRecorder);
+	pipeline->coreId = captureCore;
+	setPreferredNumaNode(-1);
+
+	startFlightRecorder(flightRecorder);
 
 	// start capturing packets and do TCP reassembly
-	liveTcpReassembly(dev, tcpReassembly);	
+	if (devices.size() == 1)
+		liveTcpReassembly(devices[0], *pipeline);
+	else
+	{
+		// the merge thread runs the pipeline on the first listed core, the devices' capture threads run on the next ones
+		std::vector<int> deviceCores;
+		for (size_t i = 0; i < devices.size(); i++)
+			deviceCores.push_back(i + 1 < captureCores.size() ? captureCores[i + 1] : -1);
+		mergedLiveTcpReassembly(devices, deviceCores, *pipeline, bufferPool);
+	}
+
+	destroyFlightRecorder(flightRecorder);
+
+	delete pipeline;
+	delete dnsCache;
+	delete bufferPool;
 }
@@ -0,0 +1,36 @@
+#ifndef HTTPECHO_CHECK_UTILS
+#define HTTPECHO_CHECK_UTILS
+
+#include <stdio.h>
+
+// the number of failed checks of the program
+static int s_NumOfFailedChecks = 0;
+
+// check a condition, print it with its location if it's false. The program goes on, so one run shows all failures
+#define CHECK(condition) do { \
+		if (!(condition)) \
+		{ \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			s_NumOfFailedChecks++; \
+		} \
+	} while(0)
+
+
+/**
+ * Print the outcome of a check program
+ * @param[in] programName The name of the program
+ * @return The program's exit code: 0 if all checks passed, 1 otherwise
+ */
+static inline int reportChecks(const char* programName)
+{
+	if (s_NumOfFailedChecks == 0)
+	{
+		printf("%s: all checks passed\n", programName);
+		return 0;
+	}
+
+	printf("%s: %d checks failed\n", programName, s_NumOfFailedChecks);
+	return 1;
+}
+
+#endif /* HTTPECHO_CHECK_UTILS */
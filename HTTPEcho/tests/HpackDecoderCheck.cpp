@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "../HpackDecoder.h"
+#include "CheckUtils.h"
+
+
+/**
+ * A header block of an RFC 7541 appendix C example, the header list it decodes to ("name: value" lines) and the dynamic table size after it
+ */
+struct HpackExample
+{
+	const char* section;
+	const char* block;
+	const char* headers;
+	size_t tableSize;
+};
+
+
+// C.2 stands alone, one decoder per block
+static const HpackExample s_LiteralExamples[] = {
+	{ "C.2.1", "400a637573746f6d2d6b65790d637573746f6d2d686561646572", "custom-key: custom-header\n", 55 },
+	{ "C.2.2", "040c2f73616d706c652f70617468", ":path: /sample/path\n", 0 },
+	{ "C.2.3", "100870617373776f726406736563726574", "password: secret\n", 0 },
+	{ "C.2.4", "82", ":method: GET\n", 0 }
+};
+
+// C.3 and C.4 are one connection's requests each, without and with Huffman coding
+static const HpackExample s_RequestExamples[] = {
+	{ "C.3.1", "828684410f7777772e6578616d706c652e636f6d",
+		":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\n", 57 },
+	{ "C.3.2", "828684be58086e6f2d6361636865",
+		":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\ncache-control: no-cache\n", 110 },
+	{ "C.3.3", "828785bf400a637573746f6d2d6b65790c637573746f6d2d76616c7565",
+		":method: GET\n:scheme: https\n:path: /index.html\n:authority: www.example.com\ncustom-key: custom-value\n", 164 }
+};
+
+static const HpackExample s_HuffmanRequestExamples[] = {
+	{ "C.4.1", "828684418cf1e3c2e5f23a6ba0ab90f4ff",
+		":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\n", 57 },
+	{ "C.4.2", "828684be5886a8eb10649cbf",
+		":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\ncache-control: no-cache\n", 110 },
+	{ "C.4.3", "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf",
+		":method: GET\n:scheme: https\n:path: /index.html\n:authority: www.example.com\ncustom-key: custom-value\n", 164 }
+};
+
+// C.5 and C.6 are one connection's responses each, with the table limited to 256 bytes so entries get evicted. The examples set the limit by
+// SETTINGS, here the first block starts with a dynamic table size update (0x3fe101) instead
+static const HpackExample s_ResponseExamples[] = {
+	{ "C.5.1", "3fe101"
+		"4803333032580770726976617465611d4d6f6e2c203231204f637420323031332032303a31333a323120474d546e1768747470733a2f2f7777772e6578616d706c652e636f6d",
+		":status: 302\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:21 GMT\nlocation: https://www.example.com\n", 222 },
+	{ "C.5.2", "4803333037c1c0bf",
+		":status: 307\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:21 GMT\nlocation: https://www.example.com\n", 222 },
+	{ "C.5.3", "88c1611d4d6f6e2c203231204f637420323031332032303a31333a323220474d54c05a04677a69707738666f6f3d415344"
+		"4a4b48514b425a584f5157454f50495541585157454f49553b206d61782d6167653d333630303b2076657273696f6e3d31",
+		":status: 200\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:22 GMT\nlocation: https://www.example.com\ncontent-encoding: gzip\n"
+		"set-cookie: foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1\n", 215 }
+};
+
+static const HpackExample s_HuffmanResponseExamples[] = {
+	{ "C.6.1", "3fe101"
+		"488264025885aec3771a4b6196d07abe941054d444a8200595040b8166e082a62d1bff6e919d29ad171863c78f0b97c8e9ae82ae43d3",
+		":status: 302\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:21 GMT\nlocation: https://www.example.com\n", 222 },
+	{ "C.6.2", "4883640effc1c0bf",
+		":status: 307\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:21 GMT\nlocation: https://www.example.com\n", 222 },
+	{ "C.6.3", "88c16196d07abe941054d444a8200595040b8166e084a62d1bffc05a839bd9ab77ad94e7821dd7f2e6c7b335dfdfcd5b3960d5af27087f3672c1ab270fb5291f9587"
+		"316065c003ed4ee5b1063d5007",
+		":status: 200\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:22 GMT\nlocation: https://www.example.com\ncontent-encoding: gzip\n"
+		"set-cookie: foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1\n", 215 }
+};
+
+
+static std::vector<uint8_t> fromHex(const char* hex)
+{
+	std::vector<uint8_t> bytes;
+	for (size_t i = 0; hex[i] != '\0' && hex[i + 1] != '\0'; i += 2)
+	{
+		char byte[3] = { hex[i], hex[i + 1], '\0' };
+		bytes.push_back((uint8_t)strtoul(byte, NULL, 16));
+	}
+
+	return bytes;
+}
+
+
+static void onHeader(const char* name, size_t nameLen, const char* value, size_t valueLen, void* userCookie)
+{
+	std::string* headers = (std::string*)userCookie;
+	headers->append(name, nameLen);
+	headers->append(": ");
+	headers->append(value, valueLen);
+	headers->append("\n");
+}
+
+
+/**
+ * Decode the examples in order with one decoder, as the header blocks of one direction of a connection
+ */
+static void checkExamples(const HpackExample* examples, size_t numOfExamples)
+{
+	HpackDecoder decoder;
+	for (size_t i = 0; i < numOfExamples; i++)
+	{
+		std::vector<uint8_t> block = fromHex(examples[i].block);
+		std::string headers;
+		bool decoded = decoder.decodeHeaderBlock(block.data(), block.size(), onHeader, &headers);
+		if (!decoded || headers != examples[i].headers || decoder.getTableSize() != examples[i].tableSize)
+			printf("example %s decoded to:\n%s(table size %d)\n", examples[i].section, headers.c_str(), (int)decoder.getTableSize());
+		CHECK(decoded);
+		CHECK(headers == examples[i].headers);
+		CHECK(decoder.getTableSize() == examples[i].tableSize);
+	}
+}
+
+
+static void checkMalformed()
+{
+	HpackDecoder decoder;
+	std::string headers;
+
+	// an index past the static table with an empty dynamic table
+	uint8_t badIndex[] = { 0xbe };
+	CHECK(!decoder.decodeHeaderBlock(badIndex, sizeof(badIndex), onHeader, &headers));
+
+	// a literal longer than the block
+	uint8_t truncated[] = { 0x40, 0x0a, 'c', 'u', 's' };
+	CHECK(!decoder.decodeHeaderBlock(truncated, sizeof(truncated), onHeader, &headers));
+
+	// Huffman padding must be the most significant bits of EOS, at most 7 of them
+	char decoded[16];
+	size_t decodedLen;
+	uint8_t badPadding[] = { 0xf1, 0xe3, 0x00 };
+	CHECK(!HpackDecoder::huffmanDecode(badPadding, sizeof(badPadding), decoded, sizeof(decoded), decodedLen));
+	uint8_t longPadding[] = { 0xf1, 0xe3, 0xff };
+	CHECK(!HpackDecoder::huffmanDecode(longPadding, sizeof(longPadding), decoded, sizeof(decoded), decodedLen));
+}
+
+
+int main()
+{
+	for (size_t i = 0; i < sizeof(s_LiteralExamples) / sizeof(s_LiteralExamples[0]); i++)
+		checkExamples(&s_LiteralExamples[i], 1);
+	checkExamples(s_RequestExamples, sizeof(s_RequestExamples) / sizeof(s_RequestExamples[0]));
+	checkExamples(s_HuffmanRequestExamples, sizeof(s_HuffmanRequestExamples) / sizeof(s_HuffmanRequestExamples[0]));
+	checkExamples(s_ResponseExamples, sizeof(s_ResponseExamples) / sizeof(s_ResponseExamples[0]));
+	checkExamples(s_HuffmanResponseExamples, sizeof(s_HuffmanResponseExamples) / sizeof(s_HuffmanResponseExamples[0]));
+	checkMalformed();
+
+	return reportChecks("HpackDecoderCheck");
+}
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "../HttpTransactionTracker.h"
+#include "../Http2TransactionTracker.h"
+#include "CheckUtils.h"
+
+#define CLIENT_SIDE 0
+#define SERVER_SIDE 1
+
+
+/**
+ * The endpoints of the test connection, and the transactions reported on it as "<method> <host> <uri> <status> <time to first byte usec>"
+ */
+struct TestConnection
+{
+	pcpp::IPv4Address clientIP;
+	pcpp::IPv4Address serverIP;
+	pcpp::ConnectionData connData;
+	HttpLatencyTable latencyTable;
+	std::vector<std::string> transactions;
+
+	TestConnection() : clientIP((uint32_t)0x0100000a), serverIP((uint32_t)0x0200000a)
+	{
+		connData.srcIP = &clientIP;
+		connData.dstIP = &serverIP;
+		connData.srcPort = 1234;
+		connData.dstPort = 80;
+	}
+
+	~TestConnection()
+	{
+		// the addresses belong to the connection, not to connData
+		connData.srcIP = NULL;
+		connData.dstIP = NULL;
+	}
+};
+
+
+static void onTransactionComplete(const HttpTransaction& transaction, void* userCookie)
+{
+	TestConnection* connection = (TestConnection*)userCookie;
+	char record[256];
+	snprintf(record, sizeof(record), "%s %s %s %d %d", transaction.method, transaction.host, transaction.uri, (int)transaction.statusCode,
+			(int)transaction.timeToFirstByteUsec);
+	connection->transactions.push_back(record);
+}
+
+
+/**
+ * Append an HTTP/2 frame
+ */
+static void appendFrame(std::string& data, uint8_t type, uint8_t flags, uint32_t streamId, const std::string& payload)
+{
+	uint8_t header[HTTP2_FRAME_HEADER_LEN] = { (uint8_t)(payload.size() >> 16), (uint8_t)(payload.size() >> 8), (uint8_t)payload.size(), type, flags,
+			(uint8_t)(streamId >> 24), (uint8_t)(streamId >> 16), (uint8_t)(streamId >> 8), (uint8_t)streamId };
+	data.append((const char*)header, sizeof(header));
+	data.append(payload);
+}
+
+
+static void checkH2cUpgrade()
+{
+	// regression: the server's frames after the 101 went to the HTTP/1.x tracker until the client's preface arrived, and the upgrade request
+	// (stream 1) was recorded as a 101 transaction instead of being paired with its HTTP/2 response
+	TestConnection connection;
+	HttpTransactionTracker httpTracker(connection.connData, CLIENT_SIDE, &connection.latencyTable, NULL, onTransactionComplete, &connection);
+
+	timeval requestTime = { 100, 0 };
+	std::string request = "GET /upgrade HTTP/1.1\r\nHost: example.com\r\nConnection: Upgrade, HTTP2-Settings\r\nUpgrade: h2c\r\n"
+			"HTTP2-Settings: AAMAAABkAAQAAP__\r\n\r\n";
+	httpTracker.feed(CLIENT_SIDE, (const uint8_t*)request.data(), request.size(), requestTime);
+
+	// the 101, then the server's SETTINGS and the response to the upgrade request (":status: 200") in the same data
+	timeval responseTime = { 100, 500000 };
+	std::string response = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+	size_t frameOffset = response.size();
+	appendFrame(response, 0x4, 0, 0, "");
+	appendFrame(response, 0x1, 0x05, 1, "\x88");
+	httpTracker.feed(SERVER_SIDE, (const uint8_t*)response.data(), response.size(), responseTime);
+
+	CHECK(httpTracker.isUpgraded());
+	CHECK(httpTracker.getUpgradeOffset() == frameOffset);
+	CHECK(connection.transactions.empty());
+
+	// the switch the capture pipeline makes
+	Http2TransactionTracker http2Tracker(connection.connData, CLIENT_SIDE, &connection.latencyTable, NULL, onTransactionComplete, &connection);
+	HttpTransaction upgradeRequest;
+	timeval requestLastByteTime;
+	CHECK(httpTracker.getUpgradeRequest(upgradeRequest, requestLastByteTime));
+	http2Tracker.addUpgradeRequest(upgradeRequest, requestLastByteTime);
+	http2Tracker.feed(SERVER_SIDE, (const uint8_t*)response.data() + frameOffset, response.size() - frameOffset, responseTime);
+
+	CHECK(connection.transactions.size() == 1 && connection.transactions[0] == "GET example.com /upgrade 200 500000");
+
+	// the client's preface and a request on stream 3 ("GET http /"), answered with headers and a body
+	timeval nextRequestTime = { 101, 0 };
+	std::string nextRequest = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+	appendFrame(nextRequest, 0x4, 0, 0, "");
+	appendFrame(nextRequest, 0x1, 0x05, 3, "\x82\x86\x84");
+	http2Tracker.feed(CLIENT_SIDE, (const uint8_t*)nextRequest.data(), nextRequest.size(), nextRequestTime);
+
+	timeval nextResponseTime = { 101, 2000 };
+	std::string nextResponse;
+	appendFrame(nextResponse, 0x1, 0x04, 3, "\x88");
+	appendFrame(nextResponse, 0x0, 0x01, 3, "hello");
+	http2Tracker.feed(SERVER_SIDE, (const uint8_t*)nextResponse.data(), nextResponse.size(), nextResponseTime);
+
+	CHECK(connection.transactions.size() == 2 && connection.transactions[1] == "GET  / 200 2000");
+	CHECK(http2Tracker.numOfTransactions == 2);
+	CHECK(http2Tracker.numOfUnmatchedResponses == 0);
+}
+
+
+static void checkWebSocketUpgradeUnchanged()
+{
+	// a WebSocket upgrade's 101 still completes its request, nothing is left for stream 1
+	TestConnection connection;
+	HttpTransactionTracker httpTracker(connection.connData, CLIENT_SIDE, &connection.latencyTable, NULL, onTransactionComplete, &connection);
+
+	timeval requestTime = { 100, 0 };
+	std::string request = "GET /chat HTTP/1.1\r\nHost: example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\n\r\n";
+	httpTracker.feed(CLIENT_SIDE, (const uint8_t*)request.data(), request.size(), requestTime);
+
+	timeval responseTime = { 100, 1000 };
+	std::string response = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: websocket\r\n\r\n";
+	httpTracker.feed(SERVER_SIDE, (const uint8_t*)response.data(), response.size(), responseTime);
+
+	HttpTransaction upgradeRequest;
+	timeval requestLastByteTime;
+	CHECK(httpTracker.isUpgraded());
+	CHECK(!httpTracker.getUpgradeRequest(upgradeRequest, requestLastByteTime));
+	CHECK(connection.transactions.size() == 1 && connection.transactions[0] == "GET example.com /chat 101 1000");
+}
+
+
+int main()
+{
+	checkH2cUpgrade();
+	checkWebSocketUpgradeUnchanged();
+
+	return reportChecks("Http2TransactionTrackerCheck");
+}
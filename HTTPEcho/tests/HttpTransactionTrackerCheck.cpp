@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "../HttpTransactionTracker.h"
+#include "CheckUtils.h"
+
+#define CLIENT_SIDE 0
+#define SERVER_SIDE 1
+
+
+/**
+ * A connection fed through the tracker, and the transactions reported on it as
+ * "<method> <host> <uri> <status> <request body bytes> <response body bytes> <time to first byte usec> <response time usec>"
+ */
+struct TrackedConnection
+{
+	pcpp::IPv4Address clientIP;
+	pcpp::IPv4Address serverIP;
+	pcpp::ConnectionData connData;
+	HttpLatencyTable latencyTable;
+	HttpTransactionTracker* tracker;
+	std::vector<std::string> transactions;
+
+	TrackedConnection() : clientIP((uint32_t)0x0100000a), serverIP((uint32_t)0x0200000a)
+	{
+		connData.srcIP = &clientIP;
+		connData.dstIP = &serverIP;
+		connData.srcPort = 1234;
+		connData.dstPort = 80;
+		tracker = new HttpTransactionTracker(connData, CLIENT_SIDE, &latencyTable, NULL, onTransactionComplete, this);
+	}
+
+	~TrackedConnection()
+	{
+		// the addresses belong to the connection, not to connData
+		connData.srcIP = NULL;
+		connData.dstIP = NULL;
+		delete tracker;
+	}
+
+	/**
+	 * Feed data captured the given number of microseconds after the connection's first byte
+	 */
+	void feed(int side, const std::string& data, long usec)
+	{
+		timeval timestamp = { 100 + usec / 1000000, usec % 1000000 };
+		tracker->feed(side, (const uint8_t*)data.data(), data.size(), timestamp);
+	}
+
+	static void onTransactionComplete(const HttpTransaction& transaction, void* userCookie)
+	{
+		TrackedConnection* connection = (TrackedConnection*)userCookie;
+		char record[256];
+		snprintf(record, sizeof(record), "%s %s %s %d %d %d %d %d", transaction.method, transaction.host, transaction.uri,
+				(int)transaction.statusCode, (int)transaction.requestBodyBytes, (int)transaction.responseBodyBytes,
+				(int)transaction.timeToFirstByteUsec, (int)transaction.responseTimeUsec);
+		connection->transactions.push_back(record);
+	}
+};
+
+
+static void checkTiming()
+{
+	// the times are taken from the request's last byte: to the first byte of the response and to its last byte
+	TrackedConnection connection;
+	connection.feed(CLIENT_SIDE, "GET /index.html?q=1 HTTP/1.1\r\nHost: exam", 0);
+	connection.feed(CLIENT_SIDE, "ple.com\r\n\r\n", 500);
+	connection.feed(SERVER_SIDE, "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nhello", 1500);
+	CHECK(connection.transactions.empty());
+	connection.feed(SERVER_SIDE, "world", 4500);
+
+	CHECK(connection.transactions.size() == 1 && connection.transactions[0] == "GET example.com /index.html 200 0 10 1000 4000");
+	CHECK(connection.tracker->numOfTransactions == 1);
+}
+
+
+static void checkPipelining()
+{
+	// requests sent back to back are paired with the responses in the order they were sent
+	TrackedConnection connection;
+	connection.feed(CLIENT_SIDE, "GET /a HTTP/1.1\r\nHost: h\r\n\r\nPOST /b HTTP/1.1\r\nHost: h\r\nContent-Length: 3\r\n\r\nabc"
+			"GET /c HTTP/1.1\r\nHost: h\r\n\r\n", 0);
+	connection.feed(SERVER_SIDE, "HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\na"
+			"HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n", 1000);
+	connection.feed(SERVER_SIDE, "HTTP/1.1 404 Not Found\r\nContent-Length: 2\r\n\r\nno", 3000);
+
+	CHECK(connection.transactions.size() == 3);
+	CHECK(connection.transactions.size() > 0 && connection.transactions[0] == "GET h /a 200 0 1 1000 1000");
+	CHECK(connection.transactions.size() > 1 && connection.transactions[1] == "POST h /b 201 3 0 1000 1000");
+	CHECK(connection.transactions.size() > 2 && connection.transactions[2] == "GET h /c 404 0 2 3000 3000");
+
+	// a response nothing asked for is counted, not paired
+	connection.feed(SERVER_SIDE, "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", 4000);
+	CHECK(connection.transactions.size() == 3);
+	CHECK(connection.tracker->numOfUnmatchedResponses == 1);
+}
+
+
+static void checkInterimResponses()
+{
+	// a 100 Continue and a 103 Early Hints precede the final response, which is the one the transaction is timed with
+	TrackedConnection connection;
+	connection.feed(CLIENT_SIDE, "POST /upload HTTP/1.1\r\nHost: h\r\nExpect: 100-continue\r\nContent-Length: 4\r\n\r\n", 0);
+	connection.feed(SERVER_SIDE, "HTTP/1.1 100 Continue\r\n\r\n", 1000);
+	connection.feed(CLIENT_SIDE, "data", 2000);
+	connection.feed(SERVER_SIDE, "HTTP/1.1 103 Early Hints\r\nLink: </style.css>; rel=preload\r\n\r\n", 3000);
+	connection.feed(SERVER_SIDE, "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok", 7000);
+
+	CHECK(connection.transactions.size() == 1 && connection.transactions[0] == "POST h /upload 200 4 2 5000 5000");
+	CHECK(connection.tracker->numOfUnmatchedResponses == 0);
+}
+
+
+static void checkResponsesWithoutBody()
+{
+	// a response to HEAD, a 204 and a 304 end with their headers whatever their Content-Length says
+	TrackedConnection connection;
+	connection.feed(CLIENT_SIDE, "HEAD /a HTTP/1.1\r\nHost: h\r\n\r\nDELETE /b HTTP/1.1\r\nHost: h\r\n\r\nGET /c HTTP/1.1\r\nHost: h\r\n\r\n"
+			"GET /d HTTP/1.1\r\nHost: h\r\n\r\n", 0);
+	connection.feed(SERVER_SIDE, "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n", 1000);
+	connection.feed(SERVER_SIDE, "HTTP/1.1 204 No Content\r\n\r\n", 2000);
+	connection.feed(SERVER_SIDE, "HTTP/1.1 304 Not Modified\r\nContent-Length: 100\r\n\r\n", 3000);
+	connection.feed(SERVER_SIDE, "HTTP/1.1 200 OK\r\nContent-Length: 3\r\n\r\nabc", 4000);
+
+	CHECK(connection.transactions.size() == 4);
+	CHECK(connection.transactions.size() > 0 && connection.transactions[0] == "HEAD h /a 200 0 0 1000 1000");
+	CHECK(connection.transactions.size() > 1 && connection.transactions[1] == "DELETE h /b 204 0 0 2000 2000");
+	CHECK(connection.transactions.size() > 2 && connection.transactions[2] == "GET h /c 304 0 0 3000 3000");
+	CHECK(connection.transactions.size() > 3 && connection.transactions[3] == "GET h /d 200 0 3 4000 4000");
+}
+
+
+static void checkChunkedBody()
+{
+	// chunk sizes in hex with extensions, a trailer, and a chunk split between feeds. The body size is counted without the framing
+	TrackedConnection connection;
+	connection.feed(CLIENT_SIDE, "POST /c HTTP/1.1\r\nHost: h\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n0\r\n\r\n", 0);
+	connection.feed(SERVER_SIDE, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\na;name=value\r\n01234", 1000);
+	connection.feed(SERVER_SIDE, "56789\r\n2\r\nxy\r\n0\r\nX-Trailer: 1\r\n", 2000);
+	CHECK(connection.transactions.empty());
+	connection.feed(SERVER_SIDE, "\r\n", 3000);
+
+	CHECK(connection.transactions.size() == 1 && connection.transactions[0] == "POST h /c 200 3 12 1000 3000");
+}
+
+
+static void checkBodyUntilClose()
+{
+	// a response without a length ends with the connection
+	TrackedConnection connection;
+	connection.feed(CLIENT_SIDE, "GET /stream HTTP/1.0\r\nHost: h\r\n\r\n", 0);
+	connection.feed(SERVER_SIDE, "HTTP/1.0 200 OK\r\n\r\nsome", 1000);
+	connection.feed(SERVER_SIDE, " more", 2500);
+	CHECK(connection.transactions.empty());
+
+	connection.tracker->finish();
+	CHECK(connection.transactions.size() == 1 && connection.transactions[0] == "GET h /stream 200 0 9 1000 2500");
+}
+
+
+static void checkHoles()
+{
+	// a hole inside a body of known length is skipped and counted as body, the connection stays in sync
+	TrackedConnection connection;
+	connection.feed(CLIENT_SIDE, "GET /a HTTP/1.1\r\nHost: h\r\n\r\n", 0);
+	connection.feed(SERVER_SIDE, "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nab", 1000);
+	connection.tracker->skipMissingData(SERVER_SIDE, 6);
+	connection.feed(SERVER_SIDE, "yz", 2000);
+	connection.feed(CLIENT_SIDE, "GET /b HTTP/1.1\r\nHost: h\r\n\r\n", 3000);
+	connection.feed(SERVER_SIDE, "HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\n", 4000);
+	connection.tracker->skipMissingData(SERVER_SIDE, 4);
+
+	CHECK(connection.transactions.size() == 2);
+	CHECK(connection.transactions.size() > 0 && connection.transactions[0] == "GET h /a 200 0 10 1000 2000");
+	CHECK(connection.transactions.size() > 1 && connection.transactions[1] == "GET h /b 200 0 4 1000 1000");
+
+	// a hole anywhere else loses sync: the pending requests are dropped, and the side waits for the next message to start
+	connection.feed(CLIENT_SIDE, "GET /c HTTP/1.1\r\nHost: h\r\n\r\n", 5000);
+	connection.feed(SERVER_SIDE, "HTTP/1.1 200 OK\r\nContent-", 6000);
+	connection.tracker->skipMissingData(SERVER_SIDE, 20);
+	connection.feed(SERVER_SIDE, "ength: 0\r\n\r\n", 7000);
+	connection.feed(CLIENT_SIDE, "GET /d HTTP/1.1\r\nHost: h\r\n\r\n", 8000);
+	connection.feed(SERVER_SIDE, "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", 9000);
+
+	CHECK(connection.transactions.size() == 3 && connection.transactions[2] == "GET h /d 200 0 0 1000 1000");
+	CHECK(connection.tracker->numOfUnmatchedResponses == 0);
+}
+
+
+int main()
+{
+	checkTiming();
+	checkPipelining();
+	checkInterimResponses();
+	checkResponsesWithoutBody();
+	checkChunkedBody();
+	checkBodyUntilClose();
+	checkHoles();
+
+	return reportChecks("HttpTransactionTrackerCheck");
+}
@@ -0,0 +1,211 @@
+#include <string.h>
+#include <vector>
+#include "../IPDefragmenter.h"
+#include "CheckUtils.h"
+
+// the datagram payload the fragments are cut from
+#define PAYLOAD_LEN 3000
+
+
+/**
+ * Build an Ethernet + IPv4 fragment of a datagram from 10.0.0.1 to 10.0.0.2
+ */
+static std::vector<uint8_t> makeIPv4Fragment(uint16_t fragmentID, size_t offset, bool moreFragments, const uint8_t* payload, size_t payloadLen)
+{
+	std::vector<uint8_t> frame(14 + 20 + payloadLen, 0);
+	frame[12] = 0x08;
+
+	uint8_t* ipHeader = &frame[14];
+	size_t totalLen = 20 + payloadLen;
+	uint16_t fragmentField = (uint16_t)((offset / 8) | (moreFragments ? 0x2000 : 0));
+	ipHeader[0] = 0x45;
+	ipHeader[2] = (uint8_t)(totalLen >> 8);
+	ipHeader[3] = (uint8_t)totalLen;
+	ipHeader[4] = (uint8_t)(fragmentID >> 8);
+	ipHeader[5] = (uint8_t)fragmentID;
+	ipHeader[6] = (uint8_t)(fragmentField >> 8);
+	ipHeader[7] = (uint8_t)fragmentField;
+	ipHeader[8] = 64;
+	ipHeader[9] = 6;
+	ipHeader[12] = 10;
+	ipHeader[15] = 1;
+	ipHeader[16] = 10;
+	ipHeader[19] = 2;
+	memcpy(ipHeader + 20, payload, payloadLen);
+	return frame;
+}
+
+
+/**
+ * Build an Ethernet + IPv6 fragment (a fixed header followed by a fragment header) of a datagram from fe80::1 to fe80::2
+ */
+static std::vector<uint8_t> makeIPv6Fragment(uint32_t fragmentID, size_t offset, bool moreFragments, const uint8_t* payload, size_t payloadLen)
+{
+	std::vector<uint8_t> frame(14 + 40 + 8 + payloadLen, 0);
+	frame[12] = 0x86;
+	frame[13] = 0xdd;
+
+	uint8_t* ipHeader = &frame[14];
+	size_t ipPayloadLen = 8 + payloadLen;
+	ipHeader[0] = 0x60;
+	ipHeader[4] = (uint8_t)(ipPayloadLen >> 8);
+	ipHeader[5] = (uint8_t)ipPayloadLen;
+	ipHeader[6] = 44;
+	ipHeader[7] = 64;
+	ipHeader[8] = 0xfe;
+	ipHeader[9] = 0x80;
+	ipHeader[23] = 1;
+	ipHeader[24] = 0xfe;
+	ipHeader[25] = 0x80;
+	ipHeader[39] = 2;
+
+	uint8_t* fragmentHeader = ipHeader + 40;
+	uint16_t fragmentField = (uint16_t)(offset | (moreFragments ? 1 : 0));
+	fragmentHeader[0] = 6;
+	fragmentHeader[2] = (uint8_t)(fragmentField >> 8);
+	fragmentHeader[3] = (uint8_t)fragmentField;
+	fragmentHeader[4] = (uint8_t)(fragmentID >> 24);
+	fragmentHeader[5] = (uint8_t)(fragmentID >> 16);
+	fragmentHeader[6] = (uint8_t)(fragmentID >> 8);
+	fragmentHeader[7] = (uint8_t)fragmentID;
+	memcpy(fragmentHeader + 8, payload, payloadLen);
+	return frame;
+}
+
+
+/**
+ * Feed one frame to the defragmenter
+ */
+static pcpp::RawPacket* feed(IPDefragmenter& defragmenter, std::vector<uint8_t>& frame, IPDefragmenter::Status& status)
+{
+	// the packet doesn't own the frame, and the defragmenter copies what it keeps
+	timeval timestamp = { 100, 0 };
+	pcpp::RawPacket packet(frame.data(), (int)frame.size(), timestamp, false);
+	return defragmenter.processPacket(&packet, status);
+}
+
+
+static void checkIPv4OutOfOrder(const uint8_t* payload)
+{
+	IPDefragmenter defragmenter;
+	IPDefragmenter::Status status;
+
+	std::vector<uint8_t> first = makeIPv4Fragment(5, 0, true, payload, 1480);
+	std::vector<uint8_t> middle = makeIPv4Fragment(5, 1480, true, payload + 1480, 1480);
+	std::vector<uint8_t> last = makeIPv4Fragment(5, 2960, false, payload + 2960, PAYLOAD_LEN - 2960);
+
+	CHECK(feed(defragmenter, last, status) == NULL && status == IPDefragmenter::FragmentStored);
+	CHECK(feed(defragmenter, first, status) == NULL && status == IPDefragmenter::FragmentStored);
+
+	pcpp::RawPacket* reassembled = feed(defragmenter, middle, status);
+	CHECK(reassembled != NULL && status == IPDefragmenter::Reassembled);
+	if (reassembled == NULL)
+		return;
+
+	const uint8_t* ipHeader = reassembled->getRawData() + 14;
+	CHECK(reassembled->getRawDataLen() == 14 + 20 + PAYLOAD_LEN);
+	CHECK(memcmp(ipHeader + 20, payload, PAYLOAD_LEN) == 0);
+	CHECK(((ipHeader[2] << 8) | ipHeader[3]) == 20 + PAYLOAD_LEN);
+	CHECK(ipHeader[6] == 0 && ipHeader[7] == 0);
+
+	// a header with a valid checksum sums to 0xffff
+	uint32_t sum = 0;
+	for (int i = 0; i < 20; i += 2)
+		sum += (uint32_t)((ipHeader[i] << 8) | ipHeader[i + 1]);
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	CHECK(sum == 0xffff);
+
+	CHECK(defragmenter.getNumOfDatagramsInReassembly() == 0);
+	CHECK(defragmenter.numOfReassembled == 1);
+}
+
+
+static void checkNonFragment(const uint8_t* payload)
+{
+	IPDefragmenter defragmenter;
+	IPDefragmenter::Status status;
+
+	std::vector<uint8_t> frame = makeIPv4Fragment(9, 0, false, payload, 100);
+	timeval timestamp = { 100, 0 };
+	pcpp::RawPacket packet(frame.data(), (int)frame.size(), timestamp, false);
+	CHECK(defragmenter.processPacket(&packet, status) == &packet && status == IPDefragmenter::NonFragment);
+	CHECK(defragmenter.numOfFragments == 0);
+}
+
+
+static void checkDuplicateDoesNotFillHole(const uint8_t* payload)
+{
+	IPDefragmenter defragmenter;
+	IPDefragmenter::Status status;
+
+	// blocks 0 and 2 of a 3-block datagram, the first one twice: block 1 is still missing
+	std::vector<uint8_t> first = makeIPv4Fragment(7, 0, true, payload, 8);
+	std::vector<uint8_t> last = makeIPv4Fragment(7, 16, false, payload + 16, 8);
+	CHECK(feed(defragmenter, first, status) == NULL && status == IPDefragmenter::FragmentStored);
+	CHECK(feed(defragmenter, first, status) == NULL && status == IPDefragmenter::FragmentStored);
+	CHECK(feed(defragmenter, last, status) == NULL && status == IPDefragmenter::FragmentStored);
+	CHECK(defragmenter.numOfReassembled == 0);
+}
+
+
+static void checkBlockPastEndDoesNotFillHole(const uint8_t* payload)
+{
+	IPDefragmenter defragmenter;
+	IPDefragmenter::Status status;
+
+	// regression: a block past the end arrives before the last fragment. The count of blocks then reached the datagram's number of blocks
+	// while block 1 was missing, and the hole was delivered with stale buffer bytes
+	std::vector<uint8_t> first = makeIPv4Fragment(8, 0, true, payload, 8);
+	std::vector<uint8_t> pastEnd = makeIPv4Fragment(8, 40, true, payload + 40, 8);
+	std::vector<uint8_t> last = makeIPv4Fragment(8, 16, false, payload + 16, 8);
+	CHECK(feed(defragmenter, first, status) == NULL && status == IPDefragmenter::FragmentStored);
+	CHECK(feed(defragmenter, pastEnd, status) == NULL && status == IPDefragmenter::FragmentStored);
+	CHECK(feed(defragmenter, last, status) == NULL && status == IPDefragmenter::MalformedFragment);
+	CHECK(defragmenter.numOfReassembled == 0);
+
+	// once the end is known, a fragment past it is dropped
+	std::vector<uint8_t> nextLast = makeIPv4Fragment(9, 16, false, payload + 16, 8);
+	std::vector<uint8_t> nextPastEnd = makeIPv4Fragment(9, 24, true, payload + 24, 8);
+	CHECK(feed(defragmenter, nextLast, status) == NULL && status == IPDefragmenter::FragmentStored);
+	CHECK(feed(defragmenter, nextPastEnd, status) == NULL && status == IPDefragmenter::MalformedFragment);
+}
+
+
+static void checkIPv6(const uint8_t* payload)
+{
+	IPDefragmenter defragmenter;
+	IPDefragmenter::Status status;
+
+	std::vector<uint8_t> first = makeIPv6Fragment(0x12345678, 0, true, payload, 1232);
+	std::vector<uint8_t> last = makeIPv6Fragment(0x12345678, 1232, false, payload + 1232, 500);
+	CHECK(feed(defragmenter, first, status) == NULL && status == IPDefragmenter::FragmentStored);
+
+	pcpp::RawPacket* reassembled = feed(defragmenter, last, status);
+	CHECK(reassembled != NULL && status == IPDefragmenter::Reassembled);
+	if (reassembled == NULL)
+		return;
+
+	// the fragment header is gone and the fixed header points to TCP
+	const uint8_t* ipHeader = reassembled->getRawData() + 14;
+	CHECK(reassembled->getRawDataLen() == 14 + 40 + 1732);
+	CHECK(ipHeader[6] == 6);
+	CHECK(((ipHeader[4] << 8) | ipHeader[5]) == 1732);
+	CHECK(memcmp(ipHeader + 40, payload, 1732) == 0);
+}
+
+
+int main()
+{
+	uint8_t payload[PAYLOAD_LEN];
+	for (int i = 0; i < PAYLOAD_LEN; i++)
+		payload[i] = (uint8_t)(i * 7);
+
+	checkIPv4OutOfOrder(payload);
+	checkNonFragment(payload);
+	checkDuplicateDoesNotFillHole(payload);
+	checkBlockPastEndDoesNotFillHole(payload);
+	checkIPv6(payload);
+
+	return reportChecks("IPDefragmenterCheck");
+}
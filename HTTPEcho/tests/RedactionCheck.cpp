@@ -0,0 +1,208 @@
+#include <string.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../HttpTransactionTracker.h"
+#include "CheckUtils.h"
+
+#define CLIENT_SIDE 0
+
+
+/**
+ * A client side of one HTTP connection fed through the tracker, and its capture file as the pipeline writes it
+ */
+struct RedactedStream
+{
+	pcpp::IPv4Address clientIP;
+	pcpp::IPv4Address serverIP;
+	pcpp::ConnectionData connData;
+	HttpLatencyTable latencyTable;
+	HttpTransactionTracker* tracker;
+	std::ostringstream file;
+
+	RedactedStream(const RedactionPolicy* policy) : clientIP((uint32_t)0x0100000a), serverIP((uint32_t)0x0200000a)
+	{
+		connData.srcIP = &clientIP;
+		connData.dstIP = &serverIP;
+		connData.srcPort = 1234;
+		connData.dstPort = 80;
+		tracker = new HttpTransactionTracker(connData, CLIENT_SIDE, &latencyTable, NULL, NULL, NULL, NULL, policy);
+	}
+
+	~RedactedStream()
+	{
+		// the addresses belong to the stream, not to connData
+		connData.srcIP = NULL;
+		connData.dstIP = NULL;
+		delete tracker;
+	}
+
+	/**
+	 * Feed a chunk and write it the way the capture file is written, with the redacted spans replaced
+	 */
+	void feed(const std::string& chunk)
+	{
+		std::vector<RedactedSpan> redactedSpans;
+		timeval timestamp = { 100, 0 };
+		tracker->feed(CLIENT_SIDE, (const uint8_t*)chunk.data(), chunk.size(), timestamp, NULL, &redactedSpans);
+
+		size_t written = 0;
+		for (size_t i = 0; i < redactedSpans.size(); i++)
+		{
+			file.write(chunk.data() + written, redactedSpans[i].offset - written);
+			RedactionPolicy::writeReplacement(file, redactedSpans[i]);
+			written = redactedSpans[i].offset + redactedSpans[i].length;
+		}
+		file.write(chunk.data() + written, chunk.size() - written);
+	}
+
+	/**
+	 * Write what's still held back when the connection ends
+	 */
+	void finish()
+	{
+		RedactedSpan span;
+		span.offset = 0;
+		span.length = 0;
+		span.replacementLen = tracker->getHeldRedactedBytes(CLIENT_SIDE);
+		span.digestLen = 0;
+		RedactionPolicy::writeReplacement(file, span);
+	}
+};
+
+
+static const char* s_Request =
+		"GET /login?user=bob&token=0123456789abcdef0123456789abcdef0123456789&x=1 HTTP/1.1\r\n"
+		"Host: example.com\r\n"
+		"Cookie: session=1234\r\n"
+		"X-Api-Key: 0123456789abcdef0123456789abcdef0123456789\r\n"
+		"\r\n";
+
+
+/**
+ * Feed the request cut at the given offsets
+ */
+static std::string writeSplit(const RedactionPolicy& policy, const std::vector<size_t>& cuts)
+{
+	RedactedStream stream(&policy);
+	std::string request = s_Request;
+	size_t start = 0;
+	for (size_t i = 0; i <= cuts.size(); i++)
+	{
+		size_t end = (i < cuts.size() ? cuts[i] : request.size());
+		stream.feed(request.substr(start, end - start));
+		start = end;
+	}
+
+	stream.finish();
+	return stream.file.str();
+}
+
+
+static void checkMaskAndHash(const RedactionPolicy& policy)
+{
+	std::string written = writeSplit(policy, std::vector<size_t>());
+	std::string request = s_Request;
+	CHECK(written.size() == request.size());
+
+	// masked values become '*', the rest of the request is untouched
+	CHECK(written.find("Cookie: ************\r\n") != std::string::npos);
+	CHECK(written.find("GET /login?user=bob&token=") == 0);
+	CHECK(written.find("Host: example.com\r\n") != std::string::npos);
+
+	// a hashed value longer than the digest is masked up to its last 32 bytes, which hold the digest
+	size_t token = written.find("token=") + 6;
+	std::string tokenValue = written.substr(token, 42);
+	CHECK(tokenValue.substr(0, 10) == std::string(10, '*'));
+	CHECK(tokenValue.find_first_not_of("0123456789abcdef", 10) == std::string::npos);
+	CHECK(written.compare(token + 42, 4, "&x=1") == 0);
+	CHECK(written.find("0123456789abcdef0123456789") == std::string::npos);
+}
+
+
+static void checkSplitHashedValue(const RedactionPolicy& policy)
+{
+	// regression: the digest of a value split over chunks was cut to the length of its last piece, and was missing if that piece was empty
+	std::string whole = writeSplit(policy, std::vector<size_t>());
+	std::string request = s_Request;
+	size_t header = request.find("X-Api-Key: ") + 11;
+	size_t token = request.find("token=") + 6;
+
+	size_t cutsInHeader[] = { 1, 10, 39, 41, 42 };
+	for (size_t i = 0; i < sizeof(cutsInHeader) / sizeof(cutsInHeader[0]); i++)
+		CHECK(writeSplit(policy, std::vector<size_t>(1, header + cutsInHeader[i])) == whole);
+
+	// several cuts in one value, and a value which ends right at a cut
+	std::vector<size_t> cuts;
+	cuts.push_back(token + 5);
+	cuts.push_back(token + 30);
+	cuts.push_back(token + 41);
+	cuts.push_back(token + 42);
+	cuts.push_back(header + 20);
+	cuts.push_back(header + 21);
+	CHECK(writeSplit(policy, cuts) == whole);
+}
+
+
+static void checkMidStreamMasked(const RedactionPolicy& policy)
+{
+	// regression: a connection picked up in the middle of a request wrote everything up to the next request in the clear
+	RedactedStream stream(&policy);
+	std::string midStream = "ion: Bearer abc\r\nCookie: session=1234\r\n\r\n";
+	stream.feed(midStream);
+	CHECK(stream.file.str() == std::string(midStream.size(), '*'));
+
+	// the next request is written as usual
+	std::string nextRequest = "GET / HTTP/1.1\r\nCookie: a\r\n\r\n";
+	stream.feed(nextRequest);
+	CHECK(stream.file.str() == std::string(midStream.size(), '*') + "GET / HTTP/1.1\r\nCookie: *\r\n\r\n");
+	CHECK(stream.file.str().find("session") == std::string::npos);
+}
+
+
+static void checkDataAfterHoleMasked(const RedactionPolicy& policy)
+{
+	// regression: data after a hole was written in the clear until the next request. Here the hole cuts a hashed value short too
+	RedactedStream stream(&policy);
+	std::string beforeHole = "GET / HTTP/1.1\r\nX-Api-Key: 0123456789";
+	stream.feed(beforeHole);
+	stream.tracker->skipMissingData(CLIENT_SIDE, 100);
+	CHECK(stream.tracker->getHeldRedactedBytes(CLIENT_SIDE) == 10);
+
+	std::string afterHole = "abcdef\r\nCookie: session=1234\r\n\r\n";
+	stream.feed(afterHole);
+	std::string expected = "GET / HTTP/1.1\r\nX-Api-Key: " + std::string(10 + afterHole.size(), '*');
+	CHECK(stream.file.str() == expected);
+	CHECK(stream.tracker->getHeldRedactedBytes(CLIENT_SIDE) == 0);
+
+	// a value cut short by the connection's end is masked when the connection ends
+	RedactedStream cutShort(&policy);
+	cutShort.feed(beforeHole);
+	cutShort.finish();
+	CHECK(cutShort.file.str() == "GET / HTTP/1.1\r\nX-Api-Key: " + std::string(10, '*'));
+}
+
+
+static void checkNoPolicyUntouched()
+{
+	// without a policy, data the parser lost sync on is written as it is
+	RedactedStream stream(NULL);
+	std::string midStream = "ion: Bearer abc\r\n";
+	stream.feed(midStream);
+	CHECK(stream.file.str() == midStream);
+}
+
+
+int main()
+{
+	RedactionPolicy policy;
+	CHECK(policy.parse("header:cookie,header:x-api-key:hash,query:token:hash,header:authorization"));
+
+	checkMaskAndHash(policy);
+	checkSplitHashedValue(policy);
+	checkMidStreamMasked(policy);
+	checkDataAfterHoleMasked(policy);
+	checkNoPolicyUntouched();
+
+	return reportChecks("RedactionCheck");
+}
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "../ResponseVerifier.h"
+#include "CheckUtils.h"
+
+#define CAPTURE_FILE_NAME "10.0.0.1.1234.txt"
+
+
+static const char* s_CapturedFirstResponse =
+		"HTTP/1.1 200 OK\r\n"
+		"Content-Type: text/plain\r\n"
+		"Date: Mon, 21 Oct 2013 20:13:21 GMT\r\n"
+		"Content-Length: 11\r\n"
+		"X-Id:  a   b \r\n"
+		"\r\n"
+		"hello world";
+
+static const char* s_CapturedSecondResponse =
+		"HTTP/1.1 404 Not Found\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n";
+
+
+/**
+ * A corpus of one captured connection with two requests, and a verifier of one connection slot writing to a diff file next to it
+ */
+struct VerifiedReplay
+{
+	char dirName[64];
+	ReplayCorpus corpus;
+	ResponseVerifier verifier;
+	VerifyCounters counters;
+
+	VerifiedReplay() : verifier(VERIFY_DEFAULT_IGNORED_HEADERS)
+	{
+		strcpy(dirName, "/tmp/ResponseVerifierCheck.XXXXXX");
+		CHECK(mkdtemp(dirName) != NULL);
+
+		std::ofstream captureFile((std::string(dirName) + "/" CAPTURE_FILE_NAME).c_str(), std::ios_base::binary);
+		captureFile << "GET /a HTTP/1.1\r\nHost: example.com\r\n\r\n" << s_CapturedFirstResponse;
+		captureFile << "GET /b HTTP/1.1\r\nHost: example.com\r\n\r\n" << s_CapturedSecondResponse;
+		captureFile.close();
+
+		CHECK(corpus.load(dirName));
+		CHECK(corpus.getNumOfRequests() == 2);
+		verifier.loadCorpus(corpus);
+		CHECK(verifier.createDiffFile(getDiffFilePath()));
+		CHECK(verifier.open(1));
+		memset(&counters, 0, sizeof(counters));
+	}
+
+	~VerifiedReplay()
+	{
+		unlink((std::string(dirName) + "/" CAPTURE_FILE_NAME).c_str());
+		unlink(getDiffFilePath().c_str());
+		rmdir(dirName);
+	}
+
+	std::string getDiffFilePath() const
+	{
+		return std::string(dirName) + "/diffs.tsv";
+	}
+
+	/**
+	 * Verify a replayed response the way a replay worker does, fed in pieces of the given size
+	 */
+	void replay(uint32_t request, const std::string& response, size_t pieceLen)
+	{
+		HttpMessageFramer framer;
+		framer.setBodyListener(verifier.getBodyListener(0));
+		framer.reset(false, false);
+		verifier.startResponse(0, request);
+
+		size_t pos = 0;
+		while (pos < response.size())
+		{
+			size_t messageLen = framer.feed((const uint8_t*)response.data() + pos, std::min(pieceLen, response.size() - pos));
+			verifier.feed(0, (const uint8_t*)response.data() + pos, messageLen);
+			pos += messageLen;
+			if (framer.isComplete() && framer.isInterim())
+			{
+				framer.reset(false, false);
+				verifier.startResponse(0, request);
+			}
+		}
+
+		CHECK(framer.isComplete());
+		verifier.finishResponse(0, framer.getStatusCode(), counters);
+	}
+
+	/**
+	 * @return The diff rows written so far, without the header row
+	 */
+	std::string getDiffRows()
+	{
+		verifier.flush();
+		std::ifstream diffFile(getDiffFilePath().c_str());
+		std::stringstream rows;
+		rows << diffFile.rdbuf();
+		std::string diffs = rows.str();
+		size_t headerEnd = diffs.find('\n');
+		return (headerEnd == std::string::npos ? "" : diffs.substr(headerEnd + 1));
+	}
+};
+
+
+static void checkStreamingHash()
+{
+	// the hash doesn't depend on how the stream is split
+	std::string data = "The quick brown fox jumps over the lazy dog, twice: the quick brown fox jumps over the lazy dog";
+	StreamingHash whole;
+	whole.add((const uint8_t*)data.data(), data.size());
+
+	for (size_t pieceLen = 1; pieceLen <= 17; pieceLen++)
+	{
+		StreamingHash split;
+		for (size_t pos = 0; pos < data.size(); pos += pieceLen)
+			split.add((const uint8_t*)data.data() + pos, std::min(pieceLen, data.size() - pos));
+		CHECK(split.getHash() == whole.getHash());
+		CHECK(split.getLength() == data.size());
+	}
+
+	// trailing zero bytes and a single changed bit give another hash
+	StreamingHash padded;
+	padded.add((const uint8_t*)data.data(), data.size());
+	padded.add((const uint8_t*)"\0", 1);
+	CHECK(padded.getHash() != whole.getHash());
+
+	std::string changed = data;
+	changed[40] ^= 0x01;
+	StreamingHash flipped;
+	flipped.add((const uint8_t*)changed.data(), changed.size());
+	CHECK(flipped.getHash() != whole.getHash());
+}
+
+
+static void checkSameResponses()
+{
+	VerifiedReplay replay;
+
+	// the captured responses as they were
+	replay.replay(0, s_CapturedFirstResponse, 4096);
+	replay.replay(1, s_CapturedSecondResponse, 4096);
+
+	// the same content with header names in another case, white space moved around, another date, the body chunked and an interim response
+	// first, fed a byte at a time
+	std::string reframed =
+			"HTTP/1.1 100 Continue\r\n\r\n"
+			"HTTP/1.1 200 OK\r\n"
+			"x-id: a b\r\n"
+			"content-type:text/plain  \r\n"
+			"Date: Tue, 22 Oct 2013 08:00:00 GMT\r\n"
+			"Transfer-Encoding: chunked\r\n"
+			"\r\n"
+			"6\r\nhello \r\n5\r\nworld\r\n0\r\n\r\n";
+	replay.replay(0, reframed, 1);
+
+	CHECK(replay.counters.numOfVerified == 3);
+	CHECK(replay.counters.numOfMismatches == 0);
+	CHECK(replay.getDiffRows() == "");
+}
+
+
+static void checkDifferences()
+{
+	VerifiedReplay replay;
+
+	// another status, a changed header, a header left out, a header added and another body
+	std::string changed =
+			"HTTP/1.1 500 Internal Server Error\r\n"
+			"Content-Type: text/html\r\n"
+			"Content-Length: 5\r\n"
+			"X-New: 1\r\n"
+			"\r\n"
+			"oops!";
+	replay.replay(0, changed, 7);
+
+	CHECK(replay.counters.numOfVerified == 1);
+	CHECK(replay.counters.numOfMismatches == 1);
+	CHECK(replay.counters.numOfStatusMismatches == 1);
+	CHECK(replay.counters.numOfHeaderMismatches == 1);
+	CHECK(replay.counters.numOfBodyMismatches == 1);
+
+	std::string rows = replay.getDiffRows();
+	std::string rowStart = CAPTURE_FILE_NAME "\t1\tGET /a\t";
+	CHECK(rows.find(rowStart + "status\t200\t500\n") != std::string::npos);
+	CHECK(rows.find(rowStart + "header\tContent-Type: text/plain\tContent-Type: text/html\n") != std::string::npos);
+	CHECK(rows.find(rowStart + "header\t\tX-New: 1\n") != std::string::npos);
+	CHECK(rows.find(rowStart + "header\tX-Id:  a   b \t\n") != std::string::npos);
+	CHECK(rows.find(rowStart + "body\t11 bytes, hash ") != std::string::npos);
+	CHECK(rows.find("\t5 bytes, hash ") != std::string::npos);
+
+	// the second request matches, only its counters move
+	replay.replay(1, s_CapturedSecondResponse, 3);
+	CHECK(replay.counters.numOfVerified == 2);
+	CHECK(replay.counters.numOfMismatches == 1);
+	CHECK(replay.getDiffRows() == rows);
+}
+
+
+int main()
+{
+	checkStreamingHash();
+	checkSameResponses();
+	checkDifferences();
+
+	return reportChecks("ResponseVerifierCheck");
+}
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "../SymmetricRss.h"
+#include "CheckUtils.h"
+
+
+// the key of Microsoft's RSS hash verification examples
+static const uint8_t s_MicrosoftKey[RSS_KEY_LEN] = {
+	0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2, 0x41, 0x67,
+	0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0, 0xd0, 0xca, 0x2b, 0xcb,
+	0xae, 0x7b, 0x30, 0xb4, 0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30,
+	0xf2, 0x0c, 0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa
+};
+
+
+/**
+ * An example of the IP-only hash: the source and destination addresses, hashed in that order, and the expected hash
+ */
+struct RssExample
+{
+	const char* srcIP;
+	const char* dstIP;
+	uint32_t hash;
+};
+
+static const RssExample s_IPv4Examples[] = {
+	{ "66.9.149.187", "161.142.100.80", 0x323e8fc2 },
+	{ "199.92.111.2", "65.69.140.83", 0xd718262a },
+	{ "24.19.198.95", "12.22.207.184", 0xd2d0a5de },
+	{ "38.27.205.30", "209.142.163.6", 0x82989176 },
+	{ "153.39.163.191", "202.188.127.2", 0x5d1809c5 }
+};
+
+static const RssExample s_IPv6Examples[] = {
+	{ "3ffe:2501:200:1fff::7", "3ffe:2501:200:3::1", 0x2cc18cd5 }
+};
+
+
+static void checkExamples(const RssExample* examples, size_t numOfExamples, int family, size_t ipAddrLen)
+{
+	for (size_t i = 0; i < numOfExamples; i++)
+	{
+		uint8_t input[32];
+		CHECK(inet_pton(family, examples[i].srcIP, input) == 1);
+		CHECK(inet_pton(family, examples[i].dstIP, input + ipAddrLen) == 1);
+		uint32_t hash = computeToeplitzHash(s_MicrosoftKey, sizeof(s_MicrosoftKey), input, ipAddrLen * 2);
+		if (hash != examples[i].hash)
+			printf("%s -> %s hashed to 0x%08x, expected 0x%08x\n", examples[i].srcIP, examples[i].dstIP, hash, examples[i].hash);
+		CHECK(hash == examples[i].hash);
+	}
+}
+
+
+static void checkSymmetricHash(size_t ipAddrLen)
+{
+	// the table lookups against the bit-by-bit hash with the symmetric key, and the two directions of each pair against each other
+	srand(1);
+	for (int i = 0; i < 1000; i++)
+	{
+		uint8_t input[32];
+		for (size_t byte = 0; byte < ipAddrLen * 2; byte++)
+			input[byte] = (uint8_t)rand();
+
+		const uint8_t* srcIP = input;
+		const uint8_t* dstIP = input + ipAddrLen;
+		uint32_t hash = computeSymmetricRssHash(srcIP, dstIP, ipAddrLen);
+		CHECK(hash == computeToeplitzHash(getSymmetricRssKey(), RSS_KEY_LEN, input, ipAddrLen * 2));
+		CHECK(hash == computeSymmetricRssHash(dstIP, srcIP, ipAddrLen));
+	}
+}
+
+
+static void checkQueues()
+{
+	// the low bits of the hash select a redirection table entry, entry i holds queue (i % number of queues)
+	CHECK(getRssQueue(0x323e8fc2, 4) == (0x42 % 4));
+	CHECK(getRssQueue(0x323e8fc2, 3) == (0x42 % 3));
+	CHECK(getRssQueue(0xffffffff, 5, 64) == (63 % 5));
+	CHECK(getRssQueue(0x12345680, 7) == 0);
+}
+
+
+int main()
+{
+	checkExamples(s_IPv4Examples, sizeof(s_IPv4Examples) / sizeof(s_IPv4Examples[0]), AF_INET, 4);
+	checkExamples(s_IPv6Examples, sizeof(s_IPv6Examples) / sizeof(s_IPv6Examples[0]), AF_INET6, 16);
+	checkSymmetricHash(4);
+	checkSymmetricHash(16);
+	checkQueues();
+
+	return reportChecks("SymmetricRssCheck");
+}
@@ -0,0 +1,223 @@
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "../TcpStreamReassembly.h"
+#include "CheckUtils.h"
+
+#define TCP_FIN 0x01
+#define TCP_SYN 0x02
+#define TCP_ACK 0x10
+
+
+/**
+ * A captured TCP packet: an Ethernet + IPv4 + TCP frame and its timestamp
+ */
+struct TestPacket
+{
+	std::vector<uint8_t> frame;
+	timeval timestamp;
+};
+
+
+/**
+ * What the reassembler reported, one line per callback: "D<side> <src port> <data>", "G<side> <src port> <missing bytes>" or "E <src port>"
+ */
+struct CallbackLog
+{
+	std::vector<std::string> events;
+	std::vector<pcpp::ConnectionData> startedConnections;
+};
+
+
+static TestPacket makePacket(const char* srcIP, uint16_t srcPort, const char* dstIP, uint16_t dstPort, uint32_t sequence, uint8_t flags,
+		const char* payload = "")
+{
+	size_t payloadLen = strlen(payload);
+	TestPacket packet;
+	packet.frame.assign(14 + 20 + 20 + payloadLen, 0);
+	packet.frame[12] = 0x08;
+	packet.timestamp.tv_sec = 1000;
+	packet.timestamp.tv_usec = 0;
+
+	uint8_t* ipHeader = &packet.frame[14];
+	size_t totalLen = 40 + payloadLen;
+	ipHeader[0] = 0x45;
+	ipHeader[2] = (uint8_t)(totalLen >> 8);
+	ipHeader[3] = (uint8_t)totalLen;
+	ipHeader[8] = 64;
+	ipHeader[9] = 6;
+	sscanf(srcIP, "%hhu.%hhu.%hhu.%hhu", &ipHeader[12], &ipHeader[13], &ipHeader[14], &ipHeader[15]);
+	sscanf(dstIP, "%hhu.%hhu.%hhu.%hhu", &ipHeader[16], &ipHeader[17], &ipHeader[18], &ipHeader[19]);
+
+	uint8_t* tcpHeader = ipHeader + 20;
+	tcpHeader[0] = (uint8_t)(srcPort >> 8);
+	tcpHeader[1] = (uint8_t)srcPort;
+	tcpHeader[2] = (uint8_t)(dstPort >> 8);
+	tcpHeader[3] = (uint8_t)dstPort;
+	tcpHeader[4] = (uint8_t)(sequence >> 24);
+	tcpHeader[5] = (uint8_t)(sequence >> 16);
+	tcpHeader[6] = (uint8_t)(sequence >> 8);
+	tcpHeader[7] = (uint8_t)sequence;
+	tcpHeader[12] = 0x50;
+	tcpHeader[13] = flags;
+	memcpy(tcpHeader + 20, payload, payloadLen);
+	return packet;
+}
+
+
+static void onMessageReady(int side, const pcpp::TcpStreamData& tcpData, void* userCookie)
+{
+	CallbackLog* log = (CallbackLog*)userCookie;
+	char event[64];
+	snprintf(event, sizeof(event), "D%d %d ", side, (int)tcpData.getConnectionData().srcPort);
+	log->events.push_back(event + std::string((const char*)tcpData.getData(), tcpData.getDataLength()));
+}
+
+
+static void onStreamGap(int side, const pcpp::ConnectionData& connData, uint32_t missingDataLen, void* userCookie)
+{
+	CallbackLog* log = (CallbackLog*)userCookie;
+	char event[64];
+	snprintf(event, sizeof(event), "G%d %d %u", side, (int)connData.srcPort, missingDataLen);
+	log->events.push_back(event);
+}
+
+
+static void onConnectionStart(const pcpp::ConnectionData& connData, void* userCookie)
+{
+	CallbackLog* log = (CallbackLog*)userCookie;
+	log->startedConnections.push_back(connData);
+}
+
+
+static void onConnectionEnd(const pcpp::ConnectionData& connData, pcpp::TcpReassembly::ConnectionEndReason reason, void* userCookie)
+{
+	CallbackLog* log = (CallbackLog*)userCookie;
+	char event[64];
+	snprintf(event, sizeof(event), "E %d %s", (int)connData.srcPort, (reason == pcpp::TcpReassembly::TcpReassemblyConnectionClosedByFIN_RST ? "fin" : "manual"));
+	log->events.push_back(event);
+}
+
+
+static void feed(TcpStreamReassembly& reassembly, TestPacket& packet)
+{
+	pcpp::RawPacket rawPacket(packet.frame.data(), (int)packet.frame.size(), packet.timestamp, false);
+	reassembly.reassemblePacket(&rawPacket);
+}
+
+
+/**
+ * A connection with out-of-order data, a hole the other side's data gives up on, and a FIN from both sides
+ */
+static std::vector<TestPacket> makeConversation(const char* clientIP)
+{
+	std::vector<TestPacket> packets;
+	packets.push_back(makePacket(clientIP, 1234, "10.0.0.2", 80, 100, TCP_SYN));
+	packets.push_back(makePacket("10.0.0.2", 80, clientIP, 1234, 500, TCP_SYN | TCP_ACK));
+	packets.push_back(makePacket(clientIP, 1234, "10.0.0.2", 80, 106, TCP_ACK, "world"));
+	packets.push_back(makePacket(clientIP, 1234, "10.0.0.2", 80, 101, TCP_ACK, "hello"));
+	packets.push_back(makePacket("10.0.0.2", 80, clientIP, 1234, 501, TCP_ACK, "OK"));
+	packets.push_back(makePacket(clientIP, 1234, "10.0.0.2", 80, 200, TCP_ACK, "xyz"));
+	packets.push_back(makePacket("10.0.0.2", 80, clientIP, 1234, 503, TCP_ACK, "more"));
+	packets.push_back(makePacket(clientIP, 1234, "10.0.0.2", 80, 203, TCP_FIN | TCP_ACK));
+	packets.push_back(makePacket("10.0.0.2", 80, clientIP, 1234, 507, TCP_FIN | TCP_ACK));
+	return packets;
+}
+
+
+static void checkConversation()
+{
+	CallbackLog log;
+	TcpStreamReassembly reassembly(onMessageReady, &log, NULL, onConnectionEnd, onStreamGap);
+	std::vector<TestPacket> packets = makeConversation("10.0.0.1");
+	for (size_t i = 0; i < packets.size(); i++)
+		feed(reassembly, packets[i]);
+
+	const char* expected[] = { "D0 1234 hello", "D0 1234 world", "D1 1234 OK", "G0 1234 89", "D0 1234 xyz", "D1 1234 more", "E 1234 fin" };
+	size_t numOfExpected = sizeof(expected) / sizeof(expected[0]);
+	CHECK(log.events.size() == numOfExpected);
+	for (size_t i = 0; i < numOfExpected && i < log.events.size(); i++)
+		CHECK(log.events[i] == expected[i]);
+}
+
+
+static void checkBurstMatchesSinglePackets()
+{
+	CallbackLog singleLog;
+	CallbackLog burstLog;
+	TcpStreamReassembly single(onMessageReady, &singleLog, NULL, onConnectionEnd, onStreamGap);
+	TcpStreamReassembly burst(onMessageReady, &burstLog, NULL, onConnectionEnd, onStreamGap);
+
+	// two conversations interleaved, so the burst holds packets of several connections
+	std::vector<TestPacket> packets = makeConversation("10.0.0.1");
+	std::vector<TestPacket> other = makeConversation("10.0.0.3");
+	std::vector<TestPacket> interleaved;
+	for (size_t i = 0; i < packets.size(); i++)
+	{
+		interleaved.push_back(packets[i]);
+		interleaved.push_back(other[i]);
+	}
+
+	std::vector<pcpp::RawPacket*> rawPackets;
+	for (size_t i = 0; i < interleaved.size(); i++)
+	{
+		feed(single, interleaved[i]);
+		rawPackets.push_back(new pcpp::RawPacket(interleaved[i].frame.data(), (int)interleaved[i].frame.size(), interleaved[i].timestamp, false));
+	}
+
+	burst.reassemblePackets(rawPackets.data(), rawPackets.size());
+	CHECK(singleLog.events.size() == 14);
+	CHECK(singleLog.events == burstLog.events);
+
+	for (size_t i = 0; i < rawPackets.size(); i++)
+		delete rawPackets[i];
+}
+
+
+static void checkFlowKeyCollision()
+{
+	// regression: these two connections share a flow key (the 32-bit hash of their 5-tuple). Manual close and skip looked connections up by
+	// the flow key alone, so they acted on whichever of the two was found first
+	CallbackLog log;
+	TcpStreamReassembly reassembly(onMessageReady, &log, onConnectionStart, onConnectionEnd, onStreamGap);
+
+	TestPacket synA = makePacket("127.116.60.81", 10777, "59.230.114.249", 80, 100, TCP_SYN);
+	TestPacket synB = makePacket("45.178.88.82", 49399, "95.70.215.23", 80, 100, TCP_SYN);
+	feed(reassembly, synA);
+	feed(reassembly, synB);
+
+	CHECK(log.startedConnections.size() == 2);
+	if (log.startedConnections.size() != 2)
+		return;
+	CHECK(log.startedConnections[0].flowKey == log.startedConnections[1].flowKey);
+	const pcpp::ConnectionData& connB = log.startedConnections[1];
+
+	// skipping B's first 5 bytes leaves A's stream alone
+	reassembly.skipStreamData(connB, 0, 5);
+	TestPacket dataB = makePacket("45.178.88.82", 49399, "95.70.215.23", 80, 101, TCP_ACK, "0123456789");
+	TestPacket dataA = makePacket("127.116.60.81", 10777, "59.230.114.249", 80, 101, TCP_ACK, "abcdef");
+	feed(reassembly, dataB);
+	feed(reassembly, dataA);
+
+	// closing B leaves A open
+	reassembly.closeConnection(connB);
+	TestPacket moreA = makePacket("127.116.60.81", 10777, "59.230.114.249", 80, 107, TCP_ACK, "ghi");
+	feed(reassembly, moreA);
+
+	const char* expected[] = { "D0 49399 56789", "D0 10777 abcdef", "E 49399 manual", "D0 10777 ghi" };
+	size_t numOfExpected = sizeof(expected) / sizeof(expected[0]);
+	CHECK(log.events.size() == numOfExpected);
+	for (size_t i = 0; i < numOfExpected && i < log.events.size(); i++)
+		CHECK(log.events[i] == expected[i]);
+}
+
+
+int main()
+{
+	checkConversation();
+	checkBurstMatchesSinglePackets();
+	checkFlowKeyCollision();
+
+	return reportChecks("TcpStreamReassemblyCheck");
+}
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "../WebSocketDecoder.h"
+#include "CheckUtils.h"
+
+#define CLIENT_SIDE 0
+#define SERVER_SIDE 1
+
+
+/**
+ * The messages a decoder reported, as "<side> <opcode> <flags> <message length> <payload>"
+ */
+static void onMessage(const WebSocketMessage& message, void* userCookie)
+{
+	std::vector<std::string>* messages = (std::vector<std::string>*)userCookie;
+	char record[64];
+	snprintf(record, sizeof(record), "%d %d %d %d ", message.side, (int)message.opcode, (int)message.flags, (int)message.messageLen);
+	messages->push_back(std::string(record) + std::string((const char*)message.payload, message.payloadLen));
+}
+
+
+static void feed(WebSocketDecoder& decoder, int side, const std::string& data)
+{
+	timeval timestamp = { 100, 0 };
+	decoder.feed(side, (const uint8_t*)data.data(), data.size(), timestamp);
+}
+
+
+static void checkRfcExamples()
+{
+	// the frames of RFC 6455 section 5.7
+	std::vector<std::string> messages;
+	WebSocketDecoder decoder(onMessage, &messages);
+
+	// a single-frame unmasked text message, and the same message masked
+	feed(decoder, SERVER_SIDE, std::string("\x81\x05Hello", 7));
+	feed(decoder, CLIENT_SIDE, std::string("\x81\x85\x37\xfa\x21\x3d\x7f\x9f\x4d\x51\x58", 11));
+
+	// a fragmented unmasked text message
+	feed(decoder, SERVER_SIDE, std::string("\x01\x03Hel", 5));
+	feed(decoder, SERVER_SIDE, std::string("\x80\x02lo", 4));
+
+	// an unmasked ping and a masked pong
+	feed(decoder, SERVER_SIDE, std::string("\x89\x05Hello", 7));
+	feed(decoder, CLIENT_SIDE, std::string("\x8a\x85\x37\xfa\x21\x3d\x7f\x9f\x4d\x51\x58", 11));
+
+	// binary messages with a 16-bit and a 64-bit extended length
+	feed(decoder, SERVER_SIDE, std::string("\x82\x7e\x01\x00", 4) + std::string(256, 'a'));
+	feed(decoder, SERVER_SIDE, std::string("\x82\x7f\x00\x00\x00\x00\x00\x01\x00\x00", 10) + std::string(65536, 'b'));
+
+	CHECK(messages.size() == 7);
+	CHECK(messages.size() > 0 && messages[0] == "1 1 0 5 Hello");
+	CHECK(messages.size() > 1 && messages[1] == "0 1 0 5 Hello");
+	CHECK(messages.size() > 2 && messages[2] == "1 1 0 5 Hello");
+	CHECK(messages.size() > 3 && messages[3] == "1 9 0 5 Hello");
+	CHECK(messages.size() > 4 && messages[4] == "0 10 0 5 Hello");
+	CHECK(messages.size() > 5 && messages[5] == "1 2 0 256 " + std::string(256, 'a'));
+	CHECK(messages.size() > 6 && messages[6] == "1 2 0 65536 " + std::string(65536, 'b'));
+	CHECK(decoder.numOfFrames == 8);
+	CHECK(decoder.numOfMessages == 7);
+	CHECK(decoder.numOfProtocolErrors == 0);
+}
+
+
+static void checkSplitFrames()
+{
+	// a masked fragmented message with a ping between its fragments, fed one byte at a time, decodes the same as fed whole
+	std::string frames = std::string("\x01\x83\x37\xfa\x21\x3d\x7f\x9f\x4d", 9) + std::string("\x89\x00", 2) +
+			std::string("\x80\x82\x01\x02\x03\x04\x6d\x6d", 8);
+
+	std::vector<std::string> whole;
+	WebSocketDecoder wholeDecoder(onMessage, &whole);
+	feed(wholeDecoder, CLIENT_SIDE, frames);
+
+	std::vector<std::string> split;
+	WebSocketDecoder splitDecoder(onMessage, &split);
+	for (size_t i = 0; i < frames.size(); i++)
+		feed(splitDecoder, CLIENT_SIDE, frames.substr(i, 1));
+
+	CHECK(whole.size() == 2);
+	CHECK(whole.size() > 0 && whole[0] == "0 9 0 0 ");
+	CHECK(whole.size() > 1 && whole[1] == "0 1 0 5 Hello");
+	CHECK(split == whole);
+}
+
+
+static void checkUnmask()
+{
+	// the vectorized XOR against a byte at a time, at every length and key offset around the 8 and 16 byte blocks
+	const uint8_t maskKey[4] = { 0x37, 0xfa, 0x21, 0x3d };
+	for (size_t dataLen = 0; dataLen <= 40; dataLen++)
+	{
+		for (uint64_t maskOffset = 0; maskOffset < 4; maskOffset++)
+		{
+			uint8_t data[40];
+			uint8_t expected[40];
+			for (size_t i = 0; i < dataLen; i++)
+			{
+				data[i] = (uint8_t)(i * 7 + 1);
+				expected[i] = data[i] ^ maskKey[(maskOffset + i) & 3];
+			}
+
+			WebSocketDecoder::unmask(data, dataLen, maskKey, maskOffset);
+			CHECK(memcmp(data, expected, dataLen) == 0);
+		}
+	}
+}
+
+
+static void checkHoles()
+{
+	std::vector<std::string> messages;
+	WebSocketDecoder decoder(onMessage, &messages);
+
+	// a hole inside a payload is skipped, the message is reported incomplete with what was kept before the hole
+	feed(decoder, SERVER_SIDE, std::string("\x81\x0aHel", 5));
+	decoder.skipMissingData(SERVER_SIDE, 4);
+	feed(decoder, SERVER_SIDE, "abc");
+	feed(decoder, SERVER_SIDE, std::string("\x81\x02ok", 4));
+
+	CHECK(messages.size() == 2);
+	CHECK(messages.size() > 0 && messages[0] == "1 1 4 10 Hel");
+	CHECK(messages.size() > 1 && messages[1] == "1 1 0 2 ok");
+
+	// a hole across a frame boundary loses the side, the other side goes on
+	feed(decoder, SERVER_SIDE, std::string("\x81\x02", 2));
+	decoder.skipMissingData(SERVER_SIDE, 10);
+	feed(decoder, SERVER_SIDE, std::string("\x81\x02ok", 4));
+	feed(decoder, CLIENT_SIDE, std::string("\x81\x80\x00\x00\x00\x00", 6));
+
+	CHECK(messages.size() == 3);
+	CHECK(messages.size() > 2 && messages[2] == "0 1 0 0 ");
+}
+
+
+static void checkLimits()
+{
+	// a message longer than the max message length is cut, its length is still counted
+	std::vector<std::string> messages;
+	WebSocketDecoder decoder(onMessage, &messages, 4);
+	feed(decoder, SERVER_SIDE, std::string("\x01\x03Hel", 5));
+	feed(decoder, SERVER_SIDE, std::string("\x80\x02lo", 4));
+
+	CHECK(messages.size() == 1 && messages[0] == "1 1 1 5 Hell");
+	CHECK(decoder.numOfTruncatedMessages == 1);
+
+	// RSV1 marks a compressed message
+	feed(decoder, SERVER_SIDE, std::string("\xc1\x01x", 3));
+	CHECK(messages.size() == 2 && messages[1] == "1 1 2 1 x");
+
+	// a fragmented control frame breaks the protocol and loses the side
+	feed(decoder, CLIENT_SIDE, std::string("\x09\x00", 2));
+	feed(decoder, CLIENT_SIDE, std::string("\x81\x01x", 3));
+	CHECK(messages.size() == 2);
+	CHECK(decoder.numOfProtocolErrors == 1);
+}
+
+
+int main()
+{
+	checkRfcExamples();
+	checkSplitFrames();
+	checkUnmask();
+	checkHoles();
+	checkLimits();
+
+	return reportChecks("WebSocketDecoderCheck");
+}
@@ -0,0 +1,24 @@
+#Prints the response time of each URI path in a capture file, using the httpecho module (build it with make in python/httpecho)
+#usage: python http_latency.py capture.pcap [server_port]
+#the packets are decoded in C++ with the GIL released, the columns are read in place (with numpy: numpy.asarray(batch.column(name)))
+import sys
+import httpecho
+
+
+def percentile(values, fraction):
+  values = sorted(values)
+  return values[min(len(values) - 1, int(fraction * len(values)))]
+
+
+if __name__ == '__main__':
+  server_port = int(sys.argv[2]) if len(sys.argv) > 2 else 80
+  times = {}
+  with httpecho.open_file(sys.argv[1], server_port=server_port) as capture:
+    for batch in capture:
+      uris = batch.dictionary('uri')
+      for code, response_time in zip(batch.column('uri'), batch.column('response_time_us')):
+        times.setdefault(uris[code], []).append(response_time)
+    print('%d packets, %d transactions' % (capture.packets, capture.transactions))
+  print('uri\tcount\tp50_us\tp99_us')
+  for uri, values in sorted(times.items(), key=lambda item: -len(item[1])):
+    print('%s\t%d\t%d\t%d' % (uri, len(values), percentile(values, 0.5), percentile(values, 0.99)))
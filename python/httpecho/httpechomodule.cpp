@@ -0,0 +1,613 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <string>
+#include "header/RawPacket.h"
+#include "header/PcapFileDevice.h"
+#include "header/PcapLiveDeviceList.h"
+#include "header/PcapFilter.h"
+#include "TransactionExtractor.h"
+#include "TransactionExport.h"
+
+// how long (in seconds) a live capture waits for a batch to fill before it hands over what it has
+#define DEFAULT_LIVE_BATCH_TIMEOUT_SEC 1
+
+
+/**
+ * A batch of transactions handed to Python. It owns its TransactionColumnBatch and never changes after it's created, so the column views
+ * exported from it stay valid as long as they're referenced
+ */
+struct TransactionBatchObject
+{
+	PyObject_HEAD
+	TransactionColumnBatch* batch;
+};
+
+
+/**
+ * The buffer protocol exporter of one column of a batch (what memoryview, numpy.asarray() and numpy.frombuffer() see)
+ */
+struct ColumnObject
+{
+	PyObject_HEAD
+	TransactionBatchObject* owner;
+	ExportColumnView view;
+	Py_ssize_t shape;
+	Py_ssize_t stride;
+};
+
+
+/**
+ * A capture file or a live device, read batch by batch. All the packet work happens with the GIL released
+ */
+struct CaptureObject
+{
+	PyObject_HEAD
+	pcpp::IFileReaderDevice* reader;
+	pcpp::PcapLiveDevice* device;
+	TransactionExtractor* extractor;
+	TransactionColumnBatch* batch;
+	size_t batchRows;
+	int timeoutSec;
+	pcpp::RawPacket* packets;
+	bool finished;
+
+	// set while a thread reads a batch with the GIL released, so another thread can't read at the same time
+	bool busy;
+};
+
+
+static PyTypeObject TransactionBatchType = { PyVarObject_HEAD_INIT(NULL, 0) };
+static PyTypeObject ColumnType = { PyVarObject_HEAD_INIT(NULL, 0) };
+static PyTypeObject CaptureType = { PyVarObject_HEAD_INIT(NULL, 0) };
+
+
+/**
+ * @return The struct module format of a column's rows. Native formats, memoryview can't index any other
+ */
+static const char* getColumnFormat(uint8_t type)
+{
+	switch (type)
+	{
+	case EXPORT_COLUMN_INT64: return "q";
+	case EXPORT_COLUMN_UINT16: return "H";
+	case EXPORT_COLUMN_UINT64: return "Q";
+	default: return "I";
+	}
+}
+
+
+/**
+ * Find a column of a batch by name
+ * @return The column index, or -1 (with a KeyError set) if there's no such column
+ */
+static Py_ssize_t findColumn(const char* name)
+{
+	for (size_t i = 0; i < TransactionColumnBatch::getNumOfColumns(); i++)
+	{
+		if (strcmp(TransactionColumnBatch::getColumnName(i), name) == 0)
+			return (Py_ssize_t)i;
+	}
+
+	PyErr_Format(PyExc_KeyError, "no column named '%s'", name);
+	return -1;
+}
+
+
+// ---------- Column ----------
+
+static void Column_dealloc(ColumnObject* self)
+{
+	Py_XDECREF(self->owner);
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+
+static int Column_getbuffer(ColumnObject* self, Py_buffer* view, int flags)
+{
+	// rows of an empty column still need a valid pointer
+	static uint64_t emptyColumn = 0;
+
+	if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE)
+	{
+		PyErr_SetString(PyExc_BufferError, "transaction columns are read-only");
+		view->obj = NULL;
+		return -1;
+	}
+
+	view->obj = (PyObject*)self;
+	Py_INCREF(self);
+	view->buf = (self->view.values != NULL ? (void*)self->view.values : (void*)&emptyColumn);
+	view->len = self->shape * self->stride;
+	view->readonly = 1;
+	view->itemsize = self->stride;
+	view->format = ((flags & PyBUF_FORMAT) == PyBUF_FORMAT ? (char*)getColumnFormat(self->view.type) : NULL);
+	view->ndim = 1;
+	view->shape = ((flags & PyBUF_ND) == PyBUF_ND ? &self->shape : NULL);
+	view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES ? &self->stride : NULL);
+	view->suboffsets = NULL;
+	view->internal = NULL;
+	return 0;
+}
+
+
+static PyBufferProcs Column_bufferProcs = { (getbufferproc)Column_getbuffer, NULL };
+
+
+// ---------- TransactionBatch ----------
+
+static void TransactionBatch_dealloc(TransactionBatchObject* self)
+{
+	delete self->batch;
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+
+/**
+ * Wrap a batch, which the new object owns from here on
+ */
+static PyObject* newTransactionBatch(TransactionColumnBatch* batch)
+{
+	TransactionBatchObject* self = PyObject_New(TransactionBatchObject, &TransactionBatchType);
+	if (self == NULL)
+	{
+		delete batch;
+		return NULL;
+	}
+
+	self->batch = batch;
+	return (PyObject*)self;
+}
+
+
+static Py_ssize_t TransactionBatch_length(TransactionBatchObject* self)
+{
+	return (Py_ssize_t)self->batch->getNumOfRows();
+}
+
+
+static PyObject* TransactionBatch_getColumns(PyObject* self, void* closure)
+{
+	size_t numOfColumns = TransactionColumnBatch::getNumOfColumns();
+	PyObject* names = PyTuple_New((Py_ssize_t)numOfColumns);
+	if (names == NULL)
+		return NULL;
+
+	for (size_t i = 0; i < numOfColumns; i++)
+	{
+		PyObject* name = PyUnicode_FromString(TransactionColumnBatch::getColumnName(i));
+		if (name == NULL)
+		{
+			Py_DECREF(names);
+			return NULL;
+		}
+		PyTuple_SET_ITEM(names, (Py_ssize_t)i, name);
+	}
+
+	return names;
+}
+
+
+static PyObject* TransactionBatch_column(TransactionBatchObject* self, PyObject* args)
+{
+	const char* name;
+	if (!PyArg_ParseTuple(args, "s", &name))
+		return NULL;
+
+	Py_ssize_t index = findColumn(name);
+	if (index < 0)
+		return NULL;
+
+	ColumnObject* column = PyObject_New(ColumnObject, &ColumnType);
+	if (column == NULL)
+		return NULL;
+
+	Py_INCREF(self);
+	column->owner = self;
+	self->batch->getColumn((size_t)index, column->view);
+	column->shape = (Py_ssize_t)self->batch->getNumOfRows();
+	column->stride = (Py_ssize_t)column->view.valueSize;
+
+	// the memoryview keeps the exporter, and through it the batch, alive
+	PyObject* memoryView = PyMemoryView_FromObject((PyObject*)column);
+	Py_DECREF(column);
+	return memoryView;
+}
+
+
+static PyObject* TransactionBatch_dictionary(TransactionBatchObject* self, PyObject* args)
+{
+	const char* name;
+	if (!PyArg_ParseTuple(args, "s", &name))
+		return NULL;
+
+	Py_ssize_t index = findColumn(name);
+	if (index < 0)
+		return NULL;
+
+	ExportColumnView view;
+	self->batch->getColumn((size_t)index, view);
+	if (view.type != EXPORT_COLUMN_DICT_STRING)
+	{
+		PyErr_Format(PyExc_ValueError, "column '%s' isn't a string column", name);
+		return NULL;
+	}
+
+	PyObject* values = PyList_New((Py_ssize_t)view.dictionarySize);
+	if (values == NULL)
+		return NULL;
+
+	for (size_t i = 0; i < view.dictionarySize; i++)
+	{
+		PyObject* value = PyUnicode_DecodeUTF8(view.dictionaryValues + view.dictionaryOffsets[i],
+				(Py_ssize_t)(view.dictionaryOffsets[i + 1] - view.dictionaryOffsets[i]), "replace");
+		if (value == NULL)
+		{
+			Py_DECREF(values);
+			return NULL;
+		}
+		PyList_SET_ITEM(values, (Py_ssize_t)i, value);
+	}
+
+	return values;
+}
+
+
+static PyObject* TransactionBatch_encode(TransactionBatchObject* self, PyObject* args)
+{
+	std::string encoded;
+	Py_BEGIN_ALLOW_THREADS
+	TransactionColumnBatch::encodeFileHeader(encoded);
+	self->batch->encode(encoded);
+	Py_END_ALLOW_THREADS
+
+	return PyBytes_FromStringAndSize(encoded.data(), (Py_ssize_t)encoded.size());
+}
+
+
+static PySequenceMethods TransactionBatch_sequenceMethods = { (lenfunc)TransactionBatch_length };
+
+static PyGetSetDef TransactionBatch_getSet[] = {
+	{ (char*)"columns", (getter)TransactionBatch_getColumns, NULL, (char*)"The column names, in export order", NULL },
+	{ NULL }
+};
+
+static PyMethodDef TransactionBatch_methods[] = {
+	{ "column", (PyCFunction)TransactionBatch_column, METH_VARARGS,
+		"column(name) -> memoryview of the column's rows, without copying (numpy.asarray() takes it as is).\n"
+		"The rows of a string column are uint32 codes into dictionary(name)" },
+	{ "dictionary", (PyCFunction)TransactionBatch_dictionary, METH_VARARGS,
+		"dictionary(name) -> list of the distinct values of a string column, indexed by the column's codes" },
+	{ "encode", (PyCFunction)TransactionBatch_encode, METH_NOARGS,
+		"encode() -> bytes of an export file holding the batch as one record group (see read_transactions.py)" },
+	{ NULL }
+};
+
+
+// ---------- Capture ----------
+
+static void Capture_close(CaptureObject* self)
+{
+	if (self->reader != NULL)
+	{
+		self->reader->close();
+		delete self->reader;
+		self->reader = NULL;
+	}
+
+	// live devices belong to the device list, they're only closed
+	if (self->device != NULL)
+	{
+		self->device->close();
+		self->device = NULL;
+	}
+
+	delete self->extractor;
+	self->extractor = NULL;
+	delete self->batch;
+	self->batch = NULL;
+	delete [] self->packets;
+	self->packets = NULL;
+	self->finished = true;
+}
+
+
+static void Capture_dealloc(CaptureObject* self)
+{
+	Capture_close(self);
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+
+/**
+ * Create a capture with its extractor and first batch, the caller sets the reader or the device
+ */
+static CaptureObject* newCapture(int serverPort, Py_ssize_t batchRows, int timeoutSec)
+{
+	if (serverPort <= 0 || serverPort > 0xFFFF || batchRows <= 0 || timeoutSec <= 0)
+	{
+		PyErr_SetString(PyExc_ValueError, "server_port must be 1-65535, batch_rows and timeout must be positive");
+		return NULL;
+	}
+
+	CaptureObject* self = PyObject_New(CaptureObject, &CaptureType);
+	if (self == NULL)
+		return NULL;
+
+	self->reader = NULL;
+	self->device = NULL;
+	self->batchRows = (size_t)batchRows;
+	self->timeoutSec = timeoutSec;
+	self->batch = new TransactionColumnBatch(self->batchRows);
+	self->extractor = new TransactionExtractor(self->batch, (uint16_t)serverPort);
+	self->packets = NULL;
+	self->finished = false;
+	self->busy = false;
+	return self;
+}
+
+
+/**
+ * Read packets from the file until the batch is full or the file ends. Runs without the GIL
+ */
+static void readFileBatch(CaptureObject* self)
+{
+	while (!self->batch->isFull())
+	{
+		size_t numOfPackets = 0;
+		while (numOfPackets < MAX_REASSEMBLY_BATCH_SIZE && self->reader->getNextPacket(self->packets[numOfPackets]))
+			numOfPackets++;
+
+		pcpp::RawPacket* burst[MAX_REASSEMBLY_BATCH_SIZE];
+		for (size_t i = 0; i < numOfPackets; i++)
+			burst[i] = &self->packets[i];
+		self->extractor->processPackets(burst, numOfPackets);
+
+		// the end of the file closes the connections which are still open
+		if (numOfPackets < MAX_REASSEMBLY_BATCH_SIZE)
+		{
+			self->extractor->finish();
+			self->finished = true;
+			return;
+		}
+	}
+}
+
+
+/**
+ * The blocking live capture callback: process the packet and stop once the batch is full
+ */
+static bool onLivePacketArrives(pcpp::RawPacket* packet, pcpp::PcapLiveDevice* dev, void* cookie)
+{
+	CaptureObject* self = (CaptureObject*)cookie;
+	self->extractor->processPacket(packet);
+	return self->batch->isFull();
+}
+
+
+static PyObject* Capture_iter(PyObject* self)
+{
+	Py_INCREF(self);
+	return self;
+}
+
+
+static PyObject* Capture_next(CaptureObject* self)
+{
+	if (self->finished)
+		return NULL;
+
+	if (self->busy)
+	{
+		PyErr_SetString(PyExc_RuntimeError, "the capture is being read by another thread");
+		return NULL;
+	}
+
+	self->busy = true;
+	Py_BEGIN_ALLOW_THREADS
+	if (self->reader != NULL)
+		readFileBatch(self);
+	else
+		self->device->startCaptureBlockingMode(onLivePacketArrives, self, self->timeoutSec);
+	Py_END_ALLOW_THREADS
+	self->busy = false;
+
+	// a live capture hands over whatever completed within the timeout, even nothing, so the caller gets control back regularly
+	if (self->finished && self->batch->getNumOfRows() == 0)
+		return NULL;
+
+	TransactionColumnBatch* batch = self->batch;
+	self->batch = new TransactionColumnBatch(self->batchRows);
+	self->extractor->setBatch(self->batch);
+	return newTransactionBatch(batch);
+}
+
+
+static PyObject* Capture_closeMethod(CaptureObject* self, PyObject* args)
+{
+	if (self->busy)
+	{
+		PyErr_SetString(PyExc_RuntimeError, "the capture is being read by another thread");
+		return NULL;
+	}
+
+	Capture_close(self);
+	Py_RETURN_NONE;
+}
+
+
+static PyObject* Capture_enter(PyObject* self, PyObject* args)
+{
+	Py_INCREF(self);
+	return self;
+}
+
+
+static PyObject* Capture_exit(CaptureObject* self, PyObject* args)
+{
+	return Capture_closeMethod(self, NULL);
+}
+
+
+static PyObject* Capture_getPackets(CaptureObject* self, void* closure)
+{
+	return PyLong_FromUnsignedLongLong(self->extractor != NULL ? self->extractor->numOfPackets : 0);
+}
+
+
+static PyObject* Capture_getTransactions(CaptureObject* self, void* closure)
+{
+	return PyLong_FromUnsignedLongLong(self->extractor != NULL ? self->extractor->numOfTransactions : 0);
+}
+
+
+static PyObject* Capture_getConnections(CaptureObject* self, void* closure)
+{
+	return PyLong_FromSize_t(self->extractor != NULL ? self->extractor->getNumOfHttpConnections() : 0);
+}
+
+
+static PyGetSetDef Capture_getSet[] = {
+	{ (char*)"packets", (getter)Capture_getPackets, NULL, (char*)"The number of packets processed", NULL },
+	{ (char*)"transactions", (getter)Capture_getTransactions, NULL, (char*)"The number of transactions extracted", NULL },
+	{ (char*)"connections", (getter)Capture_getConnections, NULL, (char*)"The number of HTTP connections currently open", NULL },
+	{ NULL }
+};
+
+static PyMethodDef Capture_methods[] = {
+	{ "close", (PyCFunction)Capture_closeMethod, METH_NOARGS, "close() -> close the file or the device" },
+	{ "__enter__", (PyCFunction)Capture_enter, METH_NOARGS, NULL },
+	{ "__exit__", (PyCFunction)Capture_exit, METH_VARARGS, NULL },
+	{ NULL }
+};
+
+
+// ---------- module ----------
+
+static PyObject* httpecho_openFile(PyObject* module, PyObject* args, PyObject* kwargs)
+{
+	static const char* keywords[] = { "path", "server_port", "batch_rows", NULL };
+	const char* path;
+	int serverPort = DEFAULT_EXTRACTOR_SERVER_PORT;
+	Py_ssize_t batchRows = DEFAULT_EXPORT_ROWS_PER_GROUP;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|in", (char**)keywords, &path, &serverPort, &batchRows))
+		return NULL;
+
+	pcpp::IFileReaderDevice* reader = pcpp::IFileReaderDevice::getReader(path);
+	if (reader == NULL || !reader->open())
+	{
+		delete reader;
+		PyErr_Format(PyExc_OSError, "cannot open capture file '%s'", path);
+		return NULL;
+	}
+
+	CaptureObject* self = newCapture(serverPort, batchRows, DEFAULT_LIVE_BATCH_TIMEOUT_SEC);
+	if (self == NULL)
+	{
+		reader->close();
+		delete reader;
+		return NULL;
+	}
+
+	self->reader = reader;
+	self->packets = new pcpp::RawPacket[MAX_REASSEMBLY_BATCH_SIZE];
+	return (PyObject*)self;
+}
+
+
+static PyObject* httpecho_openLive(PyObject* module, PyObject* args, PyObject* kwargs)
+{
+	static const char* keywords[] = { "interface", "server_port", "batch_rows", "timeout", NULL };
+	const char* interface;
+	int serverPort = DEFAULT_EXTRACTOR_SERVER_PORT;
+	Py_ssize_t batchRows = DEFAULT_EXPORT_ROWS_PER_GROUP;
+	int timeoutSec = DEFAULT_LIVE_BATCH_TIMEOUT_SEC;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|ini", (char**)keywords, &interface, &serverPort, &batchRows, &timeoutSec))
+		return NULL;
+
+	// the interface may be given by its IP address, like the -i option of HTTPEcho, or by its name
+	pcpp::PcapLiveDevice* device = pcpp::PcapLiveDeviceList::getInstance().getPcapLiveDeviceByIp(interface);
+	if (device == NULL)
+		device = pcpp::PcapLiveDeviceList::getInstance().getPcapLiveDeviceByName(interface);
+	if (device == NULL || !device->open())
+	{
+		PyErr_Format(PyExc_OSError, "cannot open interface '%s'", interface);
+		return NULL;
+	}
+
+	CaptureObject* self = newCapture(serverPort, batchRows, timeoutSec);
+	if (self == NULL)
+	{
+		device->close();
+		return NULL;
+	}
+
+	// only the server port reaches the pipeline
+	pcpp::PortFilter portFilter((uint16_t)serverPort, pcpp::SRC_OR_DST);
+	device->setFilter(portFilter);
+	self->device = device;
+	return (PyObject*)self;
+}
+
+
+static PyMethodDef httpecho_methods[] = {
+	{ "open_file", (PyCFunction)httpecho_openFile, METH_VARARGS | METH_KEYWORDS,
+		"open_file(path, server_port=80, batch_rows=16384) -> Capture of a pcap / pcapng file.\n"
+		"Iterating it yields TransactionBatch objects until the file ends. A batch ends with the burst of packets which filled it,\n"
+		"so it may hold a few more than batch_rows transactions" },
+	{ "open_live", (PyCFunction)httpecho_openLive, METH_VARARGS | METH_KEYWORDS,
+		"open_live(interface, server_port=80, batch_rows=16384, timeout=1) -> Capture of a live interface (IP address or name).\n"
+		"Iterating it yields a TransactionBatch whenever batch_rows transactions completed or timeout seconds passed" },
+	{ NULL }
+};
+
+static PyModuleDef httpecho_module = {
+	PyModuleDef_HEAD_INIT,
+	"httpecho",
+	"HTTP transaction extraction with the HTTPEcho capture pipeline: IP defragmentation, TCP reassembly and HTTP/1.x parsing in C++,\n"
+	"with the transactions handed over in column batches which Python reads without copying",
+	-1,
+	httpecho_methods
+};
+
+
+PyMODINIT_FUNC PyInit_httpecho(void)
+{
+	ColumnType.tp_name = "httpecho.Column";
+	ColumnType.tp_basicsize = sizeof(ColumnObject);
+	ColumnType.tp_dealloc = (destructor)Column_dealloc;
+	ColumnType.tp_as_buffer = &Column_bufferProcs;
+	ColumnType.tp_flags = Py_TPFLAGS_DEFAULT;
+	ColumnType.tp_doc = "The rows of a batch column, exported through the buffer protocol";
+
+	TransactionBatchType.tp_name = "httpecho.TransactionBatch";
+	TransactionBatchType.tp_basicsize = sizeof(TransactionBatchObject);
+	TransactionBatchType.tp_dealloc = (destructor)TransactionBatch_dealloc;
+	TransactionBatchType.tp_as_sequence = &TransactionBatch_sequenceMethods;
+	TransactionBatchType.tp_flags = Py_TPFLAGS_DEFAULT;
+	TransactionBatchType.tp_doc = "Completed HTTP transactions, column by column (len() is the number of rows)";
+	TransactionBatchType.tp_methods = TransactionBatch_methods;
+	TransactionBatchType.tp_getset = TransactionBatch_getSet;
+
+	CaptureType.tp_name = "httpecho.Capture";
+	CaptureType.tp_basicsize = sizeof(CaptureObject);
+	CaptureType.tp_dealloc = (destructor)Capture_dealloc;
+	CaptureType.tp_flags = Py_TPFLAGS_DEFAULT;
+	CaptureType.tp_doc = "A capture file or live interface, iterated as TransactionBatch objects";
+	CaptureType.tp_iter = Capture_iter;
+	CaptureType.tp_iternext = (iternextfunc)Capture_next;
+	CaptureType.tp_methods = Capture_methods;
+	CaptureType.tp_getset = Capture_getSet;
+
+	if (PyType_Ready(&ColumnType) < 0 || PyType_Ready(&TransactionBatchType) < 0 || PyType_Ready(&CaptureType) < 0)
+		return NULL;
+
+	PyObject* module = PyModule_Create(&httpecho_module);
+	if (module == NULL)
+		return NULL;
+
+	Py_INCREF(&TransactionBatchType);
+	PyModule_AddObject(module, "TransactionBatch", (PyObject*)&TransactionBatchType);
+	Py_INCREF(&CaptureType);
+	PyModule_AddObject(module, "Capture", (PyObject*)&CaptureType);
+	return module;
+}
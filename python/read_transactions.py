@@ -0,0 +1,96 @@
+#Reads the HTTP transaction export of HTTPEcho (http_transactions.hcol) column by column
+#usage: python read_transactions.py http_transactions.hcol [column ...]
+#without column names every column is printed as TSV, otherwise only the given columns
+#runs on Python 2.7 and 3. The file is read one record group at a time, to read the bytes of httpecho's batch.encode() wrap them in io.BytesIO
+import numbers
+import struct
+import sys
+
+INT64 = 1
+UINT16 = 2
+UINT64 = 3
+DICT_STRING = 4
+
+FIXED_FORMATS = {INT64: ('q', 8), UINT16: ('H', 2), UINT64: ('Q', 8)}
+CODE_FORMATS = {1: 'B', 2: 'H', 4: 'I'}
+
+GROUP_HEADER = struct.Struct('<4sIQ')
+
+
+#reads exactly size bytes, or fewer at the end of the file
+def read_exactly(export_file, size):
+  data = b''
+  while len(data) < size:
+    chunk = export_file.read(size - len(data))
+    if not chunk:
+      break
+    data += chunk
+  return data
+
+
+#reads the file header, leaves the file at the first record group
+def read_schema(export_file):
+  header = read_exactly(export_file, 12)
+  if len(header) < 12 or header[0:8] != b'HECOL001':
+    raise ValueError('not an HTTPEcho transaction export')
+  num_columns, = struct.unpack_from('<I', header, 8)
+  schema = []
+  for i in range(num_columns):
+    col_type, name_len = struct.unpack('<BB', read_exactly(export_file, 2))
+    schema.append((read_exactly(export_file, name_len).decode(), col_type))
+  return schema
+
+
+#yields (row count, dict of column name -> list of values) per record group, reading one group at a time
+def read_groups(export_file, wanted=None):
+  schema = read_schema(export_file)
+  pos = export_file.tell()
+  while True:
+    header = read_exactly(export_file, GROUP_HEADER.size)
+    if len(header) < GROUP_HEADER.size:
+      return
+    magic, num_rows, group_len = GROUP_HEADER.unpack(header)
+    if magic != b'RGRP':
+      raise ValueError('bad record group at offset %d' % pos)
+    data = read_exactly(export_file, group_len)
+    #the last group of a file which is still being written may be incomplete
+    if len(data) < group_len:
+      return
+    col_pos = 0
+    columns = {}
+    for name, col_type in schema:
+      if col_type in FIXED_FORMATS:
+        fmt, width = FIXED_FORMATS[col_type]
+        if wanted is None or name in wanted:
+          columns[name] = list(struct.unpack_from('<%d%s' % (num_rows, fmt), data, col_pos))
+        col_pos += num_rows * width
+      else:
+        dict_size, = struct.unpack_from('<I', data, col_pos)
+        offsets = struct.unpack_from('<%dI' % (dict_size + 1), data, col_pos + 4)
+        values_pos = col_pos + 4 + 4 * (dict_size + 1)
+        code_width, = struct.unpack_from('<B', data, values_pos + offsets[-1])
+        codes_pos = values_pos + offsets[-1] + 1
+        if wanted is None or name in wanted:
+          values = [data[values_pos + offsets[i]:values_pos + offsets[i + 1]].decode('utf-8', 'replace') for i in range(dict_size)]
+          codes = struct.unpack_from('<%d%s' % (num_rows, CODE_FORMATS[code_width]), data, codes_pos)
+          columns[name] = [values[code] for code in codes]
+        col_pos = codes_pos + num_rows * code_width
+    yield num_rows, columns
+    pos += GROUP_HEADER.size + group_len
+
+
+#writes one TSV line as UTF-8, the same on Python 2 and 3
+def write_row(out, values):
+  out.write((u'\t'.join(u'%d' % value if isinstance(value, numbers.Integral) else value for value in values) + u'\n').encode('utf-8'))
+
+
+if __name__ == '__main__':
+  out = getattr(sys.stdout, 'buffer', sys.stdout)
+  with open(sys.argv[1], 'rb') as export_file:
+    schema = read_schema(export_file)
+    names = sys.argv[2:] if len(sys.argv) > 2 else [name for name, _ in schema]
+    write_row(out, names)
+    export_file.seek(0)
+    for num_rows, columns in read_groups(export_file, set(names)):
+      for row in range(num_rows):
+        write_row(out, [columns[name][row] for name in names])
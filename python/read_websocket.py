@@ -0,0 +1,29 @@
+#Reads the WebSocket message records HTTPEcho writes next to a connection's capture file (<connection>.ws)
+#usage: python read_websocket.py <connection>.ws
+#prints one line per message: first byte time, duration, side, opcode, flags, message length and the start of the payload
+import struct
+import sys
+
+HEADER = struct.Struct('<QQBBBxIQ')
+OPCODES = {0: 'continuation', 1: 'text', 2: 'binary', 8: 'close', 9: 'ping', 10: 'pong'}
+FLAGS = ((1, 'truncated'), (2, 'compressed'), (4, 'incomplete'))
+
+
+#yields (first byte usec, last byte usec, side, opcode, flags, message length, payload) per message
+def read_messages(data):
+  pos = 0
+  while pos + HEADER.size <= len(data):
+    first_usec, last_usec, side, opcode, flags, payload_len, message_len = HEADER.unpack_from(data, pos)
+    pos += HEADER.size
+    yield first_usec, last_usec, side, opcode, flags, message_len, data[pos:pos + payload_len]
+    pos += payload_len
+
+
+if __name__ == '__main__':
+  with open(sys.argv[1], 'rb') as record_file:
+    data = record_file.read()
+  for first_usec, last_usec, side, opcode, flags, message_len, payload in read_messages(data):
+    flag_names = ','.join(name for bit, name in FLAGS if flags & bit) or '-'
+    preview = payload[:60].decode('utf-8', 'replace') if opcode == 1 else payload[:30].hex()
+    print('%.6f\t%d\t%d\t%s\t%s\t%d\t%r' % (first_usec / 1e6, last_usec - first_usec, side, OPCODES.get(opcode, str(opcode)), flag_names,
+                                          message_len, preview))